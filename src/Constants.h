@@ -5,7 +5,12 @@ Defines useful constants
 Copyright 2014-2025 ClassiCube | Licensed under BSD-3
 */
 
+#if defined CC_WIN_BACKEND && CC_WIN_BACKEND == CC_WIN_BACKEND_HEADLESS
+/* Headless rendering takes camera and capture arguments too */
+#define GAME_MAX_CMDARGS 12
+#else
 #define GAME_MAX_CMDARGS 5
+#endif
 #define GAME_APP_VER "1.3.7"
 #define GAME_API_VER 1
 
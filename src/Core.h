@@ -133,6 +133,7 @@ typedef cc_uint8  cc_bool;
 #define CC_WIN_BACKEND_COCOA    6
 #define CC_WIN_BACKEND_BEOS     7
 #define CC_WIN_BACKEND_ANDROID  8
+#define CC_WIN_BACKEND_HEADLESS 9
 
 #define CC_GFX_BACKEND_SOFTGPU   1
 #define CC_GFX_BACKEND_GL1       2
@@ -1007,6 +1007,32 @@ static cc_result Deflate_StreamClose(struct Stream* stream) {
 	return Stream_Write(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
 }
 
+/* Flushes any buffered data, then ends the current block and byte aligns the output */
+/*  by appending an empty stored block, so that more DEFLATE blocks can directly follow */
+static cc_result Deflate_StreamSyncFlush(struct DeflateState* state) {
+	static const cc_uint8 stored[4] = { 0x00, 0x00, 0xFF, 0xFF };
+	cc_result res;
+
+	res = Deflate_FlushBlock(state, state->InputPosition - DEFLATE_BLOCK_SIZE);
+	if (res) return res;
+
+	/* Write huffman encoded "literal 256" to terminate symbols */
+	Deflate_PushLit(state, 256);
+	Deflate_PushBits(state, 0, 3); /* final block FALSE, block type STORED */
+	Deflate_FlushBits(state);
+
+	/* Stored blocks always start on a byte boundary */
+	if (state->NumBits) {
+		while (state->NumBits < 8) { Deflate_PushBits(state, 0, 1); }
+		Deflate_FlushBits(state);
+	}
+
+	Mem_Copy(state->NextOut, stored, sizeof(stored));
+	state->NextOut  += sizeof(stored);
+	state->AvailOut -= sizeof(stored);
+	return Stream_Write(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
+}
+
 /* Constructs a huffman encoding table (for values to codewords) */
 static void Deflate_BuildTable(const cc_uint8* lens, int count, cc_uint16* codewords, cc_uint8* bitlens) {
 	int i, j, offset, codeword;
@@ -1065,15 +1091,9 @@ static cc_result GZip_StreamClose(struct Stream* stream) {
 
 static cc_result GZip_StreamWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
 	struct GZipState* state = (struct GZipState*)stream->meta.inflate;
-	cc_uint32 i, crc32 = state->Crc32;
 	state->Size += count;
 
-	/* TODO: Optimise this calculation */
-	for (i = 0; i < count; i++) {
-		crc32 = Utils_Crc32Table[(crc32 ^ data[i]) & 0xFF] ^ (crc32 >> 8);
-	}
-
-	state->Crc32 = crc32;
+	state->Crc32 = Utils_Crc32Update(state->Crc32, data, count);
 	return Deflate_StreamWrite(stream, data, count, modified);
 }
 
@@ -1096,6 +1116,404 @@ void GZip_MakeStream(struct Stream* stream, struct GZipState* state, struct Stre
 }
 
 
+/*########################################################################################################################*
+*------------------------------------------------Parallel GZip (compress)-------------------------------------------------*
+*#########################################################################################################################*/
+#if !defined CC_BUILD_COOPTHREADED && !defined CC_BUILD_LOWMEM
+/* Based off the approach used by pigz (https://zlib.net/pigz/) */
+/*  Each segment is compressed into a non-final DEFLATE block followed by an empty stored block, */
+/*  which means the compressed output of each segment can simply be concatenated together */
+#define GZIP_WORKERS 4
+enum GZipSegmentStatus { SEGMENT_FILLING, SEGMENT_QUEUED, SEGMENT_DONE };
+
+static void* gz_pendingMutex;
+static void* gz_pendingWaitable;
+static struct GZipSegment* gz_pendingHead;
+static struct GZipSegment* gz_pendingTail;
+static cc_bool gz_stopping;
+
+static void* gz_workersMutex;
+static void* gz_workers[GZIP_WORKERS];
+static int gz_workersUsers; /* Number of parallel streams currently using the worker threads */
+
+/* Uses the given data as the "previous block", so that matches can refer back to it */
+/* NOTE: Only the last DEFLATE_BLOCK_SIZE bytes of the data are used */
+static void Deflate_SetDictionary(struct DeflateState* state, const cc_uint8* data, cc_uint32 len) {
+	cc_uint32 hash;
+	int pos, start;
+
+	if (len > DEFLATE_BLOCK_SIZE) { data += len - DEFLATE_BLOCK_SIZE; len = DEFLATE_BLOCK_SIZE; }
+	start = DEFLATE_BLOCK_SIZE - len;
+	Mem_Copy(state->Input + start, data, len);
+
+	/* NOTE: Position 0 can't be inserted, since 0 means 'end of hash chain' */
+	for (pos = max(start, 1); pos + MIN_MATCH_LEN <= DEFLATE_BLOCK_SIZE; pos++) {
+		hash = Deflate_Hash(state->Input + pos);
+		state->Prev[pos]  = state->Head[hash];
+		state->Head[hash] = pos;
+	}
+}
+
+/* Multiplies a 32x32 bit matrix by a 32 bit vector (in GF(2)) */
+static cc_uint32 GF2_Times(const cc_uint32* mat, cc_uint32 vec) {
+	cc_uint32 sum = 0;
+	for (; vec; vec >>= 1, mat++) {
+		if (vec & 1) sum ^= *mat;
+	}
+	return sum;
+}
+
+static void GF2_Square(cc_uint32* square, const cc_uint32* mat) {
+	int i;
+	for (i = 0; i < 32; i++) { square[i] = GF2_Times(mat, mat[i]); }
+}
+
+/* Calculates the CRC32 of data A followed by data B, using CRC32 of A and B and length of B */
+/* Based off crc32_combine from zlib */
+static cc_uint32 Crc32_Combine(cc_uint32 crcA, cc_uint32 crcB, cc_uint32 lenB) {
+	cc_uint32 even[32], odd[32], row;
+	int i;
+	if (!lenB) return crcA;
+
+	/* Operator for one zero bit */
+	odd[0] = 0xEDB88320UL; row = 1;
+	for (i = 1; i < 32; i++) { odd[i] = row; row <<= 1; }
+
+	GF2_Square(even, odd); /* Operator for two zero bits */
+	GF2_Square(odd, even); /* Operator for four zero bits */
+
+	/* Apply lenB zero bytes to crcA */
+	for (;;) {
+		GF2_Square(even, odd);
+		if (lenB & 1) crcA = GF2_Times(even, crcA);
+		if (!(lenB >>= 1)) break;
+
+		GF2_Square(odd, even);
+		if (lenB & 1) crcA = GF2_Times(odd, crcA);
+		if (!(lenB >>= 1)) break;
+	}
+	return crcA ^ crcB;
+}
+
+/* Appends compressed data to the output buffer of a segment, expanding it if needed */
+static cc_result Segment_StreamWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	struct GZipSegment* seg = (struct GZipSegment*)stream->meta.inflate;
+	cc_uint32 capacity;
+	cc_uint8* output;
+
+	if (seg->outputLen + count > seg->outputCapacity) {
+		capacity = seg->outputCapacity * 2 + count;
+		output   = (cc_uint8*)Mem_TryRealloc(seg->output, capacity, 1);
+		if (!output) return ERR_OUT_OF_MEMORY;
+
+		seg->output         = output;
+		seg->outputCapacity = capacity;
+	}
+
+	Mem_Copy(seg->output + seg->outputLen, data, count);
+	seg->outputLen += count;
+	*modified = count;
+	return 0;
+}
+
+static void GZipSegment_Compress(struct DeflateState* state, struct GZipSegment* seg) {
+	struct Stream stream, output;
+	cc_uint32 modified;
+	cc_result res;
+
+	Stream_Init(&output);
+	output.meta.inflate = seg;
+	output.Write        = Segment_StreamWrite;
+	seg->outputLen      = 0;
+	seg->crc32          = Utils_CRC32(seg->input, seg->inputLen);
+
+	Deflate_MakeStream(&stream, state, &output);
+	Deflate_SetDictionary(state, seg->dict, seg->dictLen);
+	state->WroteHeader = true;
+	Deflate_PushBits(state, 2, 3); /* final block FALSE, block type FIXED */
+
+	res = Deflate_StreamWrite(&stream, seg->input, seg->inputLen, &modified);
+	if (!res) res = Deflate_StreamSyncFlush(state);
+	seg->result = res;
+}
+
+static void GZipWorker_Run(void) {
+	struct DeflateState* state = (struct DeflateState*)Mem_Alloc(1, sizeof(struct DeflateState), "GZip worker");
+	struct GZipSegment* seg;
+	cc_bool stopping;
+
+	for (;;) {
+		Mutex_Lock(gz_pendingMutex);
+		{
+			seg = gz_pendingHead;
+			if (seg) gz_pendingHead = seg->next;
+			if (!gz_pendingHead) gz_pendingTail = NULL;
+			stopping = gz_stopping;
+		}
+		Mutex_Unlock(gz_pendingMutex);
+
+		if (!seg) {
+			if (stopping) break;
+			/* Block until another thread submits a segment to compress */
+			Waitable_Wait(gz_pendingWaitable);
+			continue;
+		}
+		GZipSegment_Compress(state, seg);
+
+		/* Signal while still holding the mutex, because the owner may free */
+		/*  the waitable as soon as it sees that all its segments are done */
+		Mutex_Lock(gz_pendingMutex);
+		{
+			seg->status = SEGMENT_DONE;
+			Waitable_Signal(seg->owner->segmentDone);
+		}
+		Mutex_Unlock(gz_pendingMutex);
+	}
+
+	/* Wakeups may get merged together, so pass the wakeup on to the next worker still waiting */
+	Waitable_Signal(gz_pendingWaitable);
+	Mem_Free(state);
+}
+
+/* Starts the worker threads, if no other parallel stream is already using them */
+static void GZipWorkers_Start(void) {
+	int i;
+	if (!gz_workersMutex) {
+		gz_workersMutex    = Mutex_Create("GZip workers");
+		gz_pendingMutex    = Mutex_Create("GZip pending");
+		gz_pendingWaitable = Waitable_Create("GZip wakeup");
+	}
+
+	Mutex_Lock(gz_workersMutex);
+	if (gz_workersUsers++ == 0) {
+		for (i = 0; i < GZIP_WORKERS; i++) {
+			Thread_Run(&gz_workers[i], GZipWorker_Run, 64 * 1024, "GZip worker");
+		}
+	}
+	Mutex_Unlock(gz_workersMutex);
+}
+
+/* Stops and waits for the worker threads to exit, if no other parallel stream is still using them */
+static void GZipWorkers_Stop(void) {
+	int i;
+	Mutex_Lock(gz_workersMutex);
+	if (--gz_workersUsers == 0) {
+		Mutex_Lock(gz_pendingMutex);
+		gz_stopping = true;
+		Mutex_Unlock(gz_pendingMutex);
+
+		Waitable_Signal(gz_pendingWaitable);
+		for (i = 0; i < GZIP_WORKERS; i++) {
+			Thread_Join(gz_workers[i]);
+			gz_workers[i] = NULL;
+		}
+		gz_stopping = false;
+	}
+	Mutex_Unlock(gz_workersMutex);
+}
+
+/* Adds a segment to the queue of segments waiting to be compressed, waking up a worker thread if needed */
+static void GZipParallel_Submit(struct GZipSegment* seg) {
+	Mutex_Lock(gz_pendingMutex);
+	{
+		seg->status = SEGMENT_QUEUED;
+		seg->next   = NULL;
+
+		if (gz_pendingTail) {
+			gz_pendingTail->next = seg;
+		} else {
+			gz_pendingHead = seg;
+		}
+		gz_pendingTail = seg;
+	}
+	Mutex_Unlock(gz_pendingMutex);
+	Waitable_Signal(gz_pendingWaitable);
+}
+
+/* Blocks the calling thread until the given segment has finished being compressed */
+static void GZipParallel_Wait(struct GZipParallelState* state, struct GZipSegment* seg) {
+	cc_uint8 status;
+
+	for (;;) {
+		Mutex_Lock(gz_pendingMutex);
+		status = seg->status;
+		Mutex_Unlock(gz_pendingMutex);
+
+		if (status != SEGMENT_QUEUED) return;
+		Waitable_Wait(state->segmentDone);
+	}
+}
+
+static cc_result GZipParallel_WriteHeader(struct GZipParallelState* state) {
+	static cc_uint8 header[10] = { 0x1F, 0x8B, 0x08 }; /* GZip header */
+	if (state->wroteHeader) return 0;
+
+	state->wroteHeader = true;
+	return Stream_Write(state->Dest, header, sizeof(header));
+}
+
+/* Uses the last part of the given segment as the LZ77 dictionary of the next segment, */
+/*  so that the start of the next segment can still be compressed using earlier data */
+static void GZipParallel_SetDictionary(struct GZipSegment* seg, struct GZipSegment* next) {
+	cc_uint32 len = min(seg->inputLen, DEFLATE_BLOCK_SIZE);
+
+	Mem_Copy(next->dict, seg->input + seg->inputLen - len, len);
+	next->dictLen = len;
+}
+
+/* Waits for the given segment to be compressed, then writes its compressed output */
+static cc_result GZipParallel_Drain(struct GZipParallelState* state, struct GZipSegment* seg) {
+	cc_result res;
+	if (seg->status == SEGMENT_FILLING) return 0;
+
+	GZipParallel_Wait(state, seg);
+	seg->status = SEGMENT_FILLING;
+
+	res = seg->result;
+	if (!res) res = GZipParallel_WriteHeader(state);
+	if (!res) res = Stream_Write(state->Dest, seg->output, seg->outputLen);
+
+	state->Crc32  = Crc32_Combine(state->Crc32, seg->crc32, seg->inputLen);
+	seg->inputLen = 0;
+	return res;
+}
+
+/* Waits for any segments still being compressed, then frees all associated memory */
+static void GZipParallel_Free(struct GZipParallelState* state) {
+	struct GZipSegment* seg;
+	int i;
+	if (state->freed) return;
+	state->freed = true;
+
+	for (i = 0; i < GZIP_MAX_SEGMENTS; i++)
+	{
+		seg = &state->segments[i];
+		if (seg->status == SEGMENT_QUEUED) GZipParallel_Wait(state, seg);
+
+		Mem_Free(seg->input);
+		Mem_Free(seg->output);
+		Mem_Free(seg->dict);
+		seg->input  = NULL;
+		seg->output = NULL;
+		seg->dict   = NULL;
+	}
+
+	/* segmentDone is only created once the worker threads have been started */
+	if (!state->segmentDone) return;
+	Waitable_Free(state->segmentDone);
+	GZipWorkers_Stop();
+}
+
+static cc_result GZipParallel_StreamWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	struct GZipParallelState* state = (struct GZipParallelState*)stream->meta.inflate;
+	struct GZipSegment* seg;
+	cc_uint32 len;
+	cc_result res;
+
+	*modified = 0;
+	if (state->freed) return ERR_INVALID_ARGUMENT;
+
+	while (count > 0) {
+		seg = &state->segments[state->curSegment];
+		len = min(count, GZIP_SEGMENT_SIZE - seg->inputLen);
+
+		Mem_Copy(seg->input + seg->inputLen, data, len);
+		seg->inputLen += len;
+		state->Size   += len;
+		*modified     += len;
+		data  += len;
+		count -= len;
+		if (seg->inputLen < GZIP_SEGMENT_SIZE) break;
+
+		GZipParallel_Submit(seg);
+		state->curSegment = (state->curSegment + 1) % GZIP_MAX_SEGMENTS;
+
+		/* Next segment might still be in use from an earlier submission */
+		res = GZipParallel_Drain(state, &state->segments[state->curSegment]);
+		if (res) { GZipParallel_Free(state); return res; }
+		GZipParallel_SetDictionary(seg, &state->segments[state->curSegment]);
+	}
+	return 0;
+}
+
+static cc_result GZipParallel_StreamClose(struct Stream* stream) {
+	/* final block TRUE, block type FIXED, then huffman encoded "literal 256" */
+	static const cc_uint8 lastBlock[2] = { 0x03, 0x00 };
+	struct GZipParallelState* state = (struct GZipParallelState*)stream->meta.inflate;
+	struct GZipSegment* seg;
+	cc_uint8 data[8];
+	cc_result res = 0;
+	int i;
+	if (state->freed) return 0;
+
+	seg = &state->segments[state->curSegment];
+	if (seg->inputLen) GZipParallel_Submit(seg);
+
+	/* Oldest submitted segment is always the one after the current segment */
+	for (i = 1; i <= GZIP_MAX_SEGMENTS && !res; i++) {
+		seg = &state->segments[(state->curSegment + i) % GZIP_MAX_SEGMENTS];
+		res = GZipParallel_Drain(state, seg);
+	}
+
+	GZipParallel_Free(state);
+	if (res) return res;
+
+	if ((res = GZipParallel_WriteHeader(state)))                      return res;
+	if ((res = Stream_Write(state->Dest, lastBlock, sizeof(lastBlock)))) return res;
+
+	Stream_SetU32_LE(&data[0], state->Crc32);
+	Stream_SetU32_LE(&data[4], state->Size);
+	return Stream_Write(state->Dest, data, sizeof(data));
+}
+
+void GZip_MakeParallelStream(struct Stream* stream, struct GZipParallelState* state, struct Stream* underlying) {
+	struct GZipSegment* seg;
+	int i;
+
+	Mem_Set(state->segments, 0, sizeof(state->segments));
+	state->Dest        = underlying;
+	state->Crc32       = 0;
+	state->Size        = 0;
+	state->curSegment  = 0;
+	state->wroteHeader = false;
+	state->freed       = false;
+	state->segmentDone = NULL;
+
+	for (i = 0; i < GZIP_MAX_SEGMENTS; i++)
+	{
+		seg = &state->segments[i];
+		seg->owner  = state;
+		/* Fixed huffman codes are at most 9 bits per input byte */
+		seg->outputCapacity = GZIP_SEGMENT_SIZE + GZIP_SEGMENT_SIZE / 8 + 64;
+
+		seg->input  = (cc_uint8*)Mem_TryAlloc(GZIP_SEGMENT_SIZE,   1);
+		seg->output = (cc_uint8*)Mem_TryAlloc(seg->outputCapacity, 1);
+		seg->dict   = (cc_uint8*)Mem_TryAlloc(DEFLATE_BLOCK_SIZE,  1);
+		if (!seg->input || !seg->output || !seg->dict) break;
+	}
+
+	/* Not enough memory, so just compress everything on the calling thread instead */
+	if (i < GZIP_MAX_SEGMENTS) {
+		GZipParallel_Free(state);
+		GZip_MakeStream(stream, &state->Serial, underlying);
+		return;
+	}
+
+	GZipWorkers_Start();
+	state->segmentDone = Waitable_Create("GZip segment done");
+
+	Stream_Init(stream);
+	stream->meta.inflate = state;
+	stream->Write = GZipParallel_StreamWrite;
+	stream->Close = GZipParallel_StreamClose;
+}
+#else
+void GZip_MakeParallelStream(struct Stream* stream, struct GZipParallelState* state, struct Stream* underlying) {
+	GZip_MakeStream(stream, &state->Serial, underlying);
+}
+#endif
+
+
 /*########################################################################################################################*
 *-----------------------------------------------------ZLib (compress)-----------------------------------------------------*
 *#########################################################################################################################*/
@@ -1109,16 +1527,33 @@ static cc_result ZLib_StreamClose(struct Stream* stream) {
 	return Stream_Write(state->Base.Dest, data, sizeof(data));
 }
 
+#define ADLER32_BASE 65521
+/* Largest n such that 255n(n+1)/2 + (n+1)(BASE-1) still fits in 32 bits */
+#define ADLER32_NMAX 5552
+
 static cc_result ZLib_StreamWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
 	struct ZLibState* state = (struct ZLibState*)stream->meta.inflate;
-	cc_uint32 i, adler32 = state->Adler32;
-	cc_uint32 s1 = adler32 & 0xFFFF, s2 = (adler32 >> 16) & 0xFFFF;
+	cc_uint32 s1 = state->Adler32 & 0xFFFF, s2 = (state->Adler32 >> 16) & 0xFFFF;
+	const cc_uint8* cur = data;
+	cc_uint32 len, left = count;
+
+	/* Sums can't overflow for up to NMAX bytes, so defer the expensive modulo until then */
+	while (left > 0) {
+		len   = min(left, ADLER32_NMAX);
+		left -= len;
+
+		for (; len >= 4; len -= 4, cur += 4) {
+			s1 += cur[0]; s2 += s1;
+			s1 += cur[1]; s2 += s1;
+			s1 += cur[2]; s2 += s1;
+			s1 += cur[3]; s2 += s1;
+		}
+		for (; len > 0; len--, cur++) {
+			s1 += *cur; s2 += s1;
+		}
 
-	/* TODO: Optimise this calculation */
-	for (i = 0; i < count; i++) {
-		#define ADLER32_BASE 65521
-		s1 = (s1 + data[i]) % ADLER32_BASE;
-		s2 = (s2 + s1)      % ADLER32_BASE;
+		s1 %= ADLER32_BASE;
+		s2 %= ADLER32_BASE;
 	}
 
 	state->Adler32 = (s2 << 16) | s1;
@@ -119,6 +119,38 @@ struct GZipState { struct DeflateState Base; cc_uint32 Crc32, Size; };
 CC_API  void GZip_MakeStream(      struct Stream* stream, struct GZipState* state, struct Stream* underlying);
 typedef void (*FP_GZip_MakeStream)(struct Stream* stream, struct GZipState* state, struct Stream* underlying);
 
+#define GZIP_SEGMENT_SIZE (256 * 1024)
+#define GZIP_MAX_SEGMENTS 8
+struct GZipParallelState;
+/* Portion of the input data that is DEFLATE compressed independently of the other portions */
+struct GZipSegment {
+	struct GZipParallelState* owner;
+	struct GZipSegment* next;  /* Next segment in the queue of segments waiting to be compressed */
+	cc_uint8* input;  cc_uint32 inputLen;
+	cc_uint8* output; cc_uint32 outputLen, outputCapacity;
+	cc_uint8* dict;   cc_uint32 dictLen; /* End of the previous segment's input data */
+	cc_uint32 crc32;           /* CRC32 of the input data in this segment */
+	volatile cc_uint8 status;
+	cc_result result;
+};
+
+struct GZipParallelState {
+	struct GZipState Serial; /* Used instead when parallel compression is unsupported */
+	struct Stream* Dest;
+	cc_uint32 Crc32, Size;
+	int curSegment;
+	cc_bool wroteHeader, freed;
+	void* segmentDone;
+	struct GZipSegment segments[GZIP_MAX_SEGMENTS];
+};
+/* Compresses input data using GZIP, then writes compressed output to another stream. Write only stream. */
+/* Input data is split into segments, which are then DEFLATE compressed in parallel on worker threads. */
+/* NOTE: Falls back to GZip_MakeStream behaviour when threading is unsupported or memory is low. */
+/* NOTE: The first call to this MUST be made from the main thread. (creates the worker thread mutexes) */
+/* NOTE: Worker threads are started on demand, and stopped once no parallel streams are still open */
+CC_API  void GZip_MakeParallelStream(      struct Stream* stream, struct GZipParallelState* state, struct Stream* underlying);
+typedef void (*FP_GZip_MakeParallelStream)(struct Stream* stream, struct GZipParallelState* state, struct Stream* underlying);
+
 struct ZLibState { struct DeflateState Base; cc_uint32 Adler32; };
 /* Compresses input data using ZLIB, then writes compressed output to another stream. Write only stream. */
 /* ZLIB compression is ZLIB header, followed by DEFLATE compressed data, followed by ZLIB footer. */
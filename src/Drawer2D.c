@@ -94,8 +94,10 @@ static void CalculateTextWidths(void) {
 	tileWidths[' '] = tileSize / 4;
 }
 
+static GfxResourceID glyphsTex;
 static void FreeFontBitmap(void) {
 	int i;
+	if (glyphsTex) Gfx_DeleteTexture(&glyphsTex);
 	for (i = 0; i < Array_Elems(tileWidths); i++) tileWidths[i] = 0;
 	Mem_Free(fontBitmap.scan0);
 }
@@ -590,6 +592,55 @@ void Context2D_DrawText(struct Context2D* ctx, struct DrawTextArgs* args, int x,
 	SysFont_DrawText(args, bmp, x, y, false);
 }
 
+GfxResourceID Drawer2D_GetGlyphsTexture(void) {
+	if (glyphsTex || !fontBitmap.scan0) return glyphsTex;
+	if (!Gfx_CheckTextureSize(fontBitmap.width, fontBitmap.height, 0)) return 0;
+
+	glyphsTex = Gfx_CreateTexture(&fontBitmap, TEXTURE_FLAG_MANAGED, false);
+	return glyphsTex;
+}
+
+int Drawer2D_MakeGlyphQuads(struct DrawTextArgs* args, struct GlyphQuad* quads, int maxQuads) {
+	cc_string text = args->text;
+	int i, point   = args->font->size, count = 0;
+	BitmapCol color = Drawer2D.Colors['f'];
+	int x = 0, width, xPadding;
+	struct GlyphQuad* q;
+	float scale;
+	cc_uint8 c;
+
+	if (!fontBitmap.scan0 || !Font_IsBitmap(args->font)) return 0;
+	/* Underlines are only drawn by DrawBitmappedText */
+	if (args->font->flags & FONT_FLAGS_UNDERLINE)        return 0;
+
+	xPadding = Drawer2D_XPadding(point);
+	scale    = 1.0f / fontBitmap.width;
+
+	for (i = 0; i < text.length; i++) {
+		c = (cc_uint8)text.buffer[i];
+		if (c == '&' && Drawer2D_ValidColorCodeAt(&text, i + 1)) {
+			color = Drawer2D_GetColor(text.buffer[i + 1]);
+			i++; continue; /* skip over the color code */
+		}
+		width = Drawer2D_Width(point, c);
+
+		/* Space glyph is entirely transparent, so no point drawing it */
+		if (c != ' ' && count < maxQuads) {
+			q = &quads[count++];
+			q->x     = x;
+			q->width = width;
+			q->color = color;
+
+			q->uv.u1 = ((c & 0x0F) * tileSize) * scale;
+			q->uv.v1 = ((c >> 4)   * tileSize) * scale;
+			q->uv.u2 = q->uv.u1 + tileWidths[c] * scale;
+			q->uv.v2 = q->uv.v1 + tileSize      * scale;
+		}
+		x += width + xPadding;
+	}
+	return count;
+}
+
 int Drawer2D_TextWidth(struct DrawTextArgs* args) {
 	if (Font_IsBitmap(args->font)) return MeasureBitmappedWidth(args);
 	return SysFont_TextWidth(args);
@@ -696,8 +747,13 @@ static void OnReset(void) {
 	Mem_Copy(&Drawer2D.Colors['A'], defaults_a_f, sizeof(defaults_a_f));
 }
 
+static void OnContextLost(void* obj) {
+	if (glyphsTex) Gfx_DeleteTexture(&glyphsTex);
+}
+
 static void OnInit(void) {
 	OnReset();
+	Event_Register_(&GfxEvents.ContextLost, NULL, OnContextLost);
 	TextureEntry_Register(&default_entry);
 
 	Drawer2D.BitmappedText    = Game_ClassicMode || !Options_GetBool(OPT_USE_CHAT_FONT, false);
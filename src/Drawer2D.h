@@ -76,6 +76,18 @@ CC_API int Drawer2D_TextHeight(struct DrawTextArgs* args);
 void Drawer2D_DrawClippedText(struct Context2D* ctx, struct DrawTextArgs* args, 
 								int x, int y, int maxWidth);
 
+/* A single glyph of bitmapped text, as a quad within the font glyphs texture */
+/*  x/width are in pixels relative to start of the text, height is always font->size */
+struct GlyphQuad { int x, width; TextureRec uv; BitmapCol color; };
+/* Returns the texture containing the glyphs of the bitmapped font, or 0 if unavailable */
+/*  NOTE: The texture is lazily created, and recreated after default.png changes */
+GfxResourceID Drawer2D_GetGlyphsTexture(void);
+/* Calculates the glyph quads that would be drawn for the given bitmapped text */
+/*  This allows drawing text by batching quads, instead of by creating a texture per string */
+/*  NOTE: Glyphs for spaces and text shadows are not included */
+/*  NOTE: Returns 0 for system fonts and underlined text, as those are unsupported */
+int Drawer2D_MakeGlyphQuads(struct DrawTextArgs* args, struct GlyphQuad* quads, int maxQuads);
+
 /* Creates a texture consisting only of the given text drawn onto it */
 /*  NOTE: The returned texture is always padded up to nearest power of two dimensions */
 CC_API void Drawer2D_MakeTextTexture(struct Texture* tex, struct DrawTextArgs* args);
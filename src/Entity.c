@@ -203,6 +203,230 @@ cc_bool Entity_TouchesAnyWater(struct Entity* e) {
 }
 
 
+/*########################################################################################################################*
+*-------------------------------------------------------Skin atlas--------------------------------------------------------*
+*#########################################################################################################################*/
+/* Standard 64x64 and 64x32 skins are packed into larger shared textures, rather than */
+/*  each being a separate texture. This way entities with different skins can still be */
+/*  drawn together without needing to switch textures for each entity. */
+#define SKIN_ATLAS_PAGE_SIZE 512
+#define SKIN_ATLAS_CELL_SIZE 64
+#define SKIN_ATLAS_PAGE_ROW  (SKIN_ATLAS_PAGE_SIZE / SKIN_ATLAS_CELL_SIZE)
+#define SKIN_ATLAS_CELLS     (SKIN_ATLAS_PAGE_ROW  * SKIN_ATLAS_PAGE_ROW)
+#define SKIN_ATLAS_MAX_PAGES 4
+#define SkinAtlas_CellX(cell) (((cell) % SKIN_ATLAS_PAGE_ROW) * SKIN_ATLAS_CELL_SIZE)
+#define SkinAtlas_CellY(cell) (((cell) / SKIN_ATLAS_PAGE_ROW) * SKIN_ATLAS_CELL_SIZE)
+/* NOTE: Relies on there being exactly 64 cells per page */
+#define SkinAtlas_CellBit(cell) ((cc_uint64)1 << (cell))
+
+struct SkinAtlasCell {
+	char skin[STRING_SIZE]; /* Name of skin stored in this cell, empty if cell is unused */
+	cc_uint32 lastUsed;     /* Used to evict the least recently used skin when atlas is full */
+	cc_uint8 skinType, height;
+};
+static struct SkinAtlasPage {
+	GfxResourceID tex;
+	cc_uint64 usedCells; /* Bit is set for each cell that contains a skin */
+	struct SkinAtlasCell cells[SKIN_ATLAS_CELLS];
+} skinPages[SKIN_ATLAS_MAX_PAGES];
+static int skinPagesCount;
+static cc_uint32 skinAtlasTime;
+/* Cell within its atlas page of each entity's skin, indexed by entity ID */
+/* NOTE: Not stored in struct Entity, as plugins may declare entities using an older layout of it */
+static cc_uint8 skinCells[ENTITIES_MAX_COUNT];
+
+/* Returns the ID of the given entity, or -1 if it wasn't allocated by the game itself */
+static int SkinAtlas_GetID(struct Entity* e) {
+	cc_uintptr offset = (cc_uintptr)e - (cc_uintptr)NetPlayers_List;
+	int i;
+
+	if (offset < sizeof(NetPlayers_List) && (offset % sizeof(struct NetPlayer)) == 0)
+		return (int)(offset / sizeof(struct NetPlayer));
+
+	for (i = 0; i < MAX_LOCAL_PLAYERS; i++)
+	{
+		if (e == &LocalPlayer_Instances[i].Base) return MAX_NET_PLAYERS + i;
+	}
+	return -1;
+}
+
+static int SkinAtlas_FindPage(GfxResourceID tex) {
+	int i;
+	for (i = 0; i < skinPagesCount; i++)
+	{
+		if (skinPages[i].tex == tex) return i;
+	}
+	return -1;
+}
+
+/* NOTE: Entity must have been allocated by the game itself */
+static void SkinAtlas_Apply(struct Entity* e, int page, int cell) {
+	struct SkinAtlasCell* c = &skinPages[page].cells[cell];
+	c->lastUsed = ++skinAtlasTime;
+
+	e->TextureId = skinPages[page].tex;
+	e->SkinType  = c->skinType;
+	e->uScale    = (float)SKIN_ATLAS_CELL_SIZE / SKIN_ATLAS_PAGE_SIZE;
+	e->vScale    = (float)c->height           / SKIN_ATLAS_PAGE_SIZE;
+	e->Flags    |= ENTITY_FLAG_SKIN_ATLAS;
+	skinCells[SkinAtlas_GetID(e)] = cell;
+}
+
+/* Looks for a cell that already contains the given skin */
+static cc_bool SkinAtlas_Find(const cc_string* skin, int* page, int* cell) {
+	cc_string name;
+	int i, j;
+
+	for (i = 0; i < skinPagesCount; i++)
+	{
+		for (j = 0; j < SKIN_ATLAS_CELLS; j++)
+		{
+			name = String_FromRawArray(skinPages[i].cells[j].skin);
+			if (!String_Equals(&name, skin)) continue;
+
+			*page = i; *cell = j; return true;
+		}
+	}
+	return false;
+}
+
+static cc_bool SkinAtlas_AddPage(void) {
+	struct Bitmap bmp;
+	GfxResourceID tex;
+	if (skinPagesCount == SKIN_ATLAS_MAX_PAGES) return false;
+
+	bmp.width  = SKIN_ATLAS_PAGE_SIZE;
+	bmp.height = SKIN_ATLAS_PAGE_SIZE;
+	bmp.scan0  = (BitmapCol*)Mem_TryAllocCleared(SKIN_ATLAS_PAGE_SIZE * SKIN_ATLAS_PAGE_SIZE, BITMAPCOLOR_SIZE);
+	if (!bmp.scan0) return false;
+
+	tex = Gfx_CreateTexture(&bmp, TEXTURE_FLAG_MANAGED | TEXTURE_FLAG_DYNAMIC, false);
+	Mem_Free(bmp.scan0);
+	if (!tex) return false;
+
+	Mem_Set(&skinPages[skinPagesCount], 0, sizeof(struct SkinAtlasPage));
+	skinPages[skinPagesCount++].tex = tex;
+	return true;
+}
+
+/* Finds an unused cell, evicting the least recently used skin that no entity is using if needed */
+static cc_bool SkinAtlas_Allocate(int* page, int* cell) {
+	cc_uint64 usedByEntities[SKIN_ATLAS_MAX_PAGES] = { 0 };
+	cc_uint32 oldest = Int32_MaxValue;
+	struct SkinAtlasCell* c;
+	struct Entity* e;
+	int i, j;
+
+	for (i = 0; i < skinPagesCount; i++)
+	{
+		if (skinPages[i].usedCells == ~(cc_uint64)0) continue;
+
+		for (j = 0; j < SKIN_ATLAS_CELLS; j++)
+		{
+			if (skinPages[i].usedCells & SkinAtlas_CellBit(j)) continue;
+			*page = i; *cell = j; return true;
+		}
+	}
+
+	/* Prefer adding a new page over evicting a previously used skin */
+	if (SkinAtlas_AddPage()) {
+		*page = skinPagesCount - 1; *cell = 0; return true;
+	}
+
+	/* Only entities allocated by the game can use the atlas, and their index is their ID */
+	for (i = 0; i < ENTITIES_MAX_COUNT; i++)
+	{
+		e = Entities.List[i];
+		if (!e || !(e->Flags & ENTITY_FLAG_SKIN_ATLAS)) continue;
+
+		j = SkinAtlas_FindPage(e->TextureId);
+		if (j >= 0) usedByEntities[j] |= SkinAtlas_CellBit(skinCells[i]);
+	}
+
+	*page = -1;
+	for (i = 0; i < skinPagesCount; i++)
+	{
+		for (j = 0; j < SKIN_ATLAS_CELLS; j++)
+		{
+			c = &skinPages[i].cells[j];
+			if (c->lastUsed >= oldest || (usedByEntities[i] & SkinAtlas_CellBit(j))) continue;
+
+			oldest = c->lastUsed;
+			*page  = i; *cell = j;
+		}
+	}
+	return *page >= 0;
+}
+
+/* Attempts to store the given skin in the atlas, returning false if it couldn't be */
+static cc_bool SkinAtlas_Add(struct Entity* e, struct Bitmap* bmp, const cc_string* skin) {
+	struct SkinAtlasCell* c;
+	int page, cell;
+
+	if (SkinAtlas_GetID(e) < 0) return false;
+	if (bmp->width != SKIN_ATLAS_CELL_SIZE) return false;
+	if (bmp->height != SKIN_ATLAS_CELL_SIZE && bmp->height != SKIN_ATLAS_CELL_SIZE / 2) return false;
+
+	if (!Gfx_CheckTextureSize(SKIN_ATLAS_PAGE_SIZE, SKIN_ATLAS_PAGE_SIZE, 0)) return false;
+	/* Overwrite the old copy of the skin if it has changed since */
+	if (!SkinAtlas_Find(skin, &page, &cell) && !SkinAtlas_Allocate(&page, &cell)) return false;
+
+	c = &skinPages[page].cells[cell];
+	skinPages[page].usedCells |= SkinAtlas_CellBit(cell);
+	String_CopyToRawArray(c->skin, skin);
+	c->skinType = e->SkinType;
+	c->height   = bmp->height;
+
+	Gfx_UpdateTexturePart(skinPages[page].tex, SkinAtlas_CellX(cell), SkinAtlas_CellY(cell), bmp, false);
+	SkinAtlas_Apply(e, page, cell);
+	return true;
+}
+
+/* Reuses the given skin if it was previously stored in the atlas */
+static cc_bool SkinAtlas_TryReuse(struct Entity* e, const cc_string* skin) {
+	int page, cell;
+	if (SkinAtlas_GetID(e) < 0)              return false;
+	if (!SkinAtlas_Find(skin, &page, &cell)) return false;
+
+	SkinAtlas_Apply(e, page, cell);
+	return true;
+}
+
+/* Forgets the old copy of the skin (if any), e.g. when it has changed to a skin unsuitable for the atlas */
+static void SkinAtlas_Remove(const cc_string* skin) {
+	int page, cell;
+	if (!SkinAtlas_Find(skin, &page, &cell)) return;
+
+	skinPages[page].cells[cell].skin[0] = '\0';
+	skinPages[page].usedCells &= ~SkinAtlas_CellBit(cell);
+}
+
+void Entity_GetSkinOffset(struct Entity* e, float* u, float* v) {
+	int id = SkinAtlas_GetID(e), page, cell = 0;
+	cc_string skin;
+
+	if (id >= 0) {
+		cell = skinCells[id];
+	} else {
+		/* e.g. held block renderer's entity, which mirrors the skin of the player */
+		skin = String_FromRawArray(e->SkinRaw);
+		SkinAtlas_Find(&skin, &page, &cell);
+	}
+
+	*u = (float)SkinAtlas_CellX(cell) / SKIN_ATLAS_PAGE_SIZE;
+	*v = (float)SkinAtlas_CellY(cell) / SKIN_ATLAS_PAGE_SIZE;
+}
+
+static void SkinAtlas_Free(void) {
+	int i;
+	for (i = 0; i < skinPagesCount; i++)
+	{
+		Gfx_DeleteTexture(&skinPages[i].tex);
+	}
+	skinPagesCount = 0;
+}
+
+
 /*########################################################################################################################*
 *------------------------------------------------------Entity skins-------------------------------------------------------*
 *#########################################################################################################################*/
@@ -223,7 +447,21 @@ static struct Entity* Entity_FirstOtherWithSameSkinAndFetchedSkin(struct Entity*
 }
 
 /* Copies skin data from another entity */
+static void Entity_ResetSkin(struct Entity* e);
 static void Entity_CopySkin(struct Entity* dst, struct Entity* src) {
+	int id;
+
+	if (src->Flags & ENTITY_FLAG_SKIN_ATLAS) {
+		/* Entities declared by plugins can't use skins in the atlas */
+		id = SkinAtlas_GetID(dst);
+		if (id < 0) { Entity_ResetSkin(dst); return; }
+
+		skinCells[id] = skinCells[SkinAtlas_GetID(src)];
+		dst->Flags   |= ENTITY_FLAG_SKIN_ATLAS;
+	} else {
+		dst->Flags  &= ~ENTITY_FLAG_SKIN_ATLAS;
+	}
+
 	dst->TextureId    = src->TextureId;	
 	dst->SkinType     = src->SkinType;
 	dst->uScale       = src->uScale;
@@ -237,6 +475,7 @@ static void Entity_ResetSkin(struct Entity* e) {
 	e->MobTextureId = 0;
 	e->TextureId    = 0;
 	e->SkinType     = SKIN_64x32;
+	e->Flags       &= ~ENTITY_FLAG_SKIN_ATLAS;
 }
 
 /* Copies or resets skin data for all entity with same skin */
@@ -323,7 +562,7 @@ static cc_result ApplySkin(struct Entity* e, struct Bitmap* bmp, struct Stream*
 	cc_result res;
 	if ((res = Png_Decode(bmp, src))) return res;
 
-	Gfx_DeleteTexture(&e->TextureId);
+	if (!(e->Flags & ENTITY_FLAG_SKIN_ATLAS)) Gfx_DeleteTexture(&e->TextureId);
 	Entity_SetSkinAll(e, true);
 	if ((res = EnsurePow2Skin(e, bmp))) return res;
 	e->SkinType = Utils_CalcSkinType(bmp);
@@ -334,7 +573,10 @@ static cc_result ApplySkin(struct Entity* e, struct Bitmap* bmp, struct Stream*
 		if (e->Model->flags & MODEL_FLAG_CLEAR_HAT)
 			Entity_ClearHat(bmp, e->SkinType);
 
-		e->TextureId = Gfx_CreateTexture(bmp, TEXTURE_FLAG_MANAGED, false);
+		if (!SkinAtlas_Add(e, bmp, skin)) {
+			SkinAtlas_Remove(skin);
+			e->TextureId = Gfx_CreateTexture(bmp, TEXTURE_FLAG_MANAGED, false);
+		}
 		Entity_SetSkinAll(e, false);
 	}
 	return 0;
@@ -369,7 +611,14 @@ static void Entity_CheckSkin(struct Entity* e) {
 
 	if (!e->SkinFetchState) {
 		first = Entity_FirstOtherWithSameSkinAndFetchedSkin(e);
-		flags = e == &LocalPlayer_Instances[0].Base ? HTTP_FLAG_NOCACHE : 0;
+		flags = e == &LocalPlayer_Instances[0].Base ? HTTP_FLAG_NOCACHE : (HTTP_FLAG_BACKGROUND | HTTP_FLAG_CACHE);
+
+		if (!first && !(flags & HTTP_FLAG_NOCACHE) && SkinAtlas_TryReuse(e, &skin)) {
+			/* Skin was previously downloaded for an entity that has since been removed */
+			/*  So show that straight away, but still revalidate it in case it has changed */
+			Entity_SetSkinAll(e, false);
+			flags |= HTTP_FLAG_CACHE_SKIPLOAD;
+		}
 
 		if (!first) {
 			e->_skinReqID     = Http_AsyncGetSkin(&skin, flags);
@@ -383,7 +632,10 @@ static void Entity_CheckSkin(struct Entity* e) {
 
 	if (!Http_GetResult(e->_skinReqID, &item)) return;
 
-	if (!item.success) {
+	if (!item.success && (e->Flags & ENTITY_FLAG_SKIN_ATLAS)) {
+		/* Skin reused from the atlas is unchanged (or couldn't be revalidated) */
+		e->SkinFetchState = SKIN_FETCH_COMPLETED;
+	} else if (!item.success) {
 		Entity_SetSkinAll(e, true);
 	} else {
 		Stream_ReadonlyMemory(&mem, item.data, item.size);
@@ -400,6 +652,8 @@ static void Entity_CheckSkin(struct Entity* e) {
 static cc_bool CanDeleteTexture(struct Entity* except) {
 	int i;
 	if (!except->TextureId) return false;
+	/* Skin atlas pages are shared by many different skins */
+	if (except->Flags & ENTITY_FLAG_SKIN_ATLAS) return false;
 
 	for (i = 0; i < ENTITIES_MAX_COUNT; i++)
 	{
@@ -441,29 +695,307 @@ void Entity_LerpAngles(struct Entity* e, float t) {
 }
 
 
+/*########################################################################################################################*
+*-------------------------------------------------------Entity grid-------------------------------------------------------*
+*#########################################################################################################################*/
+/* Entities are indexed by which horizontal cell of the world their position is in */
+/*  Cells are then hashed into a fixed number of buckets, each with a list of entities */
+#define GRID_CELL_SHIFT 2
+#define GRID_CELL_SIZE  (1 << GRID_CELL_SHIFT)
+/* Max horizontal distance the bounds of an entity can extend from its position, */
+/*  which guarantees an entity only ever intersects the 3x3 cells around its cell */
+#define GRID_MAX_REACH  ((float)GRID_CELL_SIZE)
+#define GRID_BUCKETS    256
+/* Entities that extend further than GRID_MAX_REACH are always returned */
+#define GRID_OVERSIZED  GRID_BUCKETS
+/* Max cells a line is walked through, before just returning all entities instead */
+#define GRID_MAX_LINE_CELLS 512
+
+/* NOTE: Entity IDs and buckets are stored +1, so that 0 means none */
+static cc_uint16 grid_heads[GRID_BUCKETS + 1];
+static cc_uint16 grid_next[ENTITIES_MAX_COUNT];
+static cc_uint16 grid_bucket[ENTITIES_MAX_COUNT];
+static cc_uint32 grid_visited[GRID_BUCKETS + 1], grid_stamp;
+/* Range of cells that contain any entities */
+static int grid_minX, grid_minZ, grid_maxX, grid_maxZ;
+static cc_bool grid_empty = true;
+
+#define Grid_Cell(coord) (Math_Floor(coord) >> GRID_CELL_SHIFT)
+static int Grid_Bucket(int cellX, int cellZ) {
+	cc_uint32 hash = ((cc_uint32)cellX * 73856093u) ^ ((cc_uint32)cellZ * 19349663u);
+	return (int)(hash & (GRID_BUCKETS - 1));
+}
+
+/* Returns how far horizontally the entity may extend from its current position, */
+/*  including anywhere it might be interpolated to before the next tick */
+static float Grid_CalcReach(struct Entity* e) {
+	struct AABB* bb = &e->ModelAABB;
+	float x = max(Math_AbsF(bb->Min.x), Math_AbsF(bb->Max.x));
+	float y = max(Math_AbsF(bb->Min.y), Math_AbsF(bb->Max.y));
+	float z = max(Math_AbsF(bb->Min.z), Math_AbsF(bb->Max.z));
+	float dx, dz, prevDist, nextDist;
+
+	dx = e->prev.pos.x - e->Position.x; dz = e->prev.pos.z - e->Position.z;
+	prevDist = dx * dx + dz * dz;
+	dx = e->next.pos.x - e->Position.x; dz = e->next.pos.z - e->Position.z;
+	nextDist = dx * dx + dz * dz;
+
+	/* Bounds may be rotated in any direction, so Y extent is included too */
+	return Math_SqrtF(x * x + y * y + z * z) + Math_SqrtF(max(prevDist, nextDist));
+}
+
+static void Grid_Remove(int id) {
+	int bucket = grid_bucket[id];
+	cc_uint16* cur;
+	if (!bucket) return;
+
+	for (cur = &grid_heads[bucket - 1]; *cur; cur = &grid_next[*cur - 1])
+	{
+		if (*cur != id + 1) continue;
+		*cur = grid_next[id]; break;
+	}
+	grid_bucket[id] = 0;
+}
+
+void EntityGrid_Update(int id) {
+	struct Entity* e = Entities.List[id];
+	int bucket, cellX, cellZ;
+
+	if (!e) { Grid_Remove(id); return; }
+	cellX = Grid_Cell(e->Position.x);
+	cellZ = Grid_Cell(e->Position.z);
+
+	if (Grid_CalcReach(e) > GRID_MAX_REACH) {
+		bucket = GRID_OVERSIZED;
+	} else {
+		bucket = Grid_Bucket(cellX, cellZ);
+
+		if (grid_empty) {
+			grid_minX = cellX; grid_maxX = cellX;
+			grid_minZ = cellZ; grid_maxZ = cellZ;
+			grid_empty = false;
+		} else {
+			grid_minX = min(grid_minX, cellX); grid_maxX = max(grid_maxX, cellX);
+			grid_minZ = min(grid_minZ, cellZ); grid_maxZ = max(grid_maxZ, cellZ);
+		}
+	}
+
+	if (grid_bucket[id] == bucket + 1) return;
+	Grid_Remove(id);
+
+	grid_next[id]      = grid_heads[bucket];
+	grid_heads[bucket] = id + 1;
+	grid_bucket[id]    = bucket + 1;
+}
+
+static void EntityGrid_Rebuild(void) {
+	int i;
+	Mem_Set(grid_heads,  0, sizeof(grid_heads));
+	Mem_Set(grid_bucket, 0, sizeof(grid_bucket));
+
+	/* Also recalculates the range of occupied cells, which only ever grows otherwise */
+	grid_empty = true;
+	for (i = 0; i < ENTITIES_MAX_COUNT; i++) 
+	{
+		if (Entities.List[i]) EntityGrid_Update(i);
+	}
+}
+
+static int Grid_AddBucket(int bucket, int* ids, int count) {
+	int id;
+	if (grid_visited[bucket] == grid_stamp) return count;
+	grid_visited[bucket] = grid_stamp;
+
+	for (id = grid_heads[bucket]; id; id = grid_next[id - 1])
+	{
+		ids[count++] = id - 1;
+	}
+	return count;
+}
+
+static int Grid_BeginQuery(int* ids) {
+	/* Stamp wrapped around, so visited buckets must be reset */
+	if (++grid_stamp == 0) {
+		Mem_Set(grid_visited, 0, sizeof(grid_visited));
+		grid_stamp = 1;
+	}
+	return Grid_AddBucket(GRID_OVERSIZED, ids, 0);
+}
+
+static int Grid_AddAll(int* ids, int count) {
+	int i;
+	for (i = 0; i < GRID_BUCKETS; i++) { count = Grid_AddBucket(i, ids, count); }
+	return count;
+}
+
+/* Adds the entities in the 3x3 cells around the given cell */
+static int Grid_AddNeighbours(int cellX, int cellZ, int* ids, int count) {
+	int x, z;
+	for (z = cellZ - 1; z <= cellZ + 1; z++)
+		for (x = cellX - 1; x <= cellX + 1; x++)
+	{
+		count = Grid_AddBucket(Grid_Bucket(x, z), ids, count);
+	}
+	return count;
+}
+
+int EntityGrid_QueryBox(const struct AABB* bb, int* ids) {
+	int count = Grid_BeginQuery(ids);
+	int minX, minZ, maxX, maxZ, x, z;
+	if (grid_empty) return count;
+
+	minX = max(grid_minX, Grid_Cell(bb->Min.x - GRID_MAX_REACH));
+	minZ = max(grid_minZ, Grid_Cell(bb->Min.z - GRID_MAX_REACH));
+	maxX = min(grid_maxX, Grid_Cell(bb->Max.x + GRID_MAX_REACH));
+	maxZ = min(grid_maxZ, Grid_Cell(bb->Max.z + GRID_MAX_REACH));
+	if (minX > maxX || minZ > maxZ) return count;
+
+	/* Faster to just check every bucket when the area covers many cells */
+	if ((maxX - minX) >= GRID_BUCKETS || (maxZ - minZ) >= GRID_BUCKETS ||
+		(maxX - minX + 1) * (maxZ - minZ + 1) > GRID_BUCKETS) return Grid_AddAll(ids, count);
+
+	for (z = minZ; z <= maxZ; z++)
+		for (x = minX; x <= maxX; x++)
+	{
+		count = Grid_AddBucket(Grid_Bucket(x, z), ids, count);
+	}
+	return count;
+}
+
+int EntityGrid_QueryRadius(const Vec3* pos, float radius, int* ids) {
+	struct AABB bb;
+	bb.Min.x = pos->x - radius; bb.Min.y = pos->y - radius; bb.Min.z = pos->z - radius;
+	bb.Max.x = pos->x + radius; bb.Max.y = pos->y + radius; bb.Max.z = pos->z + radius;
+	return EntityGrid_QueryBox(&bb, ids);
+}
+
+/* Calculates the range of t where origin + dir * t is within [min, max] */
+static cc_bool Grid_ClipLine(float origin, float dir, float min, float max, float* t0, float* t1) {
+	float a, b;
+	if (Math_AbsF(dir) < 0.000001f) return origin >= min && origin <= max;
+
+	a = (min - origin) / dir; b = (max - origin) / dir;
+	if (a > b) { float tmp = a; a = b; b = tmp; }
+
+	*t0 = max(*t0, a); *t1 = min(*t1, b);
+	return *t0 <= *t1;
+}
+
+int EntityGrid_QueryLine(const Vec3* origin, const Vec3* dir, int* ids) {
+	int count = Grid_BeginQuery(ids);
+	float t0 = -1e30f, t1 = 1e30f;
+	float minX, minZ, maxX, maxZ;
+	float tMaxX, tMaxZ, tDeltaX, tDeltaZ;
+	int cellX, cellZ, stepX, stepZ, steps;
+	if (grid_empty) return count;
+
+	if ((grid_maxX - grid_minX) + (grid_maxZ - grid_minZ) > GRID_MAX_LINE_CELLS) 
+		return Grid_AddAll(ids, count);
+
+	/* Entity bounds never extend beyond the cells surrounding the entity's cell */
+	minX = (float)((grid_minX - 1) * GRID_CELL_SIZE); maxX = (float)((grid_maxX + 2) * GRID_CELL_SIZE);
+	minZ = (float)((grid_minZ - 1) * GRID_CELL_SIZE); maxZ = (float)((grid_maxZ + 2) * GRID_CELL_SIZE);
+
+	if (!Grid_ClipLine(origin->x, dir->x, minX, maxX, &t0, &t1)) return count;
+	if (!Grid_ClipLine(origin->z, dir->z, minZ, maxZ, &t0, &t1)) return count;
+
+	/* Vertical line, so only passes through one cell */
+	if (t0 < -1e29f || t1 > 1e29f) {
+		return Grid_AddNeighbours(Grid_Cell(origin->x), Grid_Cell(origin->z), ids, count);
+	}
+
+	/* Walk through all the cells the line passes through within the occupied area */
+	/*  See "A Fast Voxel Traversal Algorithm for Ray Tracing" by Amanatides and Woo */
+	cellX = Grid_Cell(origin->x + dir->x * t0);
+	cellZ = Grid_Cell(origin->z + dir->z * t0);
+	stepX = dir->x >= 0.0f ? 1 : -1;
+	stepZ = dir->z >= 0.0f ? 1 : -1;
+
+	tDeltaX = Math_AbsF(dir->x) < 0.000001f ? 1e30f : GRID_CELL_SIZE / Math_AbsF(dir->x);
+	tDeltaZ = Math_AbsF(dir->z) < 0.000001f ? 1e30f : GRID_CELL_SIZE / Math_AbsF(dir->z);
+	tMaxX   = tDeltaX >= 1e30f ? 1e30f : 
+		((cellX + (stepX > 0)) * GRID_CELL_SIZE - origin->x) / dir->x;
+	tMaxZ   = tDeltaZ >= 1e30f ? 1e30f : 
+		((cellZ + (stepZ > 0)) * GRID_CELL_SIZE - origin->z) / dir->z;
+
+	for (steps = 0; steps <= GRID_MAX_LINE_CELLS + 8; steps++)
+	{
+		count = Grid_AddNeighbours(cellX, cellZ, ids, count);
+
+		if (tMaxX < tMaxZ) {
+			if (tMaxX > t1) break;
+			cellX += stepX; tMaxX += tDeltaX;
+		} else {
+			if (tMaxZ > t1) break;
+			cellZ += stepZ; tMaxZ += tDeltaZ;
+		}
+	}
+	return count;
+}
+
+
 /*########################################################################################################################*
 *--------------------------------------------------------Entities---------------------------------------------------------*
 *#########################################################################################################################*/
 struct _EntitiesData Entities;
+static cc_bool NetPlayer_IsBatched(struct Entity* e);
+static void NetPlayers_Tick(struct Entity** players, int count, float delta);
+static void NetPlayer_UpdateRender(struct Entity* e, float t);
 
 void Entities_Tick(struct ScheduledTask* task) {
-	int i;
+	struct Entity* netPlayers[ENTITIES_MAX_COUNT];
+	cc_int16 netPlayerIds[ENTITIES_MAX_COUNT];
+	struct Entity* e;
+	int i, count = 0;
+	/* Entities might have been added or moved by the network since the last tick */
+	EntityGrid_Rebuild();
+
 	for (i = 0; i < ENTITIES_MAX_COUNT; i++)
 	{
-		if (!Entities.List[i]) continue;
-		Entities.List[i]->VTABLE->Tick(Entities.List[i], task->interval);
+		e = Entities.List[i];
+		if (!e) continue;
+
+		if (NetPlayer_IsBatched(e)) {
+			netPlayerIds[count] = i;
+			netPlayers[count++] = e;
+		} else {
+			e->VTABLE->Tick(e, task->interval);
+			EntityGrid_Update(i);
+		}
 	}
+
+	NetPlayers_Tick(netPlayers, count, task->interval);
+	for (i = 0; i < count; i++) { EntityGrid_Update(netPlayerIds[i]); }
 }
 
 void Entities_RenderModels(float delta, float t) {
-	int i;
+	struct Entity* batch[ENTITIES_MAX_COUNT];
+	struct Entity* e;
+	int i, count = 0;
 	Gfx_SetAlphaTest(true);
 	
 	for (i = 0; i < ENTITIES_MAX_COUNT; i++)
 	{
-		if (!Entities.List[i]) continue;
-		Entities.List[i]->VTABLE->RenderModel(Entities.List[i], delta, t);
+		e = Entities.List[i];
+		if (!e) continue;
+
+		if (!NetPlayer_IsBatched(e)) {
+			e->VTABLE->RenderModel(e, delta, t);
+			continue;
+		}
+
+		/* Crowds of humanoid network players are drawn together further below */
+		NetPlayer_UpdateRender(e, t);
+		if (!e->ShouldRender) continue;
+
+		if (Model_CanBatch(e->Model)) {
+			batch[count++] = e;
+		} else {
+			Model_Render(e->Model, e);
+		}
 	}
+
+	Model_RenderBatch(batch, count);
 	Gfx_SetAlphaTest(false);
 }
 
@@ -482,6 +1014,7 @@ static void Entities_ContextLost(void* obj) {
 		if (!Gfx.ManagedTextures)
 			DeleteSkin(entity);
 	}
+	if (!Gfx.ManagedTextures) SkinAtlas_Free();
 }
 /* No OnContextCreated, skin textures remade when needed */
 
@@ -492,6 +1025,7 @@ void Entities_Remove(int id) {
 	Event_RaiseInt(&EntityEvents.Removed, id);
 	e->VTABLE->Despawn(e);
 	Entities.List[id] = NULL;
+	EntityGrid_Update(id);
 
 	/* TODO: Move to EntityEvents.Removed callback instead */
 	if (id < TABLIST_MAX_NAMES && TabList_EntityLinked_Get(id)) {
@@ -506,18 +1040,22 @@ int Entities_GetClosest(struct Entity* src) {
 	float closestDist = -200; /* NOTE: was previously positive infinity */
 	int targetID = -1;
 
+	int ids[ENTITIES_MAX_COUNT];
 	float t0, t1;
-	int i;
+	int i, id, count;
+	count = EntityGrid_QueryLine(&eyePos, &dir, ids);
 
-	for (i = 0; i < ENTITIES_MAX_COUNT; i++) /* because we don't want to pick against local player */
+	for (i = 0; i < count; i++)
 	{
-		struct Entity* e = Entities.List[i];
+		struct Entity* e = Entities.List[id = ids[i]];
+		/* because we don't want to pick against local player */
 		if (!e || e == &Entities.CurPlayer->Base) continue;
 		if (!Intersection_RayIntersectsRotatedBox(eyePos, dir, e, &t0, &t1)) continue;
 
-		if (targetID == -1 || t0 < closestDist) {
+		/* Grid returns entities in arbitrary order, so lowest ID wins ties like before */
+		if (targetID == -1 || t0 < closestDist || (t0 == closestDist && id < targetID)) {
 			closestDist = t0;
-			targetID    = i;
+			targetID    = id;
 		}
 	}
 	return targetID;
@@ -1088,7 +1626,26 @@ static void NetPlayer_Tick(struct Entity* e, float delta) {
 	AnimatedComp_Update(e, e->prev.pos, e->next.pos, delta);
 }
 
-static void NetPlayer_RenderModel(struct Entity* e, float delta, float t) {
+/* Servers may have hundreds of network players, so rather than ticking each one */
+/*  through its VTABLE, ticks them all together one stage at a time */
+static void NetPlayers_Tick(struct Entity** players, int count, float delta) {
+	struct NetPlayer* p;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		p = (struct NetPlayer*)players[i];
+		NetInterpComp_AdvanceState(&p->Interp, &p->Base);
+	}
+	AnimatedComp_UpdateMany(players, count, delta);
+
+	for (i = 0; i < count; i++)
+	{
+		Entity_CheckSkin(players[i]);
+	}
+}
+
+static void NetPlayer_UpdateRender(struct Entity* e, float t) {
 	Vec3_Lerp(&e->Position, &e->prev.pos, &e->next.pos, t);
 	Entity_LerpAngles(e, t);
 
@@ -1096,7 +1653,10 @@ static void NetPlayer_RenderModel(struct Entity* e, float delta, float t) {
 	e->ShouldRender = Model_ShouldRender(e);
 	/* Original classic only shows players up to 64 blocks away */
 	if (Game_ClassicMode) e->ShouldRender &= Model_RenderDistance(e) <= 64 * 64;
+}
 
+static void NetPlayer_RenderModel(struct Entity* e, float delta, float t) {
+	NetPlayer_UpdateRender(e, t);
 	if (e->ShouldRender) Model_Render(e->Model, e);
 }
 
@@ -1114,6 +1674,11 @@ static const struct EntityVTABLE netPlayer_VTABLE = {
 	NetPlayer_Tick,        Player_Despawn,       NetPlayer_SetLocation, Entity_GetColor,
 	NetPlayer_RenderModel, NetPlayer_ShouldRenderName
 };
+/* Plugins may replace the VTABLE of network players to customise ticking */
+static cc_bool NetPlayer_IsBatched(struct Entity* e) {
+	return e->VTABLE == &netPlayer_VTABLE;
+}
+
 void NetPlayer_Init(struct NetPlayer* p) {
 	Mem_Set(p, 0, sizeof(struct NetPlayer));
 	Entity_Init(&p->Base);
@@ -1156,6 +1721,7 @@ static void Entities_Free(void) {
 	{
 		Entities_Remove(i);
 	}
+	SkinAtlas_Free();
 	sources_head = NULL;
 }
 
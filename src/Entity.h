@@ -101,6 +101,11 @@ struct EntityVTABLE {
 /* Whether in classic mode, to slightly adjust this entity downwards when rendering it */
 /*  to replicate the behaviour of the original vanilla classic client */
 #define ENTITY_FLAG_CLASSIC_ADJUST 0x04
+/* Whether TextureId refers to a page of the shared skin atlas, */
+/*  with the skin itself located at Entity_GetSkinOffset within that page */
+/* NOTE: Only entities allocated by the game itself (i.e. net players and local players) */
+/*   use the skin atlas, as the offset is tracked separately for each entity ID */
+#define ENTITY_FLAG_SKIN_ATLAS 0x08
 
 /* Contains a model, along with position, velocity, and rotation. May also contain other fields and properties. */
 struct Entity {
@@ -165,6 +170,8 @@ cc_bool Entity_TouchesAnyWater(struct Entity* e);
 void Entity_SetName(struct Entity* e, const cc_string* name);
 /* Sets the skin name of the given entity. */
 void Entity_SetSkin(struct Entity* e, const cc_string* skin);
+/* Gets the offset of the entity's skin within TextureId, see ENTITY_FLAG_SKIN_ATLAS */
+void Entity_GetSkinOffset(struct Entity* e, float* u, float* v);
 void Entity_LerpAngles(struct Entity* e, float t);
 
 /* Global data for all entities */
@@ -185,6 +192,18 @@ void Entities_Remove(int id);
 /* Returns -1 if there is no other entity nearby */
 int Entities_GetClosest(struct Entity* src);
 
+/* Updates where the given entity is in the spatial grid of entities */
+/*  NOTE: The grid is automatically updated for all entities every tick */
+void EntityGrid_Update(int id);
+/* Retrieves the IDs of all entities that might intersect the given box (Y is ignored) */
+/*  NOTE: Results are conservative, so callers must still check the actual entities */
+/*  NOTE: ids must be able to hold ENTITIES_MAX_COUNT elements */
+int EntityGrid_QueryBox(const struct AABB* bb, int* ids);
+/* Retrieves the IDs of all entities that might be within radius of the given position */
+int EntityGrid_QueryRadius(const Vec3* pos, float radius, int* ids);
+/* Retrieves the IDs of all entities that might intersect the infinite line through origin */
+int EntityGrid_QueryLine(const Vec3* origin, const Vec3* dir, int* ids);
+
 #define TABLIST_MAX_NAMES 256
 /* Data for all entries in tab list */
 CC_VAR extern struct _TabListData {
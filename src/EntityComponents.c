@@ -57,14 +57,11 @@ void AnimatedComp_Init(struct AnimatedComp* anim) {
 	anim->BobStrength = 1.0f; anim->BobStrengthO = 1.0f; anim->BobStrengthN = 1.0f;
 }
 
-void AnimatedComp_Update(struct Entity* e, Vec3 oldPos, Vec3 newPos, float delta) {
+static void AnimatedComp_Advance(struct Entity* e, float distance, float delta) {
 	struct AnimatedComp* anim = &e->Anim;
-	float dx = newPos.x - oldPos.x;
-	float dz = newPos.z - oldPos.z;
-	float distance = Math_SqrtF(dx * dx + dz * dz);
+	float walkDelta;
 	int i;
 
-	float walkDelta;
 	anim->WalkTimeO = anim->WalkTimeN;
 	anim->SwingO    = anim->SwingN;
 
@@ -84,6 +81,39 @@ void AnimatedComp_Update(struct Entity* e, Vec3 oldPos, Vec3 newPos, float delta
 	}
 }
 
+void AnimatedComp_Update(struct Entity* e, Vec3 oldPos, Vec3 newPos, float delta) {
+	float dx = newPos.x - oldPos.x;
+	float dz = newPos.z - oldPos.z;
+	AnimatedComp_Advance(e, Math_SqrtF(dx * dx + dz * dz), delta);
+}
+
+#define ANIM_BATCH_SIZE 64
+void AnimatedComp_UpdateMany(struct Entity** entities, int count, float delta) {
+	float dx[ANIM_BATCH_SIZE], dz[ANIM_BATCH_SIZE], dist[ANIM_BATCH_SIZE];
+	struct Entity* e;
+	int i, j, n;
+
+	for (i = 0; i < count; i += n)
+	{
+		n = min(count - i, ANIM_BATCH_SIZE);
+
+		/* Gather movement into separate arrays, so distances can be computed */
+		/*  in a single straight loop that the compiler is able to vectorise */
+		for (j = 0; j < n; j++) {
+			e     = entities[i + j];
+			dx[j] = e->next.pos.x - e->prev.pos.x;
+			dz[j] = e->next.pos.z - e->prev.pos.z;
+		}
+		for (j = 0; j < n; j++) {
+			dist[j] = Math_SqrtF(dx[j] * dx[j] + dz[j] * dz[j]);
+		}
+
+		for (j = 0; j < n; j++) {
+			AnimatedComp_Advance(entities[i + j], dist[j], delta);
+		}
+	}
+}
+
 void AnimatedComp_GetCurrent(struct Entity* e, float t) {
 	struct AnimatedComp* anim = &e->Anim;
 	float idleTime = (float)Game.Time;
@@ -286,10 +316,12 @@ float HacksComp_CalcSpeedFactor(struct HacksComp* hacks, cc_bool canSpeed) {
 *#########################################################################################################################*/
 static void InterpComp_RemoveOldestRotY(struct InterpComp* interp) {
 	int i;
-	for (i = 0; i < Array_Elems(interp->RotYStates); i++) {
+	interp->RotYCount--;
+
+	/* Only shift the states actually in use */
+	for (i = 0; i < interp->RotYCount; i++) {
 		interp->RotYStates[i] = interp->RotYStates[i + 1];
 	}
-	interp->RotYCount--;
 }
 
 static void InterpComp_AddRotY(struct InterpComp* interp, float state) {
@@ -316,26 +348,149 @@ static void InterpComp_AdvanceRotY(struct InterpComp* interp, struct Entity* e)
 (dst).rotX  = (src)->RotX;\
 (dst).rotZ  = (src)->RotZ;
 
-static void NetInterpComp_RemoveOldestPosition(struct NetInterpComp* interp) {
+/* Adaptive jitter buffer */
+/*  Received states are spaced evenly apart on a timeline, based on the average time */
+/*  between states arriving. Playback along this timeline then runs at tick rate, but */
+/*  is gently sped up or slowed down to stay behind the newest state by enough time */
+/*  to cover the measured variation in arrival times. If the next state is late, */
+/*  the entity keeps moving for a short time (extrapolation) */
+#define NETINTERP_TICK      ((float)GAME_DEF_TICKS)
+#define NETINTERP_MAX_DELAY 0.5f
+/* Servers don't send anything while entities are idle, so longer gaps aren't jitter */
+#define NETINTERP_IDLE_GAP  0.5
+#define NETINTERP_MAX_EXTRAPOLATE 0.2f
+/* Max amount playback is sped up or slowed down by */
+#define NETINTERP_MAX_RATE_ADJ 0.1f
+
+static float NetInterpComp_Interval(struct NetInterpComp* interp) {
+	/* Most servers send updates at 10 or 20 times a second */
+	return interp->Interval ? interp->Interval : NETINTERP_TICK * 2;
+}
+
+/* How far behind the newest state playback should be on average */
+/*  (newest state is on average half an interval old, and may arrive late by jitter) */
+static float NetInterpComp_Delay(struct NetInterpComp* interp) {
+	float delay = NetInterpComp_Interval(interp) + interp->Jitter * 2.0f + NETINTERP_TICK * 0.5f;
+	return min(delay, NETINTERP_MAX_DELAY);
+}
+
+static void NetInterpComp_RemoveOldestState(struct NetInterpComp* interp) {
 	int i;
-	interp->PositionsCount--;
+	interp->StatesCount--;
 
-	for (i = 0; i < interp->PositionsCount; i++) {
-		interp->Positions[i] = interp->Positions[i + 1];
+	for (i = 0; i < interp->StatesCount; i++) {
+		interp->States[i] = interp->States[i + 1];
 	}
 }
 
-static void NetInterpComp_AddPosition(struct NetInterpComp* interp, Vec3 pos) {
-	if (interp->PositionsCount == Array_Elems(interp->Positions)) {
-		NetInterpComp_RemoveOldestPosition(interp);
+/* Forgets all received states, and immediately moves to the current state */
+static void NetInterpComp_Reset(struct NetInterpComp* interp) {
+	struct NetInterpState* state = &interp->States[0];
+	state->Pos    = interp->CurPos;
+	state->Angles = interp->CurAngles;
+	state->Time   = 0.0f;
+
+	interp->StatesCount  = 1;
+	interp->AvgLead      = NetInterpComp_Delay(interp);
+	interp->PlaybackTime = -interp->AvgLead;
+}
+
+static void NetInterpComp_AddState(struct NetInterpComp* interp) {
+	struct NetInterpState* last;
+	float gap, interval;
+	cc_bool wasIdle;
+
+	gap = (float)(Game.Time - interp->LastArrival);
+	interp->LastArrival = Game.Time;
+	if (!interp->StatesCount) { NetInterpComp_Reset(interp); return; }
+	last = &interp->States[interp->StatesCount - 1];
+
+	wasIdle = gap > NETINTERP_IDLE_GAP;
+	if (wasIdle) {
+		/* Entity was idle, so only need state where it was idle at */
+		interp->States[0]      = *last;
+		interp->States[0].Time = interp->PlaybackTime;
+		interp->StatesCount    = 1;
+	} else if (!interp->Interval) {
+		interp->Interval = gap;
+	} else {
+		interval = interp->Interval;
+		interp->Jitter   += (Math_AbsF(gap - interval) - interp->Jitter) * 0.1f;
+		interp->Interval += (gap - interval) * 0.1f;
+	}
+
+	if (interp->StatesCount == NETINTERP_MAX_STATES) {
+		NetInterpComp_RemoveOldestState(interp);
+	}
+	interval = NetInterpComp_Interval(interp);
+	last     = &interp->States[interp->StatesCount++];
+
+	last->Pos    = interp->CurPos;
+	last->Angles = interp->CurAngles;
+	/* If state arrived so late that playback already went past where it */
+	/*  would be, then move it later to avoid the entity jumping backwards */
+	last->Time   = max(last[-1].Time + interval, interp->PlaybackTime + NETINTERP_TICK);
+	if (!wasIdle) return;
+
+	/* Start moving from where entity was idle at */
+	interp->AvgLead      = NetInterpComp_Delay(interp);
+	interp->PlaybackTime = last->Time - interp->AvgLead;
+}
+
+/* Calculates position and orientation at the given time along the received states */
+static void NetInterpComp_Sample(struct NetInterpComp* interp, float time, Vec3* pos, struct NetInterpAngles* angles) {
+	struct NetInterpState* a;
+	struct NetInterpState* b;
+	float t, over, window, dist;
+	Vec3 vel;
+	int i;
+
+	for (i = interp->StatesCount - 1; i > 0; i--) 
+	{
+		if (interp->States[i].Time <= time) break;
+	}
+	a = &interp->States[i];
+
+	if (time <= a->Time) {
+		/* Before the oldest state */
+		*pos = a->Pos; *angles = a->Angles;
+	} else if (i < interp->StatesCount - 1) {
+		b = &interp->States[i + 1];
+		t = (time - a->Time) / (b->Time - a->Time);
+
+		Vec3_Lerp(pos, &a->Pos, &b->Pos, t);
+		angles->Pitch = Math_LerpAngle(a->Angles.Pitch, b->Angles.Pitch, t);
+		angles->Yaw   = Math_LerpAngle(a->Angles.Yaw,   b->Angles.Yaw,   t);
+		angles->RotX  = Math_LerpAngle(a->Angles.RotX,  b->Angles.RotX,  t);
+		angles->RotZ  = Math_LerpAngle(a->Angles.RotZ,  b->Angles.RotZ,  t);
+	} else {
+		/* Past the newest state, so next state is late or lost */
+		*pos = a->Pos; *angles = a->Angles;
+		if (i == 0) return;
+
+		/* Keep moving with a velocity that decays to 0 over a short window, */
+		/*  and then ease back to the newest state if still no state arrives */
+		/*  (e.g. because the entity actually stopped moving) */
+		b      = &interp->States[i - 1];
+		window = NetInterpComp_Interval(interp) * 0.5f + interp->Jitter * 2.0f;
+		window = min(window, NETINTERP_MAX_EXTRAPOLATE);
+		over   = time - a->Time;
+
+		if (over < window) {
+			dist = over - over * over / (2.0f * window);
+		} else {
+			dist = window * 0.5f * (1.0f - (over - window) / window);
+			if (dist <= 0.0f) return;
+		}
+
+		Vec3_Sub(&vel, &a->Pos, &b->Pos);
+		Vec3_Mul1By(&vel, dist / (a->Time - b->Time));
+		Vec3_AddBy(pos, &vel);
 	}
-	interp->Positions[interp->PositionsCount++] = pos;
 }
 
 static void NetInterpComp_SetPosition(struct NetInterpComp* interp, struct LocationUpdate* update, struct Entity* e, int mode) {
-	Vec3 lastPos = interp->CurPos;
 	Vec3* curPos = &interp->CurPos;
-	Vec3 midPos;
 
 	if (mode == LU_POS_ABSOLUTE_INSTANT || mode == LU_POS_ABSOLUTE_SMOOTH) {
 		*curPos = update->pos;
@@ -346,37 +501,15 @@ static void NetInterpComp_SetPosition(struct NetInterpComp* interp, struct Locat
 	if (mode == LU_POS_ABSOLUTE_INSTANT) {
 		e->prev.pos = *curPos;
 		e->next.pos = *curPos;
-		interp->PositionsCount = 0;
-	} else {
-		/* Smoother interpolation by also adding midpoint */
-		Vec3_Lerp(&midPos, &lastPos, curPos, 0.5f);
-		NetInterpComp_AddPosition(interp,  midPos);
-		NetInterpComp_AddPosition(interp, *curPos);
+		interp->StatesCount = 0;
 	}
 }
 
-static void NetInterpComp_RemoveOldestAngles(struct NetInterpComp* interp) {
-	int i;
-	interp->AnglesCount--;
-
-	for (i = 0; i < interp->AnglesCount; i++) {
-		interp->Angles[i] = interp->Angles[i + 1];
-	}
-}
-
-static void NetInterpComp_AddAngles(struct NetInterpComp* interp, struct NetInterpAngles angles) {
-	if (interp->AnglesCount == Array_Elems(interp->Angles)) {
-		NetInterpComp_RemoveOldestAngles(interp);
-	}
-	interp->Angles[interp->AnglesCount++] = angles;
-}
-
 void NetInterpComp_SetLocation(struct NetInterpComp* interp, struct LocationUpdate* update, struct Entity* e) {
-	struct NetInterpAngles last = interp->CurAngles;
 	struct NetInterpAngles* cur = &interp->CurAngles;
-	struct NetInterpAngles mid;
 	cc_uint8 flags      = update->flags;
 	cc_bool interpolate = flags & LU_ORI_INTERPOLATE;
+	int i;
 
 	if (flags & LU_HAS_POS) {
 		NetInterpComp_SetPosition(interp, update, e, flags & LU_POS_MODEMASK);
@@ -389,36 +522,60 @@ void NetInterpComp_SetLocation(struct NetInterpComp* interp, struct LocationUpda
 	if (!interpolate) {
 		NetInterpAngles_Copy(e->prev, cur); e->prev.rotY = cur->Yaw;
 		NetInterpAngles_Copy(e->next, cur); e->next.rotY = cur->Yaw;
-		interp->RotYCount = 0; interp->AnglesCount = 0;
-	} else {
-		/* Smoother interpolation by also adding midpoint */
-		mid.RotX  = Math_LerpAngle(last.RotX,  cur->RotX,  0.5f);
-		mid.RotZ  = Math_LerpAngle(last.RotZ,  cur->RotZ,  0.5f);
-		mid.Pitch = Math_LerpAngle(last.Pitch, cur->Pitch, 0.5f);
-		mid.Yaw   = Math_LerpAngle(last.Yaw,   cur->Yaw,   0.5f);
-		NetInterpComp_AddAngles(interp, mid);
-		NetInterpComp_AddAngles(interp, *cur);
-
-		/* Body rotation lags behind head a tiny bit */
-		InterpComp_AddRotY((struct InterpComp*)interp, Math_LerpAngle(last.Yaw, cur->Yaw, 0.33333333f));
-		InterpComp_AddRotY((struct InterpComp*)interp, Math_LerpAngle(last.Yaw, cur->Yaw, 0.66666667f));
-		InterpComp_AddRotY((struct InterpComp*)interp, Math_LerpAngle(last.Yaw, cur->Yaw, 1.00000000f));
+
+		for (i = 0; i < interp->StatesCount; i++) {
+			interp->States[i].Angles = *cur;
+		}
 	}
+
+	NetInterpComp_AddState(interp);
 }
 
 void NetInterpComp_AdvanceState(struct NetInterpComp* interp, struct Entity* e) {
+	struct NetInterpAngles angles;
+	float lead, delay, rate;
+	Vec3 pos;
+	int i;
+
 	e->prev     = e->next;
 	e->Position = e->prev.pos;
+	if (!interp->StatesCount) return;
+
+	lead  = interp->States[interp->StatesCount - 1].Time - interp->PlaybackTime;
+	delay = NetInterpComp_Delay(interp);
+	interp->AvgLead += (lead - interp->AvgLead) * 0.1f;
 
-	if (interp->PositionsCount) {
-		e->next.pos = interp->Positions[0];
-		NetInterpComp_RemoveOldestPosition(interp);
+	if (lead - delay > NETINTERP_MAX_DELAY) {
+		/* Too far behind, so just skip to where playback should be */
+		interp->PlaybackTime += lead - delay;
+		interp->AvgLead = delay;
 	}
-	if (interp->AnglesCount) {
-		NetInterpAngles_Copy(e->next, &interp->Angles[0]);
-		NetInterpComp_RemoveOldestAngles(interp);
+
+	/* Speed up playback when too far behind, and slow down when too close */
+	rate = interp->AvgLead - delay;
+	Math_Clamp(rate, -NETINTERP_MAX_RATE_ADJ, NETINTERP_MAX_RATE_ADJ);
+	interp->PlaybackTime += NETINTERP_TICK * (1.0f + rate);
+
+	NetInterpComp_Sample(interp, interp->PlaybackTime, &e->next.pos, &angles);
+	NetInterpAngles_Copy(e->next, &angles);
+
+	/* Body rotation lags behind head a tiny bit */
+	NetInterpComp_Sample(interp, interp->PlaybackTime - NETINTERP_TICK, &pos, &angles);
+	e->next.rotY = angles.Yaw;
+
+	/* Oldest states are no longer needed once the body has moved past them */
+	/*  (but newest two states are always kept for extrapolating) */
+	while (interp->StatesCount > 2 && interp->States[1].Time <= interp->PlaybackTime - NETINTERP_TICK) {
+		NetInterpComp_RemoveOldestState(interp);
+	}
+
+	/* Keep times small, to avoid losing float precision */
+	if (interp->PlaybackTime > 1000.0f) {
+		for (i = 0; i < interp->StatesCount; i++) {
+			interp->States[i].Time -= 1000.0f;
+		}
+		interp->PlaybackTime -= 1000.0f;
 	}
-	InterpComp_AdvanceRotY((struct InterpComp*)interp, e);
 }
 
 
@@ -1030,15 +1187,19 @@ float PhysicsComp_CalcJumpVelocity(float jumpHeight) {
 }
 
 void PhysicsComp_DoEntityPush(struct Entity* entity) {
+	int ids[ENTITIES_MAX_COUNT];
 	struct Entity* other;
 	cc_bool yIntersects;
 	Vec3 dir;
 	float dist, pushStrength;
-	int id;
+	int i, count;
 	dir.y = 0.0f;
 
-	for (id = 0; id < ENTITIES_MAX_COUNT; id++) {
-		other = Entities.List[id];
+	/* Only entities within 1 block horizontally push */
+	count = EntityGrid_QueryRadius(&entity->Position, 1.0f, ids);
+
+	for (i = 0; i < count; i++) {
+		other = Entities.List[ids[i]];
 		if (!other || other == entity) continue;
 		if (!other->Model->pushes)     continue;
 
@@ -24,6 +24,8 @@ struct AnimatedComp {
 
 void AnimatedComp_Init(struct AnimatedComp* anim);
 void AnimatedComp_Update(struct Entity* entity, Vec3 oldPos, Vec3 newPos, float delta);
+/* Calls AnimatedComp_Update on each entity, using its previous and next positions */
+void AnimatedComp_UpdateMany(struct Entity** entities, int count, float delta);
 void AnimatedComp_GetCurrent(struct Entity* entity, float t);
 
 /* Entity component that performs tilt animation depending on movement speed and time */
@@ -90,15 +92,27 @@ void LocalInterpComp_AdvanceState(struct InterpComp* interp, struct Entity* e);
 
 /* Represents a network orientation state */
 struct NetInterpAngles { float Pitch, Yaw, RotX, RotZ; };
+/* Represents a network position and orientation state, and when it should be shown */
+struct NetInterpState { Vec3 Pos; struct NetInterpAngles Angles; float Time; };
+#define NETINTERP_MAX_STATES 8
 
 /* Entity component that performs interpolation for network players */
+/*  States are buffered and played back after a delay, which adapts to how */
+/*  evenly states arrive, so that uneven packet arrival doesn't cause stutter */
 struct NetInterpComp {
 	InterpComp_Layout
 	/* Last known position and orientation sent by the server */
 	Vec3 CurPos; struct NetInterpAngles CurAngles;
-	/* Interpolated position and orientation state */
-	int PositionsCount, AnglesCount;
-	Vec3 Positions[10]; struct NetInterpAngles Angles[10];
+	/* Received states, from oldest to newest */
+	int StatesCount;
+	struct NetInterpState States[NETINTERP_MAX_STATES];
+	/* Average time between states arriving, and average deviation from that */
+	float Interval, Jitter;
+	/* Time that the entity is currently being shown at, and average of */
+	/*  how far behind the newest received state that playback time is */
+	float PlaybackTime, AvgLead;
+	/* Game time that the last state arrived at */
+	double LastArrival;
 };
 
 void NetInterpComp_SetLocation(struct NetInterpComp* interp, struct LocationUpdate* update, struct Entity* e);
@@ -11,11 +11,11 @@
 #include "World.h"
 #include "Particle.h"
 #include "Drawer2D.h"
+#include "Camera.h"
 
 /*########################################################################################################################*
 *------------------------------------------------------Entity Shadow------------------------------------------------------*
 *#########################################################################################################################*/
-static cc_bool shadows_boundTex;
 static GfxResourceID shadows_VB;
 static GfxResourceID shadows_tex;
 static float shadow_radius, shadow_uvScale;
@@ -31,6 +31,13 @@ struct ShadowData { float y; BlockID block; cc_uint8 alpha; };
 #define SHADOW_MAX_PER_COLUMN (4 + SHADOW_MAX_PER_SUB_BLOCK * (SHADOW_MAX_RANGE - 1))
 /* Circle shadows may be split across (x,z), (x,z+1), (x+1,z), (x+1,z+1) */
 #define SHADOW_MAX_VERTS 4 * SHADOW_MAX_PER_COLUMN
+/* Shadows of many entities are drawn together using one dynamic vertex buffer */
+#define SHADOW_BATCH_VERTS 4096
+/* Shadows of entities further away than this are simplified to a single quad */
+#define SHADOW_LOD_DIST 24.0f
+
+static struct VertexTextured* shadows_data;
+static int shadows_count;
 
 static cc_bool lequal(float a, float b) { return a < b || Math_AbsF(a - b) < 0.001f; }
 static void EntityShadow_DrawCoords(struct VertexTextured** vertices, struct Entity* e, struct ShadowData* data, float x1, float z1, float x2, float z2) {
@@ -115,44 +122,108 @@ static void EntityShadow_CalcAlpha(float playerY, struct ShadowData* data) {
 	else data->y += 1.0f / 4.0f;
 }
 
+static BlockID EntityShadow_GetBlock(int x, int y, int z, cc_bool outside) {
+	if (!outside) return World_GetBlock(x, y, z);
+
+	if (y == Env.EdgeHeight - 1)
+		return Blocks.Draw[Env.EdgeBlock] == DRAW_GAS  ? BLOCK_AIR : BLOCK_BEDROCK;
+	if (y == Env_SidesHeight - 1)
+		return Blocks.Draw[Env.SidesBlock] == DRAW_GAS ? BLOCK_AIR : BLOCK_BEDROCK;
+	return BLOCK_AIR;
+}
+
+/* Returns whether the block can have a shadow cast on its top */
+static cc_bool EntityShadow_CanCastOn(BlockID block) {
+	cc_uint8 draw = Blocks.Draw[block];
+	return !(draw == DRAW_GAS || draw == DRAW_SPRITE || Blocks.IsLiquid[block]);
+}
+
+/* Returns whether the casted shadow stops at the given block, rather than continuing further down */
+static cc_bool EntityShadow_StopsAt(BlockID block) {
+	return Blocks.MinBB[block].x == 0.0f && Blocks.MaxBB[block].x == 1.0f &&
+		   Blocks.MinBB[block].z == 0.0f && Blocks.MaxBB[block].z == 1.0f;
+}
+
+/* Entities in crowds mostly stand over the same few columns of blocks, */
+/*  so the blocks found below each column are cached for the current frame */
+#define SHADOW_CACHE_SIZE 256
+struct ShadowColumn {
+	int x, y, z; cc_uint32 frame;
+	cc_uint8 count;     /* Number of blocks shadow can be cast on in this column */
+	cc_bool stopped;    /* Whether last block is where the shadow stops */
+	BlockID blocks[4];
+	float tops[4];
+};
+static struct ShadowColumn shadow_cache[SHADOW_CACHE_SIZE];
+static cc_uint32 shadow_frame;
+
+/* Finds the first (up to 4) blocks shadows can be cast on, starting downwards from y */
+static struct ShadowColumn* EntityShadow_GetColumn(int x, int y, int z) {
+	struct ShadowColumn* col;
+	cc_uint32 hash;
+	cc_bool outside;
+	BlockID block;
+
+	hash = ((cc_uint32)x * 73856093u) ^ ((cc_uint32)y * 19349663u) ^ ((cc_uint32)z * 83492791u);
+	col  = &shadow_cache[hash & (SHADOW_CACHE_SIZE - 1)];
+	if (col->frame == shadow_frame && col->x == x && col->y == y && col->z == z) return col;
+
+	col->x = x; col->y = y; col->z = z; col->frame = shadow_frame;
+	col->count   = 0;
+	col->stopped = false;
+	outside = !World_ContainsXZ(x, z);
+
+	for (; y >= 0 && col->count < 4; y--) 
+	{
+		block = EntityShadow_GetBlock(x, y, z, outside);
+		if (!EntityShadow_CanCastOn(block)) continue;
+
+		col->blocks[col->count] = block;
+		col->tops[col->count]   = y + Blocks.MaxBB[block].y;
+		col->count++;
+
+		if (EntityShadow_StopsAt(block)) { col->stopped = true; break; }
+	}
+	return col;
+}
+
 static cc_bool EntityShadow_GetBlocks(struct Entity* e, int x, int y, int z, struct ShadowData* data) {
 	struct ShadowData zeroData = { 0 };
+	struct ShadowColumn* column;
 	struct ShadowData* cur;
 	float posY, topY;
-	cc_bool outside;
-	BlockID block; cc_uint8 draw;
-	int i;
+	BlockID block;
+	int i, j;
 
 	for (i = 0; i < 4; i++) { data[i] = zeroData; }
-	cur     = data;
-	posY    = e->Position.y;
-	outside = !World_ContainsXZ(x, z);
-
-	for (i = 0; y >= 0 && i < 4; y--) 
-	{
-		if (!outside) {
-			block = World_GetBlock(x, y, z);
-		} else if (y == Env.EdgeHeight - 1) {
-			block = Blocks.Draw[Env.EdgeBlock] == DRAW_GAS  ? BLOCK_AIR : BLOCK_BEDROCK;
-		} else if (y == Env_SidesHeight - 1) {
-			block = Blocks.Draw[Env.SidesBlock] == DRAW_GAS ? BLOCK_AIR : BLOCK_BEDROCK;
-		} else {
-			block = BLOCK_AIR;
+	cur  = data;
+	posY = e->Position.y;
+	i    = 0;
+
+	/* Only the top of the block the entity is inside can be above the entity, */
+	/*  so only that block depends on the entity's exact position */
+	if (y >= 0) {
+		block = EntityShadow_GetBlock(x, y, z, !World_ContainsXZ(x, z));
+		topY  = y + Blocks.MaxBB[block].y;
+
+		if (EntityShadow_CanCastOn(block) && topY < posY + 0.01f) {
+			cur->block = block; cur->y = topY;
+			EntityShadow_CalcAlpha(posY, cur);
+			i++; cur++;
+
+			/* Check if the casted shadow will continue on further down. */
+			if (EntityShadow_StopsAt(block)) return true;
 		}
+	}
 
-		draw = Blocks.Draw[block];
-		if (draw == DRAW_GAS || draw == DRAW_SPRITE || Blocks.IsLiquid[block]) continue;
-		topY = y + Blocks.MaxBB[block].y;
-		if (topY >= posY + 0.01f) continue;
-
-		cur->block = block; cur->y = topY;
+	column = EntityShadow_GetColumn(x, y - 1, z);
+	for (j = 0; j < column->count && i < 4; j++) 
+	{
+		cur->block = column->blocks[j]; cur->y = column->tops[j];
 		EntityShadow_CalcAlpha(posY, cur);
 		i++; cur++;
-
-		/* Check if the casted shadow will continue on further down. */
-		if (Blocks.MinBB[block].x == 0.0f && Blocks.MaxBB[block].x == 1.0f &&
-			Blocks.MinBB[block].z == 0.0f && Blocks.MaxBB[block].z == 1.0f) return true;
 	}
+	if (j == column->count && column->stopped) return true;
 
 	if (i < 4) {
 		cur->block = Env.EdgeBlock; cur->y = 0.0f;
@@ -162,13 +233,21 @@ static cc_bool EntityShadow_GetBlocks(struct Entity* e, int x, int y, int z, str
 	return true;
 }
 
-static void EntityShadow_Draw(struct Entity* e) {
-	struct VertexTextured vertices[128]; /* TODO this is less than maxVertes */
+static void EntityShadows_Flush(void) {
+	Gfx_UnlockDynamicVb(shadows_VB);
+	if (shadows_count) Gfx_DrawVb_IndexedTris(shadows_count);
+
+	shadows_data  = NULL;
+	shadows_count = 0;
+}
+
+static void EntityShadow_Draw(struct Entity* e, cc_bool simple) {
+	struct VertexTextured* vertices;
 	struct VertexTextured* ptr;
 	struct ShadowData data[4];
 	Vec3 pos;
 	float radius;
-	int y, count;
+	int y;
 	int x1, z1, x2, z2;
 
 	pos = e->Position;
@@ -179,12 +258,26 @@ static void EntityShadow_Draw(struct Entity* e) {
 	shadow_radius  = radius / 16.0f;
 	shadow_uvScale = 16.0f / (radius * 2.0f);
 
-	ptr = vertices;
+	if (shadows_count + SHADOW_MAX_VERTS > SHADOW_BATCH_VERTS) {
+		EntityShadows_Flush();
+		shadows_data = (struct VertexTextured*)Gfx_LockDynamicVb(shadows_VB, 
+										VERTEX_FORMAT_TEXTURED, SHADOW_BATCH_VERTS);
+	}
+	vertices = shadows_data + shadows_count;
+	ptr      = vertices;
+
 	if (Entities.ShadowsMode == SHADOW_MODE_SNAP_TO_BLOCK) {
 		x1 = Math_Floor(pos.x); z1 = Math_Floor(pos.z);
 		if (!EntityShadow_GetBlocks(e, x1, y, z1, data)) return;
 
 		EntityShadow_DrawSquareShadow(&ptr, data[0].y, x1, z1);
+	} else if (simple) {
+		/* Just a single quad on the block directly underneath */
+		x1 = Math_Floor(pos.x); z1 = Math_Floor(pos.z);
+		if (EntityShadow_GetBlocks(e, x1, y, z1, data) && data[0].alpha > 0) {
+			EntityShadow_DrawCoords(&ptr, e, &data[0], pos.x - shadow_radius, pos.z - shadow_radius,
+										pos.x + shadow_radius, pos.z + shadow_radius);
+		}
 	} else {
 		x1 = Math_Floor(pos.x - shadow_radius); z1 = Math_Floor(pos.z - shadow_radius);
 		x2 = Math_Floor(pos.x + shadow_radius); z2 = Math_Floor(pos.z + shadow_radius);
@@ -203,16 +296,7 @@ static void EntityShadow_Draw(struct Entity* e) {
 		}
 	}
 
-	if (ptr == vertices) return;
-
-	if (!shadows_boundTex) {
-		Gfx_BindTexture(shadows_tex);
-		shadows_boundTex = true;
-	}
-
-	count = (int)(ptr - vertices);
-	Gfx_SetDynamicVbData(shadows_VB, vertices, count);
-	Gfx_DrawVb_IndexedTris(count);
+	shadows_count += (int)(ptr - vertices);
 }
 
 
@@ -242,32 +326,46 @@ static void EntityShadows_MakeTexture(void) {
 	shadows_tex = Gfx_CreateTexture(&bmp, 0, false);
 }
 
+/* Whether the entity is far enough away from the camera to only need a simple shadow */
+static cc_bool EntityShadows_IsFar(struct Entity* e) {
+	Vec3 delta;
+	Vec3_Sub(&delta, &e->Position, &Camera.CurrentPos);
+	return Vec3_LengthSquared(&delta) > SHADOW_LOD_DIST * SHADOW_LOD_DIST;
+}
+
 void EntityShadows_Render(void) {
 	struct Entity* e;
 	int i;
 	if (Entities.ShadowsMode == SHADOW_MODE_NONE) return;
 
-	shadows_boundTex = false;
 	if (!shadows_tex) 
 		EntityShadows_MakeTexture();
 	if (!shadows_VB)
-		shadows_VB = Gfx_CreateDynamicVb(VERTEX_FORMAT_TEXTURED, SHADOW_MAX_VERTS);
+		shadows_VB = Gfx_CreateDynamicVb(VERTEX_FORMAT_TEXTURED, SHADOW_BATCH_VERTS);
+	if (!shadows_VB) return;
 
 	Gfx_SetAlphaArgBlend(true);
 	Gfx_SetDepthWrite(false);
 	Gfx_SetAlphaBlending(true);
 
+	Gfx_BindTexture(shadows_tex);
 	Gfx_SetVertexFormat(VERTEX_FORMAT_TEXTURED);
-	EntityShadow_Draw(&Entities.CurPlayer->Base);
+	/* Cached columns from previous frames may be out of date */
+	shadow_frame++;
+
+	shadows_data = (struct VertexTextured*)Gfx_LockDynamicVb(shadows_VB, 
+									VERTEX_FORMAT_TEXTURED, SHADOW_BATCH_VERTS);
+	EntityShadow_Draw(&Entities.CurPlayer->Base, false);
 
 	if (Entities.ShadowsMode == SHADOW_MODE_CIRCLE_ALL) {	
 		for (i = 0; i < ENTITIES_MAX_COUNT; i++) 
 		{
 			e = Entities.List[i];
 			if (!e || !e->ShouldRender || e == &Entities.CurPlayer->Base) continue;
-			EntityShadow_Draw(e);
+			EntityShadow_Draw(e, EntityShadows_IsFar(e));
 		}
 	}
+	EntityShadows_Flush();
 
 	Gfx_SetAlphaArgBlend(false);
 	Gfx_SetDepthWrite(true);
@@ -328,37 +426,41 @@ static void MakeNameTexture(struct Entity* e) {
 	}
 }
 
+/* Calculates where the bottom centre of the name is, and the world size of one pixel of it */
+static float GetNamePosition(struct Entity* e, Vec3* pos) {
+	struct Model* model = e->Model;
+	struct Matrix mat, transform;
+	float scale;
+
+	Model_GetEntityTransform(model, e, &transform);
+	Vec3_TransformY(pos, model->GetNameY(e), &transform);
+
+	scale = e->ModelScale.y;
+	scale = scale > 1.0f ? (1.0f/70.0f) : (scale/70.0f);
+
+	if (Entities.NamesMode == NAME_MODE_ALL_UNSCALED && Entities.CurPlayer->Hacks.CanSeeAllNames) {
+		Matrix_Mul(&mat, &Gfx.View, &Gfx.Projection); /* TODO: This mul is slow, avoid it */
+		/* Get W component of transformed position */
+		scale *= (pos->x * mat.row1.w + pos->y * mat.row2.w + pos->z * mat.row3.w + mat.row4.w) * 0.2f;
+	}
+	return scale;
+}
+
 static void DrawName(struct Entity* e) {
 	struct VertexTextured* vertices;
-	struct Model* model;
-	struct Matrix mat, transform;
 	Vec3 pos;
 	float scale;
 	Vec2 size;
 
-	if (!e->VTABLE->ShouldRenderName(e)) return;
-	if (e->NameTex.x == NAME_IS_EMPTY)   return;
 	if (!e->NameTex.ID) MakeNameTexture(e);
+	if (e->NameTex.x == NAME_IS_EMPTY) return;
 	Gfx_BindTexture(e->NameTex.ID);
 
 	if (!names_VB)
 		names_VB = Gfx_CreateDynamicVb(VERTEX_FORMAT_TEXTURED, 4);
 
-	model = e->Model;
-	Model_GetEntityTransform(model, e, &transform);
-	Vec3_TransformY(&pos, model->GetNameY(e), &transform);
-
-	scale  = e->ModelScale.y;
-	scale  = scale > 1.0f ? (1.0f/70.0f) : (scale/70.0f);
+	scale  = GetNamePosition(e, &pos);
 	size.x = e->NameTex.width * scale; size.y = e->NameTex.height * scale;
-
-	if (Entities.NamesMode == NAME_MODE_ALL_UNSCALED && Entities.CurPlayer->Hacks.CanSeeAllNames) {
-		Matrix_Mul(&mat, &Gfx.View, &Gfx.Projection); /* TODO: This mul is slow, avoid it */
-		/* Get W component of transformed position */
-		scale = pos.x * mat.row1.w + pos.y * mat.row2.w + pos.z * mat.row3.w + mat.row4.w;
-		size.x *= scale * 0.2f; size.y *= scale * 0.2f;
-	}
-
 	Gfx_SetVertexFormat(VERTEX_FORMAT_TEXTURED);
 
 	vertices = (struct VertexTextured*)Gfx_LockDynamicVb(names_VB, VERTEX_FORMAT_TEXTURED, 4);
@@ -368,6 +470,120 @@ static void DrawName(struct Entity* e) {
 	Gfx_DrawVb_IndexedTris(4);
 }
 
+
+/*########################################################################################################################*
+*---------------------------------------------------Batched entity names--------------------------------------------------*
+*#########################################################################################################################*/
+/* Rather than a separate texture and draw call per name, names are built from quads that */
+/*  reference the glyphs in the bitmapped font texture, and then drawn together in batches */
+#define NAMES_BATCH_VERTICES 2048 /* max vertices per layer in a batch */
+#define NAMES_MAX_GLYPHS STRING_SIZE
+static GfxResourceID namesBatch_VB;
+static struct VertexTextured* namesBatch_data;
+static int namesBatch_count;
+
+static void AddNameQuad(struct VertexTextured* v, const Vec3* pos, const Vec3* right, const Vec3* up,
+						float x1, float x2, float y1, float y2, const TextureRec* rec, PackedCol col) {
+	Vec3 a, b;
+	/* a = bottom left corner, b = top right corner */
+	a.x = pos->x + right->x * x1 + up->x * y1; b.x = pos->x + right->x * x2 + up->x * y2;
+	a.y = pos->y + right->y * x1 + up->y * y1; b.y = pos->y + right->y * x2 + up->y * y2;
+	a.z = pos->z + right->z * x1 + up->z * y1; b.z = pos->z + right->z * x2 + up->z * y2;
+
+	/* x1,y2 = x1,y1 + (y2 - y1) * up, x2,y1 = x2,y2 - (y2 - y1) * up */
+	y2 -= y1;
+	v->x = a.x;                v->y = a.y;                v->z = a.z;                v->Col = col; v->U = rec->u1; v->V = rec->v2; v++;
+	v->x = a.x + up->x * y2;   v->y = a.y + up->y * y2;   v->z = a.z + up->z * y2;   v->Col = col; v->U = rec->u1; v->V = rec->v1; v++;
+	v->x = b.x;                v->y = b.y;                v->z = b.z;                v->Col = col; v->U = rec->u2; v->V = rec->v1; v++;
+	v->x = b.x - up->x * y2;   v->y = b.y - up->y * y2;   v->z = b.z - up->z * y2;   v->Col = col; v->U = rec->u2; v->V = rec->v2; v++;
+}
+
+static void FlushNames(void) {
+	if (!namesBatch_count) return;
+	Gfx_UnlockDynamicVb(namesBatch_VB);
+	Gfx_BindTexture(Drawer2D_GetGlyphsTexture());
+
+	/* Shadow layer must be drawn first, since depth testing might be disabled */
+	Gfx_DrawVb_IndexedTris_Range(namesBatch_count, 0);
+	Gfx_DrawVb_IndexedTris_Range(namesBatch_count, NAMES_BATCH_VERTICES);
+
+	namesBatch_data  = NULL;
+	namesBatch_count = 0;
+}
+
+static void BatchName(struct Entity* e) {
+	struct GlyphQuad quads[NAMES_MAX_GLYPHS];
+	struct VertexTextured* v;
+	struct DrawTextArgs args;
+	struct FontDesc font;
+	struct Matrix* view = &Gfx.View;
+	Vec3 pos, right, up, back, shadowPos;
+	PackedCol col, shadowCol = PackedCol_Make(80, 80, 80, 255);
+	float scale, width, height, x1, x2;
+	int i, count;
+	cc_string name;
+
+	/* Names are always drawn using default.png font */
+	Font_MakeBitmapped(&font, 24, FONT_FLAGS_NONE);
+	/* Don't want DPI scaling or padding */
+	font.size = 24; font.height = 24;
+
+	name = String_FromRawArray(e->NameRaw);
+	DrawTextArgs_Make(&args, &name, &font, false);
+	count = Drawer2D_MakeGlyphQuads(&args, quads, NAMES_MAX_GLYPHS);
+	if (!count) return;
+
+	/* Layout matches name textures, see MakeNameTexture */
+	width  = (float)(Drawer2D_TextWidth(&args) + NAME_OFFSET);
+	height = (float)(Drawer2D_TextHeight(&args) + NAME_OFFSET);
+	scale  = GetNamePosition(e, &pos);
+
+	right.x = view->row1.x * scale; right.y = view->row2.x * scale; right.z = view->row3.x * scale;
+	up.x    = view->row1.y * scale; up.y    = view->row2.y * scale; up.z    = view->row3.y * scale;
+	back.x  = view->row1.z * scale; back.y  = view->row2.z * scale; back.z  = view->row3.z * scale;
+
+	/* Shadow layer is pushed slightly further away from the camera, so that it */
+	/*  is still drawn behind the main layer when depth testing/writing is on */
+	Vec3_Sub(&shadowPos, &pos, &back);
+
+	if (namesBatch_count + count * 4 > NAMES_BATCH_VERTICES) FlushNames();
+	if (!namesBatch_data) {
+		if (!namesBatch_VB) namesBatch_VB = Gfx_CreateDynamicVb(VERTEX_FORMAT_TEXTURED, NAMES_BATCH_VERTICES * 2);
+		if (!namesBatch_VB) return;
+
+		Gfx_SetVertexFormat(VERTEX_FORMAT_TEXTURED);
+		namesBatch_data = (struct VertexTextured*)Gfx_LockDynamicVb(namesBatch_VB, 
+										VERTEX_FORMAT_TEXTURED, NAMES_BATCH_VERTICES * 2);
+	}
+
+	for (i = 0; i < count; i++) 
+	{
+		x1 = quads[i].x - width * 0.5f; x2 = x1 + quads[i].width;
+		col = PackedCol_Make(BitmapCol_R(quads[i].color), BitmapCol_G(quads[i].color),
+							 BitmapCol_B(quads[i].color), 255);
+
+		v = namesBatch_data + namesBatch_count;
+		AddNameQuad(v, &shadowPos, &right, &up, x1 + NAME_OFFSET, x2 + NAME_OFFSET,
+					0.0f, height - NAME_OFFSET, &quads[i].uv, shadowCol);
+
+		v += NAMES_BATCH_VERTICES;
+		AddNameQuad(v, &pos, &right, &up, x1, x2, 
+					NAME_OFFSET, height, &quads[i].uv, col);
+		namesBatch_count += 4;
+	}
+}
+
+static void RenderName(struct Entity* e) {
+	if (!e->VTABLE->ShouldRenderName(e)) return;
+	if (e->NameTex.x == NAME_IS_EMPTY)   return;
+
+	if (Drawer2D_GetGlyphsTexture()) {
+		BatchName(e);
+	} else {
+		DrawName(e);
+	}
+}
+
 void EntityNames_Delete(struct Entity* e) {
 	Gfx_DeleteTexture(&e->NameTex.ID);
 	e->NameTex.x = 0; /* X is used as an 'empty name' flag */
@@ -395,8 +611,9 @@ void EntityNames_Render(void) {
 	for (i = 0; i < ENTITIES_MAX_COUNT; i++) 
 	{
 		if (!Entities.List[i]) continue;
-		if (i != closestEntityId) DrawName(Entities.List[i]);
+		if (i != closestEntityId) RenderName(Entities.List[i]);
 	}
+	FlushNames();
 
 	Gfx_SetAlphaTest(false);
 	if (hadFog) Gfx_SetFog(true);
@@ -429,10 +646,11 @@ void EntityNames_RenderHovered(void) {
 			hadFog = Gfx_GetFog();
 			if (hadFog) Gfx_SetFog(false);
 		}
-		DrawName(e);
+		RenderName(e);
 	}
 
 	if (!setupState) return;
+	FlushNames();
 	Gfx_SetAlphaTest(false);
 	Gfx_SetDepthTest(true);
 	Gfx_SetDepthWrite(true);
@@ -461,6 +679,7 @@ static void EntityRenderers_ContextLost(void* obj) {
 	Gfx_DeleteDynamicVb(&shadows_VB);
 	
 	Gfx_DeleteDynamicVb(&names_VB);
+	Gfx_DeleteDynamicVb(&namesBatch_VB);
 	DeleteAllNameTextures();
 }
 
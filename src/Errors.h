@@ -138,5 +138,10 @@ enum CC_ERRORS {
 	SSL_ERR_CONTEXT_DEAD = 0xCCDED070UL, /* Server shutdown the SSL context and it must be recreated */
 	PNG_ERR_16BITSAMPLES = 0xCCDED071UL, /* Image uses 16 bit samples, which is unimplemented */
 	ERR_NO_NETWORKING    = 0xCCDED072UL, /* No working network connection */
+	NBT_ERR_TOO_DEEP     = 0xCCDED073UL, /* NBT compound/list tags are nested too deeply */
+	CCMAP_ERR_HEADER     = 0xCCDED074UL, /* .ccmap header has invalid signature, version or dimensions */
+	CCMAP_ERR_SECTION    = 0xCCDED075UL, /* .ccmap block section index is invalid */
+	HTTP_ERR_RESUME      = 0xCCDED076UL, /* Partial HTTP response doesn't continue from where download stopped */
+	HTTP_ERR_NO_CONNECTION = 0xCCDED077UL, /* All entries in the HTTP connection pool are in use */
 };
 #endif
@@ -179,6 +179,7 @@ CC_VAR extern struct _WorldEventsList {
 	struct Event_Void  MapLoaded;     /* New world has finished loading, player can now interact with it */
 	struct Event_Int   EnvVarChanged; /* World environment variable changed by player/CPE/WoM config */
 	struct Event_LightingMode LightingModeChanged; /* Lighting mode changed. */
+	struct Event_Float Saving;        /* Portion of world is saved in the background (Arg is progress from 0-1) */
 } WorldEvents;
 
 CC_VAR extern struct _ChatEventsList {
@@ -16,6 +16,7 @@
 #include "Chat.h"
 #include "TexturePack.h"
 #include "Utils.h"
+#include "Options.h"
 
 #ifdef CC_BUILD_FILESYSTEM
 static struct LocationUpdate* spawn_point;
@@ -318,14 +319,18 @@ enum NbtTagType {
 
 #define NBT_SMALL_SIZE  STRING_SIZE
 #define NBT_STRING_SIZE STRING_SIZE
+#define NBT_MAX_DEPTH   16
+#define NBT_BUFFER_SIZE 4096
 
-#define NbtTag_IsSmall(tag) ((tag)->dataSize <= NBT_SMALL_SIZE)
 #define IsTag(tag, tagName) (String_CaselessEqualsConst(&tag->name, tagName))
 struct NbtTag;
+struct NbtReader;
 
 struct NbtTag {
 	struct NbtTag* parent;
+	struct NbtReader* reader;
 	cc_uint8  type;
+	cc_bool   pending; /* whether array data has not been read yet */
 	cc_string name;
 	cc_uint32 dataSize; /* size of data for arrays */
 
@@ -337,7 +342,6 @@ struct NbtTag {
 		cc_uint32 u32;
 		float     f32;
 		cc_uint8  small[NBT_SMALL_SIZE];
-		cc_uint8* big; /* malloc for big byte arrays */
 		struct { cc_string text; char buffer[STRING_SIZE * 2]; } str;
 	} value;
 	char _nameBuffer[NBT_STRING_SIZE];
@@ -345,6 +349,182 @@ struct NbtTag {
 	int listIndex;
 };
 
+/* Compound or list tag that is currently being read */
+struct NbtScope { cc_uint8 type, childType; cc_uint32 count, left; };
+
+/* Pull based reader of NBT tags, that avoids making many small reads from the underlying stream */
+struct NbtReader {
+	struct Stream* source;
+	cc_uint8* cur;       /* Pointer within buffer to next unread byte */
+	cc_uint32 avail;     /* Number of unread bytes left in buffer */
+	cc_uint32 arrayLeft; /* Number of bytes left to read/skip in current array tag */
+	int depth;
+	struct NbtScope scopes[NBT_MAX_DEPTH];
+	cc_uint8 buffer[NBT_BUFFER_SIZE];
+};
+
+static void NbtReader_Init(struct NbtReader* r, struct Stream* source) {
+	r->source    = source;
+	r->cur       = r->buffer;
+	r->avail     = 0;
+	r->arrayLeft = 0;
+	r->depth     = 0;
+}
+
+/* Ensures that at least 'count' bytes are available in the buffer */
+static cc_result NbtReader_Ensure(struct NbtReader* r, cc_uint32 count) {
+	cc_uint32 read;
+	cc_result res;
+	if (r->avail >= count) return 0;
+
+	Mem_Move(r->buffer, r->cur, r->avail);
+	r->cur = r->buffer;
+
+	while (r->avail < count) {
+		res = r->source->Read(r->source, r->buffer + r->avail, NBT_BUFFER_SIZE - r->avail, &read);
+		if (res)   return res;
+		if (!read) return ERR_END_OF_STREAM;
+		r->avail += read;
+	}
+	return 0;
+}
+
+static cc_result NbtReader_ReadRaw(struct NbtReader* r, cc_uint8* data, cc_uint32 count) {
+	cc_uint32 len = min(count, r->avail);
+	Mem_Copy(data, r->cur, len);
+
+	r->cur   += len; 
+	r->avail -= len;
+	/* Read any remaining data straight into the destination */
+	return count > len ? Stream_Read(r->source, data + len, count - len) : 0;
+}
+
+static cc_result NbtReader_SkipRaw(struct NbtReader* r, cc_uint32 count) {
+	cc_uint32 len = min(count, r->avail);
+
+	r->cur   += len; 
+	r->avail -= len;
+	return count > len ? r->source->Skip(r->source, count - len) : 0;
+}
+
+/* Reads data of the current array tag into the given buffer */
+/* NOTE: Data not read before NbtReader_Next is next called is skipped */
+static cc_result NbtReader_ReadArray(struct NbtReader* r, cc_uint8* data, cc_uint32 count) {
+	if (count > r->arrayLeft) return ERR_END_OF_STREAM;
+
+	r->arrayLeft -= count;
+	return NbtReader_ReadRaw(r, data, count);
+}
+
+static cc_result NbtReader_ReadString(struct NbtReader* r, cc_string* str) {
+	int len;
+	cc_result res;
+
+	if ((res = NbtReader_Ensure(r, 2))) return res;
+	len = Stream_GetU16_BE(r->cur);
+	r->cur += 2; r->avail -= 2;
+
+	if (len > NBT_STRING_SIZE * 4)        return CW_ERR_STRING_LEN;
+	if ((res = NbtReader_Ensure(r, len))) return res;
+
+	String_AppendUtf8(str, r->cur, len);
+	r->cur += len; r->avail -= len;
+	return 0;
+}
+
+static cc_result NbtReader_PushScope(struct NbtReader* r, struct NbtTag* tag) {
+	struct NbtScope* scope;
+	cc_result res;
+	if (r->depth == NBT_MAX_DEPTH) return NBT_ERR_TOO_DEEP;
+
+	scope = &r->scopes[r->depth++];
+	scope->type = tag->type;
+	if (tag->type == NBT_DICT) return 0;
+
+	if ((res = NbtReader_Ensure(r, 5))) return res;
+	scope->childType = r->cur[0];
+	scope->count     = Stream_GetU32_BE(r->cur + 1);
+	r->cur += 5; r->avail -= 5;
+
+	/* Some encoders write a non-zero count for lists of NBT_END, treat these as empty lists */
+	if (scope->childType == NBT_END) scope->count = 0;
+	scope->left = scope->count;
+	return 0;
+}
+
+/* Reads the header (and value, if small) of the next tag in the current compound or list tag */
+/* Compound and list tags are entered, with an NBT_END tag returned once there are no more child tags */
+/* NOTE: Data of array tags over NBT_SMALL_SIZE must be read with NbtReader_ReadArray */
+static cc_result NbtReader_Next(struct NbtReader* r, struct NbtTag* tag) {
+	struct NbtScope* scope = r->depth ? &r->scopes[r->depth - 1] : NULL;
+	cc_result res;
+
+	if (r->arrayLeft) {
+		if ((res = NbtReader_SkipRaw(r, r->arrayLeft))) return res;
+		r->arrayLeft = 0;
+	}
+	tag->reader    = r;
+	tag->pending   = false;
+	tag->dataSize  = 0;
+	tag->listIndex = 0;
+	String_InitArray(tag->name, tag->_nameBuffer);
+
+	if (scope && scope->type == NBT_LIST) {
+		tag->type = scope->left ? scope->childType : NBT_END;
+		tag->listIndex = scope->count - scope->left;
+		if (scope->left) scope->left--;
+	} else {
+		if ((res = NbtReader_Ensure(r, 1))) return res;
+		tag->type = *r->cur++; r->avail--;
+		if (tag->type != NBT_END && (res = NbtReader_ReadString(r, &tag->name))) return res;
+	}
+
+	switch (tag->type) {
+	case NBT_END:
+		/* Reached end of the current compound or list tag */
+		if (scope) r->depth--;
+		return 0;
+
+	case NBT_I8:
+		if ((res = NbtReader_Ensure(r, 1))) return res;
+		tag->value.u8 = r->cur[0];
+		r->cur += 1; r->avail -= 1;
+		return 0;
+	case NBT_I16:
+		if ((res = NbtReader_Ensure(r, 2))) return res;
+		tag->value.u16 = Stream_GetU16_BE(r->cur);
+		r->cur += 2; r->avail -= 2;
+		return 0;
+	case NBT_I32:
+	case NBT_F32:
+		if ((res = NbtReader_Ensure(r, 4))) return res;
+		tag->value.u32 = Stream_GetU32_BE(r->cur);
+		r->cur += 4; r->avail -= 4;
+		return 0;
+	case NBT_I64:
+	case NBT_F64:
+		return NbtReader_SkipRaw(r, 8); /* (8) data */
+
+	case NBT_I8S:
+		if ((res = NbtReader_Ensure(r, 4))) return res;
+		tag->dataSize = Stream_GetU32_BE(r->cur);
+		r->cur += 4; r->avail -= 4;
+
+		r->arrayLeft = tag->dataSize;
+		if (tag->dataSize > NBT_SMALL_SIZE) { tag->pending = true; return 0; }
+		return NbtReader_ReadArray(r, tag->value.small, tag->dataSize);
+	case NBT_STR:
+		String_InitArray(tag->value.str.text, tag->value.str.buffer);
+		return NbtReader_ReadString(r, &tag->value.str.text);
+
+	case NBT_LIST:
+	case NBT_DICT:
+		return NbtReader_PushScope(r, tag);
+	}
+	return NBT_ERR_UNKNOWN;
+}
+
+
 static cc_uint8 NbtTag_U8(struct NbtTag* tag) {
 	if (tag->type == NBT_I8) return tag->value.u8; 
 	
@@ -385,10 +565,17 @@ static float NbtTag_F32(struct NbtTag* tag) {
 }
 
 static cc_uint8* NbtTag_U8_Array(struct NbtTag* tag, int minSize) {
+	cc_result res;
 	if (tag->type != NBT_I8S)    { tag->result = NBT_ERR_EXPECTED_ARR;  return NULL; }
 	if (tag->dataSize < minSize) { tag->result = NBT_ERR_ARR_TOO_SMALL; return NULL; }
+	if (!tag->pending) return tag->value.small;
 
-	return NbtTag_IsSmall(tag) ? tag->value.small : tag->value.big;
+	/* Only the start of large arrays is needed, rest gets skipped */
+	res = NbtReader_ReadArray(tag->reader, tag->value.small, NBT_SMALL_SIZE);
+	tag->pending = false;
+
+	if (res) { tag->result = res; return NULL; }
+	return tag->value.small;
 }
 
 static cc_string NbtTag_String(struct NbtTag* tag) {
@@ -398,135 +585,74 @@ static cc_string NbtTag_String(struct NbtTag* tag) {
 	return String_Empty;
 }
 
-static cc_result Nbt_ReadString(struct Stream* stream, cc_string* str) {
-	cc_uint8 buffer[NBT_STRING_SIZE * 4];
-	int len;
+/* Allocates a buffer, then reads all of the array's data directly into it */
+static BlockRaw* Nbt_TakeArray(struct NbtTag* tag) {
+	BlockRaw* ptr;
 	cc_result res;
+	if (tag->type != NBT_I8S) { tag->result = NBT_ERR_EXPECTED_ARR; return NULL; }
 
-	if ((res = Stream_Read(stream, buffer, 2)))   return res;
-	len = Stream_GetU16_BE(buffer);
+	ptr = (BlockRaw*)Mem_TryAlloc(tag->dataSize, 1);
+	if (!ptr) { tag->result = ERR_OUT_OF_MEMORY; return NULL; }
 
-	if (len > Array_Elems(buffer)) return CW_ERR_STRING_LEN;
-	if ((res = Stream_Read(stream, buffer, len))) return res;
+	if (!tag->pending) {
+		/* Small data is stored inline in the tag, so need to copy it out */
+		Mem_Copy(ptr, tag->value.small, tag->dataSize);
+		return ptr;
+	}
 
-	String_AppendUtf8(str, buffer, len);
-	return 0;
+	res = NbtReader_ReadArray(tag->reader, ptr, tag->dataSize);
+	tag->pending = false;
+
+	if (res) { Mem_Free(ptr); tag->result = res; return NULL; }
+	return ptr;
 }
 
 typedef void (*Nbt_Callback)(struct NbtTag* tag);
-static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream* stream, 
-							struct NbtTag* parent, Nbt_Callback callback, int listIndex) {
-	struct NbtTag tag;
-	cc_uint8 childType;
-	cc_uint8 tmp[5];	
+/* Reads all tags in uncompressed NBT data, invoking the callback for each tag */
+/* NOTE: Compound and list tags are passed to the callback after all of their child tags */
+static cc_result Nbt_ReadRaw(struct Stream* stream, Nbt_Callback callback) {
+	struct NbtTag tags[NBT_MAX_DEPTH + 1];
+	struct NbtReader reader;
+	struct NbtTag* tag;
+	int depth = 0;
 	cc_result res;
-	cc_uint32 i, count;
-	
-	if (typeId == NBT_END) return 0;
-	tag.type      = typeId; 
-	tag.parent    = parent;
-	tag.dataSize  = 0;
-	tag.listIndex = listIndex;
-	String_InitArray(tag.name, tag._nameBuffer);
-
-	if (readTagName) {
-		res = Nbt_ReadString(stream, &tag.name);
-		if (res) return res;
-	}
 
-	switch (typeId) {
-	case NBT_I8:
-		res = stream->ReadU8(stream, &tag.value.u8);
-		break;
-	case NBT_I16:
-		res = Stream_Read(stream, tmp, 2);
-		tag.value.u16 = Stream_GetU16_BE(tmp);
-		break;
-	case NBT_I32:
-	case NBT_F32:
-		res = Stream_ReadU32_BE(stream, &tag.value.u32);
-		break;
-	case NBT_I64:
-	case NBT_F64:
-		res = stream->Skip(stream, 8);
-		break; /* (8) data */
+	NbtReader_Init(&reader, stream);
+	if ((res = NbtReader_Next(&reader, &tags[0]))) return res;
 
-	case NBT_I8S:
-		if ((res = Stream_ReadU32_BE(stream, &tag.dataSize))) break;
+	if (tags[0].type != NBT_DICT) return CW_ERR_ROOT_TAG;
+	tags[0].parent = NULL;
 
-		if (NbtTag_IsSmall(&tag)) {
-			res = Stream_Read(stream, tag.value.small, tag.dataSize);
-		} else {
-			tag.value.big = (cc_uint8*)Mem_TryAlloc(tag.dataSize, 1);
-			if (!tag.value.big) return ERR_OUT_OF_MEMORY;
-
-			res = Stream_Read(stream, tag.value.big, tag.dataSize);
-			if (res) Mem_Free(tag.value.big);
-		}
-		break;
-	case NBT_STR:
-		String_InitArray(tag.value.str.text, tag.value.str.buffer);
-		res = Nbt_ReadString(stream, &tag.value.str.text);
-		break;
-
-	case NBT_LIST:
-		if ((res = Stream_Read(stream, tmp, 5))) break;
-		childType = tmp[0];
-		count = Stream_GetU32_BE(&tmp[1]);
-
-		for (i = 0; i < count; i++) {
-			res = Nbt_ReadTag(childType, false, stream, &tag, callback, i);
-			if (res) break;
-		}
-		break;
-
-	case NBT_DICT:
-		for (;;) {
-			if ((res = stream->ReadU8(stream, &childType))) break;
-			if (childType == NBT_END) break;
+	/* tags[depth] is the compound or list tag whose children are being read */
+	while (depth >= 0) {
+		tag = &tags[depth + 1];
+		if ((res = NbtReader_Next(&reader, tag))) return res;
 
-			res = Nbt_ReadTag(childType, true, stream, &tag, callback, 0);
-			if (res) break;
+		if (tag->type == NBT_END) {
+			tag = &tags[depth--];
+		} else if (tag->type == NBT_LIST || tag->type == NBT_DICT) {
+			tag->parent = &tags[depth++];
+			continue;
+		} else {
+			tag->parent = &tags[depth];
 		}
-		break;
-
-	default: return NBT_ERR_UNKNOWN;
-	}
-
-	if (res) return res;
-	tag.result = 0;
-	callback(&tag);
-	/* NOTE: callback must set DataBig to NULL, if doesn't want it to be freed */
-	if (!NbtTag_IsSmall(&tag)) Mem_Free(tag.value.big);
-	return tag.result;
-}
-
 
-static BlockRaw* Nbt_TakeArray(struct NbtTag* tag, const char* type) {
-	BlockRaw* ptr;
-	if (NbtTag_IsSmall(tag)) {
-		/* Small data is stored inline in tha tag, so need to copy it out */
-		ptr = (BlockRaw*)Mem_Alloc(tag->dataSize, 1, type);
-		Mem_Copy(ptr, tag->value.small, tag->dataSize);
-	} else {
-		ptr = tag->value.big;
-		tag->value.big = NULL; /* So Nbt_ReadTag doesn't call Mem_Free on the array */
+		tag->result = 0;
+		callback(tag);
+		if (tag->result) return tag->result;
 	}
-	return ptr;
+	return 0;
 }
 
+/* Reads all tags in GZip compressed NBT data, invoking the callback for each tag */
 static cc_result Nbt_Read(struct Stream* stream, Nbt_Callback callback) {
 	struct Stream compStream;
 	struct InflateState state;
 	cc_result res;
-	cc_uint8 tag;
 
 	Inflate_MakeStream2(&compStream, &state, stream);
 	if ((res = Map_SkipGZipHeader(stream))) return res;
-	if ((res = compStream.ReadU8(&compStream, &tag))) return res;
-
-	if (tag != NBT_DICT) return CW_ERR_ROOT_TAG;
-	return Nbt_ReadTag(NBT_DICT, true, &compStream, NULL, callback, 0);
+	return Nbt_ReadRaw(&compStream, callback);
 }
 
 
@@ -652,6 +778,9 @@ COMPOUND "ClassicWorld" {
 	}
 }*/
 
+/* Whether block arrays are read from the NBT data (.ccmap files store them separately) */
+static cc_bool cw_readBlocks;
+
 static void Cw_Callback_1(struct NbtTag* tag) {
 	if (IsTag(tag, "X")) { World.Width  = NbtTag_U16(tag); return; }
 	if (IsTag(tag, "Y")) { World.Height = NbtTag_U16(tag); return; }
@@ -666,13 +795,18 @@ static void Cw_Callback_1(struct NbtTag* tag) {
 		return;
 	}
 
+	if (!cw_readBlocks) return;
+
+	/* Free any previous array, in case the file contains duplicate tags */
 	if (IsTag(tag, "BlockArray")) {
+		Mem_Free(World.Blocks);
 		World.Volume = tag->dataSize;
-		World.Blocks = Nbt_TakeArray(tag, ".cw map blocks");
+		World.Blocks = Nbt_TakeArray(tag);
 	}
 #ifdef EXTENDED_BLOCKS
 	if (IsTag(tag, "BlockArray2")) {
-		World_SetMapUpper(Nbt_TakeArray(tag, ".cw map blocks2"));
+		if (World.Blocks2 != World.Blocks) Mem_Free(World.Blocks2);
+		World_SetMapUpper(Nbt_TakeArray(tag));
 	}
 #endif
 }
@@ -874,6 +1008,7 @@ static void Cw_Callback(struct NbtTag* tag) {
 /* Imports a world from a .cw ClassicWorld map file */
 /* Used by ClassiCube/ClassicalSharp */
 static cc_result Cw_Load(struct Stream* stream) {
+	cw_readBlocks = true;
 	return Nbt_Read(stream, Cw_Callback);
 }
 
@@ -1402,7 +1537,7 @@ static void MCLevel_ParseMap(struct NbtTag* tag) {
 
 	if (IsTag(tag, "blocks")) {
 		World.Volume = tag->dataSize;
-		World.Blocks = Nbt_TakeArray(tag, ".mclevel map blocks");
+		World.Blocks = Nbt_TakeArray(tag);
 	}
 }
 
@@ -1570,12 +1705,10 @@ static cc_result Cw_WriteBockDef(struct Stream* stream, int b) {
 	return Stream_Write(stream, buffer, (int)(cur - buffer));
 }
 
-cc_result Cw_Save(struct Stream* stream) {
+static cc_result Cw_WriteHeader(struct Stream* stream) {
 	struct LocalPlayer* p = Entities.CurPlayer;
 	cc_uint8 buffer[2048];
 	cc_uint8* cur;
-	cc_result res;
-	int b;
 
 	cur = buffer;
 	cur = Nbt_WriteDict(cur,   "ClassicWorld");
@@ -1600,20 +1733,38 @@ cc_result Cw_Save(struct Stream* stream) {
 		cur  = Nbt_WriteUInt8(cur,  "H", Math_Deg2Packed(p->SpawnYaw));
 		cur  = Nbt_WriteUInt8(cur,  "P", Math_Deg2Packed(p->SpawnPitch));
 	} *cur++ = NBT_END;
-	cur = Nbt_WriteArray(cur, "BlockArray", World.Volume);
+	return Stream_Write(stream, buffer, (int)(cur - buffer));
+}
 
-	if ((res = Stream_Write(stream, buffer, (int)(cur - buffer)))) return res;
-	if ((res = Stream_Write(stream, World.Blocks, World.Volume)))  return res;
+/* NOTE: blocks2 is only written when it differs from blocks */
+static cc_result Cw_WriteBlocks(struct Stream* stream, BlockRaw* blocks, BlockRaw* blocks2, cc_uint32 volume) {
+	cc_uint8 buffer[64];
+	cc_uint8* cur;
+	cc_result res;
+
+	cur = buffer;
+	cur = Nbt_WriteArray(cur, "BlockArray", volume);
 
+	if ((res = Stream_Write(stream, buffer, (int)(cur - buffer)))) return res;
+	if ((res = Stream_Write(stream, blocks, volume))) return res;
 #ifdef EXTENDED_BLOCKS
-	if (World.Blocks != World.Blocks2) {
+	if (blocks != blocks2) {
 		cur = buffer;
-		cur = Nbt_WriteArray(cur, "BlockArray2", World.Volume);
+		cur = Nbt_WriteArray(cur, "BlockArray2", volume);
 
 		if ((res = Stream_Write(stream, buffer, (int)(cur - buffer)))) return res;
-		if ((res = Stream_Write(stream, World.Blocks2, World.Volume))) return res;
+		if ((res = Stream_Write(stream, blocks2, volume))) return res;
 	}
 #endif
+	return 0;
+}
+
+static cc_result Cw_WriteMetadata(struct Stream* stream) {
+	struct LocalPlayer* p = Entities.CurPlayer;
+	cc_uint8 buffer[2048];
+	cc_uint8* cur;
+	cc_result res;
+	int b;
 
 	cur = buffer;
 	cur = Nbt_WriteDict(cur, "Metadata");
@@ -1677,6 +1828,255 @@ cc_result Cw_Save(struct Stream* stream) {
 	return Stream_Write(stream, cw_end, sizeof(cw_end));
 }
 
+cc_result Cw_Save(struct Stream* stream) {
+	cc_result res;
+	if ((res = Cw_WriteHeader(stream))) return res;
+#ifdef EXTENDED_BLOCKS
+	res = Cw_WriteBlocks(stream, World.Blocks, World.Blocks2, World.Volume);
+#else
+	res = Cw_WriteBlocks(stream, World.Blocks, World.Blocks,  World.Volume);
+#endif
+	if (res) return res;
+	return Cw_WriteMetadata(stream);
+}
+
+
+/*########################################################################################################################*
+*---------------------------------------------------ClassiCube map format-------------------------------------------------*
+*#########################################################################################################################*/
+/* Native map format designed for fast loading, where blocks are stored in fixed size sections that are
+     either uncompressed (so can be read straight into the world's blocks array) or DEFLATE compressed.
+   Uncompressed sections start on CCMAP_ALIGNMENT byte boundaries, so could be memory mapped.
+   Format (all integers are little endian):
+	U8[4] "CCMP"
+	U8  version (1), U8 flags (1 = has BlockArray2), U16 reserved
+	U16 width, U16 height, U16 length, U16 reserved
+	U32 sectionSize, U32 sectionCount, U32 metaOffset, U32 metaLength
+	sectionCount * {
+		U32 offset, U32 size, U8 method (0 = stored, 1 = DEFLATE), U8[3] reserved
+	}
+	Uncompressed NBT metadata, identical to .cw except without BlockArray/BlockArray2
+	Sections for blocks, followed by sections for blocks2 (if present) */
+#define CCMAP_VERSION 1
+#define CCMAP_HEADER_SIZE 32
+#define CCMAP_ENTRY_SIZE  12
+#define CCMAP_SECTION_SIZE (1024 * 1024)
+#define CCMAP_ALIGNMENT 4096
+#define CCMAP_MAX_SECTIONS 4096
+enum CcMapMethod { CCMAP_STORED, CCMAP_DEFLATE };
+
+static cc_result CcMap_ReadSection(struct Stream* stream, cc_uint8* entry, BlockRaw* dst, cc_uint32 len, 
+									struct InflateState** state) {
+	cc_uint32 offset = Stream_GetU32_LE(entry + 0);
+	cc_uint32 size   = Stream_GetU32_LE(entry + 4);
+	struct Stream portion, compStream;
+	cc_result res;
+
+	if ((res = stream->Seek(stream, offset))) return res;
+
+	if (entry[8] == CCMAP_STORED) {
+		if (size != len) return CCMAP_ERR_SECTION;
+		return Stream_Read(stream, dst, len);
+	}
+	if (entry[8] != CCMAP_DEFLATE) return CCMAP_ERR_SECTION;
+
+	if (!(*state)) {
+		*state = (struct InflateState*)Mem_TryAlloc(1, sizeof(struct InflateState));
+		if (!(*state)) return ERR_OUT_OF_MEMORY;
+	}
+	Stream_ReadonlyPortion(&portion, stream, size);
+	Inflate_MakeStream2(&compStream, *state, &portion);
+	return Stream_Read(&compStream, dst, len);
+}
+
+static cc_result CcMap_ReadBlocks(struct Stream* stream, cc_uint8* entries, cc_uint32 sections, BlockRaw* blocks) {
+	struct InflateState* state = NULL;
+	cc_uint32 i, offset;
+	cc_result res = 0;
+
+	for (i = 0, offset = 0; i < sections && !res; i++, offset += CCMAP_SECTION_SIZE) 
+	{
+		res = CcMap_ReadSection(stream, entries + i * CCMAP_ENTRY_SIZE, blocks + offset,
+								min(CCMAP_SECTION_SIZE, World.Volume - offset), &state);
+	}
+	Mem_Free(state);
+	return res;
+}
+
+/* Imports a world from a .ccmap ClassiCube map file */
+static cc_result CcMap_Load(struct Stream* stream) {
+	cc_uint8 header[CCMAP_HEADER_SIZE];
+	cc_uint32 sectionCount, sections, metaOffset, metaLength;
+	int width, height, length;
+	struct Stream portion;
+	cc_uint8* entries;
+	BlockRaw* blocks2;
+	cc_bool hasBlocks2;
+	cc_result res;
+
+	if ((res = Stream_Read(stream, header, sizeof(header)))) return res;
+	if (header[0] != 'C' || header[1] != 'C' || header[2] != 'M' || header[3] != 'P') return CCMAP_ERR_HEADER;
+	if (header[4] != CCMAP_VERSION) return CCMAP_ERR_HEADER;
+	hasBlocks2 = header[5] & 1;
+
+	width  = Stream_GetU16_LE(header +  8);
+	height = Stream_GetU16_LE(header + 10);
+	length = Stream_GetU16_LE(header + 12);
+	if (!World_CheckVolume(width, height, length)) return CCMAP_ERR_HEADER;
+
+	sections     = ((cc_uint32)(width * height * length) + (CCMAP_SECTION_SIZE - 1)) / CCMAP_SECTION_SIZE;
+	sectionCount = Stream_GetU32_LE(header + 20);
+	metaOffset   = Stream_GetU32_LE(header + 24);
+	metaLength   = Stream_GetU32_LE(header + 28);
+
+	if (Stream_GetU32_LE(header + 16) != CCMAP_SECTION_SIZE)   return CCMAP_ERR_SECTION;
+	if (sectionCount != (hasBlocks2 ? sections * 2 : sections)) return CCMAP_ERR_SECTION;
+	if (sectionCount > CCMAP_MAX_SECTIONS)                       return CCMAP_ERR_SECTION;
+
+	entries = (cc_uint8*)Mem_TryAlloc(sectionCount, CCMAP_ENTRY_SIZE);
+	if (!entries) return ERR_OUT_OF_MEMORY;
+
+	res = Stream_Read(stream, entries, sectionCount * CCMAP_ENTRY_SIZE);
+	if (!res) res = stream->Seek(stream, metaOffset);
+	if (!res) {
+		Stream_ReadonlyPortion(&portion, stream, metaLength);
+		cw_readBlocks = false;
+		res = Nbt_ReadRaw(&portion, Cw_Callback);
+	}
+	if (res) { Mem_Free(entries); return res; }
+
+	/* Header dimensions take precedence over any in the metadata */
+	World.Width  = width;
+	World.Height = height;
+	World.Length = length;
+	World.Volume = width * height * length;
+	World.Blocks = (BlockRaw*)Mem_TryAlloc(World.Volume, 1);
+	res = World.Blocks ? CcMap_ReadBlocks(stream, entries, sections, World.Blocks) : ERR_OUT_OF_MEMORY;
+
+#ifdef EXTENDED_BLOCKS
+	if (!res && hasBlocks2) {
+		blocks2 = (BlockRaw*)Mem_TryAlloc(World.Volume, 1);
+		res     = blocks2 ? CcMap_ReadBlocks(stream, entries + sections * CCMAP_ENTRY_SIZE, sections, blocks2) : ERR_OUT_OF_MEMORY;
+
+		if (res) Mem_Free(blocks2);
+		else World_SetMapUpper(blocks2);
+	}
+#endif
+	Mem_Free(entries);
+	return res;
+}
+
+static cc_result CcMap_WritePadding(struct Stream* stream) {
+	static const cc_uint8 zeroes[CCMAP_ALIGNMENT] = { 0 };
+	cc_uint32 pos;
+	cc_result res;
+
+	if ((res = stream->Position(stream, &pos))) return res;
+	pos %= CCMAP_ALIGNMENT;
+	return pos ? Stream_Write(stream, zeroes, CCMAP_ALIGNMENT - pos) : 0;
+}
+
+static cc_result CcMap_WriteSection(struct Stream* stream, BlockRaw* data, cc_uint32 len, 
+									struct DeflateState* state, cc_uint8* entry) {
+	struct Stream compStream;
+	cc_uint32 start, end;
+	cc_result res;
+
+	if (!state && (res = CcMap_WritePadding(stream))) return res;
+	if ((res = stream->Position(stream, &start))) return res;
+
+	if (state) {
+		Deflate_MakeStream(&compStream, state, stream);
+		if ((res = Stream_Write(&compStream, data, len))) return res;
+		if ((res = compStream.Close(&compStream)))        return res;
+	} else {
+		if ((res = Stream_Write(stream, data, len)))      return res;
+	}
+
+	if ((res = stream->Position(stream, &end))) return res;
+	Mem_Set(entry, 0, CCMAP_ENTRY_SIZE);
+	Stream_SetU32_LE(entry + 0, start);
+	Stream_SetU32_LE(entry + 4, end - start);
+	entry[8] = state ? CCMAP_DEFLATE : CCMAP_STORED;
+	return 0;
+}
+
+static cc_result CcMap_WriteBlocks(struct Stream* stream, BlockRaw* blocks, cc_uint32 sections, 
+									struct DeflateState* state, cc_uint8* entries) {
+	cc_uint32 i, offset;
+	cc_result res;
+
+	for (i = 0, offset = 0; i < sections; i++, offset += CCMAP_SECTION_SIZE) 
+	{
+		res = CcMap_WriteSection(stream, blocks + offset, min(CCMAP_SECTION_SIZE, World.Volume - offset),
+								state, entries + i * CCMAP_ENTRY_SIZE);
+		if (res) return res;
+	}
+	return 0;
+}
+
+static cc_result CcMap_WriteAll(struct Stream* stream, struct DeflateState* state, cc_uint8* entries,
+								cc_uint32 sections, cc_bool hasBlocks2) {
+	cc_uint8 header[CCMAP_HEADER_SIZE] = { 'C','C','M','P', CCMAP_VERSION };
+	cc_uint32 sectionCount, metaOffset, metaEnd;
+	cc_result res;
+
+	sectionCount = hasBlocks2 ? sections * 2 : sections;
+	metaOffset   = CCMAP_HEADER_SIZE + sectionCount * CCMAP_ENTRY_SIZE;
+
+	/* Index is written again later, once the location of each section is known */
+	if ((res = Stream_Write(stream, header, sizeof(header))))                      return res;
+	if ((res = Stream_Write(stream, entries, sectionCount * CCMAP_ENTRY_SIZE)))    return res;
+	if ((res = Cw_WriteHeader(stream)))   return res;
+	if ((res = Cw_WriteMetadata(stream))) return res;
+	if ((res = stream->Position(stream, &metaEnd))) return res;
+
+	if ((res = CcMap_WriteBlocks(stream, World.Blocks, sections, state, entries))) return res;
+#ifdef EXTENDED_BLOCKS
+	if (hasBlocks2 && (res = CcMap_WriteBlocks(stream, World.Blocks2, sections, state, 
+												entries + sections * CCMAP_ENTRY_SIZE))) return res;
+#endif
+
+	header[5] = hasBlocks2;
+	Stream_SetU16_LE(header +  8, World.Width);
+	Stream_SetU16_LE(header + 10, World.Height);
+	Stream_SetU16_LE(header + 12, World.Length);
+	Stream_SetU32_LE(header + 16, CCMAP_SECTION_SIZE);
+	Stream_SetU32_LE(header + 20, sectionCount);
+	Stream_SetU32_LE(header + 24, metaOffset);
+	Stream_SetU32_LE(header + 28, metaEnd - metaOffset);
+
+	if ((res = stream->Seek(stream, 0)))                                        return res;
+	if ((res = Stream_Write(stream, header, sizeof(header))))                   return res;
+	return Stream_Write(stream, entries, sectionCount * CCMAP_ENTRY_SIZE);
+}
+
+cc_result CcMap_Save(struct Stream* stream, cc_bool compress) {
+	struct DeflateState* state = NULL;
+	cc_uint32 sections;
+	cc_bool hasBlocks2 = false;
+	cc_uint8* entries;
+	cc_result res;
+
+#ifdef EXTENDED_BLOCKS
+	hasBlocks2 = World.Blocks != World.Blocks2;
+#endif
+	sections   = (World.Volume + (CCMAP_SECTION_SIZE - 1)) / CCMAP_SECTION_SIZE;
+
+	entries = (cc_uint8*)Mem_TryAllocCleared(2 * sections, CCMAP_ENTRY_SIZE);
+	if (!entries) return ERR_OUT_OF_MEMORY;
+
+	if (compress) {
+		state = (struct DeflateState*)Mem_TryAlloc(1, sizeof(struct DeflateState));
+		if (!state) { Mem_Free(entries); return ERR_OUT_OF_MEMORY; }
+	}
+
+	res = CcMap_WriteAll(stream, state, entries, sections, hasBlocks2);
+	Mem_Free(state);
+	Mem_Free(entries);
+	return res;
+}
+
 
 /*########################################################################################################################*
 *---------------------------------------------------Schematic export------------------------------------------------------*
@@ -1856,6 +2256,275 @@ cc_result Dat_Save(struct Stream* stream) {
 }
 
 
+/*########################################################################################################################*
+*-------------------------------------------------Background map saving---------------------------------------------------*
+*#########################################################################################################################*/
+/* Max amount of data written to the compressor at once, so progress gets updated regularly */
+#define MAPSAVER_CHUNK_SIZE (256 * 1024)
+/* Snapshotting the world just to then save synchronously would only waste memory */
+#if !defined CC_BUILD_COOPTHREADED && !defined CC_BUILD_LOWMEM
+#define MAPSAVER_THREADED
+#endif
+
+static struct MapSaverState {
+	cc_string path; char pathBuffer[FILENAME_SIZE];
+	cc_string temp; char tempBuffer[FILENAME_SIZE];
+	MapSaveCallback callback;
+	void* thread;
+	cc_bool busy, ownsBlocks;
+	volatile cc_bool done;
+
+	BlockRaw* blocks;  /* Snapshot of World.Blocks  */
+	BlockRaw* blocks2; /* Snapshot of World.Blocks2 */
+	cc_uint32 volume;
+	cc_uint8* meta;    /* Encoded .cw header, followed by encoded .cw metadata */
+	cc_uint32 headerLen, metaLen;
+
+	struct GZipParallelState* gzip;
+	struct Stream file, compStream, progressStream;
+	cc_uint32 total;
+	volatile cc_uint32 written;
+	const char* action;
+	cc_result result;
+
+	int autosaveInterval; /* Interval between autosaves in seconds, or 0 if disabled */
+	double lastAutosave;
+} saver;
+
+static cc_result MapSaver_Snapshot(cc_bool copyBlocks) {
+	struct Stream mem;
+	cc_uint32 size, end;
+	BlockRaw* blocks;
+	cc_result res;
+	int b, defs = 0;
+
+	for (b = 1; b <= BLOCK_MAX_DEFINED; b++) 
+	{
+		if (Block_IsCustomDefined(b)) defs++;
+	}
+	/* See buffers in Cw_WriteHeader, Cw_WriteMetadata and Cw_WriteBockDef */
+	size = 2048 + 2048 + defs * 1024 + sizeof(cw_end);
+
+	saver.meta = (cc_uint8*)Mem_TryAlloc(size, 1);
+	if (!saver.meta) return ERR_OUT_OF_MEMORY;
+	Stream_WriteonlyMemory(&mem, saver.meta, size);
+
+	if ((res = Cw_WriteHeader(&mem)))   return res;
+	mem.Position(&mem, &saver.headerLen);
+	if ((res = Cw_WriteMetadata(&mem))) return res;
+	mem.Position(&mem, &end);
+	saver.metaLen = end - saver.headerLen;
+
+	saver.volume     = World.Volume;
+	saver.blocks     = World.Blocks;
+#ifdef EXTENDED_BLOCKS
+	saver.blocks2    = World.Blocks2;
+#else
+	saver.blocks2    = World.Blocks;
+#endif
+	saver.total      = end + saver.volume * (saver.blocks == saver.blocks2 ? 1 : 2);
+	saver.ownsBlocks = false;
+	if (!copyBlocks) return 0;
+
+	/* Not enough memory for a copy is fine, just save synchronously instead */
+	blocks = (BlockRaw*)Mem_TryAlloc(saver.volume, saver.blocks == saver.blocks2 ? 1 : 2);
+	if (!blocks) return 0;
+
+	Mem_Copy(blocks, saver.blocks, saver.volume);
+	if (saver.blocks != saver.blocks2) {
+		Mem_Copy(blocks + saver.volume, saver.blocks2, saver.volume);
+		saver.blocks2 = blocks + saver.volume;
+	} else {
+		saver.blocks2 = blocks;
+	}
+
+	saver.blocks     = blocks;
+	saver.ownsBlocks = true;
+	return 0;
+}
+
+static void MapSaver_FreeSnapshot(void) {
+	if (saver.ownsBlocks) Mem_Free(saver.blocks);
+	Mem_Free(saver.meta);
+	Mem_Free(saver.gzip);
+
+	saver.blocks  = NULL;
+	saver.blocks2 = NULL;
+	saver.meta    = NULL;
+	saver.gzip    = NULL;
+	saver.ownsBlocks = false;
+}
+
+static cc_result MapSaver_ProgressWrite(struct Stream* s, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	cc_result res;
+	count = min(count, MAPSAVER_CHUNK_SIZE);
+
+	res = saver.compStream.Write(&saver.compStream, data, count, modified);
+	saver.written += *modified;
+	return res;
+}
+
+/* Fallback for when the platform cannot rename files */
+static cc_result MapSaver_CopyTemp(void) {
+	cc_uint8 buffer[8192];
+	struct Stream src, dst;
+	cc_filepath str;
+	cc_uint32 read;
+	cc_result res, closeRes;
+
+	if ((res = Stream_OpenFile(&src, &saver.temp))) return res;
+	if ((res = Stream_CreateFile(&dst, &saver.path))) { src.Close(&src); return res; }
+
+	for (;;) 
+	{
+		if ((res = src.Read(&src, buffer, sizeof(buffer), &read))) break;
+		if (!read) break;
+		if ((res = Stream_Write(&dst, buffer, read))) break;
+	}
+
+	closeRes = dst.Close(&dst);
+	src.Close(&src);
+	if (!res) res = closeRes;
+	if (res) return res;
+
+	/* Map was saved successfully, so failing to delete temp file doesn't matter */
+	Platform_EncodePath(&str, &saver.temp);
+	File_Delete(&str);
+	return 0;
+}
+
+static cc_result MapSaver_Encode(void) {
+	struct Stream* s = &saver.progressStream;
+	cc_result res;
+
+	if ((res = Stream_Write(s, saver.meta, saver.headerLen)))                 return res;
+	if ((res = Cw_WriteBlocks(s, saver.blocks, saver.blocks2, saver.volume))) return res;
+	return Stream_Write(s, saver.meta + saver.headerLen, saver.metaLen);
+}
+
+static void MapSaver_Run(void) {
+	cc_filepath src, dst;
+	cc_result res, closeRes;
+
+	saver.action = "encoding";
+	res      = MapSaver_Encode();
+	closeRes = saver.compStream.Close(&saver.compStream);
+	if (!res) res = closeRes;
+
+	closeRes = saver.file.Close(&saver.file);
+	if (!res && closeRes) { res = closeRes; saver.action = "closing"; }
+
+	if (!res) {
+		saver.action = "replacing";
+		Platform_EncodePath(&src, &saver.temp);
+		Platform_EncodePath(&dst, &saver.path);
+
+		res = File_Rename(&src, &dst);
+		if (res == ERR_NOT_SUPPORTED) res = MapSaver_CopyTemp();
+	}
+
+	saver.result = res;
+	saver.done   = true;
+}
+
+static void MapSaver_Finish(void) {
+#ifdef MAPSAVER_THREADED
+	if (saver.thread) {
+		Thread_Join(saver.thread);
+		saver.thread = NULL;
+	}
+#endif
+	MapSaver_FreeSnapshot();
+	saver.busy = false;
+
+	if (saver.result) Logger_SysWarn2(saver.result, saver.action, &saver.path);
+
+	Event_RaiseFloat(&WorldEvents.Saving, 1.0f);
+	if (saver.callback) saver.callback(&saver.path, saver.result);
+}
+
+cc_result Map_SaveInBackground(const cc_string* path, MapSaveCallback callback) {
+	cc_bool threaded = false;
+	cc_result res;
+	if (saver.busy) return ERR_NOT_SUPPORTED;
+
+	String_InitArray(saver.path, saver.pathBuffer);
+	String_InitArray(saver.temp, saver.tempBuffer);
+	String_Copy(&saver.path, path);
+	String_Format1(&saver.temp, "%s.tmp", path);
+
+#ifdef MAPSAVER_THREADED
+	threaded = true;
+#endif
+	res = MapSaver_Snapshot(threaded);
+	if (res) { 
+		MapSaver_FreeSnapshot();
+		Logger_SysWarn2(res, "encoding", path); return res;
+	}
+	threaded = saver.ownsBlocks;
+
+	saver.gzip = (struct GZipParallelState*)Mem_TryAlloc(1, sizeof(struct GZipParallelState));
+	if (!saver.gzip) { 
+		MapSaver_FreeSnapshot();
+		res = ERR_OUT_OF_MEMORY;
+		Logger_SysWarn(res, "allocating temp memory"); return res;
+	}
+
+	res = Stream_CreateFile(&saver.file, &saver.temp);
+	if (res) {
+		MapSaver_FreeSnapshot();
+		Logger_SysWarn2(res, "creating", &saver.temp); return res;
+	}
+
+	GZip_MakeParallelStream(&saver.compStream, saver.gzip, &saver.file);
+	Stream_Init(&saver.progressStream);
+	saver.progressStream.Write = MapSaver_ProgressWrite;
+
+	saver.callback = callback;
+	saver.written  = 0;
+	saver.result   = 0;
+	saver.done     = false;
+	saver.busy     = true;
+	Event_RaiseFloat(&WorldEvents.Saving, 0.0f);
+
+#ifdef MAPSAVER_THREADED
+	if (threaded) {
+		Thread_Run(&saver.thread, MapSaver_Run, 128 * 1024, "Map saver");
+		return 0;
+	}
+#endif
+	MapSaver_Run();
+	MapSaver_Finish();
+	return 0;
+}
+
+cc_bool Map_IsSavingInBackground(void) { return saver.busy; }
+
+static void MapSaver_CheckAutosave(void) {
+	/* Separate file, to avoid overwriting a map the user saved with same name as the world */
+	static const cc_string path = String_FromConst("maps/autosave.cw");
+	double last;
+
+	if (!saver.autosaveInterval || !Server.IsSinglePlayer) return;
+	if (!World.Loaded || !World.Blocks) return;
+
+	last = max(World.LastSave, saver.lastAutosave);
+	if (Game.Time < last + saver.autosaveInterval) return;
+	saver.lastAutosave = Game.Time;
+	Map_SaveInBackground(&path, NULL);
+}
+
+static void MapSaver_Tick(struct ScheduledTask* task) {
+	if (!saver.busy) { MapSaver_CheckAutosave(); return; }
+
+	if (saver.done) {
+		MapSaver_Finish();
+	} else {
+		Event_RaiseFloat(&WorldEvents.Saving, (float)saver.written / saver.total);
+	}
+}
+
+
 /*########################################################################################################################*
 *-------------------------------------------------------Formats component-------------------------------------------------*
 *#########################################################################################################################*/
@@ -1865,6 +2534,7 @@ static struct MapImporter lvl_imp   = { ".lvl",     Lvl_Load };
 static struct MapImporter mine_imp  = { ".mine",    Dat_Load };
 static struct MapImporter fcm_imp   = { ".fcm",     Fcm_Load };
 static struct MapImporter mclvl_imp = { ".mclevel", MCLevel_Load };
+static struct MapImporter ccmap_imp = { ".ccmap",   CcMap_Load };
 
 static void OnInit(void) {
 	MapImporter_Register(&cw_imp);
@@ -1873,10 +2543,21 @@ static void OnInit(void) {
 	MapImporter_Register(&mine_imp);
 	MapImporter_Register(&fcm_imp);
 	MapImporter_Register(&mclvl_imp);
+	MapImporter_Register(&ccmap_imp);
+
+	saver.autosaveInterval = Options_GetInt(OPT_AUTOSAVE_INTERVAL, 0, 24 * 60, 0) * 60;
+	ScheduledTask_Add(0.1, MapSaver_Tick);
 }
 
 static void OnFree(void) {
 	imp_head = NULL;
+	/* Make sure map is fully saved before the game exits */
+	saver.callback = NULL;
+	if (saver.busy) MapSaver_Finish();
+}
+
+static void OnNewMapLoaded(void) {
+	saver.lastAutosave = Game.Time;
 }
 #else
 /* No point including map format code when can't save/load maps anyways */
@@ -1886,12 +2567,20 @@ cc_result Map_LoadFrom(const cc_string* path) { return ERR_NOT_SUPPORTED; }
 cc_result Cw_Save(struct Stream* stream)  { return ERR_NOT_SUPPORTED; }
 cc_result Dat_Save(struct Stream* stream) { return ERR_NOT_SUPPORTED; }
 cc_result Schematic_Save(struct Stream* stream) { return ERR_NOT_SUPPORTED; }
+cc_result CcMap_Save(struct Stream* stream, cc_bool compress) { return ERR_NOT_SUPPORTED; }
+
+cc_result Map_SaveInBackground(const cc_string* path, MapSaveCallback callback) { return ERR_NOT_SUPPORTED; }
+cc_bool Map_IsSavingInBackground(void) { return false; }
 
 static void OnInit(void) { }
 static void OnFree(void) { }
+static void OnNewMapLoaded(void) { }
 #endif
 
 struct IGameComponent Formats_Component = {
 	OnInit, /* Init  */
-	OnFree  /* Free  */
+	OnFree, /* Free  */
+	NULL,   /* Reset */
+	NULL,   /* OnNewMap */
+	OnNewMapLoaded /* OnNewMapLoaded */
 };
@@ -38,6 +38,23 @@ cc_result Schematic_Save(struct Stream* stream);
 /* Exports a world to a .dat Classic map file */
 /* Used by MineCraft Classic */
 cc_result Dat_Save(struct Stream* stream);
+/* Exports a world to a .ccmap ClassiCube map file */
+/* Blocks are stored in sections that can be read directly into memory, for faster loading */
+/* NOTE: Stream must be seekable, and is written to directly. (i.e. not GZip compressed) */
+/* If compress is true, sections are DEFLATE compressed (smaller, but slower to load) */
+cc_result CcMap_Save(struct Stream* stream, cc_bool compress);
+
+/* Callback invoked on the main thread once a background map save has finished */
+typedef void (*MapSaveCallback)(const cc_string* path, cc_result res);
+/* Begins saving the world to a .cw ClassicWorld map file on a background thread. */
+/* Blocks and metadata are snapshotted first, so the world can keep changing while saving. */
+/* The file is written to a temp file first, which then replaces the target file once complete. */
+/* Progress is reported through WorldEvents.Saving, and callback (if not NULL) is invoked when done. */
+/* NOTE: Saves synchronously instead when threading is unsupported or memory is low. */
+/* NOTE: Returns ERR_NOT_SUPPORTED if a background save is already in progress. */
+CC_API cc_result Map_SaveInBackground(const cc_string* path, MapSaveCallback callback);
+/* Whether a background map save is currently in progress */
+CC_API cc_bool Map_IsSavingInBackground(void);
 
 CC_END_HEADER
 #endif
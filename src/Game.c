@@ -415,7 +415,10 @@ static void Game_Load(void) {
 	Game_SetFpsLimit(Options_GetEnum(OPT_FPS_LIMIT, 0, FpsLimit_Names, FPS_LIMIT_COUNT));
 	Gfx_Create();
 	
+#if CC_WIN_BACKEND != CC_WIN_BACKEND_HEADLESS
+	/* Headless rendering has no chat to show warnings in, so keeps logging them */
 	Logger_WarnFunc = Game_WarnFunc;
+#endif
 	LoadOptions();
 	GameVersion_Load();
 	Utils_EnsureDirectory("maps");
@@ -505,6 +508,9 @@ extern void Window_SetMinFrameTime(float timeMS);
 void Game_SetMinFrameTime(float frameTimeMS) {
 	if (frameTimeMS) Window_SetMinFrameTime(frameTimeMS);
 }
+#elif CC_WIN_BACKEND == CC_WIN_BACKEND_HEADLESS
+/* Frames should be rendered as fast as possible when there's no display */
+void Game_SetMinFrameTime(float frameTimeMS) { }
 #else
 void Game_SetMinFrameTime(float frameTimeMS) {
 	gfx_minFrameMs = frameTimeMS;
@@ -747,6 +753,10 @@ static CC_INLINE void Game_RenderFrame(void) {
 	cc_uint64 elapsed = Stopwatch_ElapsedMicroseconds(frameStart, render);
 	/* avoid large delta with suspended process */
 	if (elapsed > 5000000) elapsed = 5000000;
+#if CC_WIN_BACKEND == CC_WIN_BACKEND_HEADLESS
+	/* Always advance by exactly 1/60th of a second, so rendered frames are reproducible */
+	elapsed = 1000000 / 60;
+#endif
 	
 	deltaD = (int)elapsed / (1000.0 * 1000.0);
 	delta  = (float)deltaD;
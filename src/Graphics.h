@@ -427,6 +427,13 @@ cc_bool Gfx_GetUIOptions(struct MenuOptionsScreen* s);
 /* NOTE: Each line is separated by \n */
 void Gfx_GetApiInfo(cc_string* info);
 
+#if CC_GFX_BACKEND == CC_GFX_BACKEND_SOFTGPU && CC_WIN_BACKEND == CC_WIN_BACKEND_HEADLESS
+/* Loads a frame previously recorded to the given file (see HeadlessInfo.Capture), */
+/*  then renders it the given number of times and logs how long rendering took */
+/* NOTE: If output is not empty, the rendered frame is also saved there as a PNG */
+cc_result Gfx_ReplayCapture(const cc_string* path, int iterations, const cc_string* output);
+#endif
+
 /* Updates state when the window's dimensions have changed */
 /* NOTE: This may require recreating the context depending on the backend */
 void Gfx_OnWindowResize(void);
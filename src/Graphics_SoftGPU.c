@@ -4,6 +4,33 @@
 #include "Errors.h"
 #include "Window.h"
 
+#if defined CC_BUILD_COOPTHREADED || defined CC_BUILD_LOWMEM
+	/* Not worth the extra memory or threads */
+	#define SOFTGPU_DISABLE_BINNING
+#endif
+
+#if (defined __SSE2__ || defined _M_X64) && !defined BITMAP_16BPP && !defined SOFTGPU_DISABLE_ZBUFFER && !defined SOFTGPU_DISABLE_SIMD
+	#define SOFTGPU_SSE2
+	#include <emmintrin.h>
+#endif
+
+/* Used for the row rasterisers, so that specialised versions with constant modes are generated */
+#if defined __GNUC__
+	#define RAST_FORCE_INLINE inline __attribute__((always_inline))
+#elif defined _MSC_VER
+	#define RAST_FORCE_INLINE __forceinline
+#else
+	#define RAST_FORCE_INLINE CC_INLINE
+#endif
+
+#if CC_WIN_BACKEND == CC_WIN_BACKEND_HEADLESS
+	/* Frames can be recorded and then replayed, for benchmarking the rasteriser (see HeadlessInfo.Capture) */
+	#define SOFTGPU_CAPTURE
+	#include "Stream.h"
+	#include "Deflate.h"
+	#include "Utils.h"
+#endif
+
 static cc_bool faceCulling;
 static int fb_width, fb_height; 
 static struct Bitmap fb_bmp;
@@ -16,6 +43,8 @@ static cc_bool colWrite = true;
 static int cb_stride;
 
 static float* depthBuffer;
+static float* hiZBuffer; /* Largest depth value in each 8x8 pixel block of depthBuffer */
+static int hiZ_stride, hiZ_rows;
 static cc_bool depthTest  = true;
 static cc_bool depthWrite = true;
 static int db_stride;
@@ -23,6 +52,18 @@ static int db_stride;
 static void* gfx_vertices;
 static GfxResourceID white_square;
 
+static void FlushTriangles(void);
+static void DiscardTriangles(void);
+static void InitTileBins(void);
+static void FreeTileBins(void);
+
+#ifdef SOFTGPU_CAPTURE
+static void RecordQuads(int startVertex, int verticesCount);
+static void RecordLines(int verticesCount);
+static void RecordClear(GfxBuffers buffers);
+static void ForgetTexture(void* tex);
+#endif
+
 void Gfx_RestoreState(void) {
 	InitDefaultResources();
 
@@ -49,14 +90,21 @@ void Gfx_Create(void) {
 
 	Gfx.Created      = true;
 	Gfx.BackendType  = CC_GFX_BACKEND_SOFTGPU;
+	customMipmapsLevels = true;
 	
 	Gfx_RestoreState();
 }
 
 static void DestroyBuffers(void) {
+	/* Pending triangles would just be drawn into buffers that are about to be freed */
+	DiscardTriangles();
+	FreeTileBins();
+
 	Window_FreeFramebuffer(&fb_bmp);
 	Mem_Free(depthBuffer);
+	Mem_Free(hiZBuffer);
 	depthBuffer = NULL;
+	hiZBuffer   = NULL;
 }
 
 void Gfx_Free(void) { 
@@ -67,65 +115,267 @@ void Gfx_Free(void) {
 
 typedef struct CCTexture {
 	int width, height;
+	int mipLevels; /* Number of mipmap levels stored after the base level pixels */
 	BitmapCol pixels[];
 } CCTexture;
 
+/* Texels are stored in 4x4 texel tiles instead of row by row, so that the texels */
+/*  sampled by nearby pixels are likely to be in the same cache line, regardless of */
+/*  which direction the texture is being stepped through in. */
+/* Tiles are stored row by row, and texels within each tile are also stored row by row */
+/* NOTE: For textures less than 4 texels wide or tall, tiles are narrower/shorter instead */
+#define TEX_TILE_SHIFT 2
+
+/* Texture (or one of its mipmap levels) being sampled from, */
+/*  along with the constants needed to calculate where texels are stored */
+struct TexSampler {
+	BitmapCol* pixels;
+	int width, height;
+	int widthMask, heightMask;
+	int widthShift;             /* log2(width) */
+	int tileShiftX, tileShiftY; /* log2 of tile width and height */
+	int tileMaskX,  tileMaskY;
+};
+
 static CCTexture* curTexture;
-static BitmapCol* curTexPixels;
-static int curTexWidth, curTexHeight;
-static int texWidthMask, texHeightMask;
-static int texSinglePixel;
+static struct TexSampler curSampler;
+static cc_bool mipmapsEnabled;
+
+static void SetupSampler(struct TexSampler* s, BitmapCol* pixels, int width, int height) {
+	int heightShift = Math_ilog2(height);
+
+	s->pixels     = pixels;
+	s->width      = width;
+	s->height     = height;
+	s->widthShift = Math_ilog2(width);
+	s->widthMask  = (1 << s->widthShift) - 1;
+	s->heightMask = (1 << heightShift)   - 1;
+
+	s->tileShiftX = min(s->widthShift, TEX_TILE_SHIFT);
+	s->tileShiftY = min(heightShift,   TEX_TILE_SHIFT);
+	s->tileMaskX  = (1 << s->tileShiftX) - 1;
+	s->tileMaskY  = (1 << s->tileShiftY) - 1;
+}
+
+/* Returns index into the texel storage of the given texel */
+static CC_INLINE int TexelIndex(const struct TexSampler* s, int x, int y) {
+	return ((y & ~s->tileMaskY) << s->widthShift) + ((x & ~s->tileMaskX) << s->tileShiftY)
+		 + ((y &  s->tileMaskY) << s->tileShiftX) +  (x &  s->tileMaskX);
+}
+
+/* Copies the given rectangle of row by row pixels into a texture's tiled texel storage */
+static void StoreTexels(struct TexSampler* s, int x, int y, BitmapCol* src, int srcStride, int width, int height) {
+	int i, j;
+	for (j = 0; j < height; j++, src += srcStride)
+	{
+		for (i = 0; i < width; i++) s->pixels[TexelIndex(s, x + i, y + j)] = src[i];
+	}
+}
+
+/* Copies the given rectangle of a texture's tiled texel storage into row by row pixels */
+static void LoadTexels(struct TexSampler* s, int x, int y, BitmapCol* dst, int width, int height) {
+	int i, j;
+	for (j = 0; j < height; j++, dst += width)
+	{
+		for (i = 0; i < width; i++) dst[i] = s->pixels[TexelIndex(s, x + i, y + j)];
+	}
+}
 		
 void Gfx_BindTexture(GfxResourceID texId) {
 	if (!texId) texId = white_square;
 	CCTexture* tex = texId;
 
-	curTexture   = tex;
-	curTexPixels = tex->pixels;
-	curTexWidth  = tex->width;
-	curTexHeight = tex->height;
-
-	texWidthMask   = (1 << Math_ilog2(tex->width))  - 1;
-	texHeightMask  = (1 << Math_ilog2(tex->height)) - 1;
-	texSinglePixel = curTexWidth == 1 && curTexHeight == 1;
+	curTexture = tex;
+	SetupSampler(&curSampler, tex->pixels, tex->width, tex->height);
 }
 		
 void Gfx_DeleteTexture(GfxResourceID* texId) {
 	GfxResourceID data = *texId;
-	if (data) Mem_Free(data);
+	if (!data) return;
+
+	/* Pending triangles might still be using the texture */
+	FlushTriangles();
+#ifdef SOFTGPU_CAPTURE
+	ForgetTexture(data);
+#endif
+	Mem_Free(data);
 	*texId = NULL;
 }
+
+/* Returns offset of the pixels of the given mipmap level, which are stored straight after the previous level */
+/* NOTE: width and height are updated to the dimensions of the given mipmap level */
+static int MipLevelOffset(int lvl, int* width, int* height) {
+	int i, offset = 0;
+	for (i = 0; i < lvl; i++)
+	{
+		offset += *width * *height;
+		if (*width  > 1) *width  /= 2;
+		if (*height > 1) *height /= 2;
+	}
+	return offset;
+}
+
+/* Regenerates the portion of every mipmap level that was derived from the given base level rectangle */
+static void UpdateMipmaps(CCTexture* tex, int x, int y, int width, int height) {
+	struct TexSampler prev, cur;
+	int lvl;
+	SetupSampler(&prev, tex->pixels, tex->width, tex->height);
+
+	for (lvl = 1; lvl <= tex->mipLevels; lvl++)
+	{
+		int lvlWidth  = prev.width;
+		int lvlHeight = prev.height;
+		BitmapCol* pixels = prev.pixels + MipLevelOffset(1, &lvlWidth, &lvlHeight);
+		SetupSampler(&cur, pixels, lvlWidth, lvlHeight);
+
+		/* Every pixel in this level is the average of a 2x2 block in the previous level */
+		int x1 = min((x + width  + 1) >> 1, lvlWidth);
+		int y1 = min((y + height + 1) >> 1, lvlHeight);
+		x >>= 1; y >>= 1;
+		width = x1 - x; height = y1 - y;
+
+		/* GenMipmaps works on row by row pixels, so the 2x2 blocks have to be untiled first */
+		BitmapCol* src = (BitmapCol*)Mem_Alloc(width * height * 5, BITMAPCOLOR_SIZE, "mipmaps");
+		BitmapCol* dst = src + width * height * 4;
+
+		LoadTexels(&prev, x * 2, y * 2, src, width * 2, height * 2);
+		GenMipmaps(width, height, dst, src, width * 2);
+		StoreTexels(&cur, x, y, dst, width, width, height);
+		Mem_Free(src);
+
+		prev = cur;
+	}
+}
 		
 GfxResourceID Gfx_AllocTexture(struct Bitmap* bmp, int rowWidth, cc_uint8 flags, cc_bool mipmaps) {
-	CCTexture* tex = (CCTexture*)Mem_Alloc(2 + bmp->width * bmp->height, 4, "Texture");
-
-	tex->width  = bmp->width;
-	tex->height = bmp->height;
-	CopyTextureData(tex->pixels, bmp->width * BITMAPCOLOR_SIZE,
-					bmp, rowWidth * BITMAPCOLOR_SIZE);
+	int lvls  = mipmaps ? CalcMipmapsLevels(bmp->width, bmp->height) : 0;
+	int width = bmp->width, height = bmp->height;
+	/* Size of every level together is just the offset of the level after the last one */
+	int size  = MipLevelOffset(lvls + 1, &width, &height);
+
+	CCTexture* tex = (CCTexture*)Mem_Alloc(1, sizeof(CCTexture) + size * BITMAPCOLOR_SIZE, "Texture");
+	struct TexSampler base;
+	tex->width     = bmp->width;
+	tex->height    = bmp->height;
+	tex->mipLevels = lvls;
+
+	SetupSampler(&base, tex->pixels, tex->width, tex->height);
+	StoreTexels(&base, 0, 0, bmp->scan0, rowWidth, bmp->width, bmp->height);
+	if (lvls) UpdateMipmaps(tex, 0, 0, bmp->width, bmp->height);
 	return tex;
 }
 
 void Gfx_UpdateTexture(GfxResourceID texId, int x, int y, struct Bitmap* part, int rowWidth, cc_bool mipmaps) {
 	CCTexture* tex = (CCTexture*)texId;
-	BitmapCol* dst = (tex->pixels + x) + y * tex->width;
+	struct TexSampler base;
+
+	FlushTriangles();
+	SetupSampler(&base, tex->pixels, tex->width, tex->height);
+	StoreTexels(&base, x, y, part->scan0, rowWidth, part->width, part->height);
+	if (mipmaps && tex->mipLevels) UpdateMipmaps(tex, x, y, part->width, part->height);
+#ifdef SOFTGPU_CAPTURE
+	ForgetTexture(tex);
+#endif
+}
 
-	CopyTextureData(dst, tex->width * BITMAPCOLOR_SIZE,
-					part, rowWidth  * BITMAPCOLOR_SIZE);
+void Gfx_EnableMipmaps(void) {
+	if (!Gfx.Mipmaps) return;
+	mipmapsEnabled = true;
 }
 
-void Gfx_EnableMipmaps(void)  { }
-void Gfx_DisableMipmaps(void) { }
+void Gfx_DisableMipmaps(void) {
+	if (!Gfx.Mipmaps) return;
+	mipmapsEnabled = false;
+}
 
 
 /*########################################################################################################################*
 *------------------------------------------------------State management---------------------------------------------------*
 *#########################################################################################################################*/
-void Gfx_SetFog(cc_bool enabled)	{ }
-void Gfx_SetFogCol(PackedCol col)   { }
-void Gfx_SetFogDensity(float value) { }
-void Gfx_SetFogEnd(float value) 	{ }
-void Gfx_SetFogMode(FogFunc func)   { }
+/* Fog factors are looked up from a table indexed by distance from the camera, */
+/*  instead of calculating exp() or a division for every single pixel */
+#define FOG_TABLE_SIZE 256
+#define FOG_LOG2E 1.44269504f /* exp(x) = exp2(x * log2(e)) */
+static cc_uint16 fog_table[FOG_TABLE_SIZE]; /* Visibility from 0 (fully fogged) to 256 (no fog) */
+static float fog_scale; /* Distance to fog table index scale */
+static int fog_R, fog_G, fog_B;
+
+static PackedCol gfx_fogColor;
+static float gfx_fogEnd = -1.0f, gfx_fogDensity = -1.0f;
+static int gfx_fogMode  = -1;
+
+static void UpdateFogTable(void) {
+	float dist, maxDist, visibility;
+	int i;
+
+	/* Beyond these distances, fog always completely covers a pixel (i.e. visibility < 1/256) */
+	if (gfx_fogMode == FOG_LINEAR) {
+		maxDist = gfx_fogEnd;
+	} else if (gfx_fogMode == FOG_EXP) {
+		maxDist = 5.55f / gfx_fogDensity;  /* exp(-5.55)   ~= 1/256 */
+	} else {
+		maxDist = 2.36f / gfx_fogDensity;  /* exp(-2.36^2) ~= 1/256 */
+	}
+
+	/* Fog parameters haven't been fully set yet */
+	if (gfx_fogMode < 0 || !(maxDist > 0.0f)) {
+		for (i = 0; i < FOG_TABLE_SIZE; i++) fog_table[i] = 256;
+		fog_scale = 0.0f; return;
+	}
+	fog_scale = (FOG_TABLE_SIZE - 1) / maxDist;
+
+	for (i = 0; i < FOG_TABLE_SIZE; i++)
+	{
+		dist = i / fog_scale;
+
+		if (gfx_fogMode == FOG_LINEAR) {
+			visibility = (gfx_fogEnd - dist) / gfx_fogEnd;
+		} else if (gfx_fogMode == FOG_EXP) {
+			visibility = (float)Math_Exp2(-gfx_fogDensity * dist * FOG_LOG2E);
+		} else {
+			visibility = gfx_fogDensity * dist;
+			visibility = (float)Math_Exp2(-visibility * visibility * FOG_LOG2E);
+		}
+		Math_Clamp(visibility, 0.0f, 1.0f);
+		fog_table[i] = (cc_uint16)(visibility * 256);
+	}
+}
+
+void Gfx_SetFog(cc_bool enabled) {
+	gfx_fogEnabled = enabled;
+}
+
+void Gfx_SetFogCol(PackedCol color) {
+	if (color == gfx_fogColor) return;
+	/* Pending triangles must still be drawn with the old fog */
+	FlushTriangles();
+	gfx_fogColor = color;
+
+	fog_R = PackedCol_R(color);
+	fog_G = PackedCol_G(color);
+	fog_B = PackedCol_B(color);
+}
+
+void Gfx_SetFogDensity(float value) {
+	if (value == gfx_fogDensity) return;
+	FlushTriangles();
+	gfx_fogDensity = value;
+	UpdateFogTable();
+}
+
+void Gfx_SetFogEnd(float value) {
+	if (value == gfx_fogEnd) return;
+	FlushTriangles();
+	gfx_fogEnd = value;
+	UpdateFogTable();
+}
+
+void Gfx_SetFogMode(FogFunc func) {
+	if (func == gfx_fogMode) return;
+	FlushTriangles();
+	gfx_fogMode = func;
+	UpdateFogTable();
+}
 
 void Gfx_SetFaceCulling(cc_bool enabled) {
 	faceCulling = enabled;
@@ -161,10 +411,17 @@ static void ClearDepthBuffer(void) {
 #ifndef SOFTGPU_DISABLE_ZBUFFER
 	int i, size = fb_width * fb_height;
 	for (i = 0; i < size; i++) depthBuffer[i] = 100000000.0f;
+
+	size = hiZ_stride * hiZ_rows;
+	for (i = 0; i < size; i++) hiZBuffer[i]   = 100000000.0f;
 #endif
 }
 
 void Gfx_ClearBuffers(GfxBuffers buffers) {
+#ifdef SOFTGPU_CAPTURE
+	RecordClear(buffers);
+#endif
+	FlushTriangles();
 	if (buffers & GFX_BUFFER_COLOR) ClearColorBuffer();
 	if (buffers & GFX_BUFFER_DEPTH) ClearDepthBuffer();
 }
@@ -322,6 +579,71 @@ typedef struct Vertex_ {
 	PackedCol c;
 } Vertex;
 
+#define RAST_TEXTURED    0x01
+#define RAST_ALPHA_TEST  0x02
+#define RAST_ALPHA_BLEND 0x04
+#define RAST_DEPTH_TEST  0x08
+#define RAST_DEPTH_WRITE 0x10
+#define RAST_COLOR_WRITE 0x20
+#define RAST_2D          0x40
+#define RAST_FOG         0x80
+#define RAST_MIPMAPS     0x100
+
+/* Render state a triangle was submitted with */
+/* (triangles may be rasterised long after the state has been changed) */
+struct RastState {
+	struct TexSampler tex; /* Base level of the bound texture */
+	int mipLevels;
+	int flags;
+};
+
+/* Triangle that has been transformed and clipped, and is ready to be rasterised */
+struct RastTriangle {
+	Vertex v[3];
+	int fx[3], fy[3]; /* Screen positions of vertices in 28.4 fixed point */
+	int minX, minY, maxX, maxY; /* Screen bounds, already clipped to scissor rectangle */
+	int state;
+	int mipLevel; /* Mipmap level of the texture to sample from */
+};
+
+#ifdef SOFTGPU_DISABLE_BINNING
+	#define RAST_MAX_STATES 1
+#else
+	#define RAST_MAX_STATES 256
+#endif
+static struct RastState rast_states[RAST_MAX_STATES];
+static int rast_numStates, rast_curState = -1;
+
+static void CaptureState(void) {
+	struct RastState* cur;
+	struct RastState s;
+
+	s.tex       = curSampler;
+	s.mipLevels = curTexture ? curTexture->mipLevels : 0;
+
+	s.flags = 0;
+	if (gfx_format == VERTEX_FORMAT_TEXTURED) s.flags |= RAST_TEXTURED;
+	if (gfx_alphaTest)   s.flags |= RAST_ALPHA_TEST;
+	if (gfx_alphaBlend)  s.flags |= RAST_ALPHA_BLEND;
+	if (depthTest)       s.flags |= RAST_DEPTH_TEST;
+	if (depthWrite)      s.flags |= RAST_DEPTH_WRITE;
+	if (colWrite)        s.flags |= RAST_COLOR_WRITE;
+	if (gfx_rendering2D) s.flags |= RAST_2D;
+
+	if (!gfx_rendering2D && gfx_fogEnabled) s.flags |= RAST_FOG;
+	if (!gfx_rendering2D && mipmapsEnabled && s.mipLevels && (s.flags & RAST_TEXTURED)) s.flags |= RAST_MIPMAPS;
+
+	if (rast_curState >= 0) {
+		cur = &rast_states[rast_curState];
+		if (cur->tex.pixels == s.tex.pixels && cur->tex.width == s.tex.width &&
+			cur->tex.height == s.tex.height && cur->flags     == s.flags) return;
+	}
+
+	if (rast_numStates == RAST_MAX_STATES) FlushTriangles();
+	rast_curState = rast_numStates++;
+	rast_states[rast_curState] = s;
+}
+
 static void TransformVertex2D(int index, Vertex* vertex) {
 	// TODO: avoid the multiply, just add down in DrawTriangles
 	char* ptr = (char*)gfx_vertices + index * gfx_stride;
@@ -342,16 +664,7 @@ static void TransformVertex2D(int index, Vertex* vertex) {
 	}
 }
 
-static int TransformVertex3D(int index, Vertex* vertex) {
-	// TODO: avoid the multiply, just add down in DrawTriangles
-	char* ptr = (char*)gfx_vertices + index * gfx_stride;
-	Vector3* pos = (Vector3*)ptr;
-
-	vertex->x = pos->x * _mvp.row1.x + pos->y * _mvp.row2.x + pos->z * _mvp.row3.x + _mvp.row4.x;
-	vertex->y = pos->x * _mvp.row1.y + pos->y * _mvp.row2.y + pos->z * _mvp.row3.y + _mvp.row4.y;
-	vertex->z = pos->x * _mvp.row1.z + pos->y * _mvp.row2.z + pos->z * _mvp.row3.z + _mvp.row4.z;
-	vertex->w = pos->x * _mvp.row1.w + pos->y * _mvp.row2.w + pos->z * _mvp.row3.w + _mvp.row4.w;
-
+static void LoadAttributes3D(char* ptr, Vertex* vertex) {
 	if (gfx_format != VERTEX_FORMAT_TEXTURED) {
 		struct VertexColoured* v = (struct VertexColoured*)ptr;
 		vertex->u = 0.0f;
@@ -363,9 +676,118 @@ static int TransformVertex3D(int index, Vertex* vertex) {
 		vertex->v = (v->V + texOffsetY);
 		vertex->c = v->Col;
 	}
+}
+
+static int TransformVertex3D(int index, Vertex* vertex) {
+	char* ptr = (char*)gfx_vertices + index * gfx_stride;
+	Vector3* pos = (Vector3*)ptr;
+
+	vertex->x = pos->x * _mvp.row1.x + pos->y * _mvp.row2.x + pos->z * _mvp.row3.x + _mvp.row4.x;
+	vertex->y = pos->x * _mvp.row1.y + pos->y * _mvp.row2.y + pos->z * _mvp.row3.y + _mvp.row4.y;
+	vertex->z = pos->x * _mvp.row1.z + pos->y * _mvp.row2.z + pos->z * _mvp.row3.z + _mvp.row4.z;
+	vertex->w = pos->x * _mvp.row1.w + pos->y * _mvp.row2.w + pos->z * _mvp.row3.w + _mvp.row4.w;
+
+	LoadAttributes3D(ptr, vertex);
 	return vertex->z >= 0.0f;
 }
 
+
+/*########################################################################################################################*
+*----------------------------------------------------Batched transform----------------------------------------------------*
+*#########################################################################################################################*/
+/* Vertices are transformed by the MVP matrix in batches into the SoA clip space arrays below, */
+/*  along with an outcode for each vertex, so that whole quads outside the view frustum */
+/*  can be rejected before any per-vertex attributes are loaded or triangles set up */
+#define XF_BATCH_SIZE 1024 /* Must be a multiple of 4 */
+#define XF_NEAR   0x01 /* z < 0 (i.e. behind near plane, triangles must be clipped) */
+#define XF_LEFT   0x02 /* x < -w */
+#define XF_RIGHT  0x04 /* x >  w */
+#define XF_BOTTOM 0x08 /* y < -w */
+#define XF_TOP    0x10 /* y >  w */
+
+static float xf_x[XF_BATCH_SIZE], xf_y[XF_BATCH_SIZE], xf_z[XF_BATCH_SIZE], xf_w[XF_BATCH_SIZE];
+static cc_uint8 xf_outcodes[XF_BATCH_SIZE];
+
+#ifdef SOFTGPU_SSE2
+/* Transforms 4 vertices at a time, with one vertex in each SIMD lane */
+static void TransformBatch(int start, int count) {
+	__m128 m11 = _mm_set1_ps(_mvp.row1.x), m12 = _mm_set1_ps(_mvp.row1.y), m13 = _mm_set1_ps(_mvp.row1.z), m14 = _mm_set1_ps(_mvp.row1.w);
+	__m128 m21 = _mm_set1_ps(_mvp.row2.x), m22 = _mm_set1_ps(_mvp.row2.y), m23 = _mm_set1_ps(_mvp.row2.z), m24 = _mm_set1_ps(_mvp.row2.w);
+	__m128 m31 = _mm_set1_ps(_mvp.row3.x), m32 = _mm_set1_ps(_mvp.row3.y), m33 = _mm_set1_ps(_mvp.row3.z), m34 = _mm_set1_ps(_mvp.row3.w);
+	__m128 m41 = _mm_set1_ps(_mvp.row4.x), m42 = _mm_set1_ps(_mvp.row4.y), m43 = _mm_set1_ps(_mvp.row4.z), m44 = _mm_set1_ps(_mvp.row4.w);
+	__m128 zero = _mm_setzero_ps();
+	char* ptr   = (char*)gfx_vertices + start * gfx_stride;
+	int stride  = gfx_stride;
+
+	for (int i = 0; i < count; i += 4, ptr += 4 * stride)
+	{
+		Vector3* p0 = (Vector3*)(ptr);
+		Vector3* p1 = (Vector3*)(ptr + stride);
+		Vector3* p2 = (Vector3*)(ptr + stride * 2);
+		Vector3* p3 = (Vector3*)(ptr + stride * 3);
+
+		__m128 px = _mm_set_ps(p3->x, p2->x, p1->x, p0->x);
+		__m128 py = _mm_set_ps(p3->y, p2->y, p1->y, p0->y);
+		__m128 pz = _mm_set_ps(p3->z, p2->z, p1->z, p0->z);
+
+		// Same order of operations as TransformVertex3D, so results are identical
+		__m128 x = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m11), _mm_mul_ps(py, m21)), _mm_mul_ps(pz, m31)), m41);
+		__m128 y = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m12), _mm_mul_ps(py, m22)), _mm_mul_ps(pz, m32)), m42);
+		__m128 z = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m13), _mm_mul_ps(py, m23)), _mm_mul_ps(pz, m33)), m43);
+		__m128 w = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m14), _mm_mul_ps(py, m24)), _mm_mul_ps(pz, m34)), m44);
+		__m128 negW = _mm_sub_ps(zero, w);
+
+		_mm_storeu_ps(&xf_x[i], x);
+		_mm_storeu_ps(&xf_y[i], y);
+		_mm_storeu_ps(&xf_z[i], z);
+		_mm_storeu_ps(&xf_w[i], w);
+
+		__m128i oc = _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(z, zero)), _mm_set1_epi32(XF_NEAR));
+		oc = _mm_or_si128(oc, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(x, negW)), _mm_set1_epi32(XF_LEFT)));
+		oc = _mm_or_si128(oc, _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(x, w)),    _mm_set1_epi32(XF_RIGHT)));
+		oc = _mm_or_si128(oc, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(y, negW)), _mm_set1_epi32(XF_BOTTOM)));
+		oc = _mm_or_si128(oc, _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(y, w)),    _mm_set1_epi32(XF_TOP)));
+
+		// Pack the 4 32 bit outcodes down into 4 bytes
+		oc = _mm_packs_epi32(oc, oc);
+		oc = _mm_packus_epi16(oc, oc);
+		int packed = _mm_cvtsi128_si32(oc);
+		Mem_Copy(&xf_outcodes[i], &packed, 4);
+	}
+}
+#else
+static void TransformBatch(int start, int count) {
+	char* ptr = (char*)gfx_vertices + start * gfx_stride;
+
+	for (int i = 0; i < count; i++, ptr += gfx_stride)
+	{
+		Vector3* pos = (Vector3*)ptr;
+		float x = pos->x * _mvp.row1.x + pos->y * _mvp.row2.x + pos->z * _mvp.row3.x + _mvp.row4.x;
+		float y = pos->x * _mvp.row1.y + pos->y * _mvp.row2.y + pos->z * _mvp.row3.y + _mvp.row4.y;
+		float z = pos->x * _mvp.row1.z + pos->y * _mvp.row2.z + pos->z * _mvp.row3.z + _mvp.row4.z;
+		float w = pos->x * _mvp.row1.w + pos->y * _mvp.row2.w + pos->z * _mvp.row3.w + _mvp.row4.w;
+
+		xf_x[i] = x; xf_y[i] = y; xf_z[i] = z; xf_w[i] = w;
+		int oc  = 0;
+		if (z <  0) oc |= XF_NEAR;
+		if (x < -w) oc |= XF_LEFT;
+		if (x >  w) oc |= XF_RIGHT;
+		if (y < -w) oc |= XF_BOTTOM;
+		if (y >  w) oc |= XF_TOP;
+		xf_outcodes[i] = oc;
+	}
+}
+#endif
+
+/* Loads the vertex at the given index in the vertex buffer, using the position in the batch arrays */
+static CC_INLINE void LoadVertex3D(int index, int i, Vertex* vertex) {
+	vertex->x = xf_x[i];
+	vertex->y = xf_y[i];
+	vertex->z = xf_z[i];
+	vertex->w = xf_w[i];
+	LoadAttributes3D((char*)gfx_vertices + index * gfx_stride, vertex);
+}
+
 static void ViewportVertex3D(Vertex* vertex) {
 	float invW = 1.0f / vertex->w;
 
@@ -384,65 +806,124 @@ static CC_INLINE int FastFloor(float value) {
 	return valueI > value ? valueI - 1 : valueI;
 }
 
-#define edgeFunction(ax,ay, bx,by, cx,cy) (((bx) - (ax)) * ((cy) - (ay)) - ((by) - (ay)) * ((cx) - (ax)))
+/* Vertex positions are snapped to 28.4 fixed point, i.e. 1/16th of a pixel */
+#define RAST_SUBPIXEL_BITS 4
+#define RAST_SUBPIXEL_ONE  (1 << RAST_SUBPIXEL_BITS)
+#define RAST_SUBPIXEL_HALF (1 << (RAST_SUBPIXEL_BITS - 1))
+/* Positions further away than this are clamped, so that edge functions can't overflow */
+#define RAST_MAX_COORD 16777216.0f
 
-static void DrawTriangle2D(Vertex* V0, Vertex* V1, Vertex* V2) {
-	int x0 = (int)V0->x, y0 = (int)V0->y;
-	int x1 = (int)V1->x, y1 = (int)V1->y;
-	int x2 = (int)V2->x, y2 = (int)V2->y;
-	int minX = min(x0, min(x1, x2));
-	int minY = min(y0, min(y1, y2));
-	int maxX = max(x0, max(x1, x2));
-	int maxY = max(y0, max(y1, y2));
+static CC_INLINE int ToFixed(float value) {
+	Math_Clamp(value, -RAST_MAX_COORD, RAST_MAX_COORD);
+	return FastFloor(value * RAST_SUBPIXEL_ONE + 0.5f);
+}
 
-	int area = edgeFunction(x0,y0, x1,y1, x2,y2);
-	// Reject triangles completely outside
-	if (maxX < 0 || minX > fb_maxX) return;
-	if (maxY < 0 || minY > fb_maxY) return;
+static void SnapTriangle(struct RastTriangle* tri) {
+	int i;
+	for (i = 0; i < 3; i++) 
+	{
+		tri->fx[i] = ToFixed(tri->v[i].x);
+		tri->fy[i] = ToFixed(tri->v[i].y);
+	}
+}
 
-	// Perform scissoring
-	minX = max(minX, 0); maxX = min(maxX, fb_maxX);
-	minY = max(minY, 0); maxY = min(maxY, fb_maxY);
-	float factor = 1.0f / area;
+/* Twice the signed area of the given triangle, in 24.8 fixed point */
+static cc_int64 TriangleArea(struct RastTriangle* tri) {
+	int x0 = tri->fx[0], y0 = tri->fy[0];
+	int x1 = tri->fx[1], y1 = tri->fy[1];
+	int x2 = tri->fx[2], y2 = tri->fy[2];
+	return (cc_int64)(x1 - x0) * (y2 - y0) - (cc_int64)(y1 - y0) * (x2 - x0);
+}
 
-	float u0 = V0->u * curTexWidth,  u1 = V1->u * curTexWidth,  u2 = V2->u * curTexWidth;
-	float v0 = V0->v * curTexHeight, v1 = V1->v * curTexHeight, v2 = V2->v * curTexHeight;
-	PackedCol color = V0->c;
-	
-	// https://fgiesen.wordpress.com/2013/02/10/optimizing-the-basic-rasterizer/
-	// Essentially these are the deltas of edge functions between X/Y and X/Y + 1 (i.e. one X/Y step)
-	int dx01  = y0 - y1, dy01 = x1 - x0;
-	int dx12  = y1 - y2, dy12 = x2 - x1;
-	int dx20  = y2 - y0, dy20 = x0 - x2;
+/* Edge functions of a triangle in 24.8 fixed point (i.e. products of 28.4 fixed point values) */
+/* NOTE: Edge functions are normalised so that they are never negative for pixels inside the triangle */
+struct RastEdges {
+	int originX, originY;
+	cc_int64 e0, e1, e2;    /* Edge functions at centre of the origin pixel, minus fill rule bias */
+	cc_int64 dx0, dx1, dx2; /* Change in edge functions for one pixel step in X */
+	cc_int64 dy0, dy1, dy2; /* Change in edge functions for one pixel step in Y */
+	int bias0, bias1, bias2;
+	float factor; /* 1 / area, for converting edge functions into barycentric weights */
+};
+
+static void SetupEdge(cc_int64* e, cc_int64* dx, cc_int64* dy, int* bias,
+					int ax, int ay, int bx, int by, int px, int py, int sign) {
+	cc_int64 stepX = (cc_int64)(ay - by) * sign;
+	cc_int64 stepY = (cc_int64)(bx - ax) * sign;
+	cc_int64 value = ((cc_int64)(bx - ax) * (py - ay) - (cc_int64)(by - ay) * (px - ax)) * sign;
+
+	/* Top-left fill rule: pixel centres exactly on an edge are only inside for top and left edges, */
+	/*  so pixels on the shared edge of two adjacent triangles are drawn exactly once */
+	*bias = (stepX > 0 || (stepX == 0 && stepY > 0)) ? 0 : 1;
+	*e    = value - *bias;
+	*dx   = stepX * RAST_SUBPIXEL_ONE;
+	*dy   = stepY * RAST_SUBPIXEL_ONE;
+}
 
-	float bc0_start = edgeFunction(x1,y1, x2,y2, minX+0.5f,minY+0.5f);
-	float bc1_start = edgeFunction(x2,y2, x0,y0, minX+0.5f,minY+0.5f);
-	float bc2_start = edgeFunction(x0,y0, x1,y1, minX+0.5f,minY+0.5f);
+/* Computes edge functions of the given triangle at the centre of the given origin pixel */
+static void SetupEdges(struct RastEdges* t, struct RastTriangle* tri, int originX, int originY) {
+	int x0 = tri->fx[0], y0 = tri->fy[0];
+	int x1 = tri->fx[1], y1 = tri->fy[1];
+	int x2 = tri->fx[2], y2 = tri->fy[2];
+	int px = originX * RAST_SUBPIXEL_ONE + RAST_SUBPIXEL_HALF;
+	int py = originY * RAST_SUBPIXEL_ONE + RAST_SUBPIXEL_HALF;
 
-	for (int y = minY; y <= maxY; y++, bc0_start += dy12, bc1_start += dy20, bc2_start += dy01) 
+	cc_int64 area = TriangleArea(tri);
+	int sign      = area > 0 ? 1 : -1;
+
+	SetupEdge(&t->e0, &t->dx0, &t->dy0, &t->bias0, x1,y1, x2,y2, px,py, sign);
+	SetupEdge(&t->e1, &t->dx1, &t->dy1, &t->bias1, x2,y2, x0,y0, px,py, sign);
+	SetupEdge(&t->e2, &t->dx2, &t->dy2, &t->bias2, x0,y0, x1,y1, px,py, sign);
+
+	t->factor  = 1.0f / (float)(area * sign);
+	t->originX = originX;
+	t->originY = originY;
+}
+
+/* Rasterises the portion of the given 2D triangle within the given rectangle */
+static void RasterTriangle2D(struct RastTriangle* tri, int minX, int minY, int maxX, int maxY) {
+	struct RastState* s = &rast_states[tri->state];
+	struct RastEdges t;
+	Vertex* V0 = &tri->v[0];
+	Vertex* V1 = &tri->v[1];
+	Vertex* V2 = &tri->v[2];
+
+	SetupEdges(&t, tri, minX, minY);
+	float factor = t.factor;
+
+	struct TexSampler* tex = &s->tex;
+	int texWidth  = tex->width,  texWidthMask  = tex->widthMask;
+	int texHeight = tex->height, texHeightMask = tex->heightMask;
+	cc_bool alphaTest  = s->flags & RAST_ALPHA_TEST;
+	cc_bool alphaBlend = s->flags & RAST_ALPHA_BLEND;
+
+	float u0 = V0->u * texWidth,  u1 = V1->u * texWidth,  u2 = V2->u * texWidth;
+	float v0 = V0->v * texHeight, v1 = V1->v * texHeight, v2 = V2->v * texHeight;
+	PackedCol color = V0->c;
+
+	for (int y = minY; y <= maxY; y++, t.e0 += t.dy0, t.e1 += t.dy1, t.e2 += t.dy2) 
 	{
-		float bc0 = bc0_start;
-		float bc1 = bc1_start;
-		float bc2 = bc2_start;
+		cc_int64 e0 = t.e0;
+		cc_int64 e1 = t.e1;
+		cc_int64 e2 = t.e2;
 
-		for (int x = minX; x <= maxX; x++, bc0 += dx12, bc1 += dx20, bc2 += dx01) 
+		for (int x = minX; x <= maxX; x++, e0 += t.dx0, e1 += t.dx1, e2 += t.dx2) 
 		{
-			float ic0 = bc0 * factor;
-			float ic1 = bc1 * factor;
-			float ic2 = bc2 * factor;
-
-			if (ic0 < 0 || ic1 < 0 || ic2 < 0) continue;
+			if ((e0 | e1 | e2) < 0) continue;
 			int cb_index = y * cb_stride + x;
 
 			int R, G, B, A;
-			if (gfx_format == VERTEX_FORMAT_TEXTURED) {
+			if (s->flags & RAST_TEXTURED) {
+				float ic0 = (float)(e0 + t.bias0) * factor;
+				float ic1 = (float)(e1 + t.bias1) * factor;
+				float ic2 = (float)(e2 + t.bias2) * factor;
+
 				float u = ic0 * u0 + ic1 * u1 + ic2 * u2;
 				float v = ic0 * v0 + ic1 * v1 + ic2 * v2;
 				int texX = ((int)u) & texWidthMask;
 				int texY = ((int)v) & texHeightMask;
-				int texIndex = texY * curTexWidth + texX;
 
-				BitmapCol tColor = curTexPixels[texIndex];
+				BitmapCol tColor = tex->pixels[TexelIndex(tex, texX, texY)];
 				int a1 = PackedCol_A(color), a2 = BitmapCol_A(tColor);
 				A = ( a1 * a2 ) >> 8;
 				int r1 = PackedCol_R(color), r2 = BitmapCol_R(tColor);
@@ -458,10 +939,10 @@ static void DrawTriangle2D(Vertex* V0, Vertex* V1, Vertex* V2) {
 				A = PackedCol_A(color);
 			}
 
-			if (gfx_alphaTest && A < 0x80) continue;
-			if (gfx_alphaBlend && A == 0)  continue;
+			if (alphaTest && A < 0x80) continue;
+			if (alphaBlend && A == 0)  continue;
 
-			if (gfx_alphaBlend && A != 255) {
+			if (alphaBlend && A != 255) {
 				BitmapCol dst = colorBuffer[cb_index];
 				int dstR = BitmapCol_R(dst);
 				int dstG = BitmapCol_G(dst);
@@ -494,231 +975,954 @@ static void DrawTriangle2D(Vertex* V0, Vertex* V1, Vertex* V2) {
 	b2 = BitmapCol_B(tColor); \
 	B  = ( b1 * b2 ) >> 8;    \
 
-static void DrawTriangle3D(Vertex* V0, Vertex* V1, Vertex* V2) {
-	int x0 = (int)V0->x, y0 = (int)V0->y;
-	int x1 = (int)V1->x, y1 = (int)V1->y;
-	int x2 = (int)V2->x, y2 = (int)V2->y;
-	int minX = min(x0, min(x1, x2));
-	int minY = min(y0, min(y1, y2));
-	int maxX = max(x0, max(x1, x2));
-	int maxY = max(y0, max(y1, y2));
-
-	int area = edgeFunction(x0,y0, x1,y1, x2,y2);
-	if (faceCulling) {
-		// https://gamedev.stackexchange.com/questions/203694/how-to-make-backface-culling-work-correctly-in-both-orthographic-and-perspective
-		if (area < 0) return;
-	}
-
-	// Reject triangles completely outside
-	if (maxX < 0 || minX > fb_maxX) return;
-	if (maxY < 0 || minY > fb_maxY) return;
-
-	// Perform scissoring
-	minX = max(minX, 0); maxX = min(maxX, fb_maxX);
-	minY = max(minY, 0); maxY = min(maxY, fb_maxY);
+/* Constants shared by every pixel of a 3D triangle being rasterised */
+struct RastSetup3D {
+	struct RastState* s;
+	struct RastEdges edges;
+	cc_bool fits32; /* Whether edge functions fit in 32 bits everywhere within the rectangle */
 
 	// NOTE: W in frag variables below is actually 1/W 
-	float factor = 1.0f / area;
-	float w0 = V0->w, w1 = V1->w, w2 = V2->w;
-	
-	// TODO proper clipping
-	if (w0 <= 0 || w1 <= 0 || w2 <= 0) {
-		return;
-	}
-
-	float z0 = V0->z, z1 = V1->z, z2 = V2->z;
-	float u0 = V0->u, u1 = V1->u, u2 = V2->u;
-	float v0 = V0->v, v1 = V1->v, v2 = V2->v;
-	PackedCol color = V0->c;
-	
-	// https://fgiesen.wordpress.com/2013/02/10/optimizing-the-basic-rasterizer/
-	// Essentially these are the deltas of edge functions between X/Y and X/Y + 1 (i.e. one X/Y step)
-	int dx01  = y0 - y1, dy01 = x1 - x0;
-	int dx12  = y1 - y2, dy12 = x2 - x1;
-	int dx20  = y2 - y0, dy20 = x0 - x2;
-
-	float bc0_start = edgeFunction(x1,y1, x2,y2, minX+0.5f,minY+0.5f);
-	float bc1_start = edgeFunction(x2,y2, x0,y0, minX+0.5f,minY+0.5f);
-	float bc2_start = edgeFunction(x0,y0, x1,y1, minX+0.5f,minY+0.5f);
+	float w0, w1, w2;
+	float z0, z1, z2;
+	float u0, u1, u2;
+	float v0, v1, v2;
+
+	PackedCol color;
+	int mode; /* RAST_TEXTURED, RAST_ALPHA_TEST and RAST_ALPHA_BLEND flags that apply to this triangle */
+	int R, G, B, A; /* Final color when not texturing */
+
+	/* Texture (or one of its mipmap levels) being sampled from */
+	struct TexSampler tex;
+};
+
+/* Returns index into the fog table for the given distance from the camera */
+static CC_INLINE int FogIndex(float dist) {
+	float index = dist * fog_scale;
+	return index <= 0.0f ? 0 : (int)min(index, FOG_TABLE_SIZE - 1.0f);
+}
 
-	int R, G, B, A;
+/* Rasterises pixels minX to maxX of the given row of a 3D triangle */
+/* NOTE: mode is passed separately so that specialised versions for common modes can be made */
+static RAST_FORCE_INLINE void RasterRow3D_Core(struct RastSetup3D* t, int y, int minX, int maxX, int mode) {
+	struct RastState* s = t->s;
+	struct RastEdges* E = &t->edges;
+	struct TexSampler* tex = &t->tex;
+	float texWidth     = (float)tex->width, texHeight = (float)tex->height;
+	int texWidthMask   = tex->widthMask, texHeightMask = tex->heightMask;
+	cc_bool depthTest  = s->flags & RAST_DEPTH_TEST;
+	cc_bool depthWrite = s->flags & RAST_DEPTH_WRITE;
+	cc_bool colWrite   = s->flags & RAST_COLOR_WRITE;
+	cc_bool alphaTest  = mode & RAST_ALPHA_TEST;
+	cc_bool alphaBlend = mode & RAST_ALPHA_BLEND;
+	cc_bool fogging    = s->flags & RAST_FOG;
+	cc_bool texturing  = mode & RAST_TEXTURED;
+
+	float factor = E->factor;
+	float w0 = t->w0, w1 = t->w1, w2 = t->w2;
+	float z0 = t->z0, z1 = t->z1, z2 = t->z2;
+	float u0 = t->u0, u1 = t->u1, u2 = t->u2;
+	float v0 = t->v0, v1 = t->v1, v2 = t->v2;
+	PackedCol color = t->color;
+
+	int R = t->R, G = t->G, B = t->B, A = t->A;
 	int a1, r1, g1, b1;
 	int a2, r2, g2, b2;
-	cc_bool texturing = gfx_format == VERTEX_FORMAT_TEXTURED;
-
-	if (!texturing) {
-		R = PackedCol_R(color);
-		G = PackedCol_G(color);
-		B = PackedCol_B(color);
-		A = PackedCol_A(color);
-	} else if (texSinglePixel) {
-		/* Don't need to calculate complicated texturing in this case */
-		MultiplyColors(color, curTexPixels[0]);
-		texturing = false;
-	}
 
-	for (int y = minY; y <= maxY; y++, bc0_start += dy12, bc1_start += dy20, bc2_start += dy01) 
+	cc_int64 e0 = E->e0 + (y - E->originY) * E->dy0 + (minX - E->originX) * E->dx0;
+	cc_int64 e1 = E->e1 + (y - E->originY) * E->dy1 + (minX - E->originX) * E->dx1;
+	cc_int64 e2 = E->e2 + (y - E->originY) * E->dy2 + (minX - E->originX) * E->dx2;
+
+	for (int x = minX; x <= maxX; x++, e0 += E->dx0, e1 += E->dx1, e2 += E->dx2) 
 	{
-		float bc0 = bc0_start;
-		float bc1 = bc1_start;
-		float bc2 = bc2_start;
+		if ((e0 | e1 | e2) < 0) continue;
+		int db_index = y * db_stride + x;
 
-		for (int x = minX; x <= maxX; x++, bc0 += dx12, bc1 += dx20, bc2 += dx01) 
-		{
-			float ic0 = bc0 * factor;
-			float ic1 = bc1 * factor;
-			float ic2 = bc2 * factor;
-			if (ic0 < 0 || ic1 < 0 || ic2 < 0) continue;
-			int db_index = y * db_stride + x;
+		float ic0 = (float)(e0 + E->bias0) * factor;
+		float ic1 = (float)(e1 + E->bias1) * factor;
+		float ic2 = (float)(e2 + E->bias2) * factor;
 
-			float w = 1 / (ic0 * w0 + ic1 * w1 + ic2 * w2);
-			float z = (ic0 * z0 + ic1 * z1 + ic2 * z2) * w;
+		float w = 1 / (ic0 * w0 + ic1 * w1 + ic2 * w2);
+		float z = (ic0 * z0 + ic1 * z1 + ic2 * z2) * w;
 
 #ifndef SOFTGPU_DISABLE_ZBUFFER
-			if (depthTest && (z < 0 || z > depthBuffer[db_index])) continue;
-			if (!colWrite) {
-				if (depthWrite) depthBuffer[db_index] = z;
-				continue;
-			}
+		if (depthTest && (z < 0 || z > depthBuffer[db_index])) continue;
+		if (!colWrite) {
+			if (depthWrite) depthBuffer[db_index] = z;
+			continue;
+		}
 #else
-			if (!colWrite) continue;
+		if (!colWrite) continue;
 #endif
 
-			if (texturing) {
-				float u = (ic0 * u0 + ic1 * u1 + ic2 * u2) * w;
-				float v = (ic0 * v0 + ic1 * v1 + ic2 * v2) * w;
-				int texX = ((int)(Math_AbsF(u - FastFloor(u)) * curTexWidth )) & texWidthMask;
-				int texY = ((int)(Math_AbsF(v - FastFloor(v)) * curTexHeight)) & texHeightMask;
+		if (texturing) {
+			float u = (ic0 * u0 + ic1 * u1 + ic2 * u2) * w;
+			float v = (ic0 * v0 + ic1 * v1 + ic2 * v2) * w;
+			/* Texture dimensions are powers of two, so masking the integer texel coordinate */
+			/*  discards the whole texture repeats (same as sampling with only the fraction of u/v) */
+			int texX = FastFloor(u * texWidth)  & texWidthMask;
+			int texY = FastFloor(v * texHeight) & texHeightMask;
 
-				int texIndex = texY * curTexWidth + texX;
-				BitmapCol tColor = curTexPixels[texIndex];
+			BitmapCol tColor = tex->pixels[TexelIndex(tex, texX, texY)];
 
-				MultiplyColors(color, tColor);
-			}
+			MultiplyColors(color, tColor);
+		}
 
-			if (gfx_alphaTest && A < 0x80) continue;
+		if (alphaTest && A < 0x80) continue;
 #ifndef SOFTGPU_DISABLE_ZBUFFER
-			if (depthWrite) depthBuffer[db_index] = z;
+		if (depthWrite) depthBuffer[db_index] = z;
 #endif
-			int cb_index = y * cb_stride + x;
-			
-			if (!gfx_alphaBlend) {
-				colorBuffer[cb_index] = BitmapCol_Make(R, G, B, 0xFF);
-				continue;
-			}
+		int cb_index = y * cb_stride + x;
+		int srcR = R, srcG = G, srcB = B;
+
+		if (fogging) {
+			/* W is distance from the camera here */
+			int visibility = fog_table[FogIndex(w)];
+			srcR = (R * visibility + fog_R * (256 - visibility)) >> 8;
+			srcG = (G * visibility + fog_G * (256 - visibility)) >> 8;
+			srcB = (B * visibility + fog_B * (256 - visibility)) >> 8;
+		}
+		
+		if (!alphaBlend) {
+			colorBuffer[cb_index] = BitmapCol_Make(srcR, srcG, srcB, 0xFF);
+			continue;
+		}
 
-			BitmapCol dst = colorBuffer[cb_index];
-			int dstR = BitmapCol_R(dst);
-			int dstG = BitmapCol_G(dst);
-			int dstB = BitmapCol_B(dst);
+		BitmapCol dst = colorBuffer[cb_index];
+		int dstR = BitmapCol_R(dst);
+		int dstG = BitmapCol_G(dst);
+		int dstB = BitmapCol_B(dst);
 
-			int finR = (R * A + dstR * (255 - A)) >> 8;
-			int finG = (G * A + dstG * (255 - A)) >> 8;
-			int finB = (B * A + dstB * (255 - A)) >> 8;
-			colorBuffer[cb_index] = BitmapCol_Make(finR, finG, finB, 0xFF);
-		}
+		int finR = (srcR * A + dstR * (255 - A)) >> 8;
+		int finG = (srcG * A + dstG * (255 - A)) >> 8;
+		int finB = (srcB * A + dstB * (255 - A)) >> 8;
+		colorBuffer[cb_index] = BitmapCol_Make(finR, finG, finB, 0xFF);
 	}
 }
 
-#define V0_VIS (1 << 0)
-#define V1_VIS (1 << 1)
-#define V2_VIS (1 << 2)
-#define V3_VIS (1 << 3)
-
-// https://github.com/behindthepixels/EDXRaster/blob/master/EDXRaster/Core/Clipper.h
-static void ClipLine(Vertex* v1, Vertex* v2, Vertex* V) {
-	float t  = Math_AbsF(v1->z / (v2->z - v1->z));
-	float invt = 1.0f - t;
-	
-	V->x = invt * v1->x + t * v2->x;
-	V->y = invt * v1->y + t * v2->y;
-	//V->z = invt * v1->z + t * v2->z;
-	V->z = 0.0f; // clipped against near plane anyways (I.e Z/W = 0 --> Z = 0)
-	V->w = invt * v1->w + t * v2->w;
-	
-	V->u = invt * v1->u + t * v2->u;
-	V->v = invt * v1->v + t * v2->v;
-	V->c = v1->c;
+static void RasterRow3D(struct RastSetup3D* t, int y, int minX, int maxX) {
+	RasterRow3D_Core(t, y, minX, maxX, t->mode);
 }
 
-// https://casual-effects.com/research/McGuire2011Clipping/clip.glsl
-static void DrawClipped(int mask, Vertex* v0, Vertex* v1, Vertex* v2, Vertex* v3) {
-	Vertex tmp[2];
-	Vertex* a = &tmp[0];
-	Vertex* b = &tmp[1];
-
-    switch (mask) {
-	case V0_VIS:
+#ifdef SOFTGPU_SSE2
+#define SSE2_Blend(mask, a, b) _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+
+/* Rasterises pixels minX to maxX of the given row of a 3D triangle, 4 pixels at a time */
+/* NOTE: Pixels outside minX to maxX in the same 4 pixel group are read and then written back */
+/*  unchanged. This is fine since 4 pixel groups never cross a tile boundary, and any group */
+/*  that would go past the end of a framebuffer row is instead rasterised one pixel at a time */
+static RAST_FORCE_INLINE void RasterRow3D_SSE2(struct RastSetup3D* t, int y, int minX, int maxX, int mode) {
+	struct RastState* s = t->s;
+	struct RastEdges* E = &t->edges;
+	struct TexSampler* tex = &t->tex;
+	cc_bool depthTest  = s->flags & RAST_DEPTH_TEST;
+	cc_bool depthWrite = s->flags & RAST_DEPTH_WRITE;
+	cc_bool colWrite   = s->flags & RAST_COLOR_WRITE;
+	cc_bool alphaTest  = mode & RAST_ALPHA_TEST;
+	cc_bool alphaBlend = mode & RAST_ALPHA_BLEND;
+	cc_bool fogging    = s->flags & RAST_FOG;
+	cc_bool texturing  = mode & RAST_TEXTURED;
+	int x = minX & ~3, i;
+
+	__m128 zero   = _mm_setzero_ps();
+	__m128 factor = _mm_set1_ps(E->factor);
+	__m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+	__m128i minXs = _mm_set1_epi32(minX - 1);
+	__m128i maxXs = _mm_set1_epi32(maxX + 1);
+	__m128i alphaMask = _mm_set1_epi32((int)BITMAPCOLOR_A_MASK);
+	__m128i byteMask  = _mm_set1_epi32(0xFF);
+	__m128i izero     = _mm_setzero_si128();
+
+	/* Caller has already checked that edge functions fit in 32 bits */
+	cc_int64 row0 = E->e0 + (y - E->originY) * E->dy0;
+	cc_int64 row1 = E->e1 + (y - E->originY) * E->dy1;
+	cc_int64 row2 = E->e2 + (y - E->originY) * E->dy2;
+	int dx0 = (int)E->dx0, dx1 = (int)E->dx1, dx2 = (int)E->dx2;
+	__m128i step0 = _mm_set_epi32(dx0 * 3, dx0 * 2, dx0, 0);
+	__m128i step1 = _mm_set_epi32(dx1 * 3, dx1 * 2, dx1, 0);
+	__m128i step2 = _mm_set_epi32(dx2 * 3, dx2 * 2, dx2, 0);
+	__m128i bias0 = _mm_set1_epi32(E->bias0);
+	__m128i bias1 = _mm_set1_epi32(E->bias1);
+	__m128i bias2 = _mm_set1_epi32(E->bias2);
+	__m128i negOne = _mm_set1_epi32(-1);
+
+	BitmapCol vColor = BitmapCol_Make(PackedCol_R(t->color), PackedCol_G(t->color), 
+									  PackedCol_B(t->color), PackedCol_A(t->color));
+	__m128i vColor16 = _mm_unpacklo_epi8(_mm_set1_epi32((int)vColor), izero);
+	__m128i flatColor = _mm_set1_epi32((int)BitmapCol_Make(t->R, t->G, t->B, t->A));
+	__m128 texWidth   = _mm_set1_ps((float)tex->width);
+	__m128 texHeight  = _mm_set1_ps((float)tex->height);
+	__m128i texWidthMask  = _mm_set1_epi32(tex->widthMask);
+	__m128i texHeightMask = _mm_set1_epi32(tex->heightMask);
+	__m128i tileMaskX     = _mm_set1_epi32(tex->tileMaskX);
+	__m128i tileMaskY     = _mm_set1_epi32(tex->tileMaskY);
+	__m128i widthShift    = _mm_cvtsi32_si128(tex->widthShift);
+	__m128i tileShiftX    = _mm_cvtsi32_si128(tex->tileShiftX);
+	__m128i tileShiftY    = _mm_cvtsi32_si128(tex->tileShiftY);
+
+	__m128 fogScale = _mm_set1_ps(fog_scale);
+	__m128 fogMax   = _mm_set1_ps(FOG_TABLE_SIZE - 1.0f);
+	__m128i fogColor16 = _mm_unpacklo_epi8(_mm_set1_epi32((int)BitmapCol_Make(fog_R, fog_G, fog_B, 0)), izero);
+
+	for (; x <= maxX; x += 4)
 	{
-		//		   v0
-		//		  / |
-		//       /   |
-		// .....A....B...
-		//    /      |
-		//  v3--v2---v1
-		ClipLine(v3, v0, a);
-		ClipLine(v0, v1, b);
+		/* Group would go past the end of the framebuffer row */
+		if (x + 3 >= fb_width) {
+			RasterRow3D(t, y, max(x, minX), maxX); return;
+		}
 
-		ViewportVertex3D(v0);
-		ViewportVertex3D(a);
-		ViewportVertex3D(b);
+		__m128i xs  = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+		__m128i valid = _mm_and_si128(_mm_cmpgt_epi32(xs, minXs), _mm_cmplt_epi32(xs, maxXs));
 
-		DrawTriangle3D(v0, a, b);
-	}
-    break;
-	case V1_VIS:
-	{
-		//		   v1
-		//		  / |
-		//       /   |
-		// ....A.....B...
-		//    /      |
-		//  v0--v3---v2
-		ClipLine(v0, v1, a);
-		ClipLine(v1, v2, b);
+		__m128i e0 = _mm_add_epi32(_mm_set1_epi32((int)(row0 + (x - E->originX) * E->dx0)), step0);
+		__m128i e1 = _mm_add_epi32(_mm_set1_epi32((int)(row1 + (x - E->originX) * E->dx1)), step1);
+		__m128i e2 = _mm_add_epi32(_mm_set1_epi32((int)(row2 + (x - E->originX) * E->dx2)), step2);
 
-		ViewportVertex3D(v1);
-		ViewportVertex3D(a);
-		ViewportVertex3D(b);
+		__m128i inside = _mm_cmpgt_epi32(_mm_or_si128(e0, _mm_or_si128(e1, e2)), negOne);
+		__m128i mask   = _mm_and_si128(valid, inside);
+		if (!_mm_movemask_epi8(mask)) continue;
 
-		DrawTriangle3D(a, b, v1);
-	} break;
-	case V2_VIS:
-	{
-		//		   v2
-		//		  / |
-		//       /   |
-		// ....A.....B...
-		//    /      |
-		//  v1--v0---v3
-		ClipLine(v1, v2, a);
-		ClipLine(v2, v3, b);
+		__m128 ic0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(e0, bias0)), factor);
+		__m128 ic1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(e1, bias1)), factor);
+		__m128 ic2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(e2, bias2)), factor);
 
-		ViewportVertex3D(v2);
-		ViewportVertex3D(a);
-		ViewportVertex3D(b);
+		__m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ic0, _mm_set1_ps(t->w0)), 
+										 _mm_mul_ps(ic1, _mm_set1_ps(t->w1))),
+										 _mm_mul_ps(ic2, _mm_set1_ps(t->w2)));
+		w = _mm_div_ps(_mm_set1_ps(1.0f), w);
 
-		DrawTriangle3D(a, b, v2);
-	} break;
-	case V3_VIS:
-	{
-		//		   v3
-		//		  / |
-		//       /   |
-		// ....A.....B...
-		//    /      |
-		//  v2--v1---v0
-		ClipLine(v2, v3, a);
-		ClipLine(v3, v0, b);
+		__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ic0, _mm_set1_ps(t->z0)), 
+										 _mm_mul_ps(ic1, _mm_set1_ps(t->z1))),
+										 _mm_mul_ps(ic2, _mm_set1_ps(t->z2)));
+		z = _mm_mul_ps(z, w);
 
-		ViewportVertex3D(v3);
-		ViewportVertex3D(a);
-		ViewportVertex3D(b);
-		
-		DrawTriangle3D(b, v3, a);
-	}
-	break;
-	case V0_VIS | V1_VIS:
+		int db_index = y * db_stride + x;
+		__m128 depth = _mm_loadu_ps(depthBuffer + db_index);
+
+		if (depthTest) {
+			__m128 pass = _mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, depth));
+			mask = _mm_and_si128(mask, _mm_castps_si128(pass));
+			if (!_mm_movemask_epi8(mask)) continue;
+		}
+
+		if (!colWrite) {
+			if (depthWrite) {
+				depth = _mm_castsi128_ps(SSE2_Blend(mask, _mm_castps_si128(z), _mm_castps_si128(depth)));
+				_mm_storeu_ps(depthBuffer + db_index, depth);
+			}
+			continue;
+		}
+
+		__m128i col;
+		if (texturing) {
+			__m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ic0, _mm_set1_ps(t->u0)), 
+											 _mm_mul_ps(ic1, _mm_set1_ps(t->u1))),
+											 _mm_mul_ps(ic2, _mm_set1_ps(t->u2)));
+			__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ic0, _mm_set1_ps(t->v0)), 
+											 _mm_mul_ps(ic1, _mm_set1_ps(t->v1))),
+											 _mm_mul_ps(ic2, _mm_set1_ps(t->v2)));
+			u = _mm_mul_ps(_mm_mul_ps(u, w), texWidth);
+			v = _mm_mul_ps(_mm_mul_ps(v, w), texHeight);
+
+			/* Same as FastFloor, i.e. truncate then subtract 1 when truncated value is larger */
+			__m128i texX = _mm_cvttps_epi32(u);
+			__m128i texY = _mm_cvttps_epi32(v);
+			texX = _mm_add_epi32(texX, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(texX), u)));
+			texY = _mm_add_epi32(texY, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(texY), v)));
+			texX = _mm_and_si128(texX, texWidthMask);
+			texY = _mm_and_si128(texY, texHeightMask);
+
+			/* Same as TexelIndex */
+			__m128i texIndex = _mm_add_epi32(
+				_mm_add_epi32(_mm_sll_epi32(_mm_andnot_si128(tileMaskY, texY), widthShift),
+							  _mm_sll_epi32(_mm_andnot_si128(tileMaskX, texX), tileShiftY)),
+				_mm_add_epi32(_mm_sll_epi32(_mm_and_si128(texY, tileMaskY), tileShiftX),
+							  _mm_and_si128(texX, tileMaskX)));
+
+			/* SSE2 has no gather instruction, so texels have to be fetched one by one */
+			int texIndices[4];
+			BitmapCol texels[4];
+			_mm_storeu_si128((__m128i*)texIndices, texIndex);
+
+			for (i = 0; i < 4; i++) 
+			{
+				texels[i] = tex->pixels[texIndices[i]];
+			}
+			col = _mm_loadu_si128((__m128i*)texels);
+
+			/* Same as MultiplyColors, but for every channel of 4 pixels at once */
+			__m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(col, izero), vColor16), 8);
+			__m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(col, izero), vColor16), 8);
+			col = _mm_packus_epi16(lo, hi);
+		} else {
+			col = flatColor;
+		}
+
+		__m128i alpha = _mm_and_si128(_mm_srli_epi32(col, BITMAPCOLOR_A_SHIFT), byteMask);
+		if (alphaTest) {
+			mask = _mm_and_si128(mask, _mm_cmpgt_epi32(alpha, _mm_set1_epi32(0x7F)));
+			if (!_mm_movemask_epi8(mask)) continue;
+		}
+
+		if (depthWrite) {
+			depth = _mm_castsi128_ps(SSE2_Blend(mask, _mm_castps_si128(z), _mm_castps_si128(depth)));
+			_mm_storeu_ps(depthBuffer + db_index, depth);
+		}
+
+		if (fogging) {
+			/* Same as scalar fog, i.e. (src * visibility + fog * (256 - visibility)) >> 8 */
+			/* NOTE: W is garbage for pixels outside the triangle, so index must always be clamped */
+			__m128 index = _mm_max_ps(_mm_min_ps(_mm_mul_ps(w, fogScale), fogMax), zero);
+			int fogIndex[4];
+			_mm_storeu_si128((__m128i*)fogIndex, _mm_cvttps_epi32(index));
+			__m128i vis = _mm_set_epi32(fog_table[fogIndex[3]], fog_table[fogIndex[2]],
+										fog_table[fogIndex[1]], fog_table[fogIndex[0]]);
+
+			__m128i vis2 = _mm_or_si128(vis, _mm_slli_epi32(vis, 16));
+			__m128i vLo  = _mm_unpacklo_epi32(vis2, vis2);
+			__m128i vHi  = _mm_unpackhi_epi32(vis2, vis2);
+			__m128i full = _mm_set1_epi16(256);
+
+			__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(col, izero), vLo),
+							_mm_mullo_epi16(fogColor16, _mm_sub_epi16(full, vLo)));
+			__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(col, izero), vHi),
+							_mm_mullo_epi16(fogColor16, _mm_sub_epi16(full, vHi)));
+			col = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+		}
+
+		int cb_index = y * cb_stride + x;
+		__m128i dst  = _mm_loadu_si128((__m128i*)(colorBuffer + cb_index));
+
+		if (alphaBlend) {
+			/* Same as scalar blending, i.e. (src * A + dst * (255 - A)) >> 8 */
+			__m128i alpha2 = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+			__m128i aLo    = _mm_unpacklo_epi32(alpha2, alpha2);
+			__m128i aHi    = _mm_unpackhi_epi32(alpha2, alpha2);
+			__m128i inv    = _mm_set1_epi16(255);
+
+			__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(col, izero), aLo),
+							_mm_mullo_epi16(_mm_unpacklo_epi8(dst, izero), _mm_sub_epi16(inv, aLo)));
+			__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(col, izero), aHi),
+							_mm_mullo_epi16(_mm_unpackhi_epi8(dst, izero), _mm_sub_epi16(inv, aHi)));
+			col = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+		}
+
+		col = _mm_or_si128(col, alphaMask);
+		_mm_storeu_si128((__m128i*)(colorBuffer + cb_index), SSE2_Blend(mask, col, dst));
+	}
+}
+#define RasterRow3D_Fast RasterRow3D_SSE2
+#else
+#define RasterRow3D_Fast RasterRow3D_Core
+#endif
+
+/* Specialised versions of the row rasteriser for the most common modes, */
+/*  so the branches for disabled features are removed from the inner loop entirely */
+/* NOTE: These all require that edge functions fit in 32 bits */
+typedef void (*RastRowFunc)(struct RastSetup3D* t, int y, int minX, int maxX);
+
+static void RasterRow3D_Generic(struct RastSetup3D* t, int y, int minX, int maxX) {
+	RasterRow3D_Fast(t, y, minX, maxX, t->mode);
+}
+static void RasterRow3D_Coloured(struct RastSetup3D* t, int y, int minX, int maxX) {
+	RasterRow3D_Fast(t, y, minX, maxX, 0);
+}
+static void RasterRow3D_TexturedAlphaTest(struct RastSetup3D* t, int y, int minX, int maxX) {
+	RasterRow3D_Fast(t, y, minX, maxX, RAST_TEXTURED | RAST_ALPHA_TEST);
+}
+static void RasterRow3D_TexturedAlphaBlend(struct RastSetup3D* t, int y, int minX, int maxX) {
+	RasterRow3D_Fast(t, y, minX, maxX, RAST_TEXTURED | RAST_ALPHA_BLEND);
+}
+
+static RastRowFunc SelectRowFunc(struct RastSetup3D* t) {
+	if (!t->fits32) return RasterRow3D;
+
+	switch (t->mode)
+	{
+	case 0:                                 return RasterRow3D_Coloured;
+	case RAST_TEXTURED | RAST_ALPHA_TEST:   return RasterRow3D_TexturedAlphaTest;
+	case RAST_TEXTURED | RAST_ALPHA_BLEND:  return RasterRow3D_TexturedAlphaBlend;
+	}
+	return RasterRow3D_Generic;
+}
+
+#ifndef SOFTGPU_DISABLE_ZBUFFER
+/* Recalculates the largest depth value in the given 8x8 pixel block, after depth values in it were written */
+static void HiZ_UpdateBlock(int bx, int by) {
+	int minX = bx << 3, maxX = min(minX + 7, fb_width  - 1);
+	int minY = by << 3, maxY = min(minY + 7, fb_height - 1);
+	float maxZ = 0.0f;
+	int x, y;
+
+	for (y = minY; y <= maxY; y++)
+	{
+		float* row = depthBuffer + y * db_stride;
+		for (x = minX; x <= maxX; x++) 
+		{
+			maxZ = max(maxZ, row[x]);
+		}
+	}
+	hiZBuffer[by * hiZ_stride + bx] = maxZ;
+}
+
+/* Whether every block overlapping the given rectangle only contains depth values in front of minZ */
+static cc_bool HiZ_Occluded(float minZ, int minX, int minY, int maxX, int maxY) {
+	int bx, by;
+
+	for (by = minY >> 3; by <= (maxY >> 3); by++)
+		for (bx = minX >> 3; bx <= (maxX >> 3); bx++)
+	{
+		if (minZ <= hiZBuffer[by * hiZ_stride + bx]) return false;
+	}
+	return true;
+}
+#endif
+
+/* Whether the given edge function is negative for every pixel in the given block */
+static CC_INLINE cc_bool EdgeOutsideBlock(cc_int64 e, cc_int64 dx, cc_int64 dy, int width, int height) {
+	/* Edge functions are linear, so their largest value in a block is at one of the corners */
+	return e + (dx > 0 ? dx * width : 0) + (dy > 0 ? dy * height : 0) < 0;
+}
+
+/* Whether the given edge function fits in 32 bits everywhere within the given rectangle */
+static CC_INLINE cc_bool EdgeFits32(cc_int64 e, cc_int64 dx, cc_int64 dy, int width, int height) {
+	/* 4 pixel groups may start up to 3 pixels before or end up to 3 pixels after the rectangle */
+	cc_int64 bound = (e < 0 ? -e : e) + (dx < 0 ? -dx : dx) * (width + 6) + (dy < 0 ? -dy : dy) * height;
+	return bound < ((cc_int64)1 << 30);
+}
+
+/* Rasterises the portion of the given 3D triangle within the given rectangle */
+static void RasterTriangle3D(struct RastTriangle* tri, int minX, int minY, int maxX, int maxY) {
+	struct RastSetup3D t;
+	struct RastEdges* E  = &t.edges;
+	struct RastState* s = &rast_states[tri->state];
+	Vertex* V0 = &tri->v[0];
+	Vertex* V1 = &tri->v[1];
+	Vertex* V2 = &tri->v[2];
+	int a1, r1, g1, b1;
+	int a2, r2, g2, b2;
+	int R, G, B, A;
+	int bx, by, y;
+
+#ifndef SOFTGPU_DISABLE_ZBUFFER
+	/* Depth of a pixel is a weighted average of the depths at the vertices, so can't be smaller */
+	/*  than the smallest vertex depth. (small margin is for floating point rounding error) */
+	float minZ = min(V0->z / V0->w, min(V1->z / V1->w, V2->z / V2->w));
+	minZ -= Math_AbsF(minZ) * (1.0f / (1 << 20));
+
+	cc_bool hiZTest  = (s->flags & RAST_DEPTH_TEST) != 0;
+	cc_bool hiZWrite = (s->flags & RAST_DEPTH_WRITE) != 0;
+	/* Quick rejection of triangles that are entirely behind what has already been drawn */
+	if (hiZTest && HiZ_Occluded(minZ, minX, minY, maxX, maxY)) return;
+#endif
+
+	SetupEdges(E, tri, minX, minY);
+	t.s      = s;
+	t.fits32 = EdgeFits32(E->e0, E->dx0, E->dy0, maxX - minX, maxY - minY) &&
+			   EdgeFits32(E->e1, E->dx1, E->dy1, maxX - minX, maxY - minY) &&
+			   EdgeFits32(E->e2, E->dx2, E->dy2, maxX - minX, maxY - minY);
+
+	t.w0 = V0->w; t.w1 = V1->w; t.w2 = V2->w;
+	t.z0 = V0->z; t.z1 = V1->z; t.z2 = V2->z;
+	t.u0 = V0->u; t.u1 = V1->u; t.u2 = V2->u;
+	t.v0 = V0->v; t.v1 = V1->v; t.v2 = V2->v;
+	t.color = V0->c;
+
+	t.tex = s->tex;
+	if (tri->mipLevel) {
+		int lvlWidth  = t.tex.width, lvlHeight = t.tex.height;
+		BitmapCol* pixels = t.tex.pixels + MipLevelOffset(tri->mipLevel, &lvlWidth, &lvlHeight);
+		SetupSampler(&t.tex, pixels, lvlWidth, lvlHeight);
+	}
+
+	t.mode = s->flags & (RAST_TEXTURED | RAST_ALPHA_TEST | RAST_ALPHA_BLEND);
+	if (!(t.mode & RAST_TEXTURED)) {
+		R = PackedCol_R(t.color);
+		G = PackedCol_G(t.color);
+		B = PackedCol_B(t.color);
+		A = PackedCol_A(t.color);
+	} else if (t.tex.width == 1 && t.tex.height == 1) {
+		/* Don't need to calculate complicated texturing in this case */
+		MultiplyColors(t.color, t.tex.pixels[0]);
+		t.mode &= ~RAST_TEXTURED;
+	} else {
+		R = G = B = A = 0;
+	}
+	t.R = R; t.G = G; t.B = B; t.A = A;
+	RastRowFunc rasterRow = SelectRowFunc(&t);
+
+	/* Skip 8x8 pixel blocks that are entirely outside the triangle */
+	for (by = minY & ~7; by <= maxY; by += 8)
+	{
+		int bMinY = max(by, minY), bMaxY = min(by + 7, maxY);
+		int dy    = bMinY - minY;
+
+		for (bx = minX & ~7; bx <= maxX; bx += 8)
+		{
+			int bMinX = max(bx, minX), bMaxX = min(bx + 7, maxX);
+			int dx    = bMinX - minX;
+			int w     = bMaxX - bMinX, h = bMaxY - bMinY;
+#ifndef SOFTGPU_DISABLE_ZBUFFER
+			if (hiZTest && minZ > hiZBuffer[(by >> 3) * hiZ_stride + (bx >> 3)]) continue;
+#endif
+
+			if (EdgeOutsideBlock(E->e0 + dy * E->dy0 + dx * E->dx0, E->dx0, E->dy0, w, h)) continue;
+			if (EdgeOutsideBlock(E->e1 + dy * E->dy1 + dx * E->dx1, E->dx1, E->dy1, w, h)) continue;
+			if (EdgeOutsideBlock(E->e2 + dy * E->dy2 + dx * E->dx2, E->dx2, E->dy2, w, h)) continue;
+
+			for (y = bMinY; y <= bMaxY; y++) 
+			{
+				rasterRow(&t, y, bMinX, bMaxX);
+			}
+#ifndef SOFTGPU_DISABLE_ZBUFFER
+			if (hiZWrite) HiZ_UpdateBlock(bx >> 3, by >> 3);
+#endif
+		}
+	}
+}
+
+static void RasterTriangle(struct RastTriangle* tri, int minX, int minY, int maxX, int maxY) {
+	if (rast_states[tri->state].flags & RAST_2D) {
+		RasterTriangle2D(tri, minX, minY, maxX, maxY);
+	} else {
+		RasterTriangle3D(tri, minX, minY, maxX, maxY);
+	}
+}
+
+
+/*########################################################################################################################*
+*--------------------------------------------------------Tile binning-----------------------------------------------------*
+*#########################################################################################################################*/
+#ifdef SOFTGPU_DISABLE_BINNING
+static void SubmitTriangle(struct RastTriangle* tri) {
+	tri->state = rast_curState;
+	RasterTriangle(tri, tri->minX, tri->minY, tri->maxX, tri->maxY);
+}
+
+static void FlushTriangles(void) { 
+	rast_numStates = 0;
+	rast_curState  = -1;
+}
+static void DiscardTriangles(void) { }
+static void InitTileBins(void) { }
+static void FreeTileBins(void) { }
+#else
+/* Triangles are first sorted into bins of 64x64 pixel screen tiles, and then later */
+/*  all the tiles are rasterised in parallel by the worker threads and calling thread. */
+/* Since tiles never overlap and each bin preserves the order triangles were submitted in, */
+/*  the final output is identical to rasterising every triangle in order on one thread */
+#define RAST_TILE_SHIFT 6
+#define RAST_TILE_SIZE  (1 << RAST_TILE_SHIFT)
+#define RAST_MAX_TRIS   8192
+#define RAST_WORKERS    3 /* Calling thread also rasterises tiles */
+/* Below this many triangles, it's faster to just rasterise on the calling thread */
+#define RAST_MIN_PARALLEL_TRIS 64
+
+static struct RastTriangle* rast_tris;
+static int rast_numTris;
+
+static int tiles_x, tiles_y, tiles_count;
+static int* bin_starts;  /* Index into bin_items of each tile's first triangle */
+static int* bin_cursor;  /* Index into bin_items of where to put each tile's next triangle */
+static int* bin_items;   /* Indices of the triangles that overlap each tile */
+static int  bin_capacity;
+
+static void* rast_mutex;
+static void* rast_done;
+static void* rast_wakeups[RAST_WORKERS];
+static int rast_nextTile, rast_busyWorkers, rast_startedWorkers;
+
+static void RasterTile(int tile) {
+	struct RastTriangle* tri;
+	int tMinX = (tile % tiles_x) << RAST_TILE_SHIFT;
+	int tMinY = (tile / tiles_x) << RAST_TILE_SHIFT;
+	int tMaxX = tMinX + RAST_TILE_SIZE - 1;
+	int tMaxY = tMinY + RAST_TILE_SIZE - 1;
+	int i;
+
+	for (i = bin_starts[tile]; i < bin_starts[tile + 1]; i++)
+	{
+		tri = &rast_tris[bin_items[i]];
+		RasterTriangle(tri, max(tri->minX, tMinX), max(tri->minY, tMinY),
+							min(tri->maxX, tMaxX), min(tri->maxY, tMaxY));
+	}
+}
+
+/* Rasterises tiles until there are no more tiles left to rasterise */
+static void RasterTiles(void) {
+	int tile;
+
+	for (;;) {
+		Mutex_Lock(rast_mutex);
+		tile = rast_nextTile++;
+		Mutex_Unlock(rast_mutex);
+
+		if (tile >= tiles_count) return;
+		RasterTile(tile);
+	}
+}
+
+static void RastWorker_Run(void) {
+	int id;
+	Mutex_Lock(rast_mutex);
+	id = rast_startedWorkers++;
+	Mutex_Unlock(rast_mutex);
+
+	for (;;) {
+		Waitable_Wait(rast_wakeups[id]);
+		RasterTiles();
+
+		Mutex_Lock(rast_mutex);
+		{
+			if (--rast_busyWorkers == 0) Waitable_Signal(rast_done);
+		}
+		Mutex_Unlock(rast_mutex);
+	}
+}
+
+static void RastWorkers_Start(void) {
+	void* thread;
+	int i;
+	if (rast_mutex) return;
+
+	rast_mutex = Mutex_Create("Raster tiles");
+	rast_done  = Waitable_Create("Raster done");
+	rast_tris  = (struct RastTriangle*)Mem_Alloc(RAST_MAX_TRIS, sizeof(struct RastTriangle), "triangle bins");
+
+	for (i = 0; i < RAST_WORKERS; i++) {
+		rast_wakeups[i] = Waitable_Create("Raster wakeup");
+		Thread_Run(&thread, RastWorker_Run, 64 * 1024, "Raster worker");
+		Thread_Detach(thread);
+	}
+}
+
+#define TileRange(tri) \
+	minTX = tri->minX >> RAST_TILE_SHIFT; maxTX = min(tri->maxX >> RAST_TILE_SHIFT, tiles_x - 1); \
+	minTY = tri->minY >> RAST_TILE_SHIFT; maxTY = min(tri->maxY >> RAST_TILE_SHIFT, tiles_y - 1);
+
+/* Sorts the pending triangles into the bins of the tiles they overlap */
+static void BinTriangles(void) {
+	struct RastTriangle* tri;
+	int minTX, minTY, maxTX, maxTY;
+	int i, x, y, tile, total = 0;
+
+	for (i = 0; i <= tiles_count; i++) bin_starts[i] = 0;
+
+	/* Count number of triangles in each tile */
+	for (i = 0; i < rast_numTris; i++)
+	{
+		tri = &rast_tris[i];
+		TileRange(tri);
+
+		for (y = minTY; y <= maxTY; y++)
+			for (x = minTX; x <= maxTX; x++)
+		{
+			bin_starts[y * tiles_x + x + 1]++;
+		}
+		total += (maxTX - minTX + 1) * (maxTY - minTY + 1);
+	}
+
+	if (total > bin_capacity) {
+		bin_capacity = total + total / 2;
+		bin_items    = (int*)Mem_Realloc(bin_items, bin_capacity, 4, "tile bins");
+	}
+
+	for (tile = 0; tile < tiles_count; tile++)
+	{
+		bin_starts[tile + 1] += bin_starts[tile];
+		bin_cursor[tile]      = bin_starts[tile];
+	}
+
+	/* Triangles are added in submission order, so draw order is preserved within each tile */
+	for (i = 0; i < rast_numTris; i++)
+	{
+		tri = &rast_tris[i];
+		TileRange(tri);
+
+		for (y = minTY; y <= maxTY; y++)
+			for (x = minTX; x <= maxTX; x++)
+		{
+			tile = y * tiles_x + x;
+			bin_items[bin_cursor[tile]++] = i;
+		}
+	}
+}
+
+static void FlushTriangles(void) {
+	int i, busy;
+	if (!rast_numTris) return;
+	BinTriangles();
+
+	Mutex_Lock(rast_mutex);
+	{
+		rast_nextTile    = 0;
+		rast_busyWorkers = rast_numTris >= RAST_MIN_PARALLEL_TRIS ? RAST_WORKERS : 0;
+		busy = rast_busyWorkers;
+	}
+	Mutex_Unlock(rast_mutex);
+
+	for (i = 0; i < busy; i++) Waitable_Signal(rast_wakeups[i]);
+	RasterTiles();
+
+	/* Wait for the workers to finish rasterising their last tiles */
+	while (busy) {
+		Waitable_Wait(rast_done);
+
+		Mutex_Lock(rast_mutex);
+		busy = rast_busyWorkers;
+		Mutex_Unlock(rast_mutex);
+	}
+
+	rast_numTris   = 0;
+	rast_numStates = 0;
+	rast_curState  = -1;
+}
+
+static void DiscardTriangles(void) {
+	rast_numTris   = 0;
+	rast_numStates = 0;
+	rast_curState  = -1;
+}
+
+static void SubmitTriangle(struct RastTriangle* tri) {
+	if (rast_numTris == RAST_MAX_TRIS) FlushTriangles();
+	/* Flushing discards the state table, so state needs to be recaptured */
+	if (rast_curState < 0) CaptureState();
+
+	tri->state = rast_curState;
+	rast_tris[rast_numTris++] = *tri;
+}
+
+static void FreeTileBins(void) {
+	Mem_Free(bin_starts);
+	Mem_Free(bin_cursor);
+	bin_starts = NULL;
+	bin_cursor = NULL;
+}
+
+static void InitTileBins(void) {
+	FreeTileBins();
+	tiles_x     = (fb_width  + RAST_TILE_SIZE - 1) >> RAST_TILE_SHIFT;
+	tiles_y     = (fb_height + RAST_TILE_SIZE - 1) >> RAST_TILE_SHIFT;
+	tiles_count = tiles_x * tiles_y;
+
+	bin_starts = (int*)Mem_Alloc(tiles_count + 1, 4, "tile bin starts");
+	bin_cursor = (int*)Mem_Alloc(tiles_count,     4, "tile bin cursors");
+	RastWorkers_Start();
+}
+#endif
+
+/* Computes screen bounds of the given triangle, returning false if entirely outside the scissor rectangle */
+static cc_bool CalcTriangleBounds(struct RastTriangle* tri) {
+	int x0 = tri->fx[0], y0 = tri->fy[0];
+	int x1 = tri->fx[1], y1 = tri->fy[1];
+	int x2 = tri->fx[2], y2 = tri->fy[2];
+
+	/* Pixels whose centres might be inside the triangle */
+	int minX = (min(x0, min(x1, x2)) + RAST_SUBPIXEL_HALF - 1) >> RAST_SUBPIXEL_BITS;
+	int minY = (min(y0, min(y1, y2)) + RAST_SUBPIXEL_HALF - 1) >> RAST_SUBPIXEL_BITS;
+	int maxX = (max(x0, max(x1, x2)) - RAST_SUBPIXEL_HALF)     >> RAST_SUBPIXEL_BITS;
+	int maxY = (max(y0, max(y1, y2)) - RAST_SUBPIXEL_HALF)     >> RAST_SUBPIXEL_BITS;
+
+	// Reject triangles completely outside
+	if (maxX < 0 || minX > fb_maxX) return false;
+	if (maxY < 0 || minY > fb_maxY) return false;
+
+	// Perform scissoring
+	tri->minX = max(minX, 0); tri->maxX = min(maxX, fb_maxX);
+	tri->minY = max(minY, 0); tri->maxY = min(maxY, fb_maxY);
+	/* Triangle might be too small to cover any pixel centres */
+	return tri->minX <= tri->maxX && tri->minY <= tri->maxY;
+}
+
+/* Picks the mipmap level whose texels are closest in size to the pixels covered by the given triangle */
+/* NOTE: Picking just one level for the entire triangle means a lot fewer cache misses when */
+/*  rasterising far away triangles, at the cost of some aliasing for triangles at steep angles */
+static int CalcMipLevel(struct RastTriangle* tri, struct RastState* s, cc_int64 area) {
+	Vertex* V0 = &tri->v[0];
+	Vertex* V1 = &tri->v[1];
+	Vertex* V2 = &tri->v[2];
+	/* Vertex texture coordinates were divided by W in ViewportVertex3D */
+	float u0 = V0->u / V0->w, v0 = V0->v / V0->w;
+	float u1 = V1->u / V1->w, v1 = V1->v / V1->w;
+	float u2 = V2->u / V2->w, v2 = V2->v / V2->w;
+
+	/* Twice the area of the triangle, in texels and in pixels */
+	float texArea = Math_AbsF((u1 - u0) * (v2 - v0) - (u2 - u0) * (v1 - v0)) * s->tex.width * s->tex.height;
+	float pixArea = (float)(area < 0 ? -area : area) * (1.0f / (RAST_SUBPIXEL_ONE * RAST_SUBPIXEL_ONE));
+	int lvl = 0;
+
+	/* Each mipmap level has 1/4 the texels of the previous level, so round log4(texArea / pixArea) */
+	/*  to nearest, which is the largest level where 4^level <= 2 * (texArea / pixArea) */
+	texArea *= 2.0f;
+	while (lvl < s->mipLevels && pixArea * 4.0f <= texArea) 
+	{
+		pixArea *= 4.0f; lvl++;
+	}
+	return lvl;
+}
+
+#ifdef SOFTGPU_CAPTURE
+static cc_uint64 replay_tris, replay_pixels;
+
+/* Counts triangles and pixels drawn, for replay statistics */
+/* NOTE: Pixels rejected by depth or alpha testing are still counted */
+static void CountTriangle(struct RastTriangle* tri, cc_int64 area) {
+	cc_int64 bounds = (cc_int64)(tri->maxX - tri->minX + 1) * (tri->maxY - tri->minY + 1);
+	area = (area < 0 ? -area : area) >> 9; /* Twice the area, in 24.8 fixed point */
+
+	replay_tris++;
+	replay_pixels += min(area, bounds);
+}
+#endif
+
+static void DrawTriangle2D(Vertex* V0, Vertex* V1, Vertex* V2) {
+	struct RastTriangle tri;
+	cc_int64 area;
+	tri.v[0] = *V0; tri.v[1] = *V1; tri.v[2] = *V2;
+	tri.mipLevel = 0;
+	SnapTriangle(&tri);
+	area = TriangleArea(&tri);
+
+	// Degenerate triangles don't cover any pixels
+	if (area == 0) return;
+
+	if (!CalcTriangleBounds(&tri)) return;
+#ifdef SOFTGPU_CAPTURE
+	CountTriangle(&tri, area);
+#endif
+	SubmitTriangle(&tri);
+}
+
+static void DrawTriangle3D(Vertex* V0, Vertex* V1, Vertex* V2) {
+	struct RastState* s;
+	struct RastTriangle tri;
+	cc_int64 area;
+
+	// TODO proper clipping
+	if (V0->w <= 0 || V1->w <= 0 || V2->w <= 0) return;
+
+	tri.v[0] = *V0; tri.v[1] = *V1; tri.v[2] = *V2;
+	SnapTriangle(&tri);
+	area = TriangleArea(&tri);
+
+	if (faceCulling) {
+		// https://gamedev.stackexchange.com/questions/203694/how-to-make-backface-culling-work-correctly-in-both-orthographic-and-perspective
+		if (area < 0) return;
+	}
+	// Degenerate triangles don't cover any pixels
+	if (area == 0) return;
+
+	if (!CalcTriangleBounds(&tri)) return;
+	/* Flushing pending triangles discards the state table, so state might need to be recaptured */
+	if (rast_curState < 0) CaptureState();
+	s = &rast_states[rast_curState];
+
+	tri.mipLevel = (s->flags & RAST_MIPMAPS) ? CalcMipLevel(&tri, s, area) : 0;
+#ifdef SOFTGPU_CAPTURE
+	CountTriangle(&tri, area);
+#endif
+	SubmitTriangle(&tri);
+}
+
+#define V0_VIS (1 << 0)
+#define V1_VIS (1 << 1)
+#define V2_VIS (1 << 2)
+#define V3_VIS (1 << 3)
+
+// https://github.com/behindthepixels/EDXRaster/blob/master/EDXRaster/Core/Clipper.h
+static void ClipLine(Vertex* v1, Vertex* v2, Vertex* V) {
+	float t  = Math_AbsF(v1->z / (v2->z - v1->z));
+	float invt = 1.0f - t;
+	
+	V->x = invt * v1->x + t * v2->x;
+	V->y = invt * v1->y + t * v2->y;
+	//V->z = invt * v1->z + t * v2->z;
+	V->z = 0.0f; // clipped against near plane anyways (I.e Z/W = 0 --> Z = 0)
+	V->w = invt * v1->w + t * v2->w;
+	
+	V->u = invt * v1->u + t * v2->u;
+	V->v = invt * v1->v + t * v2->v;
+	V->c = v1->c;
+}
+
+// https://casual-effects.com/research/McGuire2011Clipping/clip.glsl
+static void DrawClipped(int mask, Vertex* v0, Vertex* v1, Vertex* v2, Vertex* v3) {
+	Vertex tmp[2];
+	Vertex* a = &tmp[0];
+	Vertex* b = &tmp[1];
+
+    switch (mask) {
+	case V0_VIS:
+	{
+		//		   v0
+		//		  / |
+		//       /   |
+		// .....A....B...
+		//    /      |
+		//  v3--v2---v1
+		ClipLine(v3, v0, a);
+		ClipLine(v0, v1, b);
+
+		ViewportVertex3D(v0);
+		ViewportVertex3D(a);
+		ViewportVertex3D(b);
+
+		DrawTriangle3D(v0, a, b);
+	}
+    break;
+	case V1_VIS:
+	{
+		//		   v1
+		//		  / |
+		//       /   |
+		// ....A.....B...
+		//    /      |
+		//  v0--v3---v2
+		ClipLine(v0, v1, a);
+		ClipLine(v1, v2, b);
+
+		ViewportVertex3D(v1);
+		ViewportVertex3D(a);
+		ViewportVertex3D(b);
+
+		DrawTriangle3D(a, b, v1);
+	} break;
+	case V2_VIS:
+	{
+		//		   v2
+		//		  / |
+		//       /   |
+		// ....A.....B...
+		//    /      |
+		//  v1--v0---v3
+		ClipLine(v1, v2, a);
+		ClipLine(v2, v3, b);
+
+		ViewportVertex3D(v2);
+		ViewportVertex3D(a);
+		ViewportVertex3D(b);
+
+		DrawTriangle3D(a, b, v2);
+	} break;
+	case V3_VIS:
+	{
+		//		   v3
+		//		  / |
+		//       /   |
+		// ....A.....B...
+		//    /      |
+		//  v2--v1---v0
+		ClipLine(v2, v3, a);
+		ClipLine(v3, v0, b);
+
+		ViewportVertex3D(v3);
+		ViewportVertex3D(a);
+		ViewportVertex3D(b);
+		
+		DrawTriangle3D(b, v3, a);
+	}
+	break;
+	case V0_VIS | V1_VIS:
 	{
 		//    v0-----------v1
 		//     \		   |
@@ -883,9 +2087,48 @@ static void DrawClipped(int mask, Vertex* v0, Vertex* v1, Vertex* v2, Vertex* v3
 	}
 }
 
+/* Draws the quads in a batch of vertices that was transformed by TransformBatch */
+static void DrawQuadsBatch3D(int startVertex, int count) {
+	Vertex vertices[4];
+	int j = startVertex;
+
+	// 4 vertices = 1 quad = 2 triangles
+	for (int i = 0; i < count; i += 4, j += 4)
+	{
+		cc_uint8* oc = &xf_outcodes[i];
+		// Quad entirely outside one of the frustum planes (includes entirely behind near plane)
+		if (oc[0] & oc[1] & oc[2] & oc[3]) continue;
+
+		LoadVertex3D(j + 0, i + 0, &vertices[0]);
+		LoadVertex3D(j + 1, i + 1, &vertices[1]);
+		LoadVertex3D(j + 2, i + 2, &vertices[2]);
+		LoadVertex3D(j + 3, i + 3, &vertices[3]);
+
+		int clip = !(oc[0] & XF_NEAR) << 0
+				|  !(oc[1] & XF_NEAR) << 1
+				|  !(oc[2] & XF_NEAR) << 2
+				|  !(oc[3] & XF_NEAR) << 3;
+
+		if (clip == 0x0F) {
+			// Quad entirely visible
+			ViewportVertex3D(&vertices[0]);
+			ViewportVertex3D(&vertices[1]);
+			ViewportVertex3D(&vertices[2]);
+			ViewportVertex3D(&vertices[3]);
+
+			DrawTriangle3D(&vertices[0], &vertices[2], &vertices[1]);
+			DrawTriangle3D(&vertices[2], &vertices[0], &vertices[3]);
+		} else {
+			// Quad partially visible
+			DrawClipped(clip, &vertices[0], &vertices[1], &vertices[2], &vertices[3]);
+		}
+	}
+}
+
 void DrawQuads(int startVertex, int verticesCount) {
 	Vertex vertices[4];
 	int j = startVertex;
+	CaptureState();
 
 	if (gfx_rendering2D) {
 		// 4 vertices = 1 quad = 2 triangles
@@ -900,29 +2143,13 @@ void DrawQuads(int startVertex, int verticesCount) {
 			DrawTriangle2D(&vertices[2], &vertices[0], &vertices[3]);
 		}
 	} else {
-		// 4 vertices = 1 quad = 2 triangles
-		for (int i = 0; i < verticesCount / 4; i++, j += 4)
+		int count = verticesCount & ~0x03;
+
+		for (int i = 0; i < count; i += XF_BATCH_SIZE, j += XF_BATCH_SIZE)
 		{
-			int clip = TransformVertex3D(j + 0, &vertices[0]) << 0
-					|  TransformVertex3D(j + 1, &vertices[1]) << 1
-					|  TransformVertex3D(j + 2, &vertices[2]) << 2
-					|  TransformVertex3D(j + 3, &vertices[3]) << 3;
-
-			if (clip == 0) {
-				// Quad entirely clipped
-			} else if (clip == 0x0F) {
-				// Quad entirely visible
-				ViewportVertex3D(&vertices[0]);
-				ViewportVertex3D(&vertices[1]);
-				ViewportVertex3D(&vertices[2]);
-				ViewportVertex3D(&vertices[3]);
-
-				DrawTriangle3D(&vertices[0], &vertices[2], &vertices[1]);
-				DrawTriangle3D(&vertices[2], &vertices[0], &vertices[3]);
-			} else {
-				// Quad partially visible
-				DrawClipped(clip, &vertices[0], &vertices[1], &vertices[2], &vertices[3]);
-			}
+			int batchSize = min(count - i, XF_BATCH_SIZE);
+			TransformBatch(j, batchSize);
+			DrawQuadsBatch3D(j, batchSize);
 		}
 	}
 }
@@ -932,21 +2159,804 @@ void Gfx_SetVertexFormat(VertexFormat fmt) {
 	gfx_stride = strideSizes[fmt];
 }
 
-void Gfx_DrawVb_Lines(int verticesCount) { } /* TODO */
+/* Clips the given screen space line to the scissor rectangle, returning false if entirely outside it */
+/* https://en.wikipedia.org/wiki/Liang%E2%80%93Barsky_algorithm */
+static cc_bool ClipLineToScreen(Vertex* V0, Vertex* V1) {
+	float dx = V1->x - V0->x, dy = V1->y - V0->y;
+	float p[4] = { -dx, dx, -dy, dy };
+	float q[4] = { V0->x, (fb_maxX + 0.999f) - V0->x, V0->y, (fb_maxY + 0.999f) - V0->y };
+	float t0 = 0.0f, t1 = 1.0f, t;
+	Vertex a = *V0, b = *V1;
+	int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		if (p[i] == 0.0f) {
+			if (q[i] < 0.0f) return false;
+			continue;
+		}
+
+		t = q[i] / p[i];
+		if (p[i] < 0.0f) { if (t > t0) t0 = t; }
+		else             { if (t < t1) t1 = t; }
+	}
+	if (t0 > t1) return false;
+
+	V0->x = a.x + t0 * dx; V0->y = a.y + t0 * dy; V0->z = a.z + t0 * (b.z - a.z);
+	V1->x = a.x + t1 * dx; V1->y = a.y + t1 * dy; V1->z = a.z + t1 * (b.z - a.z);
+	return true;
+}
+
+static void DrawLinePixel(int x, int y, float z, int R, int G, int B, int A) {
+	int cb_index = y * cb_stride + x;
+#ifndef SOFTGPU_DISABLE_ZBUFFER
+	int db_index = y * db_stride + x;
+
+	if (depthTest && (z < 0 || z > depthBuffer[db_index])) return;
+	/* Depth values only ever get smaller, so hierarchical depth buffer is still conservative */
+	if (depthWrite) depthBuffer[db_index] = z;
+#endif
+	if (!colWrite) return;
+
+	if (!gfx_alphaBlend) {
+		colorBuffer[cb_index] = BitmapCol_Make(R, G, B, 0xFF);
+		return;
+	}
+
+	BitmapCol dst = colorBuffer[cb_index];
+	int finR = (R * A + BitmapCol_R(dst) * (255 - A)) >> 8;
+	int finG = (G * A + BitmapCol_G(dst) * (255 - A)) >> 8;
+	int finB = (B * A + BitmapCol_B(dst) * (255 - A)) >> 8;
+	colorBuffer[cb_index] = BitmapCol_Make(finR, finG, finB, 0xFF);
+}
+
+/* Draws a line between the given screen space vertices using Bresenham's line algorithm */
+static void DrawLine3D(Vertex* V0, Vertex* V1) {
+	if (!ClipLineToScreen(V0, V1)) return;
+
+	int x0 = (int)V0->x, y0 = (int)V0->y;
+	int x1 = (int)V1->x, y1 = (int)V1->y;
+	int dx =  Math_AbsI(x1 - x0), sx = x0 < x1 ? 1 : -1;
+	int dy = -Math_AbsI(y1 - y0), sy = y0 < y1 ? 1 : -1;
+	int err = dx + dy, err2, i;
+	int steps = max(dx, -dy);
+
+	/* Z/W is linear in screen space, so can just be stepped along the line */
+	float z = V0->z, zStep = steps ? (V1->z - V0->z) / steps : 0.0f;
+	PackedCol color = V0->c;
+	int R = PackedCol_R(color), G = PackedCol_G(color);
+	int B = PackedCol_B(color), A = PackedCol_A(color);
+
+	for (i = 0; i <= steps; i++, z += zStep)
+	{
+		DrawLinePixel(x0, y0, z, R, G, B, A);
+
+		err2 = 2 * err;
+		if (err2 >= dy) { err += dy; x0 += sx; }
+		if (err2 <= dx) { err += dx; y0 += sy; }
+	}
+}
+
+void Gfx_DrawVb_Lines(int verticesCount) {
+	Vertex vertices[3];
+	int i, clip;
+#ifdef SOFTGPU_CAPTURE
+	RecordLines(verticesCount);
+#endif
+	/* Lines are drawn straight away, so must be drawn after any pending triangles */
+	FlushTriangles();
+
+	// 2 vertices = 1 line
+	for (i = 0; i < verticesCount / 2; i++)
+	{
+		clip = TransformVertex3D(i * 2 + 0, &vertices[0]) << 0
+			 | TransformVertex3D(i * 2 + 1, &vertices[1]) << 1;
+
+		if (clip == 0) continue; // Line entirely clipped
+
+		// Line partially visible, so clip against near plane
+		if (clip == V0_VIS) {
+			ClipLine(&vertices[0], &vertices[1], &vertices[2]);
+			vertices[1] = vertices[2];
+		} else if (clip == V1_VIS) {
+			ClipLine(&vertices[1], &vertices[0], &vertices[2]);
+			vertices[0] = vertices[2];
+		}
+
+		ViewportVertex3D(&vertices[0]);
+		ViewportVertex3D(&vertices[1]);
+		DrawLine3D(&vertices[0], &vertices[1]);
+	}
+}
 
 void Gfx_DrawVb_IndexedTris_Range(int verticesCount, int startVertex) {
+#ifdef SOFTGPU_CAPTURE
+	RecordQuads(startVertex, verticesCount);
+#endif
 	DrawQuads(startVertex, verticesCount);
 }
 
 void Gfx_DrawVb_IndexedTris(int verticesCount) {
+#ifdef SOFTGPU_CAPTURE
+	RecordQuads(0, verticesCount);
+#endif
 	DrawQuads(0, verticesCount);
 }
 
 void Gfx_DrawIndexedTris_T2fC4b(int verticesCount, int startVertex) {
+#ifdef SOFTGPU_CAPTURE
+	RecordQuads(startVertex, verticesCount);
+#endif
 	DrawQuads(startVertex, verticesCount);
 }
 
 
+#ifdef SOFTGPU_CAPTURE
+/*########################################################################################################################*
+*--------------------------------------------------Frame capture/replay---------------------------------------------------*
+*#########################################################################################################################*/
+/* The draw calls made during a frame can be recorded to a file, which can later be replayed without */
+/*  the rest of the game. This way changes to the rasteriser can be benchmarked using exactly the same */
+/*  workload each time, even on machines without a display or GPU. (e.g. CI servers) */
+/* Recordings are GZIP compressed, and consist of: */
+/*   Header   - magic, version, framebuffer width, framebuffer height */
+/*   Commands - command type, followed by the data for that type of command (see RecCommand) */
+/* NOTE: All values are 32 bit little endian, except for colors which are stored as R,G,B,A bytes */
+#define REC_MAGIC   0x46474343UL /* "CCGF" */
+#define REC_VERSION 1
+#define REC_MAX_TEXTURES 1024
+
+enum RecCommand {
+	REC_CMD_END,     /* End of the recording */
+	REC_CMD_TEXTURE, /* ID, width, height, mipmapped, then every texel's color row by row */
+	REC_CMD_CLEAR,   /* Buffers to clear, clear color */
+	REC_CMD_QUADS,   /* State, number of vertices, then every vertex (X,Y,Z, color, and U,V if textured) */
+	REC_CMD_LINES    /* Same as REC_CMD_QUADS */
+};
+
+#define REC_ALPHA_TEST   0x001
+#define REC_ALPHA_BLEND  0x002
+#define REC_DEPTH_TEST   0x004
+#define REC_DEPTH_WRITE  0x008
+#define REC_COLOR_WRITE  0x010
+#define REC_FACE_CULLING 0x020
+#define REC_FOG          0x040
+#define REC_MIPMAPS      0x080
+#define REC_2D           0x100
+
+/* Render state that a recorded draw call was made with */
+struct RecState {
+	int flags, format;
+	int texture; /* ID of recorded texture, or 0 for none */
+	struct Matrix mvp;
+	float texOffsetX, texOffsetY;
+	float vpHalfWidth, vpHalfHeight;
+	int maxX, maxY;
+	PackedCol fogColor;
+	int fogMode;
+	float fogEnd, fogDensity;
+};
+#define REC_STATE_SIZE (29 * 4)
+#define REC_VERTEX_SIZE(fmt) ((fmt) == VERTEX_FORMAT_TEXTURED ? 24 : 16)
+
+static void PutF32(cc_uint8* data, float value) {
+	union { float f; cc_uint32 u; } raw;
+	raw.f = value;
+	Stream_SetU32_LE(data, raw.u);
+}
+
+static float GetF32(const cc_uint8* data) {
+	union { float f; cc_uint32 u; } raw;
+	raw.u = Stream_GetU32_LE(data);
+	return raw.f;
+}
+
+static void PutColor(cc_uint8* data, PackedCol color) {
+	data[0] = PackedCol_R(color); data[1] = PackedCol_G(color);
+	data[2] = PackedCol_B(color); data[3] = PackedCol_A(color);
+}
+
+static PackedCol GetColor(const cc_uint8* data) {
+	return PackedCol_Make(data[0], data[1], data[2], data[3]);
+}
+
+static cc_bool recording;
+static cc_result rec_res;
+static struct Stream rec_file, rec_stream;
+static struct GZipState* rec_gzip;
+static void* rec_textures[REC_MAX_TEXTURES]; /* Texture with ID i is stored at index i - 1 */
+static int rec_numTextures, rec_frames;
+
+static void RecordData(const cc_uint8* data, cc_uint32 count) {
+	if (rec_res) return;
+	rec_res = Stream_Write(&rec_stream, data, count);
+}
+
+static void RecordU32(cc_uint32 value) {
+	cc_uint8 data[4];
+	Stream_SetU32_LE(data, value);
+	RecordData(data, 4);
+}
+
+/* Records the given texture if it hasn't been recorded yet, then returns its ID */
+static int RecordTexture(CCTexture* tex) {
+	struct TexSampler s;
+	BitmapCol* pixels;
+	cc_uint8* data;
+	int i, count;
+
+	for (i = 0; i < rec_numTextures; i++)
+	{
+		if (rec_textures[i] == tex) return i + 1;
+	}
+	if (rec_numTextures == REC_MAX_TEXTURES) { rec_res = ERR_NOT_SUPPORTED; return 0; }
+
+	count  = tex->width * tex->height;
+	pixels = (BitmapCol*)Mem_TryAlloc(count, BITMAPCOLOR_SIZE + 4);
+	if (!pixels) { rec_res = ERR_OUT_OF_MEMORY; return 0; }
+	data   = (cc_uint8*)(pixels + count);
+
+	/* Texels are stored tiled, but recorded row by row */
+	SetupSampler(&s, tex->pixels, tex->width, tex->height);
+	LoadTexels(&s, 0, 0, pixels, tex->width, tex->height);
+
+	for (i = 0; i < count; i++)
+	{
+		data[i * 4 + 0] = BitmapCol_R(pixels[i]);
+		data[i * 4 + 1] = BitmapCol_G(pixels[i]);
+		data[i * 4 + 2] = BitmapCol_B(pixels[i]);
+		data[i * 4 + 3] = BitmapCol_A(pixels[i]);
+	}
+	rec_textures[rec_numTextures++] = tex;
+
+	RecordU32(REC_CMD_TEXTURE);
+	RecordU32(rec_numTextures);
+	RecordU32(tex->width);
+	RecordU32(tex->height);
+	RecordU32(tex->mipLevels > 0);
+	RecordData(data, count * 4);
+
+	Mem_Free(pixels);
+	return rec_numTextures;
+}
+
+/* Textures that are changed or deleted need to be recorded again (with a new ID) if used afterwards */
+static void ForgetTexture(void* tex) {
+	int i;
+	for (i = 0; i < rec_numTextures; i++)
+	{
+		if (rec_textures[i] == tex) rec_textures[i] = NULL;
+	}
+}
+
+static void RecordState(int texture) {
+	cc_uint8 data[REC_STATE_SIZE];
+	const float* m = (const float*)&_mvp;
+	int i, flags = 0;
+
+	if (gfx_alphaTest)   flags |= REC_ALPHA_TEST;
+	if (gfx_alphaBlend)  flags |= REC_ALPHA_BLEND;
+	if (depthTest)       flags |= REC_DEPTH_TEST;
+	if (depthWrite)      flags |= REC_DEPTH_WRITE;
+	if (colWrite)        flags |= REC_COLOR_WRITE;
+	if (faceCulling)     flags |= REC_FACE_CULLING;
+	if (gfx_fogEnabled)  flags |= REC_FOG;
+	if (mipmapsEnabled)  flags |= REC_MIPMAPS;
+	if (gfx_rendering2D) flags |= REC_2D;
+
+	Stream_SetU32_LE(data + 0, flags);
+	Stream_SetU32_LE(data + 4, gfx_format);
+	Stream_SetU32_LE(data + 8, texture);
+	for (i = 0; i < 16; i++) PutF32(data + 12 + i * 4, m[i]);
+
+	PutF32(data +  76, texOffsetX);
+	PutF32(data +  80, texOffsetY);
+	PutF32(data +  84, vp_hwidth);
+	PutF32(data +  88, vp_hheight);
+	Stream_SetU32_LE(data +  92, fb_maxX);
+	Stream_SetU32_LE(data +  96, fb_maxY);
+	PutColor(data + 100, gfx_fogColor);
+	Stream_SetU32_LE(data + 104, gfx_fogMode);
+	PutF32(data + 108, gfx_fogEnd);
+	PutF32(data + 112, gfx_fogDensity);
+	RecordData(data, REC_STATE_SIZE);
+}
+
+static void RecordVertices(int startVertex, int count) {
+	char* ptr = (char*)gfx_vertices + startVertex * gfx_stride;
+	cc_uint8 data[24];
+	int i;
+
+	for (i = 0; i < count; i++, ptr += gfx_stride)
+	{
+		if (gfx_format == VERTEX_FORMAT_TEXTURED) {
+			struct VertexTextured* v = (struct VertexTextured*)ptr;
+			PutF32(data +  0, v->x); PutF32(data + 4, v->y); PutF32(data + 8, v->z);
+			PutColor(data + 12, v->Col);
+			PutF32(data + 16, v->U); PutF32(data + 20, v->V);
+		} else {
+			struct VertexColoured* v = (struct VertexColoured*)ptr;
+			PutF32(data +  0, v->x); PutF32(data + 4, v->y); PutF32(data + 8, v->z);
+			PutColor(data + 12, v->Col);
+		}
+		RecordData(data, REC_VERTEX_SIZE(gfx_format));
+	}
+}
+
+static void RecordDraw(int cmd, int startVertex, int verticesCount) {
+	int texture = 0;
+	if (!recording) return;
+
+	if (gfx_format == VERTEX_FORMAT_TEXTURED && curTexture)
+		texture = RecordTexture(curTexture);
+
+	RecordU32(cmd);
+	RecordState(texture);
+	RecordU32(verticesCount);
+	RecordVertices(startVertex, verticesCount);
+}
+
+static void RecordQuads(int startVertex, int verticesCount) {
+	RecordDraw(REC_CMD_QUADS, startVertex, verticesCount);
+}
+
+static void RecordLines(int verticesCount) {
+	RecordDraw(REC_CMD_LINES, 0, verticesCount);
+}
+
+static void RecordClear(GfxBuffers buffers) {
+	cc_uint8 data[4];
+	if (!recording) return;
+
+	data[0] = BitmapCol_R(clearColor); data[1] = BitmapCol_G(clearColor);
+	data[2] = BitmapCol_B(clearColor); data[3] = BitmapCol_A(clearColor);
+
+	RecordU32(REC_CMD_CLEAR);
+	RecordU32(buffers);
+	RecordData(data, 4);
+}
+
+static void BeginRecording(void) {
+	const cc_string* path = &HeadlessInfo.Capture;
+	cc_result res;
+
+	rec_gzip = (struct GZipState*)Mem_TryAlloc(1, sizeof(struct GZipState));
+	if (!rec_gzip) { Logger_SysWarn2(ERR_OUT_OF_MEMORY, "recording to", path); return; }
+
+	res = Stream_CreateFile(&rec_file, path);
+	if (res) { Logger_SysWarn2(res, "creating", path); Mem_Free(rec_gzip); return; }
+
+	GZip_MakeStream(&rec_stream, rec_gzip, &rec_file);
+	recording       = true;
+	rec_res         = 0;
+	rec_numTextures = 0;
+
+	RecordU32(REC_MAGIC);
+	RecordU32(REC_VERSION);
+	RecordU32(fb_width);
+	RecordU32(fb_height);
+}
+
+static void EndRecording(void) {
+	const cc_string* path = &HeadlessInfo.Capture;
+	cc_result res;
+
+	RecordU32(REC_CMD_END);
+	recording = false;
+	res = rec_res ? rec_res : rec_stream.Close(&rec_stream);
+
+	if (res) {
+		Logger_SysWarn2(res, "recording to", path);
+	} else {
+		Platform_Log1("Recorded frame to %s", path);
+	}
+
+	rec_file.Close(&rec_file);
+	Mem_Free(rec_gzip);
+}
+
+
+/* Command from a recording that has been loaded into memory */
+struct ReplayCommand {
+	int type;
+	int count; /* Number of vertices, or buffers to clear for REC_CMD_CLEAR */
+	BitmapCol clearColor;
+	struct RecState state;
+	void* vertices;
+};
+
+static struct ReplayCommand* replay_cmds;
+static int replay_numCmds, replay_capacity;
+static GfxResourceID replay_textures[REC_MAX_TEXTURES + 1];
+
+static cc_result ReadTexture(struct Stream* s) {
+	cc_uint8 header[16];
+	struct Bitmap bmp;
+	BitmapCol* pixels;
+	cc_uint8* data;
+	int i, id, width, height, count;
+	cc_bool mipmaps;
+	cc_result res;
+
+	if ((res = Stream_Read(s, header, sizeof(header)))) return res;
+	id      = Stream_GetU32_LE(header + 0);
+	width   = Stream_GetU32_LE(header + 4);
+	height  = Stream_GetU32_LE(header + 8);
+	mipmaps = Stream_GetU32_LE(header + 12) != 0;
+
+	if (id <= 0 || id > REC_MAX_TEXTURES)                      return ERR_INVALID_ARGUMENT;
+	if (width  <= 0 || width  > Gfx.MaxTexWidth  || !Math_IsPowOf2(width))  return ERR_INVALID_ARGUMENT;
+	if (height <= 0 || height > Gfx.MaxTexHeight || !Math_IsPowOf2(height)) return ERR_INVALID_ARGUMENT;
+
+	count  = width * height;
+	pixels = (BitmapCol*)Mem_TryAlloc(count, BITMAPCOLOR_SIZE + 4);
+	if (!pixels) return ERR_OUT_OF_MEMORY;
+	data   = (cc_uint8*)(pixels + count);
+
+	if (!(res = Stream_Read(s, data, count * 4))) {
+		for (i = 0; i < count; i++)
+		{
+			pixels[i] = BitmapCol_Make(data[i * 4 + 0], data[i * 4 + 1], data[i * 4 + 2], data[i * 4 + 3]);
+		}
+
+		Bitmap_Init(bmp, width, height, pixels);
+		Gfx_DeleteTexture(&replay_textures[id]);
+		replay_textures[id] = Gfx_CreateTexture(&bmp, 0, mipmaps);
+	}
+
+	Mem_Free(pixels);
+	return res;
+}
+
+static cc_result ReadState(struct Stream* s, struct RecState* st) {
+	cc_uint8 data[REC_STATE_SIZE];
+	float* m = (float*)&st->mvp;
+	cc_result res;
+	int i;
+
+	if ((res = Stream_Read(s, data, REC_STATE_SIZE))) return res;
+	st->flags   = Stream_GetU32_LE(data + 0);
+	st->format  = Stream_GetU32_LE(data + 4);
+	st->texture = Stream_GetU32_LE(data + 8);
+	for (i = 0; i < 16; i++) m[i] = GetF32(data + 12 + i * 4);
+
+	st->texOffsetX   = GetF32(data +  76);
+	st->texOffsetY   = GetF32(data +  80);
+	st->vpHalfWidth  = GetF32(data +  84);
+	st->vpHalfHeight = GetF32(data +  88);
+	st->maxX         = Stream_GetU32_LE(data +  92);
+	st->maxY         = Stream_GetU32_LE(data +  96);
+	st->fogColor     = GetColor(data + 100);
+	st->fogMode      = Stream_GetU32_LE(data + 104);
+	st->fogEnd       = GetF32(data + 108);
+	st->fogDensity   = GetF32(data + 112);
+
+	if (st->format != VERTEX_FORMAT_COLOURED && st->format != VERTEX_FORMAT_TEXTURED) return ERR_INVALID_ARGUMENT;
+	if (st->texture < 0 || st->texture > REC_MAX_TEXTURES)                            return ERR_INVALID_ARGUMENT;
+	return 0;
+}
+
+static cc_result ReadVertices(struct Stream* s, struct ReplayCommand* cmd) {
+	int i, fmt = cmd->state.format;
+	cc_uint8 data[24];
+	cc_result res;
+	char* ptr;
+
+	if (cmd->count < 0) return ERR_INVALID_ARGUMENT;
+	cmd->vertices = Mem_TryAlloc(max(cmd->count, 1), strideSizes[fmt]);
+	if (!cmd->vertices) return ERR_OUT_OF_MEMORY;
+	ptr = (char*)cmd->vertices;
+
+	for (i = 0; i < cmd->count; i++, ptr += strideSizes[fmt])
+	{
+		if ((res = Stream_Read(s, data, REC_VERTEX_SIZE(fmt)))) return res;
+
+		if (fmt == VERTEX_FORMAT_TEXTURED) {
+			struct VertexTextured* v = (struct VertexTextured*)ptr;
+			v->x = GetF32(data + 0); v->y = GetF32(data + 4); v->z = GetF32(data + 8);
+			v->Col = GetColor(data + 12);
+			v->U = GetF32(data + 16); v->V = GetF32(data + 20);
+		} else {
+			struct VertexColoured* v = (struct VertexColoured*)ptr;
+			v->x = GetF32(data + 0); v->y = GetF32(data + 4); v->z = GetF32(data + 8);
+			v->Col = GetColor(data + 12);
+		}
+	}
+	return 0;
+}
+
+static cc_result ReadCommands(struct Stream* s) {
+	struct ReplayCommand* cmd;
+	cc_uint8 data[4];
+	cc_uint32 type;
+	cc_result res;
+
+	for (;;)
+	{
+		if ((res = Stream_ReadU32_LE(s, &type))) return res;
+		if (type == REC_CMD_END) return 0;
+
+		if (type == REC_CMD_TEXTURE) {
+			if ((res = ReadTexture(s))) return res;
+			continue;
+		}
+		if (type != REC_CMD_CLEAR && type != REC_CMD_QUADS && type != REC_CMD_LINES) return ERR_INVALID_ARGUMENT;
+
+		if (replay_numCmds == replay_capacity) {
+			Utils_Resize((void**)&replay_cmds, &replay_capacity,
+				sizeof(struct ReplayCommand), 0, 256);
+		}
+		cmd = &replay_cmds[replay_numCmds++];
+		Mem_Set(cmd, 0, sizeof(struct ReplayCommand));
+		cmd->type = type;
+
+		if (type == REC_CMD_CLEAR) {
+			if ((res = Stream_ReadU32_LE(s, (cc_uint32*)&cmd->count))) return res;
+			if ((res = Stream_Read(s, data, 4)))                       return res;
+			cmd->clearColor = BitmapCol_Make(data[0], data[1], data[2], data[3]);
+		} else {
+			if ((res = ReadState(s, &cmd->state)))                     return res;
+			if ((res = Stream_ReadU32_LE(s, (cc_uint32*)&cmd->count))) return res;
+			if ((res = ReadVertices(s, cmd)))                          return res;
+		}
+	}
+}
+
+static cc_result ReadRecording(struct Stream* s) {
+	cc_uint8 header[16];
+	int width, height;
+	cc_result res;
+
+	if ((res = Stream_Read(s, header, sizeof(header)))) return res;
+	if (Stream_GetU32_LE(header + 0) != REC_MAGIC)   return ERR_INVALID_ARGUMENT;
+	if (Stream_GetU32_LE(header + 4) != REC_VERSION) return ERR_NOT_SUPPORTED;
+
+	width  = Stream_GetU32_LE(header +  8);
+	height = Stream_GetU32_LE(header + 12);
+	if (width <= 0 || height <= 0 || width > 16384 || height > 16384) return ERR_INVALID_ARGUMENT;
+
+	/* Textures can only be created once the backend has been initialised */
+	Game.Width  = width;
+	Game.Height = height;
+	Gfx_Create();
+	Gfx_OnWindowResize();
+
+	return ReadCommands(s);
+}
+
+static void FreeReplay(void) {
+	int i;
+	for (i = 0; i < replay_numCmds; i++)
+	{
+		Mem_Free(replay_cmds[i].vertices);
+	}
+	for (i = 0; i <= REC_MAX_TEXTURES; i++)
+	{
+		Gfx_DeleteTexture(&replay_textures[i]);
+	}
+
+	if (replay_cmds) Mem_Free(replay_cmds);
+	replay_cmds     = NULL;
+	replay_numCmds  = 0;
+	replay_capacity = 0;
+}
+
+static void ApplyState(const struct RecState* st) {
+	gfx_alphaTest   = (st->flags & REC_ALPHA_TEST)   != 0;
+	gfx_alphaBlend  = (st->flags & REC_ALPHA_BLEND)  != 0;
+	depthTest       = (st->flags & REC_DEPTH_TEST)   != 0;
+	depthWrite      = (st->flags & REC_DEPTH_WRITE)  != 0;
+	colWrite        = (st->flags & REC_COLOR_WRITE)  != 0;
+	faceCulling     = (st->flags & REC_FACE_CULLING) != 0;
+	gfx_fogEnabled  = (st->flags & REC_FOG)          != 0;
+	mipmapsEnabled  = (st->flags & REC_MIPMAPS)      != 0;
+	gfx_rendering2D = (st->flags & REC_2D)           != 0;
+
+	Gfx_SetVertexFormat((VertexFormat)st->format);
+	Gfx_BindTexture(replay_textures[st->texture]);
+
+	_mvp       = st->mvp;
+	texOffsetX = st->texOffsetX;
+	texOffsetY = st->texOffsetY;
+	vp_hwidth  = st->vpHalfWidth;
+	vp_hheight = st->vpHalfHeight;
+	fb_maxX    = min(st->maxX, fb_width  - 1);
+	fb_maxY    = min(st->maxY, fb_height - 1);
+
+	Gfx_SetFogCol(st->fogColor);
+	Gfx_SetFogMode((FogFunc)st->fogMode);
+	Gfx_SetFogEnd(st->fogEnd);
+	Gfx_SetFogDensity(st->fogDensity);
+}
+
+static void ReplayCommand(struct ReplayCommand* cmd) {
+	switch (cmd->type)
+	{
+	case REC_CMD_CLEAR:
+		clearColor = cmd->clearColor;
+		Gfx_ClearBuffers((GfxBuffers)cmd->count);
+		break;
+	case REC_CMD_QUADS:
+		ApplyState(&cmd->state);
+		gfx_vertices = cmd->vertices;
+		DrawQuads(0, cmd->count);
+		break;
+	case REC_CMD_LINES:
+		ApplyState(&cmd->state);
+		gfx_vertices = cmd->vertices;
+		Gfx_DrawVb_Lines(cmd->count);
+		break;
+	}
+}
+
+static void ReplayFrame(void) {
+	int i;
+	for (i = 0; i < replay_numCmds; i++)
+	{
+		ReplayCommand(&replay_cmds[i]);
+	}
+	FlushTriangles();
+}
+
+static void ReplayFrames(int iterations) {
+	cc_uint64 beg, end, elapsed;
+	float frameMs, trisRate, pixelsRate;
+	int i;
+
+	replay_tris   = 0;
+	replay_pixels = 0;
+	beg = Stopwatch_Measure();
+
+	for (i = 0; i < iterations; i++) ReplayFrame();
+
+	end     = Stopwatch_Measure();
+	elapsed = max(Stopwatch_ElapsedMicroseconds(beg, end), 1);
+
+	frameMs    = (float)elapsed / iterations / 1000.0f;
+	trisRate   = (float)replay_tris   / elapsed; /* per microsecond = million per second */
+	pixelsRate = (float)replay_pixels / elapsed;
+
+	Platform_Log2("Replayed %i frames, %f3 ms per frame", &iterations, &frameMs);
+	Platform_Log2("  %f2 million triangles/sec, %f2 million pixels/sec", &trisRate, &pixelsRate);
+}
+
+/* Draw calls are grouped by command type, vertex format and state flags */
+#define REPLAY_MAX_GROUPS 64
+struct ReplayGroup { int key, draws; cc_uint64 elapsed, tris, pixels; };
+
+static void DescribeGroup(cc_string* str, int key) {
+	int type = key >> 16, fmt = (key >> 12) & 0x0F, flags = key & 0xFFF;
+	if (type == REC_CMD_CLEAR) { String_AppendConst(str, "clear"); return; }
+
+	String_AppendConst(str, (flags & REC_2D) ? "2D" : "3D");
+	String_AppendConst(str, type == REC_CMD_LINES ? " lines" : " quads");
+	String_AppendConst(str, fmt == VERTEX_FORMAT_TEXTURED ? ", textured" : ", coloured");
+
+	if (flags & REC_ALPHA_TEST)     String_AppendConst(str, ", alpha test");
+	if (flags & REC_ALPHA_BLEND)    String_AppendConst(str, ", alpha blend");
+	if (flags & REC_FOG)            String_AppendConst(str, ", fog");
+	if (flags & REC_MIPMAPS)        String_AppendConst(str, ", mipmaps");
+	if (flags & REC_FACE_CULLING)   String_AppendConst(str, ", face culling");
+	if (!(flags & REC_DEPTH_TEST))  String_AppendConst(str, ", no depth test");
+	if (!(flags & REC_DEPTH_WRITE)) String_AppendConst(str, ", no depth write");
+	if (!(flags & REC_COLOR_WRITE)) String_AppendConst(str, ", depth only");
+}
+
+/* Reports how much time is spent drawing with each combination of render state */
+/* NOTE: Every draw call is flushed separately, which is slower than rendering normally */
+static void ProfileFrames(int iterations) {
+	struct ReplayGroup groups[REPLAY_MAX_GROUPS];
+	struct ReplayCommand* cmd;
+	struct ReplayGroup* group;
+	cc_uint64 beg, tris, pixels;
+	int i, j, key, numGroups = 0, frameTris;
+	cc_string str; char strBuffer[128];
+	float ms, mpixels;
+
+	for (i = 0; i < iterations; i++)
+	{
+		for (j = 0; j < replay_numCmds; j++)
+		{
+			cmd    = &replay_cmds[j];
+			key    = (cmd->type << 16) | (cmd->state.format << 12) | (cmd->state.flags & 0xFFF);
+			tris   = replay_tris;
+			pixels = replay_pixels;
+
+			beg = Stopwatch_Measure();
+			ReplayCommand(cmd);
+			FlushTriangles();
+
+			for (group = groups; group < groups + numGroups; group++)
+			{
+				if (group->key == key) break;
+			}
+			if (group == groups + numGroups) {
+				if (numGroups == REPLAY_MAX_GROUPS) continue;
+				Mem_Set(group, 0, sizeof(struct ReplayGroup));
+				group->key = key;
+				numGroups++;
+			}
+
+			group->elapsed += Stopwatch_ElapsedMicroseconds(beg, Stopwatch_Measure());
+			group->draws++;
+			group->tris    += replay_tris   - tris;
+			group->pixels  += replay_pixels - pixels;
+		}
+	}
+
+	Platform_LogConst("Time per frame for each render state (with every draw call flushed separately):");
+	for (group = groups; group < groups + numGroups; group++)
+	{
+		String_InitArray(str, strBuffer);
+		DescribeGroup(&str, group->key);
+
+		ms      = (float)group->elapsed / iterations / 1000.0f;
+		mpixels = (float)group->pixels  / iterations / 1000000.0f;
+		frameTris = (int)(group->tris / iterations);
+
+		if (group->key >> 16 == REC_CMD_CLEAR) {
+			Platform_Log2("  %s: %f3 ms", &str, &ms);
+		} else {
+			Platform_Log4("  %s: %f3 ms, %i triangles, %f2 million pixels", &str, &ms, &frameTris, &mpixels);
+		}
+	}
+}
+
+static void SaveReplayFrame(const cc_string* path) {
+	struct Stream stream;
+	cc_result res;
+
+	/* Redraw the frame, since profiling leaves only the last draw call's state in the buffers */
+	ReplayFrame();
+	res = Stream_CreateFile(&stream, path);
+	if (res) { Logger_SysWarn2(res, "creating", path); return; }
+
+	res = Gfx_TakeScreenshot(&stream);
+	if (res) { Logger_SysWarn2(res, "saving to", path); }
+	stream.Close(&stream);
+}
+
+cc_result Gfx_ReplayCapture(const cc_string* path, int iterations, const cc_string* output) {
+	struct GZipHeader gzHeader;
+	struct InflateState* inflate;
+	struct Stream file, stream;
+	cc_result res;
+
+	res = Stream_OpenFile(&file, path);
+	if (res) { Logger_SysWarn2(res, "opening", path); return res; }
+
+	inflate = (struct InflateState*)Mem_TryAlloc(1, sizeof(struct InflateState));
+	if (!inflate) { file.Close(&file); return ERR_OUT_OF_MEMORY; }
+
+	GZipHeader_Init(&gzHeader);
+	while (!gzHeader.done)
+	{
+		if ((res = GZipHeader_Read(&file, &gzHeader))) break;
+	}
+
+	if (!res) {
+		Inflate_MakeStream2(&stream, inflate, &file);
+		res = ReadRecording(&stream);
+	}
+	Mem_Free(inflate);
+	file.Close(&file);
+
+	if (res) {
+		Logger_SysWarn2(res, "loading", path);
+	} else {
+		/* First frame is slower, due to e.g. worker threads starting and caches being cold */
+		ReplayFrame();
+		ReplayFrames(iterations);
+		ProfileFrames(max(iterations / 10, 1));
+		if (output->length) SaveReplayFrame(output);
+	}
+
+	FreeReplay();
+	return res;
+}
+#endif
+
+
 /*########################################################################################################################*
 *---------------------------------------------------------Other/Misc------------------------------------------------------*
 *#########################################################################################################################*/
@@ -957,16 +2967,28 @@ static BitmapCol* CB_GetRow(struct Bitmap* bmp, int y, void* ctx) {
 cc_result Gfx_TakeScreenshot(struct Stream* output) {
 	struct Bitmap bmp;
 	Bitmap_Init(bmp, fb_width, fb_height, NULL);
+
+	FlushTriangles();
 	return Png_Encode(&bmp, output, CB_GetRow, false, NULL);
 }
 
 cc_bool Gfx_WarnIfNecessary(void) { return false; }
 cc_bool Gfx_GetUIOptions(struct MenuOptionsScreen* s) { return false; }
 
-void Gfx_BeginFrame(void) { }
+void Gfx_BeginFrame(void) {
+#ifdef SOFTGPU_CAPTURE
+	/* Only the frame that gets saved by the window backend is recorded */
+	if (HeadlessInfo.Capture.length && !recording && rec_frames + 1 == HeadlessInfo.Frames) BeginRecording();
+#endif
+}
 
 void Gfx_EndFrame(void) {
 	Rect2D r = { 0, 0, fb_width, fb_height };
+	FlushTriangles();
+#ifdef SOFTGPU_CAPTURE
+	if (recording) EndRecording();
+	rec_frames++;
+#endif
 	Window_DrawFramebuffer(r, &fb_bmp);
 }
 
@@ -987,7 +3009,12 @@ void Gfx_OnWindowResize(void) {
 #ifndef SOFTGPU_DISABLE_ZBUFFER
 	depthBuffer = Mem_Alloc(fb_width * fb_height, 4, "depth buffer");
 	db_stride   = fb_width;
+
+	hiZ_stride = (fb_width  + 7) >> 3;
+	hiZ_rows   = (fb_height + 7) >> 3;
+	hiZBuffer  = Mem_Alloc(hiZ_stride * hiZ_rows, 4, "hierarchical depth buffer");
 #endif
+	InitTileBins();
 
 	Gfx_SetViewport(0, 0, Game.Width, Game.Height);
 	Gfx_SetScissor (0, 0, Game.Width, Game.Height);
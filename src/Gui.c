@@ -430,6 +430,104 @@ void TextAtlas_AddInt(struct TextAtlas* atlas, int value, struct VertexTextured*
 }
 
 
+/*########################################################################################################################*
+*-------------------------------------------------------GlyphText---------------------------------------------------------*
+*#########################################################################################################################*/
+static GfxResourceID glyphText_vb;
+
+cc_bool GlyphText_Make(struct GlyphText* text, struct DrawTextArgs* args, struct Texture* tex) {
+	struct GlyphQuad quads[GLYPHTEXT_MAX_GLYPHS + 1];
+	int count, point = args->font->size;
+
+	text->quads = NULL;
+	text->count = 0;
+	if (!GLYPHTEXT_MAX_GLYPHS || Gfx.LostContext) return false;
+	if (Gfx.Limitations & GFX_LIMIT_NO_UV_SUPPORT) return false;
+	if (!Drawer2D_GetGlyphsTexture())             return false;
+
+	count = Drawer2D_MakeGlyphQuads(args, quads, GLYPHTEXT_MAX_GLYPHS + 1);
+	if (!count || count > GLYPHTEXT_MAX_GLYPHS) return false;
+
+	text->quads = (struct GlyphQuad*)Mem_TryAlloc(count, sizeof(struct GlyphQuad));
+	if (!text->quads) return false;
+	Mem_Copy(text->quads, quads, count * sizeof(struct GlyphQuad));
+
+	/* Layout matches the text drawn by Context2D_DrawText */
+	text->count  = count;
+	text->y      = (args->font->height - point) / 2;
+	text->height = point;
+	text->shadow = args->useShadow ? point / 8 : 0;
+
+	tex->ID     = 0;
+	tex->width  = Drawer2D_TextWidth(args);
+	tex->height = Drawer2D_TextHeight(args);
+	tex->uv.u1  = 0.0f; tex->uv.v1 = 0.0f;
+	tex->uv.u2  = 1.0f; tex->uv.v2 = 1.0f;
+	return true;
+}
+
+void GlyphText_Free(struct GlyphText* text) {
+	Mem_Free(text->quads);
+	text->quads = NULL;
+	text->count = 0;
+}
+
+int GlyphText_Vertices(struct GlyphText* text) {
+	return text->shadow ? text->count * 8 : text->count * 4;
+}
+
+static void GlyphText_AddLayer(struct GlyphText* text, const struct Texture* tex, PackedCol color, 
+								int offset, cc_bool shadow, struct VertexTextured** vertices) {
+	struct GlyphQuad* q;
+	struct Texture part;
+	BitmapCol col;
+	int i;
+
+	part.y      = tex->y + text->y + offset;
+	part.height = text->height;
+
+	for (i = 0; i < text->count; i++)
+	{
+		q   = &text->quads[i];
+		col = shadow ? GetShadowColor(q->color) : q->color;
+
+		part.x     = tex->x + q->x + offset;
+		part.width = q->width;
+		part.uv    = q->uv;
+		Gfx_Make2DQuad(&part, PackedCol_Tint(color, 
+			PackedCol_Make(BitmapCol_R(col), BitmapCol_G(col), BitmapCol_B(col), 255)), vertices);
+	}
+}
+
+void GlyphText_BuildMesh(struct GlyphText* text, const struct Texture* tex, PackedCol color, struct VertexTextured** vertices) {
+	/* Shadow layer must be added first, so that it is drawn underneath the main layer */
+	if (text->shadow) GlyphText_AddLayer(text, tex, color, text->shadow, true, vertices);
+	GlyphText_AddLayer(text, tex, color, 0, false, vertices);
+}
+
+void GlyphText_Render2(struct GlyphText* text, int offset) {
+	Gfx_BindTexture(Drawer2D_GetGlyphsTexture());
+	Gfx_DrawVb_IndexedTris_Range(GlyphText_Vertices(text), offset);
+}
+
+void GlyphText_Render(struct GlyphText* text, const struct Texture* tex, PackedCol color) {
+	struct VertexTextured* ptr;
+	int count = GlyphText_Vertices(text);
+	if (!count) return;
+
+	if (!glyphText_vb) glyphText_vb = Gfx_CreateDynamicVb(VERTEX_FORMAT_TEXTURED, GLYPHTEXT_MAX_VERTICES);
+	if (!glyphText_vb) return;
+
+	Gfx_SetVertexFormat(VERTEX_FORMAT_TEXTURED);
+	ptr = (struct VertexTextured*)Gfx_LockDynamicVb(glyphText_vb, VERTEX_FORMAT_TEXTURED, count);
+	GlyphText_BuildMesh(text, tex, color, &ptr);
+	Gfx_UnlockDynamicVb(glyphText_vb);
+
+	Gfx_BindTexture(Drawer2D_GetGlyphsTexture());
+	Gfx_DrawVb_IndexedTris(count);
+}
+
+
 /*########################################################################################################################*
 *-------------------------------------------------------Widget base-------------------------------------------------------*
 *#########################################################################################################################*/
@@ -692,6 +790,7 @@ static void OnTextChanged(void* obj, const cc_string* str) {
 
 static void OnContextLost(void* obj) {
 	LoseAllScreens();
+	Gfx_DeleteDynamicVb(&glyphText_vb);
 	if (Gfx.ManagedTextures) return;
 
 	Gfx_DeleteTexture(&Gui.GuiTex);
@@ -20,6 +20,8 @@ enum GuiAnchor {
 struct IGameComponent;
 struct VertexTextured;
 struct FontDesc;
+struct DrawTextArgs;
+struct GlyphQuad;
 struct Widget;
 struct InputDevice;
 extern struct IGameComponent Gui_Component;
@@ -298,6 +300,36 @@ void TextAtlas_Free(struct TextAtlas* atlas);
 void TextAtlas_Add(struct TextAtlas* atlas, int charI, struct VertexTextured** vertices);
 void TextAtlas_AddInt(struct TextAtlas* atlas, int value, struct VertexTextured** vertices);
 
+/* Text drawn as quads that reference glyphs in the bitmapped font's glyphs texture */
+/*  Unlike a text texture, changing the text does not require rasterising a new texture */
+#ifdef CC_BUILD_LOWMEM
+#define GLYPHTEXT_MAX_GLYPHS 0
+#else
+#define GLYPHTEXT_MAX_GLYPHS 64
+#endif
+/* Max vertices needed to draw glyph text (shadow quad and main quad for each glyph) */
+#define GLYPHTEXT_MAX_VERTICES (GLYPHTEXT_MAX_GLYPHS * 8)
+
+struct GlyphText {
+	struct GlyphQuad* quads;
+	int count;
+	/* Y offset, height and shadow offset of glyphs, relative to the text's texture */
+	short y, height, shadow;
+};
+/* Lays out the given text as glyph quads, and sets the width/height of the given texture */
+/*  Returns false if the text can't be drawn this way (e.g. system font or too many glyphs), */
+/*  in which case Drawer2D_MakeTextTexture should be used to draw the text instead */
+cc_bool GlyphText_Make(struct GlyphText* text, struct DrawTextArgs* args, struct Texture* tex);
+void GlyphText_Free(struct GlyphText* text);
+/* Returns the number of vertices GlyphText_BuildMesh adds for the given text */
+int GlyphText_Vertices(struct GlyphText* text);
+/* Adds the vertices of the glyph quads, positioned relative to the given texture */
+void GlyphText_BuildMesh(struct GlyphText* text, const struct Texture* tex, PackedCol color, struct VertexTextured** vertices);
+/* Draws the glyph quads previously added at the given offset in the bound vertex buffer */
+void GlyphText_Render2(struct GlyphText* text, int offset);
+/* Draws the glyph quads immediately, positioned relative to the given texture */
+void GlyphText_Render(struct GlyphText* text, const struct Texture* tex, PackedCol color);
+
 #define Elem_Render(elem, delta) (elem)->VTABLE->Render(elem, delta)
 #define Elem_Free(elem)          (elem)->VTABLE->Free(elem)
 #define Elem_HandlesKeyPress(elem, key) (elem)->VTABLE->HandlesKeyPress(elem, key)
@@ -9,6 +9,7 @@
 #include "Entity.h"
 #include "Model.h"
 #include "Options.h"
+#include "Platform.h"
 
 cc_bool HeldBlockRenderer_Show;
 #ifndef CC_DISABLE_HELDBLOCK
@@ -91,6 +92,9 @@ static void ResetHeldState(void) {
 	held_entity.MobTextureId = p->MobTextureId;
 	held_entity.uScale       = p->uScale;
 	held_entity.vScale       = p->vScale;
+	held_entity.Flags        = (held_entity.Flags & ~ENTITY_FLAG_SKIN_ATLAS) | (p->Flags & ENTITY_FLAG_SKIN_ATLAS);
+	/* Needed to look up where the skin is in the skin atlas */
+	if (p->Flags & ENTITY_FLAG_SKIN_ATLAS) Mem_Copy(held_entity.SkinRaw, p->SkinRaw, STRING_SIZE);
 }
 
 static void SetBaseOffset(void) {
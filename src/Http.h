@@ -12,10 +12,14 @@ Copyright 2014-2025 ClassiCube | Licensed under BSD-3
 struct IGameComponent;
 struct ScheduledTask;
 struct StringsBuffer;
+struct Stream;
 
 #define URL_MAX_SIZE (STRING_SIZE * 2)
-#define HTTP_FLAG_PRIORITY 0x01
-#define HTTP_FLAG_NOCACHE  0x02
+#define HTTP_FLAG_PRIORITY   0x01 /* Request is important (e.g. texture pack) and is performed before others */
+#define HTTP_FLAG_NOCACHE    0x02
+#define HTTP_FLAG_BACKGROUND 0x04 /* Request is unimportant (e.g. skin) and is performed after others */
+#define HTTP_FLAG_CACHE      0x08 /* Response is stored on disk, and reused/revalidated by later requests */
+#define HTTP_FLAG_CACHE_SKIPLOAD 0x10 /* Cached response isn't loaded into data (caller uses Http_OpenCachedData instead) */
 
 extern struct IGameComponent Http_Component;
 
@@ -25,6 +29,8 @@ enum HttpProgress {
 	HTTP_PROGRESS_MAKING_REQUEST = -2,
 	HTTP_PROGRESS_FETCHING_DATA  = -1
 };
+/* Pending requests with a higher priority are always started before those with a lower priority */
+enum HttpPriority { HTTP_PRIORITY_BACKGROUND, HTTP_PRIORITY_NORMAL, HTTP_PRIORITY_HIGH };
 
 struct HttpRequest {
 	char url[URL_MAX_SIZE];   /* URL data is downloaded from/uploaded to. */
@@ -44,12 +50,20 @@ struct HttpRequest {
 	char lastModified[STRING_SIZE]; /* Time item cached at (if at all) */
 	char etag[STRING_SIZE];         /* ETag of cached item (if any) */
 	cc_uint8 requestType;           /* See the various REQUEST_TYPE_ */
+	cc_uint8 priority;              /* See the various HTTP_PRIORITY_ */
+	char* path;                     /* File the response contents are downloaded to (if any) */
+	void* _download;                /* (private) State for streaming response contents to a file */
+	cc_bool fromCache;              /* Whether the response contents are in the disk cache, instead of from the server */
+	cc_uint8 _cache;                /* (private) See the various HTTP_CACHE_ */
+	int _maxAge;                    /* (private) max-age from Cache-Control header of the response */
 	cc_bool success;                /* Whether Result is 0, status is 200, and data is not NULL */
 	struct StringsBuffer* cookies;  /* Cookie list sent in requests. May be modified by the response. */
 };
 
 /* Frees all dynamically allocated data from a HTTP request */
 void HttpRequest_Free(struct HttpRequest* request);
+/* Attempts to open the cached response contents for the given url. (see HTTP_FLAG_CACHE) */
+cc_bool Http_OpenCachedData(const cc_string* url, struct Stream* stream);
 
 /* Aschronously performs a http GET request to download a skin. */
 /* If url is a skin, downloads from there. (if not, downloads from SKIN_SERVER/[skinName].png) */
@@ -64,6 +78,11 @@ int Http_AsyncPostData(const cc_string* url, cc_uint8 flags, const void* data, c
 /* Asynchronously performs a http GET request. (e.g. to download data) */
 /* Also sets the If-Modified-Since and If-None-Match headers. (if not NULL)  */
 int Http_AsyncGetDataEx(const cc_string* url, cc_uint8 flags, const cc_string* lastModified, const cc_string* etag, struct StringsBuffer* cookies);
+/* Asynchronously performs a http GET request, writing the response contents to the given file. */
+/* Contents are written to "[path].part" as they are downloaded, which is renamed to path once complete. */
+/* NOTE: An interrupted download is resumed from where it stopped, if the server supports that. */
+/* NOTE: The request result never has any data, as the response contents are only written to the file. */
+int Http_AsyncDownloadFile(const cc_string* url, cc_uint8 flags, const cc_string* path);
 /* Attempts to remove given request from pending and finished request lists. */
 /* NOTE: Won't cancel the request if it is currently in progress. */
 void Http_TryCancel(int reqID);
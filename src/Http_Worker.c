@@ -1,12 +1,229 @@
 #include "Core.h"
 #ifndef CC_BUILD_WEB
 #include "_HttpBase.h"
+/* Maximum number of worker threads that can perform http requests at the same time */
+#define HTTP_MAX_WORKERS 8
 
+/*########################################################################################################################*
+*-----------------------------------------------------File downloading----------------------------------------------------*
+*#########################################################################################################################*/
+#define HTTP_DOWNLOAD_BUFFER_SIZE (64 * 1024)
+
+struct HttpDownload {
+	struct Stream file;
+	cc_bool opened;      /* Whether the .part file has been opened for writing yet */
+	cc_uint32 offset;    /* Number of bytes that were already downloaded by an earlier attempt */
+	cc_uint32 written;   /* Number of bytes written to the .part file by this attempt */
+	int rangeStart;      /* Starting offset of a partial response (from Content-Range header) */
+	cc_result res;       /* Error from writing to the .part file (if any) */
+	cc_string validator; /* ETag or Last-Modified of the partially downloaded file */
+	char _validatorBuffer[STRING_SIZE];
+};
+
+static void HttpDownload_GetPath(struct HttpRequest* req, const char* ext, cc_string* path) {
+	String_Format2(path, "%c%c", req->path, ext);
+}
+
+/* Whether the response contents are written to a file instead of stored in memory */
+static cc_bool HttpDownload_IsStreaming(struct HttpRequest* req) {
+	return req->_download && (req->statusCode == 200 || req->statusCode == 206);
+}
+
+static cc_result HttpDownload_ReadValidator(struct HttpRequest* req, struct HttpDownload* dl) {
+	cc_string path; char pathBuffer[FILENAME_SIZE];
+	struct Stream s;
+	cc_uint32 len;
+	cc_result res;
+
+	String_InitArray(path, pathBuffer);
+	HttpDownload_GetPath(req, ".resume", &path);
+	if ((res = Stream_OpenFile(&s, &path))) return res;
+
+	res = s.Length(&s, &len);
+	if (!res) {
+		len = min(len, STRING_SIZE);
+		res = Stream_Read(&s, (cc_uint8*)dl->_validatorBuffer, len);
+		if (!res) dl->validator.length = len;
+	}
+	s.Close(&s);
+	return res;
+}
+
+/* Checks whether an earlier attempt left behind a partially downloaded file that can be resumed */
+static void HttpDownload_Begin(struct HttpRequest* req, struct HttpDownload* dl) {
+	cc_string path; char pathBuffer[FILENAME_SIZE];
+	struct Stream s;
+	cc_uint32 len = 0;
+
+	Mem_Set(dl, 0, sizeof(struct HttpDownload));
+	String_InitArray(dl->validator, dl->_validatorBuffer);
+	req->_download = dl;
+	
+	String_InitArray(path, pathBuffer);
+	HttpDownload_GetPath(req, ".part", &path);
+	if (Stream_OpenFile(&s, &path)) return;
+
+	s.Length(&s, &len);
+	s.Close(&s);
+	/* Resuming is only safe when server can check the file hasn't changed since */
+	if (!len || HttpDownload_ReadValidator(req, dl) || !dl->validator.length) return;
+
+	dl->offset = len;
+	Platform_Log2("Resuming download of %c from %i bytes", req->path, &len);
+}
+
+static cc_bool HttpDownload_Open(struct HttpRequest* req, struct HttpDownload* dl) {
+	cc_string path; char pathBuffer[FILENAME_SIZE];
+	String_InitArray(path, pathBuffer);
+	HttpDownload_GetPath(req, ".part", &path);
+
+	if (req->statusCode == 206 && dl->offset) {
+		/* Server must continue exactly from where the last attempt stopped */
+		if (dl->rangeStart != dl->offset) { dl->res = HTTP_ERR_RESUME; return false; }
+		dl->res = Stream_AppendFile(&dl->file, &path);
+	} else {
+		/* Server ignored the Range header (or file changed), so start from scratch */
+		dl->offset = 0;
+		dl->res    = Stream_CreateFile(&dl->file, &path);
+	}
+
+	dl->opened = !dl->res;
+	return dl->opened;
+}
+
+/* Writes all the response data received so far to the .part file */
+static cc_bool HttpDownload_Flush(struct HttpRequest* req) {
+	struct HttpDownload* dl = (struct HttpDownload*)req->_download;
+	if (dl->res) return false;
+	if (!dl->opened && !HttpDownload_Open(req, dl)) return false;
+
+	if (req->size) dl->res = Stream_Write(&dl->file, req->data, req->size);
+	dl->written += req->size;
+	req->size    = 0;
+	return !dl->res;
+}
+
+/* Ensures data buffer has enough space left to append amount bytes, writing out data to the file if needed */
+static cc_bool HttpDownload_Expand(struct HttpRequest* req, cc_uint32 amount) {
+	cc_uint8* ptr;
+	if (req->size && !HttpDownload_Flush(req)) return false;
+	if (amount <= req->_capacity) return true;
+
+	amount = max(amount, HTTP_DOWNLOAD_BUFFER_SIZE);
+	ptr    = (cc_uint8*)Mem_TryRealloc(req->data, amount, 1);
+	if (!ptr) return false;
+
+	req->data      = ptr;
+	req->_capacity = amount;
+	return true;
+}
+
+static void HttpDownload_Delete(struct HttpRequest* req, const char* ext) {
+	cc_string path; char pathBuffer[FILENAME_SIZE];
+	cc_filepath str;
+
+	String_InitArray(path, pathBuffer);
+	HttpDownload_GetPath(req, ext, &path);
+	Platform_EncodePath(&str, &path);
+	File_Delete(&str);
+}
+
+/* Fallback for when the .part file can't just be renamed */
+static cc_result HttpDownload_CopyPart(const cc_string* src, const cc_string* dst) {
+	cc_uint8 buffer[4096];
+	struct Stream in, out;
+	cc_uint32 read;
+	cc_result res, closeRes;
+
+	if ((res = Stream_OpenFile(&in, src))) return res;
+	if ((res = Stream_CreateFile(&out, dst))) { in.Close(&in); return res; }
+
+	for (;;) {
+		res = in.Read(&in, buffer, sizeof(buffer), &read);
+		if (res || !read) break;
+		if ((res = Stream_Write(&out, buffer, read))) break;
+	}
+
+	closeRes = out.Close(&out);
+	in.Close(&in);
+	return res ? res : closeRes;
+}
+
+static void HttpDownload_Complete(struct HttpRequest* req) {
+	cc_string part; char partBuffer[FILENAME_SIZE];
+	cc_string path = String_FromReadonly(req->path);
+	cc_filepath src, dst;
+	cc_result res;
+
+	String_InitArray(part, partBuffer);
+	HttpDownload_GetPath(req, ".part", &part);
+	Platform_EncodePath(&src, &part);
+	Platform_EncodePath(&dst, &path);
+
+	res = File_Rename(&src, &dst);
+	if (res == ERR_NOT_SUPPORTED) res = HttpDownload_CopyPart(&part, &path);
+	if (res) { req->result = res; return; }
+
+	HttpDownload_Delete(req, ".resume");
+}
+
+/* Remembers how to resume the download later, or discards it when resuming isn't possible */
+static void HttpDownload_Interrupted(struct HttpRequest* req, struct HttpDownload* dl) {
+	static const cc_string weak = String_FromConst("W/");
+	cc_string path; char pathBuffer[FILENAME_SIZE];
+	cc_string validator;
+
+	/* If-Range only accepts strong ETags, so fallback to Last-Modified for weak ones */
+	validator = String_FromRawArray(req->etag);
+	if (String_CaselessStarts(&validator, &weak)) validator.length = 0;
+	if (!validator.length) validator = String_FromRawArray(req->lastModified);
+
+	if (dl->opened && validator.length) {
+		String_InitArray(path, pathBuffer);
+		HttpDownload_GetPath(req, ".resume", &path);
+		Stream_WriteAllTo(&path, (const cc_uint8*)validator.buffer, validator.length);
+	} else if (dl->opened || req->statusCode == 416 || dl->res == HTTP_ERR_RESUME) {
+		/* e.g. 416 Range Not Satisfiable when .part file is bigger than the actual file */
+		HttpDownload_Delete(req, ".part");
+		HttpDownload_Delete(req, ".resume");
+	}
+}
+
+/* Writes out any remaining response data, then moves the .part file to its final location */
+static void HttpDownload_End(struct HttpRequest* req, struct HttpDownload* dl) {
+	cc_result res;
+	/* Even when the transfer failed, the data received so far can still be resumed from */
+	if (HttpDownload_IsStreaming(req)) HttpDownload_Flush(req);
+
+	if (dl->opened) {
+		res = dl->file.Close(&dl->file);
+		if (!dl->res) dl->res = res;
+	}
+	if (dl->res) req->result = dl->res;
+
+	if (!req->result && dl->opened) {
+		HttpDownload_Complete(req);
+	} else {
+		HttpDownload_Interrupted(req, dl);
+	}
+
+	Mem_Free(req->data);
+	req->data      = NULL;
+	req->size      = 0;
+	req->_capacity = 0;
+	req->_download = NULL;
+}
+
+
+/*########################################################################################################################*
+*-----------------------------------------------------Response buffer-----------------------------------------------------*
+*#########################################################################################################################*/
 /* Ensures data buffer has enough space left to append amount bytes */
 static cc_bool Http_BufferExpand(struct HttpRequest* req, cc_uint32 amount) {
 	cc_uint32 newSize = req->size + amount;
 	cc_uint8* ptr;
 	if (newSize <= req->_capacity) return true;
+	if (HttpDownload_IsStreaming(req)) return HttpDownload_Expand(req, amount);
 
 	if (!req->_capacity) {
 		/* Allocate initial storage */
@@ -25,10 +242,27 @@ static cc_bool Http_BufferExpand(struct HttpRequest* req, cc_uint32 amount) {
 	return true;
 }
 
+#if CC_NET_BACKEND == CC_NET_BACKEND_BUILTIN
+/* Preallocates space for the given amount of data, to avoid repeatedly reallocating */
+/* NOTE: Does nothing when the response is being streamed to a file instead */
+static cc_bool Http_BufferReserve(struct HttpRequest* req, cc_uint32 amount) {
+	if (HttpDownload_IsStreaming(req)) return true;
+	return Http_BufferExpand(req, amount);
+}
+#endif
+
 /* Increases size and updates current progress */
 static void Http_BufferExpanded(struct HttpRequest* req, cc_uint32 read) {
+	struct HttpDownload* dl = (struct HttpDownload*)req->_download;
+	cc_uint32 cur = req->size + read, total = req->contentLength;
 	req->size += read;
-	if (req->contentLength) req->progress = (int)(100.0f * req->size / req->contentLength);
+
+	if (HttpDownload_IsStreaming(req)) {
+		/* Include data downloaded by earlier attempts when resuming */
+		cur += dl->written;
+		if (req->statusCode == 206) { cur += dl->offset; total += dl->offset; }
+	}
+	if (total) req->progress = (int)(100.0f * cur / total);
 }
 
 
@@ -55,9 +289,43 @@ static void Http_ParseContentLength(struct HttpRequest* req, const cc_string* va
 	req->contentLength = contentLen;
 }
 
+/* Parses the starting offset from e.g. "bytes 500-999/1000" */
+static void Http_ParseContentRange(struct HttpRequest* req, const cc_string* value) {
+	struct HttpDownload* dl = (struct HttpDownload*)req->_download;
+	cc_string unit, range;
+	int end;
+
+	if (!String_UNSAFE_Separate(value, ' ', &unit, &range)) return;
+	end = String_IndexOf(&range, '-');
+	if (end >= 0) range.length = end;
+
+	Convert_ParseInt(&range, &dl->rangeStart);
+}
+
+/* Parses e.g. "public, max-age=3600" */
+static void Http_ParseCacheControl(struct HttpRequest* req, const cc_string* value) {
+	cc_string left = *value, part, name, arg;
+
+	while (left.length)
+	{
+		String_UNSAFE_SplitBy(&left, ',', &part);
+		String_UNSAFE_TrimStart(&part);
+		String_UNSAFE_TrimEnd(&part);
+
+		if (String_CaselessEqualsConst(&part, "no-store")) {
+			req->_cache |= HTTP_CACHE_NOSTORE;
+		} else if (String_CaselessEqualsConst(&part, "no-cache")) {
+			req->_maxAge = 0;
+		} else if (String_UNSAFE_Separate(&part, '=', &name, &arg) && String_CaselessEqualsConst(&name, "max-age")) {
+			Convert_ParseInt(&arg, &req->_maxAge);
+		}
+	}
+}
+
 /* Parses a HTTP header */
 static void Http_ParseHeader(struct HttpRequest* req, const cc_string* line) {
 	static const cc_string httpVersion = String_FromConst("HTTP");
+	struct HttpDownload* dl = (struct HttpDownload*)req->_download;
 	cc_string name, value, parts[3];
 	int numParts;
 
@@ -65,6 +333,9 @@ static void Http_ParseHeader(struct HttpRequest* req, const cc_string* line) {
 	if (String_CaselessStarts(line, &httpVersion)) {
 		numParts = String_UNSAFE_Split(line, ' ', parts, 3);
 		if (numParts >= 2) Convert_ParseInt(&parts[1], &req->statusCode);
+
+		/* Request was retried after some of the response had already been written to the file */
+		if (dl && dl->opened && !dl->res) dl->res = HTTP_ERR_RESUME;
 	}
 	/* For all other headers:  name: value */
 	if (!String_UNSAFE_Separate(line, ':', &name, &value)) return;
@@ -79,6 +350,10 @@ static void Http_ParseHeader(struct HttpRequest* req, const cc_string* line) {
 		Http_ParseContentLength(req, &value);
 	} else if (String_CaselessEqualsConst(&name, "Last-Modified")) {
 		String_CopyToRawArray(req->lastModified, &value);
+	} else if (req->_cache && String_CaselessEqualsConst(&name, "Cache-Control")) {
+		Http_ParseCacheControl(req, &value);
+	} else if (dl && String_CaselessEqualsConst(&name, "Content-Range")) {
+		Http_ParseContentRange(req, &value);
 	} else if (req->cookies && String_CaselessEqualsConst(&name, "Set-Cookie")) {
 		Http_ParseCookie(req, &value);
 	}
@@ -90,9 +365,19 @@ static void Http_AddHeader(struct HttpRequest* req, const char* key, const cc_st
 /* Adds all the appropriate headers for a request. */
 static void Http_SetRequestHeaders(struct HttpRequest* req) {
 	static const cc_string contentType = String_FromConst("application/x-www-form-urlencoded");
+	struct HttpDownload* dl = (struct HttpDownload*)req->_download;
 	cc_string str, cookies; char cookiesBuffer[1024];
+	char rangeBuffer[STRING_SIZE];
 	int i;
 
+	/* Only continue a partial download if the file hasn't changed since */
+	if (dl && dl->offset) {
+		String_InitArray(str, rangeBuffer);
+		String_Format1(&str, "bytes=%i-", &dl->offset);
+		Http_AddHeader(req, "Range",    &str);
+		Http_AddHeader(req, "If-Range", &dl->validator);
+	}
+
 	if (req->lastModified[0]) {
 		str = String_FromRawArray(req->lastModified);
 		Http_AddHeader(req, "If-Modified-Since", &str);
@@ -229,8 +514,12 @@ static cc_bool LoadCurlFuncs(void) {
 	return success;
 }
 
-static CURL* curl;
+/* Each easy handle can only perform one request at a time, so each worker needs its own */
+static CURL* curlHandles[HTTP_MAX_WORKERS];
+static cc_bool curlHandleUsed[HTTP_MAX_WORKERS];
+static void* curlMutex;
 static cc_bool curlSupported, curlVerbose;
+#define HTTP_BACKEND_WORKERS HTTP_MAX_WORKERS
 
 static cc_bool HttpBackend_DescribeError(cc_result res, cc_string* dst) {
 	const char* err;
@@ -250,9 +539,10 @@ static void HttpBackend_Init(void) {
 	if (!LoadCurlFuncs()) { Logger_WarnFunc(&msg); return; }
 	res = _curl_global_init(CURL_GLOBAL_DEFAULT);
 	if (res) { Logger_SimpleWarn(res, "initing curl"); return; }
-	curl = _curl_easy_init();
-	if (!curl) { Logger_SimpleWarn(res, "initing curl_easy"); return; }
+	curlHandles[0] = _curl_easy_init();
+	if (!curlHandles[0]) { Logger_SimpleWarn(res, "initing curl_easy"); return; }
 
+	curlMutex     = Mutex_Create("HTTP curl");
 	curlSupported = true;
 	curlVerbose = Options_GetBool("curl-verbose", false);
 }
@@ -285,6 +575,8 @@ static size_t Http_ProcessData(char *buffer, size_t size, size_t nitems, void* u
 	struct HttpRequest* req = (struct HttpRequest*)userdata;
 
 	int ok = Http_BufferExpand(req, nitems);
+	/* Returning less than nitems makes curl stop the transfer */
+	if (!ok && req->_download) return 0;
 	if (!ok) Process_Abort("Out of memory for HTTP request");
 
 	Mem_Copy(&req->data[req->size], buffer, nitems);
@@ -292,8 +584,39 @@ static size_t Http_ProcessData(char *buffer, size_t size, size_t nitems, void* u
 	return nitems;
 }
 
+/* Finds an easy handle not being used by any other worker */
+static CURL* Http_AcquireCurl(void) {
+	CURL* curl = NULL;
+	int i;
+
+	Mutex_Lock(curlMutex);
+	for (i = 0; i < HTTP_MAX_WORKERS; i++)
+	{
+		if (curlHandleUsed[i]) continue;
+		if (!curlHandles[i]) curlHandles[i] = _curl_easy_init();
+		if (!curlHandles[i]) break;
+
+		curlHandleUsed[i] = true;
+		curl = curlHandles[i];
+		break;
+	}
+	Mutex_Unlock(curlMutex);
+	return curl;
+}
+
+static void Http_ReleaseCurl(CURL* curl) {
+	int i;
+
+	Mutex_Lock(curlMutex);
+	for (i = 0; i < HTTP_MAX_WORKERS; i++)
+	{
+		if (curlHandles[i] == curl) curlHandleUsed[i] = false;
+	}
+	Mutex_Unlock(curlMutex);
+}
+
 /* Sets general curl options for a request */
-static void Http_SetCurlOpts(struct HttpRequest* req) {
+static void Http_SetCurlOpts(CURL* curl, struct HttpRequest* req) {
 	_curl_easy_setopt(curl, CURLOPT_USERAGENT,      GAME_APP_NAME);
 	_curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 	_curl_easy_setopt(curl, CURLOPT_MAXREDIRS,      20L);
@@ -314,13 +637,15 @@ static cc_result HttpBackend_Do(struct HttpRequest* req, cc_string* url) {
 	char urlStr[NATIVE_STR_LEN];
 	void* post_data = req->data;
 	CURLcode res;
+	CURL* curl;
 	if (!curlSupported) return ERR_NOT_SUPPORTED;
+	if (!(curl = Http_AcquireCurl())) return ERR_OUT_OF_MEMORY;
 
 	req->meta = NULL;
 	Http_SetRequestHeaders(req);
 	_curl_easy_setopt(curl, CURLOPT_HTTPHEADER, req->meta);
 
-	Http_SetCurlOpts(req);
+	Http_SetCurlOpts(curl, req);
 	String_EncodeUtf8(urlStr, url);
 	_curl_easy_setopt(curl, CURLOPT_URL, urlStr);
 
@@ -360,6 +685,8 @@ static cc_result HttpBackend_Do(struct HttpRequest* req, cc_string* url) {
 	/* can free now that request has finished */
 	Mem_Free(post_data);
 	_curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, NULL);
+
+	Http_ReleaseCurl(curl);
 	return res;
 }
 #elif CC_NET_BACKEND == CC_NET_BACKEND_BUILTIN
@@ -534,41 +861,87 @@ static struct ConnectionPoolEntry {
 	cc_string addr;
 	char addrBuffer[STRING_SIZE];
 	cc_bool https;
+	cc_bool inUse; /* Whether a worker is currently performing a request with this connection */
 } connection_pool[10];
+/* NOTE: Must have more entries than workers, so there is always an entry that can be evicted */
+static void* connection_poolMutex;
 
-static cc_result ConnectionPool_Insert(int i, struct HttpConnection** conn, const struct HttpUrl* url) {
+static void ConnectionPool_Claim(int i, const struct HttpUrl* url) {
 	struct ConnectionPoolEntry* e = &connection_pool[i];
-	*conn = &e->conn;
+	e->inUse = true;
 
 	String_InitArray(e->addr, e->addrBuffer);
 	String_Copy(&e->addr, &url->address);
 	e->https = url->https;
-	return HttpConnection_Open(&e->conn, url);
 }
 
-static cc_result ConnectionPool_Open(struct HttpConnection** conn, const struct HttpUrl* url) {
+static int ConnectionPool_Find(const struct HttpUrl* url, cc_bool* reuse) {
 	struct ConnectionPoolEntry* e;
-	int i;
+	int i, j;
 
 	for (i = 0; i < Array_Elems(connection_pool); i++)
 	{
 		e = &connection_pool[i];
-		if (e->conn.valid && e->https == url->https && String_Equals(&e->addr, &url->address)) {
-			*conn = &connection_pool[i].conn;
-			return 0;
+		if (e->inUse || !e->conn.valid) continue;
+
+		if (e->https == url->https && String_Equals(&e->addr, &url->address)) {
+			*reuse = true; return i;
 		}
 	}
 
 	for (i = 0; i < Array_Elems(connection_pool); i++)
 	{
 		e = &connection_pool[i];
-		if (!e->conn.valid) return ConnectionPool_Insert(i, conn, url);
+		if (!e->inUse && !e->conn.valid) return i;
 	}
 
 	/* TODO: Should we be consistent in which entry gets evicted? */
-	i = (cc_uint8)Stopwatch_Measure() % Array_Elems(connection_pool);
-	HttpConnection_Close(&connection_pool[i].conn);
-	return ConnectionPool_Insert(i, conn, url);
+	j = (cc_uint8)Stopwatch_Measure() % Array_Elems(connection_pool);
+	for (i = 0; i < Array_Elems(connection_pool); i++, j = (j + 1) % Array_Elems(connection_pool))
+	{
+		e = &connection_pool[j];
+		if (e->inUse) continue;
+
+		HttpConnection_Close(&e->conn);
+		return j;
+	}
+	return -1;
+}
+
+/* Retrieves a connection to the given url's host, opening a new connection if necessary */
+/* NOTE: ConnectionPool_Release must be called afterwards, even if this fails (unless conn is NULL) */
+static cc_result ConnectionPool_Open(struct HttpConnection** conn, const struct HttpUrl* url) {
+	cc_bool reuse = false;
+	int i;
+	*conn = NULL;
+
+	Mutex_Lock(connection_poolMutex);
+	{
+		i = ConnectionPool_Find(url, &reuse);
+		if (i >= 0 && reuse)  connection_pool[i].inUse = true;
+		if (i >= 0 && !reuse) ConnectionPool_Claim(i, url);
+	}
+	Mutex_Unlock(connection_poolMutex);
+
+	/* Shouldn't happen since there are more entries than workers, but just fail the request if it does */
+	if (i < 0) return HTTP_ERR_NO_CONNECTION;
+	*conn = &connection_pool[i].conn;
+	if (reuse) return 0;
+
+	/* Slow part (DNS lookup, TCP connect, SSL handshake) is done outside the lock */
+	return HttpConnection_Open(*conn, url);
+}
+
+/* Allows other workers to use the given connection again */
+static void ConnectionPool_Release(struct HttpConnection* conn) {
+	int i;
+
+	Mutex_Lock(connection_poolMutex);
+	for (i = 0; i < Array_Elems(connection_pool); i++)
+	{
+		if (&connection_pool[i].conn == conn) connection_pool[i].inUse = false;
+	}
+	Mutex_Unlock(connection_poolMutex);
 }
 
 
@@ -747,7 +1120,7 @@ static cc_result HttpClient_Process(struct HttpClientState* state, char* buffer,
 					/* The rest of the request body is just content/data */
 					if (state->state == HTTP_RESPONSE_STATE_DATA) {
 						state->dataLeft = req->contentLength;
-						ok = Http_BufferExpand(req, state->dataLeft);
+						ok = Http_BufferReserve(req, state->dataLeft);
 						if (!ok) return ERR_OUT_OF_MEMORY;
 					}
 					break;
@@ -766,6 +1139,8 @@ static cc_result HttpClient_Process(struct HttpClientState* state, char* buffer,
 			avail = state->dataLeft;
 			read  = min(left, avail);
 
+			ok = Http_BufferExpand(req, read);
+			if (!ok) return ERR_OUT_OF_MEMORY;
 			Mem_Copy(req->data + req->size, buffer + offset, read);
 			Http_BufferExpanded(req, read); 
 
@@ -798,7 +1173,7 @@ static cc_result HttpClient_Process(struct HttpClientState* state, char* buffer,
 					state->state = HTTP_RESPONSE_STATE_DATA;
 
 					state->dataLeft = chunkLen;
-					ok = Http_BufferExpand(req, state->dataLeft);
+					ok = Http_BufferReserve(req, state->dataLeft);
 					if (!ok) return ERR_OUT_OF_MEMORY;
 				}
 				break;
@@ -855,7 +1230,11 @@ static cc_result HttpClient_ParseResponse(struct HttpClientState* state) {
 
 	for (;;) 
 	{
-		dst = state->dataLeft > INPUT_BUFFER_LEN ? (req->data + req->size) : buffer;
+		dst = buffer;
+		if (state->dataLeft > INPUT_BUFFER_LEN) {
+			if (!Http_BufferExpand(req, INPUT_BUFFER_LEN)) return ERR_OUT_OF_MEMORY;
+			dst = req->data + req->size;
+		}
 		res = HttpConnection_Read(state->conn, dst, INPUT_BUFFER_LEN, &total);
 		if (res) return res;
 
@@ -897,7 +1276,9 @@ static cc_result HttpClient_HandleRedirect(struct HttpClientState* state) {
 /*########################################################################################################################*
 *-----------------------------------------------Http backend implementation-----------------------------------------------*
 *#########################################################################################################################*/
+#define HTTP_BACKEND_WORKERS HTTP_MAX_WORKERS
 static void HttpBackend_Init(void) {
+	connection_poolMutex = Mutex_Create("HTTP connections");
 	SSLBackend_Init(httpsVerify);
 	//httpOnly = true; // TODO: insecure
 }
@@ -910,14 +1291,14 @@ static cc_result HttpBackend_PerformRequest(struct HttpClientState* state) {
 	cc_result res;
 
 	res = ConnectionPool_Open(&state->conn, &state->url);
-	if (res) { HttpConnection_Close(state->conn); return res; }
-
-	res = HttpClient_SendRequest(state);
-	if (res) { HttpConnection_Close(state->conn); return res; }
+	if (!state->conn) return res;
 
-	res = HttpClient_ParseResponse(state);
-	if (res) HttpConnection_Close(state->conn);
+	if (!res) res = HttpClient_SendRequest(state);
+	if (!res) res = HttpClient_ParseResponse(state);
 
+	/* Connections that the server closes can't be reused by later requests */
+	if (res || state->autoClose) HttpConnection_Close(state->conn);
+	ConnectionPool_Release(state->conn);
 	return res;
 }
 
@@ -1034,6 +1415,8 @@ static void CacheMethodRefs(JNIEnv* env) {
 	JAVA_httpDescribeError = JavaGetSMethod(env, "httpDescribeError", "(I)Ljava/lang/String;");
 }
 
+/* Requests are performed through the single static Java request state */
+#define HTTP_BACKEND_WORKERS 1
 static void HttpBackend_Init(void) {
 	JNIEnv* env;
 	JavaGetCurrentEnv(env);
@@ -1099,6 +1482,7 @@ static cc_bool HttpBackend_DescribeError(cc_result res, cc_string* dst) {
     return false;
 }
 
+#define HTTP_BACKEND_WORKERS 1
 static void HttpBackend_Init(void) {
     
 }
@@ -1212,6 +1596,7 @@ static cc_bool HttpBackend_DescribeError(cc_result res, cc_string* dst) {
 	return false;
 }
 
+#define HTTP_BACKEND_WORKERS 1
 static void HttpBackend_Init(void) { }
 
 static void Http_AddHeader(struct HttpRequest* req, const char* key, const cc_string* value) { }
@@ -1223,14 +1608,52 @@ static cc_result HttpBackend_Do(struct HttpRequest* req, cc_string* url) {
 #endif
 
 
-static void* workerWaitable;
-static void* workerThread;
+#if defined CC_BUILD_COOPTHREADED || defined CC_BUILD_LOWMEM
+	#define HTTP_DEF_WORKERS 1
+#else
+	#define HTTP_DEF_WORKERS 6
+#endif
+#define HTTP_DEF_HOST_LIMIT 4
+
+struct HttpWorker {
+	void* thread;
+	void* waitable;
+	struct HttpRequest request; /* Copy of request currently being performed (id is 0 when idle) */
+	/* NOTE: Fields below are protected by pendingMutex instead of curRequestMutex */
+	cc_bool busy, sleeping;
+	cc_uint8 priority;
+	cc_string host;
+	char _hostBuffer[STRING_SIZE];
+};
+
+static struct HttpWorker http_workers[HTTP_MAX_WORKERS];
+static int http_numWorkers, http_startedWorkers, http_hostLimit;
 
 static void* pendingMutex;
 static struct RequestList pendingReqs;
 
+/* Adds a request to the pending list, after all other requests of the same or higher priority */
+/* NOTE: Like RequestList_Append, HTTP_FLAG_PRIORITY requests still go before other priority requests */
+static void PendingList_Insert(struct HttpRequest* item) {
+	struct RequestList* list = &pendingReqs;
+	int i, prev;
+	RequestList_EnsureSpace(list);
+
+	/* Shift lower priority requests right one place */
+	for (i = list->count; i > 0; i--)
+	{
+		prev = list->entries[i - 1].priority;
+		if (prev > item->priority) break;
+		if (prev == item->priority && prev != HTTP_PRIORITY_HIGH) break;
+
+		HttpRequest_Copy(&list->entries[i], &list->entries[i - 1]);
+	}
+
+	HttpRequest_Copy(&list->entries[i], item);
+	list->count++;
+}
+
 static void* curRequestMutex;
-static struct HttpRequest http_curRequest;
 
 
 /*########################################################################################################################*
@@ -1249,20 +1672,37 @@ cc_bool Http_GetResult(int reqID, struct HttpRequest* item) {
 }
 
 cc_bool Http_GetCurrent(int* reqID, int* progress) {
+	struct HttpWorker* w;
+	int i;
+
+	*reqID    = 0;
+	*progress = HTTP_PROGRESS_NOT_WORKING_ON;
+
 	Mutex_Lock(curRequestMutex);
+	for (i = 0; i < http_numWorkers; i++)
 	{
-		*reqID    = http_curRequest.id;
-		*progress = http_curRequest.progress;
+		w = &http_workers[i];
+		if (!w->request.id) continue;
+		/* Report the oldest request still in progress */
+		if (*reqID && w->request.id > *reqID) continue;
+
+		*reqID    = w->request.id;
+		*progress = w->request.progress;
 	}
 	Mutex_Unlock(curRequestMutex);
 	return *reqID != 0;
 }
 
 int Http_CheckProgress(int reqID) {
-	int curReqID, progress;
-	Http_GetCurrent(&curReqID, &progress);
+	int i, progress = HTTP_PROGRESS_NOT_WORKING_ON;
 
-	if (reqID != curReqID) progress = HTTP_PROGRESS_NOT_WORKING_ON;
+	Mutex_Lock(curRequestMutex);
+	for (i = 0; i < http_numWorkers; i++)
+	{
+		if (http_workers[i].request.id != reqID) continue;
+		progress = http_workers[i].request.progress;
+	}
+	Mutex_Unlock(curRequestMutex);
 	return progress;
 }
 
@@ -1293,7 +1733,7 @@ void Http_TryCancel(int reqID) {
 *-----------------------------------------------------Http worker---------------------------------------------------------*
 *#########################################################################################################################*/
 /* Sets up state to begin a http request */
-static void PrepareCurrentRequest(struct HttpRequest* req, cc_string* url) {
+static void PrepareCurrentRequest(struct HttpWorker* w, struct HttpRequest* req, cc_string* url) {
 	static const char* verbs[] = { "GET", "HEAD", "POST" };
 	Http_GetUrl(req, url);
 	Platform_Log2("Fetching %s (%c)", url, verbs[req->requestType]);
@@ -1301,18 +1741,28 @@ static void PrepareCurrentRequest(struct HttpRequest* req, cc_string* url) {
 
 	Mutex_Lock(curRequestMutex);
 	{
-		HttpRequest_Copy(&http_curRequest, req);
-		http_curRequest.progress = HTTP_PROGRESS_MAKING_REQUEST;
+		HttpRequest_Copy(&w->request, req);
+		w->request.progress = HTTP_PROGRESS_MAKING_REQUEST;
 	}
 	Mutex_Unlock(curRequestMutex);
 }
 
 static void PerformRequest(struct HttpRequest* req, cc_string* url) {
+	struct HttpDownload download;
 	cc_uint64 beg, end;
 	int elapsed;
 
 	beg = Stopwatch_Measure();
-	req->result = HttpBackend_Do(req, url);
+	if (req->path) HttpDownload_Begin(req, &download);
+	if (req->_cache)  HttpCache_Prepare(req);
+
+	if (req->_cache & HTTP_CACHE_FRESH) {
+		/* Cached response hasn't expired yet, so just pretend server said it's unchanged */
+		req->statusCode = 304;
+	} else {
+		req->result = HttpBackend_Do(req, url);
+	}
+	if (req->path) HttpDownload_End(req, &download);
 	end = Stopwatch_Measure();
 
 	elapsed = Stopwatch_ElapsedMS(beg, end);
@@ -1322,63 +1772,155 @@ static void PerformRequest(struct HttpRequest* req, cc_string* url) {
 	Http_FinishRequest(req);
 }
 
-static void ClearCurrentRequest(void) {
+static void ClearCurrentRequest(struct HttpWorker* w) {
 	Mutex_Lock(curRequestMutex);
 	{
-		http_curRequest.id       = 0;
-		http_curRequest.progress = HTTP_PROGRESS_NOT_WORKING_ON;
+		w->request.id       = 0;
+		w->request.progress = HTTP_PROGRESS_NOT_WORKING_ON;
 	}
 	Mutex_Unlock(curRequestMutex);
 }
 
-static void DoRequest(struct HttpRequest* request) {
+static void DoRequest(struct HttpWorker* w, struct HttpRequest* request) {
 	char urlBuffer[URL_MAX_SIZE]; cc_string url;
 
 	String_InitArray(url, urlBuffer);
-	PrepareCurrentRequest(request, &url);
-	PerformRequest(&http_curRequest, &url);
-	ClearCurrentRequest();
+	PrepareCurrentRequest(w, request, &url);
+	PerformRequest(&w->request, &url);
+	ClearCurrentRequest(w);
+}
+
+/* Extracts the "host:port" part of a request's url */
+static void GetRequestHost(struct HttpRequest* req, cc_string* host) {
+	cc_string url = String_FromRawArray(req->url);
+	int beg, end;
+
+	beg = String_IndexOfConst(&url, "://");
+	beg = beg == -1 ? 0 : beg + 3;
+	end = String_IndexOfAt(&url, beg, '/');
+	if (end == -1) end = url.length;
+
+	*host = String_UNSAFE_Substring(&url, beg, end - beg);
+}
+
+/* Whether the given pending request can be started without exceeding any limits */
+/* NOTE: Must be called while pendingMutex is locked */
+static cc_bool CanStartRequest(struct HttpRequest* req) {
+	struct HttpWorker* w;
+	int i, sameHost = 0, background = 0;
+	cc_string host;
+
+	GetRequestHost(req, &host);
+	for (i = 0; i < http_numWorkers; i++)
+	{
+		w = &http_workers[i];
+		if (!w->busy) continue;
+
+		if (String_CaselessEquals(&w->host, &host)) sameHost++;
+		if (w->priority == HTTP_PRIORITY_BACKGROUND) background++;
+	}
+	if (sameHost >= http_hostLimit) return false;
+
+	/* Always keep one worker free for more important requests (e.g. texture pack) */
+	/*  so that they don't have to wait for dozens of skin downloads to finish first */
+	if (req->priority == HTTP_PRIORITY_BACKGROUND && http_numWorkers > 1) {
+		return background < http_numWorkers - 1;
+	}
+	return true;
+}
+
+/* Removes the highest priority request that can currently be started from the pending list */
+static cc_bool TakeNextRequest(struct HttpWorker* w, struct HttpRequest* request) {
+	cc_string host;
+	int i;
+
+	for (i = 0; i < pendingReqs.count; i++)
+	{
+		if (!CanStartRequest(&pendingReqs.entries[i])) continue;
+
+		HttpRequest_Copy(request, &pendingReqs.entries[i]);
+		RequestList_RemoveAt(&pendingReqs, i);
+
+		GetRequestHost(request, &host);
+		String_Copy(&w->host, &host);
+		w->priority = request->priority;
+		w->busy     = true;
+		return true;
+	}
+	return false;
+}
+
+/* Wakes up one sleeping worker, if any other pending request can currently be started */
+/* NOTE: Must be called while pendingMutex is locked */
+static void WakeupWorker(void) {
+	int i;
+	for (i = 0; i < pendingReqs.count; i++)
+	{
+		if (CanStartRequest(&pendingReqs.entries[i])) break;
+	}
+	if (i == pendingReqs.count) return;
+
+	for (i = 0; i < http_numWorkers; i++)
+	{
+		if (!http_workers[i].sleeping) continue;
+
+		http_workers[i].sleeping = false;
+		Waitable_Signal(http_workers[i].waitable);
+		return;
+	}
 }
 
 static void WorkerLoop(void) {
 	struct HttpRequest request;
+	struct HttpWorker* w;
 	cc_bool hasRequest;
 
-	for (;;) {
-		hasRequest = false;
+	Mutex_Lock(pendingMutex);
+	{
+		w = &http_workers[http_startedWorkers++];
+	}
+	Mutex_Unlock(pendingMutex);
 
+	for (;;) {
 		Mutex_Lock(pendingMutex);
 		{
-			if (pendingReqs.count) {
-				HttpRequest_Copy(&request, &pendingReqs.entries[0]);
-				hasRequest = true;
-				RequestList_RemoveAt(&pendingReqs, 0);
-			}
+			hasRequest  = TakeNextRequest(w, &request);
+			w->sleeping = !hasRequest;
+			/* Let another worker start any other request that can be started now */
+			if (hasRequest) WakeupWorker();
 		}
 		Mutex_Unlock(pendingMutex);
 
 		if (hasRequest) {
-			DoRequest(&request);
+			DoRequest(w, &request);
+
+			/* Requests held back by the per host or priority limits */
+			/*  may be startable now, which is checked on next loop iteration */
+			Mutex_Lock(pendingMutex);
+			{
+				w->busy = false;
+			}
+			Mutex_Unlock(pendingMutex);
 		} else {
 			/* Block until another thread submits a request to do */
 			Platform_LogConst("Download queue empty, going back to sleep...");
-			Waitable_Wait(workerWaitable);
+			Waitable_Wait(w->waitable);
 		}
 	}
 }
 
-/* Adds a req to the list of pending requests, waking up worker thread if needed */
+/* Adds a req to the list of pending requests, waking up worker threads if needed */
 static void HttpBackend_Add(struct HttpRequest* req, cc_uint8 flags) {
 #if defined CC_BUILD_PSP || defined CC_BUILD_NDS
 	/* TODO why doesn't threading work properly on PSP */
-	DoRequest(req);
+	DoRequest(&http_workers[0], req);
 #else
 	Mutex_Lock(pendingMutex);
 	{
-		RequestList_Append(&pendingReqs, req, flags);
+		PendingList_Insert(req);
+		WakeupWorker();
 	}
 	Mutex_Unlock(pendingMutex);
-	Waitable_Signal(workerWaitable);
 #endif
 }
 
@@ -1386,20 +1928,36 @@ static void HttpBackend_Add(struct HttpRequest* req, cc_uint8 flags) {
 *-----------------------------------------------------Http component------------------------------------------------------*
 *#########################################################################################################################*/
 static void Http_Init(void) {
+	struct HttpWorker* w;
+	int i;
+
 	Http_InitCommon();
-	http_curRequest.progress = HTTP_PROGRESS_NOT_WORKING_ON;
 	/* Http component gets initialised multiple times on Android */
-	if (workerThread) return;
+	if (http_numWorkers) return;
 
 	HttpBackend_Init();
 	RequestList_Init(&pendingReqs);
 	RequestList_Init(&processedReqs);
 
-	workerWaitable  = Waitable_Create("HTTP wakeup");
+	http_numWorkers = Options_GetInt(OPT_HTTP_WORKERS,    1, HTTP_MAX_WORKERS, HTTP_DEF_WORKERS);
+	http_numWorkers = min(http_numWorkers, HTTP_BACKEND_WORKERS);
+	http_hostLimit  = Options_GetInt(OPT_HTTP_HOST_LIMIT, 1, HTTP_MAX_WORKERS, HTTP_DEF_HOST_LIMIT);
+
 	pendingMutex    = Mutex_Create("HTTP pending");
 	processedMutex  = Mutex_Create("HTTP processed");
 	curRequestMutex = Mutex_Create("HTTP current");
-	
-	Thread_Run(&workerThread, WorkerLoop, 128 * 1024, "HTTP");
+
+	for (i = 0; i < http_numWorkers; i++)
+	{
+		w = &http_workers[i];
+		w->request.progress = HTTP_PROGRESS_NOT_WORKING_ON;
+		w->waitable = Waitable_Create("HTTP wakeup");
+		String_InitArray(w->host, w->_hostBuffer);
+	}
+
+	for (i = 0; i < http_numWorkers; i++)
+	{
+		Thread_Run(&http_workers[i].thread, WorkerLoop, 128 * 1024, "HTTP");
+	}
 }
 #endif
@@ -114,8 +114,13 @@ static const char* GetCCErrorDesc(cc_result res) {
 	case NBT_ERR_EXPECTED_STR: return "Expected String NBT tag";
 	case NBT_ERR_EXPECTED_ARR: return "Expected ByteArray NBT tag";
 	case NBT_ERR_ARR_TOO_SMALL:return "ByteArray NBT tag too small";
+	case NBT_ERR_TOO_DEEP:     return "NBT tags nested too deeply";
+	case CCMAP_ERR_HEADER:     return "Invalid .ccmap header";
+	case CCMAP_ERR_SECTION:    return "Invalid .ccmap block sections";
 
 	case HTTP_ERR_NO_SSL: return "HTTPS URLs are not currently supported";
+	case HTTP_ERR_RESUME: return "Server returned wrong part of the file when resuming download";
+	case HTTP_ERR_NO_CONNECTION: return "Too many HTTP connections in use";
 	case SOCK_ERR_UNKNOWN_HOST: return "Host could not be resolved to an IP address";
 	case ERR_NO_NETWORKING: return "No working network access";
 	}
@@ -1331,15 +1331,29 @@ static void SaveLevelScreen_RemoveOverwrites(struct SaveLevelScreen* s) {
 	}
 }
 
-static cc_result DoSaveMap(const cc_string* path, struct GZipState* state) {
+static cc_result DoSaveMap(const cc_string* path, struct GZipParallelState* state) {
 	static const cc_string schematic = String_FromConst(".schematic");
 	static const cc_string mine      = String_FromConst(".mine");
+	static const cc_string ccmap     = String_FromConst(".ccmap");
 	struct Stream stream, compStream;
 	cc_result res;
 
 	res = Stream_CreateFile(&stream, path);
 	if (res) { Logger_SysWarn2(res, "creating", path); return res; }
-	GZip_MakeStream(&compStream, state, &stream);
+
+	/* .ccmap files are written uncompressed, so they can be loaded faster */
+	if (String_CaselessEnds(path, &ccmap)) {
+		res = CcMap_Save(&stream, false);
+		if (res) {
+			stream.Close(&stream);
+			Logger_SysWarn2(res, "encoding", path); return res;
+		}
+
+		res = stream.Close(&stream);
+		if (res) { Logger_SysWarn2(res, "closing", path); return res; }
+		return 0;
+	}
+	GZip_MakeParallelStream(&compStream, state, &stream);
 
 	if (String_CaselessEnds(path, &schematic)) {
 		res = Schematic_Save(&compStream);
@@ -1365,10 +1379,10 @@ static cc_result DoSaveMap(const cc_string* path, struct GZipState* state) {
 }
 
 static cc_result SaveLevelScreen_SaveMap(const cc_string* path) {
-	struct GZipState* state;
+	struct GZipParallelState* state;
 	cc_result res;
 
-	state = Mem_TryAlloc(1, sizeof(struct GZipState));
+	state = Mem_TryAlloc(1, sizeof(struct GZipParallelState));
 	res   = ERR_OUT_OF_MEMORY;
 	if (!state) { Logger_SysWarn(res, "allocating temp memory"); return res; }
 
@@ -1376,11 +1390,19 @@ static cc_result SaveLevelScreen_SaveMap(const cc_string* path) {
 	Mem_Free(state);
 	if (res) return res;
 
-	World.LastSave = Game.Time;
 	Gui_ShowPauseMenu();
 	return 0;
 }
 
+static void SaveLevelScreen_SavedMap(const cc_string* path, cc_result res) {
+	/* Failure has already been logged by this point */
+	if (res) return;
+
+	World.LastSave = Game.Time;
+	Chat_Add1("&eSaved map to: %s", path);
+	CPE_SendNotifyAction(NOTIFY_ACTION_LEVEL_SAVED, 0);
+}
+
 static void SaveLevelScreen_Save(void* screen, void* widget) { 
 	struct SaveLevelScreen* s = (struct SaveLevelScreen*)screen;
 	struct ButtonWidget* btn  = (struct ButtonWidget*)widget;
@@ -1393,6 +1415,11 @@ static void SaveLevelScreen_Save(void* screen, void* widget) {
 		TextWidget_SetConst(&s->desc, "&ePlease enter a filename", &s->textFont);
 		return;
 	}
+	/* e.g. an autosave is still being written */
+	if (Map_IsSavingInBackground()) {
+		TextWidget_SetConst(&s->desc, "&eStill saving previous map, please wait", &s->textFont);
+		return;
+	}
 
 	String_InitArray(path, pathBuffer);
 	String_Format1(&path, "maps/%s.cw", &file);
@@ -1406,25 +1433,22 @@ static void SaveLevelScreen_Save(void* screen, void* widget) {
 	}
 		
 	SaveLevelScreen_RemoveOverwrites(s);
-	if ((res = SaveLevelScreen_SaveMap(&path))) return;
-	Chat_Add1("&eSaved map to: %s", &path);
-	CPE_SendNotifyAction(NOTIFY_ACTION_LEVEL_SAVED, 0);
+	/* .cw maps are written on a background thread, so the game doesn't freeze while saving */
+	if ((res = Map_SaveInBackground(&path, SaveLevelScreen_SavedMap))) return;
+	Gui_ShowPauseMenu();
 }
 
 static void SaveLevelScreen_UploadCallback(const cc_string* path) {
 	cc_result res = SaveLevelScreen_SaveMap(path);
-	if (!res) {
-		Chat_Add1("&eSaved map to: %s", path);
-		CPE_SendNotifyAction(NOTIFY_ACTION_LEVEL_SAVED, 0);
-	}
+	SaveLevelScreen_SavedMap(path, res);
 }
 
 static void SaveLevelScreen_File(void* screen, void* b) {
 	static const char* const titles[] = {
-		"ClassiCube map", "Minecraft schematic", "Minecraft classic map", NULL
+		"ClassiCube map", "Minecraft schematic", "Minecraft classic map", "ClassiCube uncompressed map", NULL
 	};
 	static const char* const filters[] = {
-		".cw", ".schematic", ".mine", NULL
+		".cw", ".schematic", ".mine", ".ccmap", NULL
 	};
 	struct SaveLevelScreen* s = (struct SaveLevelScreen*)screen;
 	struct SaveFileDialogArgs args;
@@ -1824,7 +1848,7 @@ static void LoadLevelScreen_LoadEntries(struct ListScreen* s) {
 static void LoadLevelScreen_UploadCallback(const cc_string* path) { Map_LoadFrom(path); }
 static void LoadLevelScreen_ActionFunc(void* s, void* w) {
 	static const char* const filters[] = { 
-		".cw", ".dat", ".lvl", ".mine", ".fcm", ".mclevel", NULL 
+		".cw", ".dat", ".lvl", ".mine", ".fcm", ".mclevel", ".ccmap", NULL 
 	}; /* TODO not hardcode list */
 	static struct OpenFileDialogArgs args = {
 		"Classic map files", filters,
@@ -131,6 +131,8 @@ void Model_SetupState(struct Model* model, struct Entity* e) {
 	/* TODO: Remove setting this eventually */
 	Models.uScale = 100.0f;
 	Models.vScale = 100.0f;
+	Models.uOffset = 0.0f;
+	Models.vOffset = 0.0f;
 
 	if (!e->NoShade) {
 		Models.Cols[1] = PackedCol_Scale(col, PACKEDCOL_SHADE_YMIN);
@@ -149,26 +151,32 @@ void Model_SetupState(struct Model* model, struct Entity* e) {
 	Models.Active  = model;
 }
 
-void Model_ApplyTexture(struct Entity* e) {
-	struct Model* model = Models.Active;
-	struct ModelTex* data;
-	GfxResourceID tex;
-	cc_bool _64x64;
+static GfxResourceID Model_GetTexture(struct Model* model, struct Entity* e, cc_uint8* skinType) {
+	GfxResourceID tex = model->usesHumanSkin ? e->TextureId : e->MobTextureId;
+	if (tex) { *skinType = e->SkinType; return tex; }
+
+	*skinType = model->defaultTex->skinType;
+	return model->defaultTex->texID;
+}
 
-	tex = model->usesHumanSkin ? e->TextureId : e->MobTextureId;
-	if (tex) {
-		Models.skinType = e->SkinType;
+static void Model_SetTexScale(struct Entity* e, GfxResourceID tex) {
+	cc_bool _64x64 = Models.skinType != SKIN_64x32;
+	Models.uScale  = e->uScale * 0.015625f;
+	Models.vScale  = e->vScale * (_64x64 ? 0.015625f : 0.03125f);
+
+	/* Model might be using its default texture instead of the entity's skin */
+	if ((e->Flags & ENTITY_FLAG_SKIN_ATLAS) && (tex == e->TextureId || tex == e->MobTextureId)) {
+		Entity_GetSkinOffset(e, &Models.uOffset, &Models.vOffset);
 	} else {
-		data = model->defaultTex;
-		tex  = data->texID;
-		Models.skinType = data->skinType;
+		Models.uOffset = 0.0f;
+		Models.vOffset = 0.0f;
 	}
+}
 
+void Model_ApplyTexture(struct Entity* e) {
+	GfxResourceID tex = Model_GetTexture(Models.Active, e, &Models.skinType);
 	Gfx_BindTexture(tex);
-	_64x64 = Models.skinType != SKIN_64x32;
-
-	Models.uScale = e->uScale * 0.015625f;
-	Models.vScale = e->vScale * (_64x64 ? 0.015625f : 0.03125f);
+	Model_SetTexScale(e, tex);
 }
 
 
@@ -222,8 +230,8 @@ void Model_DrawPart(struct ModelPart* part) {
 		dst->x = v.x; dst->y = v.y; dst->z = v.z;
 		dst->Col = Models.Cols[i >> 2];
 
-		dst->U = (v.u & UV_POS_MASK) * Models.uScale - (v.u >> UV_MAX_SHIFT) * 0.01f * Models.uScale;
-		dst->V = (v.v & UV_POS_MASK) * Models.vScale - (v.v >> UV_MAX_SHIFT) * 0.01f * Models.vScale;
+		dst->U = (v.u & UV_POS_MASK) * Models.uScale - (v.u >> UV_MAX_SHIFT) * 0.01f * Models.uScale + Models.uOffset;
+		dst->V = (v.v & UV_POS_MASK) * Models.vScale - (v.v >> UV_MAX_SHIFT) * 0.01f * Models.vScale + Models.vOffset;
 		src++; dst++;
 	}
 	model->index += count;
@@ -276,8 +284,8 @@ void Model_DrawRotate(float angleX, float angleY, float angleZ, struct ModelPart
 		dst->x = v.x + x; dst->y = v.y + y; dst->z = v.z + z;
 		dst->Col = Models.Cols[i >> 2];
 
-		dst->U = (v.u & UV_POS_MASK) * Models.uScale - (v.u >> UV_MAX_SHIFT) * 0.01f * Models.uScale;
-		dst->V = (v.v & UV_POS_MASK) * Models.vScale - (v.v >> UV_MAX_SHIFT) * 0.01f * Models.vScale;
+		dst->U = (v.u & UV_POS_MASK) * Models.uScale - (v.u >> UV_MAX_SHIFT) * 0.01f * Models.uScale + Models.uOffset;
+		dst->V = (v.v & UV_POS_MASK) * Models.vScale - (v.v >> UV_MAX_SHIFT) * 0.01f * Models.vScale + Models.vOffset;
 		src++; dst++;
 	}
 	model->index += count;
@@ -845,8 +853,8 @@ static void CustomModel_DrawArm(struct Entity* e) {
 	if (!cm->numArmParts) return;
 	Gfx_SetAlphaTest(true);
 
-	Models.uScale = 1.0f / cm->uScale;
-	Models.vScale = 1.0f / cm->vScale;
+	Models.uScale = e->uScale / cm->uScale;
+	Models.vScale = e->vScale / cm->vScale;
 	Model_LockVB(e, cm->numArmParts * MODEL_BOX_VERTICES);
 
 	for (i = 0; i < cm->numParts; i++) 
@@ -936,16 +944,8 @@ struct ModelSet {
 #define HUMAN_HAT64_VERTICES (6 * MODEL_BOX_VERTICES)
 #define HUMAN_MAX_VERTICES   HUMAN_BASE_VERTICES + HUMAN_HAT64_VERTICES
 
-static void HumanModel_DrawCore(struct Entity* e, struct ModelSet* model, cc_bool opaqueBody) {
-	struct ModelLimbs* set;
-	int type, num;
-	Model_ApplyTexture(e);
-
-	type = Models.skinType;
-	set  = &model->limbs[type & 0x3];
-	num  = HUMAN_BASE_VERTICES + (type == SKIN_64x32 ? HUMAN_HAT32_VERTICES : HUMAN_HAT64_VERTICES);
-	Model_LockVB(e, num);
-
+/* Draws the head, torso, arms and legs (HUMAN_BASE_VERTICES vertices) */
+static void HumanModel_DrawBase(struct Entity* e, struct ModelSet* model, struct ModelLimbs* set) {
 	Model_DrawRotate(-e->Pitch * MATH_DEG2RAD, 0, 0, &model->head, true);
 	Model_DrawPart(&model->torso);
 	Model_DrawRotate(e->Anim.LeftLegX,  0, e->Anim.LeftLegZ,  &set->leftLeg,  false);
@@ -955,7 +955,10 @@ static void HumanModel_DrawCore(struct Entity* e, struct ModelSet* model, cc_boo
 	Model_DrawRotate(e->Anim.LeftArmX,  0, e->Anim.LeftArmZ,  &set->leftArm,  false);
 	Model_DrawRotate(e->Anim.RightArmX, 0, e->Anim.RightArmZ, &set->rightArm, false);
 	Models.Rotation = ROTATE_ORDER_ZYX;
+}
 
+/* Draws the hat, and the torso/arm/leg layers for 64x64 skins */
+static void HumanModel_DrawLayers(struct Entity* e, struct ModelSet* model, struct ModelLimbs* set, int type) {
 	if (type != SKIN_64x32) {
 		Model_DrawPart(&model->torsoLayer);
 		Model_DrawRotate(e->Anim.LeftLegX,  0, e->Anim.LeftLegZ,  &set->leftLegLayer,  false);
@@ -967,6 +970,21 @@ static void HumanModel_DrawCore(struct Entity* e, struct ModelSet* model, cc_boo
 		Models.Rotation = ROTATE_ORDER_ZYX;
 	}
 	Model_DrawRotate(-e->Pitch * MATH_DEG2RAD, 0, 0, &model->hat, true);
+}
+
+#define HumanModel_LayerVertices(type) ((type) == SKIN_64x32 ? HUMAN_HAT32_VERTICES : HUMAN_HAT64_VERTICES)
+static void HumanModel_DrawCore(struct Entity* e, struct ModelSet* model, cc_bool opaqueBody) {
+	struct ModelLimbs* set;
+	int type, num;
+	Model_ApplyTexture(e);
+
+	type = Models.skinType;
+	set  = &model->limbs[type & 0x3];
+	num  = HUMAN_BASE_VERTICES + HumanModel_LayerVertices(type);
+	Model_LockVB(e, num);
+
+	HumanModel_DrawBase(e, model, set);
+	HumanModel_DrawLayers(e, model, set, type);
 
 	Model_UnlockVB();
 	if (opaqueBody) {
@@ -1274,6 +1292,127 @@ static void ChibiModel_Register(void) {
 }
 
 
+/*########################################################################################################################*
+*--------------------------------------------------------Model batching---------------------------------------------------*
+*#########################################################################################################################*/
+/* Rather than drawing each humanoid entity separately with its own transform matrix, */
+/*  vertices of entities with the same model and skin are transformed into world space */
+/*  on the CPU and then drawn together, which needs far fewer draw calls and state changes */
+#define MODEL_BATCH_MAX_ENTITIES 16
+#define MODEL_BATCH_MAX_VERTICES (HUMAN_MAX_VERTICES * MODEL_BATCH_MAX_ENTITIES)
+static GfxResourceID batchVB;
+static struct VertexTextured batchVertices[HUMAN_MAX_VERTICES];
+
+static struct ModelSet* Model_GetBatchSet(struct Model* model) {
+	/* Plugins may have replaced how the model is drawn */
+	if (model == &human_model && model->Draw == HumanModel_Draw) return &human_set;
+	if (model == &chibi_model && model->Draw == ChibiModel_Draw) return &chibi_set;
+	return NULL;
+}
+
+cc_bool Model_CanBatch(struct Model* model) {
+#ifdef CC_BUILD_CONSOLE
+	/* Consoles need a separate VB per entity (see Model_LockVB) */
+	return false;
+#else
+	return Model_GetBatchSet(model) != NULL;
+#endif
+}
+
+static void Model_TransformVertices(struct VertexTextured* dst, const struct VertexTextured* src, 
+									int count, const struct Matrix* m) {
+	int i;
+	for (i = 0; i < count; i++, src++, dst++)
+	{
+		dst->x   = src->x * m->row1.x + src->y * m->row2.x + src->z * m->row3.x + m->row4.x;
+		dst->y   = src->x * m->row1.y + src->y * m->row2.y + src->z * m->row3.y + m->row4.y;
+		dst->z   = src->x * m->row1.z + src->y * m->row2.z + src->z * m->row3.z + m->row4.z;
+		dst->Col = src->Col;
+		dst->U   = src->U; dst->V = src->V;
+	}
+}
+
+static void Model_DrawBatch(struct Entity** entities, int count, GfxResourceID tex, cc_uint8 skinType) {
+	struct Model* model   = entities[0]->Model;
+	struct ModelSet* set  = Model_GetBatchSet(model);
+	struct ModelLimbs* limbs = &set->limbs[skinType & 0x3];
+	struct VertexTextured* real = Models.Vertices;
+	struct VertexTextured* base;
+	struct VertexTextured* layers;
+	int i, numLayers = HumanModel_LayerVertices(skinType);
+	struct Matrix m;
+	struct Entity* e;
+
+	if (!batchVB) batchVB = Gfx_CreateDynamicVb(VERTEX_FORMAT_TEXTURED, MODEL_BATCH_MAX_VERTICES);
+	Gfx_BindTexture(tex);
+
+	/* Body parts of all the entities are drawn first, followed by all the layers */
+	base   = (struct VertexTextured*)Gfx_LockDynamicVb(batchVB, VERTEX_FORMAT_TEXTURED,
+												count * (HUMAN_BASE_VERTICES + numLayers));
+	layers = base + count * HUMAN_BASE_VERTICES;
+	/* Vertices are built in system memory, since reading from a locked VB may be slow */
+	Models.Vertices = batchVertices;
+
+	for (i = 0; i < count; i++)
+	{
+		e = entities[i];
+		Model_SetupState(model, e);
+		Models.skinType = skinType;
+		Model_SetTexScale(e, tex);
+		Model_GetEntityTransform(model, e, &m);
+
+		HumanModel_DrawBase(e, set, limbs);
+		Model_TransformVertices(base, batchVertices, HUMAN_BASE_VERTICES, &m);
+		base += HUMAN_BASE_VERTICES;
+
+		model->index = 0;
+		HumanModel_DrawLayers(e, set, limbs, skinType);
+		Model_TransformVertices(layers, batchVertices, numLayers, &m);
+		layers += numLayers;
+	}
+
+	model->index    = 0;
+	Models.Vertices = real;
+	Gfx_UnlockDynamicVb(batchVB);
+
+	/* human model draws the body opaque so players can't have invisible skins */
+	Gfx_SetAlphaTest(false);
+	Gfx_DrawVb_IndexedTris_Range(count * HUMAN_BASE_VERTICES, 0);
+	Gfx_SetAlphaTest(true);
+	Gfx_DrawVb_IndexedTris_Range(count * numLayers, count * HUMAN_BASE_VERTICES);
+}
+
+void Model_RenderBatch(struct Entity** entities, int count) {
+	struct Entity* group[MODEL_BATCH_MAX_ENTITIES];
+	struct Entity* e;
+	struct Entity* other;
+	cc_uint8 skinType, otherType;
+	GfxResourceID tex;
+	int i, j, n;
+	if (!count) return;
+
+	Gfx_SetVertexFormat(VERTEX_FORMAT_TEXTURED);
+	for (i = 0; i < count; i++)
+	{
+		if (!(e = entities[i])) continue;
+		tex = Model_GetTexture(e->Model, e, &skinType);
+		group[0] = e; n = 1;
+
+		/* Find other entities with the same model and skin */
+		for (j = i + 1; j < count && n < MODEL_BATCH_MAX_ENTITIES; j++)
+		{
+			other = entities[j];
+			if (!other || other->Model != e->Model) continue;
+			if (Model_GetTexture(other->Model, other, &otherType) != tex || otherType != skinType) continue;
+
+			group[n++]  = other;
+			entities[j] = NULL;
+		}
+		Model_DrawBatch(group, n, tex, skinType);
+	}
+}
+
+
 /*########################################################################################################################*
 *--------------------------------------------------------SittingModel-----------------------------------------------------*
 *#########################################################################################################################*/
@@ -2420,6 +2559,7 @@ static void RegisterDefaultModels(void) {
 static void OnContextLost(void* obj) {
 	struct ModelTex* tex;
 	Gfx_DeleteDynamicVb(&Models.Vb);
+	Gfx_DeleteDynamicVb(&batchVB);
 	if (Gfx.ManagedTextures) return;
 
 	for (tex = textures_head; tex; tex = tex->next) 
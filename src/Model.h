@@ -118,6 +118,9 @@ CC_VAR extern struct _ModelsData {
 	struct Model* Human;
 	/* Pointer to block model */
 	struct Model* Block;
+	/* U/V offset of skin within skin texture when rendering models. */
+	/* Usually 0, except for skins that are stored in the skin atlas */
+	float uOffset, vOffset;
 } Models;
 
 /* Initialises fields of a model to default. */
@@ -130,6 +133,12 @@ cc_bool Model_ShouldRender(struct Entity* entity);
 float Model_RenderDistance(struct Entity* entity);
 /* Draws the given entity as the given model. */
 CC_API void Model_Render(struct Model* model, struct Entity* entity);
+/* Whether entities using the given model can be drawn together using Model_RenderBatch. */
+cc_bool Model_CanBatch(struct Model* model);
+/* Draws the given entities, combining entities with the same model and skin into as few draw calls as possible. */
+/* NOTE: All entities MUST use a model that Model_CanBatch returns true for. */
+/* NOTE: Contents of the given array are modified. */
+void Model_RenderBatch(struct Entity** entities, int count);
 /* Sets up state to be suitable for rendering the given model. */
 /* NOTE: Model_Render already calls this, you don't normally need to call this. */
 CC_API void Model_SetupState(struct Model* model, struct Entity* entity);
@@ -285,6 +285,12 @@ cc_result File_Seek(cc_file file, int offset, int seekType);
 cc_result File_Position(cc_file file, cc_uint32* pos);
 /* Attempts to retrieve the length of the given file. */
 cc_result File_Length(cc_file file, cc_uint32* len);
+/* Attempts to rename a file, replacing the destination file if it already exists. */
+/* NOTE: Returns ERR_NOT_SUPPORTED on platforms where files cannot be renamed */
+cc_result File_Rename(const cc_filepath* src, const cc_filepath* dst);
+/* Attempts to delete a file. */
+/* NOTE: Returns ERR_NOT_SUPPORTED on platforms where files cannot be deleted */
+cc_result File_Delete(const cc_filepath* path);
 
 
 /*########################################################################################################################*
@@ -436,6 +436,14 @@ cc_result File_Length(cc_file file, cc_uint32* len) {
 	return res == -1 ? errno : 0;
 }
 
+cc_result File_Rename(const cc_filepath* src, const cc_filepath* dst) {
+	return ERR_NOT_SUPPORTED;
+}
+
+cc_result File_Delete(const cc_filepath* path) {
+	return ERR_NOT_SUPPORTED;
+}
+
 
 /*########################################################################################################################*
 *--------------------------------------------------------Threading--------------------------------------------------------*
@@ -237,6 +237,14 @@ cc_result File_Length(cc_file file, cc_uint32* len) {
 	*len = raw_len; return 0;
 }
 
+cc_result File_Rename(const cc_filepath* src, const cc_filepath* dst) {
+	return rename(src->buffer, dst->buffer) == -1 ? errno : 0;
+}
+
+cc_result File_Delete(const cc_filepath* path) {
+	return remove(path->buffer) == -1 ? errno : 0;
+}
+
 
 /*########################################################################################################################*
 *--------------------------------------------------------Threading--------------------------------------------------------*
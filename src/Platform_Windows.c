@@ -7,6 +7,7 @@
 #include "Funcs.h"
 #include "Utils.h"
 #include "Errors.h"
+#include "Window.h"
 
 #define WIN32_LEAN_AND_MEAN
 #define NOSERVICE
@@ -122,6 +123,9 @@ void Platform_Log(const char* msg, int len) {
 	if (conHandle) {
 		WriteFile(conHandle, msg,  len, &wrote, NULL);
 		WriteFile(conHandle, "\n",   1, &wrote, NULL);
+#if CC_WIN_BACKEND == CC_WIN_BACKEND_TERMINAL
+		Window_InvalidateTerminal();
+#endif
 	}
 
 	if (!hasDebugger) return;
@@ -408,6 +412,24 @@ cc_result File_Length(cc_file file, cc_uint32* len) {
 	return *len != INVALID_FILE_SIZE ? 0 : GetLastError();
 }
 
+cc_result File_Rename(const cc_filepath* src, const cc_filepath* dst) {
+	cc_result res;
+	if (MoveFileExW(src->uni, dst->uni, MOVEFILE_REPLACE_EXISTING)) return 0;
+	if ((res = GetLastError()) != ERROR_CALL_NOT_IMPLEMENTED) return res;
+
+	/* Windows 9x does not support MoveFileEx, and MoveFile fails when destination exists */
+	DeleteFileA(dst->ansi);
+	return MoveFileA(src->ansi, dst->ansi) ? 0 : GetLastError();
+}
+
+cc_result File_Delete(const cc_filepath* path) {
+	cc_result res;
+	if (DeleteFileW(path->uni)) return 0;
+	if ((res = GetLastError()) != ERROR_CALL_NOT_IMPLEMENTED) return res;
+
+	return DeleteFileA(path->ansi) ? 0 : GetLastError();
+}
+
 
 /*########################################################################################################################*
 *--------------------------------------------------------Threading--------------------------------------------------------*
@@ -175,7 +175,7 @@ static cc_result ZipWriter_FixupLocalFile(struct Stream* s, struct ResourceZipEn
 	int filenameLen = String_Length(e->filename);
 	cc_uint8 tmp[2048];
 	cc_uint32 dataBeg, dataEnd;
-	cc_uint32 i, crc, toRead, read;
+	cc_uint32 crc, toRead, read;
 	cc_result res;
 
 	dataBeg = e->offset + 30 + filenameLen;
@@ -192,10 +192,7 @@ static cc_result ZipWriter_FixupLocalFile(struct Stream* s, struct ResourceZipEn
 
 		if ((res = s->Read(s, tmp, toRead, &read))) return res;
 		if (!read) return ERR_END_OF_STREAM;
-
-		for (i = 0; i < read; i++) {
-			crc = Utils_Crc32Table[(crc ^ tmp[i]) & 0xFF] ^ (crc >> 8);
-		}
+		crc = Utils_Crc32Update(crc, tmp, read);
 	}
 	e->crc32 = crc ^ 0xffffffffUL;
 
@@ -333,21 +330,32 @@ static void MusicAssets_CountMissing(void) {
 /*########################################################################################################################*
 *-----------------------------------------------------Music asset fetching -----------------------------------------------*
 *#########################################################################################################################*/
-CC_NOINLINE static int MusicAsset_Download(const char* hash) {
+CC_NOINLINE static int MinecraftAsset_Download(const char* hash, const cc_string* path) {
 	cc_string url; char urlBuffer[URL_MAX_SIZE];
 
 	String_InitArray(url, urlBuffer);
 	String_Format3(&url, "https://resources.download.minecraft.net/%r%r/%c", 
 					&hash[0], &hash[1], hash);
+
+	if (path) return Http_AsyncDownloadFile(&url, 0, path);
 	return Http_AsyncGetData(&url, 0);
 }
 
+static int MusicAsset_Download(struct MusicAsset* music) {
+	cc_string path; char pathBuffer[STRING_SIZE];
+	String_InitArray(path, pathBuffer);
+	String_Format1(&path, "audio/%c", music->name);
+
+	/* Music files are large, so stream them straight to disk instead of keeping in memory */
+	return MinecraftAsset_Download(music->hash, &path);
+}
+
 static void MusicAssets_DownloadAssets(void) {
 	int i;
 	for (i = 0; i < Array_Elems(musicAssets); i++) 
 	{
 		if (musicAssets[i].downloaded) continue;
-		musicAssets[i].reqID = MusicAsset_Download(musicAssets[i].hash);
+		musicAssets[i].reqID = MusicAsset_Download(&musicAssets[i]);
 	}
 }
 
@@ -364,23 +372,12 @@ static const char* MusicAssets_GetRequestName(int reqID) {
 /*########################################################################################################################*
 *----------------------------------------------------Music asset processing ----------------------------------------------*
 *#########################################################################################################################*/
-static void MusicAsset_Save(const char* name, struct HttpRequest* req) {
-	cc_string path; char pathBuffer[STRING_SIZE];
-	cc_result res;
-
-	String_InitArray(path, pathBuffer);
-	String_Format1(&path, "audio/%c", name);
-
-	res = Stream_WriteAllTo(&path, req->data, req->size);
-	if (res) Logger_SysWarn(res, "saving music file");
-}
-
 static void MusicAsset_Check(struct MusicAsset* music) {
 	struct HttpRequest item;
+	/* Contents were already written to the music file by the downloader */
 	if (!Fetcher_Get(music->reqID, &item)) return;
 
 	music->downloaded = true;
-	MusicAsset_Save(music->name, &item);
 	HttpRequest_Free(&item);
 }
 
@@ -630,7 +627,7 @@ static void SoundAsset_CreateZip(void) {
 /*########################################################################################################################*
 *-----------------------------------------------------Sound asset fetching -----------------------------------------------*
 *#########################################################################################################################*/
-#define SoundAsset_Download(hash) MusicAsset_Download(hash)
+#define SoundAsset_Download(hash) MinecraftAsset_Download(hash, NULL)
 
 static void SoundAssets_DownloadAssets(void) {
 	int i;
@@ -86,6 +86,10 @@ static struct HUDScreen {
 /* [PREFIX] [(] [X] [,] [Y] [,] [Z] [)] */
 #define POSITION_HUD_CHARS (1 + 1 + POSITION_VAL_CHARS + 1 + POSITION_VAL_CHARS + 1 + POSITION_VAL_CHARS + 1)
 #define HUD_MAX_VERTICES (4 + TEXTWIDGET_MAX * 2 + HOTBAR_MAX_VERTICES + POSITION_HUD_CHARS * 4)
+/* Offsets of the widgets in the vertex buffer, see HUDScreen_BuildMesh */
+#define HUD_LINE1_OFFSET  4
+#define HUD_LINE2_OFFSET  (HUD_LINE1_OFFSET + TEXTWIDGET_MAX)
+#define HUD_HOTBAR_OFFSET (HUD_LINE2_OFFSET + TEXTWIDGET_MAX)
 
 static void HUDScreen_RemakeLine1(struct HUDScreen* s) {
 	cc_string status; char statusBuffer[STRING_SIZE * 2];
@@ -94,7 +98,7 @@ static void HUDScreen_RemakeLine1(struct HUDScreen* s) {
 
 	String_InitArray(status, statusBuffer);
 	/* Don't remake texture when FPS isn't being shown */
-	if (!Gui.ShowFPS && s->line1.tex.ID) return;
+	if (!Gui.ShowFPS && TextWidget_HasText(&s->line1)) return;
 	fps = s->accumulator == 0 ? 1 : (int)(s->frames / s->accumulator);
 
 	if (Gfx.ReducedPerfMode || (Gfx.ReducedPerfModeCooldown > 0)) {
@@ -393,20 +397,20 @@ static void HUDScreen_Render(void* screen, float delta) {
 
 	Gfx_SetVertexFormat(VERTEX_FORMAT_TEXTURED);
 	Gfx_BindDynamicVb(s->vb);
-	if (Gui.ShowFPS) Widget_Render2(&s->line1, 4);
+	if (Gui.ShowFPS) Widget_Render2(&s->line1, HUD_LINE1_OFFSET);
 
 	if (Game_ClassicMode) {
-		Widget_Render2(&s->line2, 8);
+		Widget_Render2(&s->line2, HUD_LINE2_OFFSET);
 	} else if (IsOnlyChatActive() && Gui.ShowFPS) {
-		Widget_Render2(&s->line2, 8);
+		Widget_Render2(&s->line2, HUD_LINE2_OFFSET);
 		Gfx_BindTexture(s->posAtlas.tex.ID);
-		Gfx_DrawVb_IndexedTris_Range(s->posCount, 12 + HOTBAR_MAX_VERTICES);
+		Gfx_DrawVb_IndexedTris_Range(s->posCount, HUD_HOTBAR_OFFSET + HOTBAR_MAX_VERTICES);
 		/* TODO swap these two lines back */
 	}
 
 	if (!Gui_GetBlocksWorld()) {
 		Gfx_BindDynamicVb(s->vb);
-		if (!Gui.HideHotbar) Widget_Render2(&s->hotbar, 12);
+		if (!Gui.HideHotbar) Widget_Render2(&s->hotbar, HUD_HOTBAR_OFFSET);
 
 		if (!Gui.HideCrosshair && Gui.IconsTex && !tablist_active) {
 			Gfx_BindTexture(Gui.IconsTex);
@@ -899,6 +903,7 @@ static struct ChatScreen {
 	cc_bool suppressNextPress;
 	int chatIndex, paddingX, paddingY;
 	int lastDownloadStatus;
+	int saveProgress; /* Percentage of map saved, or -1 when not saving a map */
 	struct FontDesc chatFont, announcementFont, bigAnnouncementFont, smallAnnouncementFont;
 	struct TextWidget announcement, bigAnnouncement, smallAnnouncement;
 	struct ChatInputWidget input;
@@ -1043,15 +1048,15 @@ static void ChatScreen_EnterChatInput(struct ChatScreen* s, cc_bool close) {
 	}
 }
 
-static void ChatScreen_UpdateTexpackStatus(struct ChatScreen* s) {
-	int progress = Http_CheckProgress(TexturePack_ReqID);
+/* Map saving and texture pack downloading progress share the same status line */
+static void ChatScreen_ShowProgress(struct ChatScreen* s) {
 	cc_string msg; char msgBuffer[STRING_SIZE];
-	if (progress == s->lastDownloadStatus) return;
-
-	s->lastDownloadStatus = progress;
+	int progress = s->lastDownloadStatus;
 	String_InitArray(msg, msgBuffer);
 
-	if (progress == HTTP_PROGRESS_MAKING_REQUEST) {
+	if (s->saveProgress >= 0) {
+		String_Format1(&msg, "&eSaving map (&7%i&e%%)", &s->saveProgress);
+	} else if (progress == HTTP_PROGRESS_MAKING_REQUEST) {
 		String_AppendConst(&msg, "&eRetrieving texture pack..");
 	} else if (progress == HTTP_PROGRESS_FETCHING_DATA) {
 		String_AppendConst(&msg, "&eDownloading texture pack");
@@ -1061,6 +1066,26 @@ static void ChatScreen_UpdateTexpackStatus(struct ChatScreen* s) {
 	Chat_AddOf(&msg, MSG_TYPE_EXTRASTATUS_1);
 }
 
+static void ChatScreen_UpdateTexpackStatus(struct ChatScreen* s) {
+	int progress = Http_CheckProgress(TexturePack_ReqID);
+	if (progress == s->lastDownloadStatus) return;
+
+	s->lastDownloadStatus = progress;
+	/* Map saving progress is shown instead while saving */
+	if (s->saveProgress < 0) ChatScreen_ShowProgress(s);
+}
+
+static void ChatScreen_MapSaving(void* screen, float progress) {
+	struct ChatScreen* s = (struct ChatScreen*)screen;
+	int percent = (int)(progress * 100);
+	/* Saving has finished, so texture pack progress (if any) is shown again */
+	if (percent >= 100) percent = -1;
+	if (percent == s->saveProgress) return;
+
+	s->saveProgress = percent;
+	ChatScreen_ShowProgress(s);
+}
+
 static void ChatScreen_ColCodeChanged(void* screen, int code) {
 	struct ChatScreen* s = (struct ChatScreen*)screen;
 	float caretAcc;
@@ -1118,15 +1143,15 @@ static void ChatScreen_Update(void* screen, float delta) {
 
 	/* Destroy announcement texture before even rendering it at all, */
 	/* otherwise changing texture pack shows announcement for one frame */
-	if (s->announcement.tex.ID && now > Chat_AnnouncementReceived + 5) {
+	if (TextWidget_HasText(&s->announcement) && now > Chat_AnnouncementReceived + 5) {
 		Elem_Free(&s->announcement);
 	}
 
-	if (s->bigAnnouncement.tex.ID && now > Chat_BigAnnouncementReceived + 5) {
+	if (TextWidget_HasText(&s->bigAnnouncement) && now > Chat_BigAnnouncementReceived + 5) {
 		Elem_Free(&s->bigAnnouncement);
 	}
 
-	if (s->smallAnnouncement.tex.ID && now > Chat_SmallAnnouncementReceived + 5) {
+	if (TextWidget_HasText(&s->smallAnnouncement) && now > Chat_SmallAnnouncementReceived + 5) {
 		Elem_Free(&s->smallAnnouncement);
 	}
 }
@@ -1147,7 +1172,6 @@ static void ChatScreen_DrawChatBackground(struct ChatScreen* s) {
 }
 
 static void ChatScreen_DrawChat(struct ChatScreen* s, float delta) {
-	struct Texture tex;
 	double now;
 	int i, logIdx;
 
@@ -1165,16 +1189,14 @@ static void ChatScreen_DrawChat(struct ChatScreen* s, float delta) {
 	} else {
 		/* Only render recent chat */
 		for (i = 0; i < s->chat.lines; i++) {
-			tex    = s->chat.textures[i];
 			logIdx = s->chatIndex + i;
-			if (!tex.ID) continue;
+			if (!TextGroupWidget_HasText(&s->chat, i)) continue;
 
 			if (logIdx < 0 || logIdx >= Chat_Log.count) continue;
 			/* Only draw chat within last 10 seconds */
 			if (Chat_GetLogTime(logIdx) + 10 < now) continue;
 			
-			Gfx_BindTexture(tex.ID);
-			Gfx_DrawVb_IndexedTris_Range(4, i * 4);
+			TextGroupWidget_RenderLine(&s->chat, i, 0);
 		}
 	}
 
@@ -1483,6 +1505,7 @@ static void ChatScreen_Init(void* screen) {
 
 	Event_Register_(&ChatEvents.ChatReceived,   s, ChatScreen_ChatReceived);
 	Event_Register_(&ChatEvents.ColCodeChanged, s, ChatScreen_ColCodeChanged);
+	Event_Register_(&WorldEvents.Saving,        s, ChatScreen_MapSaving);
 	
 	s->maxVertices = ChatScreen_CalcMaxVertices(s);
 	
@@ -1527,6 +1550,7 @@ static void ChatScreen_Free(void* screen) {
 	struct ChatScreen* s = (struct ChatScreen*)screen;
 	Event_Unregister_(&ChatEvents.ChatReceived,   s, ChatScreen_ChatReceived);
 	Event_Unregister_(&ChatEvents.ColCodeChanged, s, ChatScreen_ColCodeChanged);
+	Event_Unregister_(&WorldEvents.Saving,        s, ChatScreen_MapSaving);
 }
 
 static const struct ScreenVTABLE ChatScreen_VTABLE = {
@@ -1539,6 +1563,7 @@ static const struct ScreenVTABLE ChatScreen_VTABLE = {
 void ChatScreen_Show(void) {
 	struct ChatScreen* s  = &ChatScreen_Instance;
 	s->lastDownloadStatus = HTTP_PROGRESS_NOT_WORKING_ON;
+	s->saveProgress       = -1;
 
 	s->VTABLE = &ChatScreen_VTABLE;
 	Gui_Chat  = s;
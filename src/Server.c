@@ -25,6 +25,7 @@
 #include "Input.h"
 #include "Errors.h"
 #include "Options.h"
+#include "Window.h"
 
 static char nameBuffer[STRING_SIZE];
 static char motdBuffer[STRING_SIZE];
@@ -126,7 +127,14 @@ static void SPConnection_BeginConnect(void) {
 
 	/* For when user drops a map file onto ClassiCube.exe */
 	if (SP_AutoloadMap.length) {
-		Map_LoadFrom(&SP_AutoloadMap); return;
+#if CC_WIN_BACKEND == CC_WIN_BACKEND_HEADLESS
+		/* No point rendering a blank frame when the map is missing or invalid */
+		HeadlessInfo.Result = Map_LoadFrom(&SP_AutoloadMap);
+		if (HeadlessInfo.Result) Window_RequestClose();
+#else
+		Map_LoadFrom(&SP_AutoloadMap);
+#endif
+		return;
 	}
 
 	Random_SeedFromCurrentTime(&rnd);
@@ -289,6 +289,28 @@ void Stream_ReadonlyMemory(struct Stream* s, void* data, cc_uint32 len) {
 	s->meta.mem.base   = (cc_uint8*)data;
 }
 
+static cc_result Stream_MemoryWrite(struct Stream* s, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	count = min(count, s->meta.mem.left);
+	Mem_Copy(s->meta.mem.cur, data, count);
+	
+	s->meta.mem.cur  += count; 
+	s->meta.mem.left -= count;
+	*modified = count;
+	return 0;
+}
+
+void Stream_WriteonlyMemory(struct Stream* s, void* data, cc_uint32 len) {
+	Stream_Init(s);
+	s->Write    = Stream_MemoryWrite;
+	s->Position = Stream_MemoryPosition;
+	s->Length   = Stream_MemoryLength;
+
+	s->meta.mem.cur    = (cc_uint8*)data;
+	s->meta.mem.left   = len;
+	s->meta.mem.length = len;
+	s->meta.mem.base   = (cc_uint8*)data;
+}
+
 
 /*########################################################################################################################*
 *----------------------------------------------------BufferedStream-------------------------------------------------------*
@@ -373,13 +395,7 @@ void Stream_ReadonlyBuffered(struct Stream* s, struct Stream* source, void* data
 *#########################################################################################################################*/
 static cc_result Stream_Crc32Write(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
 	struct Stream* source;
-	cc_uint32 i, crc32 = stream->meta.crc32.crc32;
-
-	/* TODO: Optimise this calculation */
-	for (i = 0; i < count; i++) {
-		crc32 = Utils_Crc32Table[(crc32 ^ data[i]) & 0xFF] ^ (crc32 >> 8);
-	}
-	stream->meta.crc32.crc32 = crc32;
+	stream->meta.crc32.crc32 = Utils_Crc32Update(stream->meta.crc32.crc32, data, count);
 
 	source = stream->meta.crc32.source;
 	return source->Write(source, data, count, modified);
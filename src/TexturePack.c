@@ -300,154 +300,6 @@ int TextureUrls_ClearDenied(void) { return 0; }
 #endif
 
 
-/*########################################################################################################################*
-*------------------------------------------------------TextureCache-------------------------------------------------------*
-*#########################################################################################################################*/
-static struct StringsBuffer etagCache, lastModCache;
-#define ETAGS_TXT    "texturecache/etags.txt"
-#define LASTMOD_TXT  "texturecache/lastmodified.txt"
-
-static void TextureCache_Init(void) {
-	EntryList_UNSAFE_Load(&etagCache,    ETAGS_TXT);
-	EntryList_UNSAFE_Load(&lastModCache, LASTMOD_TXT);
-}
-
-CC_INLINE static void HashUrl(cc_string* key, const cc_string* url) {
-	String_AppendUInt32(key, Utils_CRC32((const cc_uint8*)url->buffer, url->length));
-}
-
-static cc_bool createdCache, cacheInvalid;
-static cc_bool UseDedicatedCache(cc_string* path, const cc_string* key) {
-	cc_result res;
-	cc_filepath str;
-	Directory_GetCachePath(path);
-	if (!path->length || cacheInvalid) return false;
-
-	String_AppendConst(path, "/texturecache");
-	Platform_EncodePath(&str, path);
-	res = Directory_Create(&str);
-
-	/* Check if something is deleting the cache directory behind our back */
-	/*  (Several users have reported this happening on some Android devices) */
-	if (createdCache && res == 0) {
-		Chat_AddRaw("&cSomething has deleted system managed cache folder");
-		Chat_AddRaw("  &cFalling back to caching to game folder instead..");
-		cacheInvalid = true;
-	}
-	if (res == 0) createdCache = true;
-
-	String_Format1(path, "/%s", key);
-	return !cacheInvalid;
-}
-
-CC_NOINLINE static void MakeCachePath(cc_string* mainPath, cc_string* altPath, const cc_string* url) {
-	cc_string key; char keyBuffer[STRING_INT_CHARS];
-	String_InitArray(key, keyBuffer);
-	HashUrl(&key, url);
-	
-	if (UseDedicatedCache(mainPath, &key)) {
-		/* If using dedicated cache directory, also fallback to default cache directory */
-		String_Format1(altPath,  "texturecache/%s",  &key);
-	} else {
-		mainPath->length = 0;
-		String_Format1(mainPath, "texturecache/%s",  &key);
-	}
-}
-
-/* Returns non-zero if given URL has been cached */
-static int IsCached(const cc_string* url) {
-	cc_string mainPath; char mainBuffer[FILENAME_SIZE];
-	cc_string altPath;  char  altBuffer[FILENAME_SIZE];
-	cc_filepath mainStr, altStr;
-	
-	String_InitArray(mainPath, mainBuffer);
-	String_InitArray(altPath,   altBuffer);
-
-	MakeCachePath(&mainPath, &altPath, url);
-	Platform_EncodePath(&mainStr, &mainPath);
-	Platform_EncodePath(&altStr,  &altPath);
-
-	return File_Exists(&mainStr) || (altPath.length && File_Exists(&altStr));
-}
-
-/* Attempts to open the cached data stream for the given url */
-static cc_bool OpenCachedData(const cc_string* url, struct Stream* stream) {
-	cc_string mainPath; char mainBuffer[FILENAME_SIZE];
-	cc_string altPath;  char  altBuffer[FILENAME_SIZE];
-	cc_result res;
-	String_InitArray(mainPath, mainBuffer);
-	String_InitArray(altPath,   altBuffer);
-	
-
-	MakeCachePath(&mainPath, &altPath, url);
-	res = Stream_OpenFile(stream, &mainPath);
-
-	/* try fallback cache if can't find in main cache */
-	if (res == ReturnCode_FileNotFound && altPath.length)
-		res = Stream_OpenFile(stream, &altPath);
-
-	if (res == ReturnCode_FileNotFound) return false;
-	if (res) { Logger_SysWarn2(res, "opening cache for", url); return false; }
-	return true;
-}
-
-CC_NOINLINE static cc_string GetCachedTag(const cc_string* url, struct StringsBuffer* list) {
-	cc_string key; char keyBuffer[STRING_INT_CHARS];
-	String_InitArray(key, keyBuffer);
-
-	HashUrl(&key, url);
-	return EntryList_UNSAFE_Get(list, &key, ' ');
-}
-
-static cc_string GetCachedLastModified(const cc_string* url) {
-	int i;
-	cc_string entry = GetCachedTag(url, &lastModCache);
-	/* Entry used to be a timestamp of C# DateTime ticks since 01/01/0001 */
-	/* Check whether timestamp entry is old or new format */
-	for (i = 0; i < entry.length; i++) {
-		if (entry.buffer[i] < '0' || entry.buffer[i] > '9') return entry;
-	}
-
-	/* Entry is all digits, so the old unsupported format */
-	entry.length = 0; return entry;
-}
-
-static cc_string GetCachedETag(const cc_string* url) {
-	return GetCachedTag(url, &etagCache);
-}
-
-CC_NOINLINE static void SetCachedTag(const cc_string* url, struct StringsBuffer* list,
-									 const cc_string* data, const char* file) {
-	cc_string key; char keyBuffer[STRING_INT_CHARS];
-	if (!data->length) return;
-
-	String_InitArray(key, keyBuffer);
-	HashUrl(&key, url);
-	EntryList_Set(list, &key, data, ' ');
-	EntryList_Save(list, file);
-}
-
-/* Updates cached data, ETag, and Last-Modified for the given URL */
-static void UpdateCache(struct HttpRequest* req) {
-	cc_string url, altPath, value;
-	cc_string path; char pathBuffer[FILENAME_SIZE];
-	cc_result res;
-	url = String_FromRawArray(req->url);
-
-	value = String_FromRawArray(req->etag);
-	SetCachedTag(&url, &etagCache,    &value, ETAGS_TXT);
-	value = String_FromRawArray(req->lastModified);
-	SetCachedTag(&url, &lastModCache, &value, LASTMOD_TXT);
-
-	String_InitArray(path, pathBuffer);
-	altPath = String_Empty;
-	MakeCachePath(&path, &altPath, &url);
-
-	res = Stream_WriteAllTo(&path, req->data, req->size);
-	if (res) { Logger_SysWarn2(res, "caching", &url); }
-}
-
-
 /*########################################################################################################################*
 *-------------------------------------------------------TexturePack-------------------------------------------------------*
 *#########################################################################################################################*/
@@ -578,7 +430,7 @@ cc_result TexturePack_ExtractCurrent(cc_bool forceReload) {
 		usingDefault = true;
 	}
 
-	if (url.length && OpenCachedData(&url, &stream)) {
+	if (url.length && Http_OpenCachedData(&url, &stream)) {
 		res = ExtractFrom(&stream, &url);
 		usingDefault = false;
 
@@ -591,13 +443,12 @@ cc_result TexturePack_ExtractCurrent(cc_bool forceReload) {
 	return res;
 }
 
-/* Extracts and updates cache for the downloaded texture pack */
+/* Extracts the downloaded texture pack */
 static void ApplyDownloaded(struct HttpRequest* item) {
 	struct Stream mem;
 	cc_string url;
 
 	url = String_FromRawArray(item->url);
-	if (!Platform_ReadonlyFilesystem) UpdateCache(item);
 	/* Took too long to download and is no longer active texture pack */
 	if (!String_Equals(&TexturePack_Url, &url)) return;
 
@@ -610,6 +461,8 @@ void TexturePack_CheckPending(void) {
 	struct HttpRequest item;
 	if (!Http_GetResult(TexturePack_ReqID, &item)) return;
 
+	/* Cached texture pack was already extracted by TexturePack_ExtractCurrent */
+	/*  (and so has statusCode 304 without any data, due to HTTP_FLAG_CACHE_SKIPLOAD) */
 	if (item.success) {
 		ApplyDownloaded(&item);
 	} else if (item.result) {
@@ -630,18 +483,8 @@ void TexturePack_CheckPending(void) {
 
 /* Asynchronously downloads the given texture pack */
 static void DownloadAsync(const cc_string* url) {
-	cc_string etag = String_Empty;
-	cc_string time = String_Empty;
-
-	/* Only retrieve etag/last-modified headers if the file exists */
-	/* This inconsistency can occur if user deleted some cached files */
-	if (IsCached(url)) {
-		time = GetCachedLastModified(url);
-		etag = GetCachedETag(url);
-	}
-
 	Http_TryCancel(TexturePack_ReqID);
-	TexturePack_ReqID = Http_AsyncGetDataEx(url, HTTP_FLAG_PRIORITY, &time, &etag, NULL);
+	TexturePack_ReqID = Http_AsyncGetData(url, HTTP_FLAG_PRIORITY | HTTP_FLAG_CACHE | HTTP_FLAG_CACHE_SKIPLOAD);
 }
 
 void TexturePack_Extract(const cc_string* url) {
@@ -717,7 +560,6 @@ static void OnInit(void) {
 	TextureEntry_Register(&terrain_entry);
 	Utils_EnsureDirectory("texpacks");
 	Utils_EnsureDirectory("texturecache");
-	TextureCache_Init();
 	TextureUrls_Init();
 }
 
@@ -38,12 +38,17 @@ static void AddWidget(void* screen, void* w) {
 *#########################################################################################################################*/
 static void TextWidget_Render(void* widget, float delta) {
 	struct TextWidget* w = (struct TextWidget*)widget;
-	if (w->tex.ID) Texture_RenderShaded(&w->tex, w->color);
+	if (w->glyphs.count) {
+		GlyphText_Render(&w->glyphs, &w->tex, w->color);
+	} else if (w->tex.ID) {
+		Texture_RenderShaded(&w->tex, w->color);
+	}
 }
 
 static void TextWidget_Free(void* widget) {
 	struct TextWidget* w = (struct TextWidget*)widget;
 	Gfx_DeleteTexture(&w->tex.ID);
+	GlyphText_Free(&w->glyphs);
 }
 
 static void TextWidget_Reposition(void* widget) {
@@ -54,16 +59,26 @@ static void TextWidget_Reposition(void* widget) {
 
 static void TextWidget_BuildMesh(void* widget, struct VertexTextured** vertices) {
 	struct TextWidget* w = (struct TextWidget*)widget;
-	Gfx_Make2DQuad(&w->tex, w->color, vertices);
+	struct VertexTextured* beg = *vertices;
+
+	if (w->glyphs.count) {
+		GlyphText_BuildMesh(&w->glyphs, &w->tex, w->color, vertices);
+	} else {
+		Gfx_Make2DQuad(&w->tex, w->color, vertices);
+	}
+	/* Always use same amount of vertices, so offsets don't change with the text */
+	*vertices = beg + TEXTWIDGET_MAX;
 }
 
 static int TextWidget_Render2(void* widget, int offset) {
 	struct TextWidget* w = (struct TextWidget*)widget;
-	if (w->tex.ID) {
+	if (w->glyphs.count) {
+		GlyphText_Render2(&w->glyphs, offset);
+	} else if (w->tex.ID) {
 		Gfx_BindTexture(w->tex.ID);
 		Gfx_DrawVb_IndexedTris_Range(4, offset);
 	}
-	return offset + 4;
+	return offset + TEXTWIDGET_MAX;
 }
 
 static int TextWidget_MaxVertices(void* widget) { return TEXTWIDGET_MAX; }
@@ -88,8 +103,13 @@ void TextWidget_Add(void* screen, struct TextWidget* w) {
 void TextWidget_Set(struct TextWidget* w, const cc_string* text, struct FontDesc* font) {
 	struct DrawTextArgs args;
 	Gfx_DeleteTexture(&w->tex.ID);
+	GlyphText_Free(&w->glyphs);
 	DrawTextArgs_Make(&args, text, font, true);
-	Drawer2D_MakeTextTexture(&w->tex, &args);
+
+	/* Bitmapped text can be drawn without rasterising a new texture */
+	if (!GlyphText_Make(&w->glyphs, &args, &w->tex)) {
+		Drawer2D_MakeTextTexture(&w->tex, &args);
+	}
 
 	/* Give text widget default height when text is empty */
 	if (!w->tex.height) {
@@ -2032,13 +2052,16 @@ void ChatInputWidget_SetFont(struct ChatInputWidget* w, struct FontDesc* font) {
 void TextGroupWidget_ShiftUp(struct TextGroupWidget* w) {
 	int last, i;
 	Gfx_DeleteTexture(&w->textures[0].ID);
+	GlyphText_Free(&w->glyphs[0]);
 	last = w->lines - 1;
 
 	for (i = 0; i < last; i++) 
 	{
 		w->textures[i] = w->textures[i + 1];
+		w->glyphs[i]   = w->glyphs[i + 1];
 	}
 	w->textures[last].ID = 0; /* Gfx_DeleteTexture() called by TextGroupWidget_Redraw otherwise */
+	w->glyphs[last].quads = NULL; w->glyphs[last].count = 0;
 	TextGroupWidget_Redraw(w, last);
 }
 
@@ -2046,12 +2069,15 @@ void TextGroupWidget_ShiftDown(struct TextGroupWidget* w) {
 	int last, i;
 	last = w->lines - 1;
 	Gfx_DeleteTexture(&w->textures[last].ID);
+	GlyphText_Free(&w->glyphs[last]);
 
 	for (i = last; i > 0; i--) 
 	{
 		w->textures[i] = w->textures[i - 1];
+		w->glyphs[i]   = w->glyphs[i - 1];
 	}
 	w->textures[0].ID = 0; /* Gfx_DeleteTexture() called by TextGroupWidget_Redraw otherwise */
+	w->glyphs[0].quads = NULL; w->glyphs[0].count = 0;
 	TextGroupWidget_Redraw(w, 0);
 }
 
@@ -2061,7 +2087,7 @@ int TextGroupWidget_UsedHeight(struct TextGroupWidget* w) {
 
 	for (i = 0; i < w->lines; i++) 
 	{
-		if (textures[i].ID) break;
+		if (TextGroupWidget_HasText(w, i)) break;
 	}
 	for (; i < w->lines; i++) 
 	{
@@ -2287,7 +2313,7 @@ int TextGroupWidget_GetSelected(struct TextGroupWidget* w, cc_string* text, int
 
 	for (i = 0; i < w->lines; i++) 
 	{
-		if (!w->textures[i].ID) continue;
+		if (!TextGroupWidget_HasText(w, i)) continue;
 		tex = w->textures[i];
 		if (!Gui_Contains(tex.x, tex.y, tex.width, tex.height, x, y)) continue;
 
@@ -2362,7 +2388,10 @@ void TextGroupWidget_Redraw(struct TextGroupWidget* w, int index) {
 	cc_string text;
 	struct DrawTextArgs args;
 	struct Texture tex = { 0 };
+	struct GlyphText* glyphs = &w->glyphs[index];
+	int height;
 	Gfx_DeleteTexture(&w->textures[index].ID);
+	GlyphText_Free(glyphs);
 
 	text = TextGroupWidget_UNSAFE_Get(w, index);
 	if (!Drawer2D_IsEmptyText(&text)) {
@@ -2370,10 +2399,14 @@ void TextGroupWidget_Redraw(struct TextGroupWidget* w, int index) {
 
 		if (w->underlineUrls && TextGroupWidget_MightHaveUrls(w)) {
 			TextGroupWidget_DrawAdvanced(w, &tex, &args, index, &text);
-		} else {
+		} else if (!GlyphText_Make(glyphs, &args, &tex)) {
 			Drawer2D_MakeTextTexture(&tex, &args);
 		}
+
+		/* Padding is removed from both top and bottom of the line */
+		height = tex.height;
 		Drawer2D_ReducePadding_Tex(&tex, w->font->size, 3);
+		glyphs->y -= (height - tex.height) / 2;
 	} else {
 		tex.height = w->collapsible[index] ? 0 : w->defaultHeight;
 	}
@@ -2425,8 +2458,11 @@ static void TextGroupWidget_Render(void* widget, float delta) {
 
 	for (i = 0; i < w->lines; i++) 
 	{
-		if (!textures[i].ID) continue;
-		Texture_Render(&textures[i]);
+		if (w->glyphs[i].count) {
+			GlyphText_Render(&w->glyphs[i], &textures[i], PACKEDCOL_WHITE);
+		} else if (textures[i].ID) {
+			Texture_Render(&textures[i]);
+		}
 	}
 }
 
@@ -2437,37 +2473,53 @@ static void TextGroupWidget_Free(void* widget) {
 	for (i = 0; i < w->lines; i++) 
 	{
 		Gfx_DeleteTexture(&w->textures[i].ID);
+		GlyphText_Free(&w->glyphs[i]);
 	}
 }
 
 static void TextGroupWidget_BuildMesh(void* widget, struct VertexTextured** vertices) {
 	struct TextGroupWidget* w = (struct TextGroupWidget*)widget;
+	struct VertexTextured* beg;
 	int i;
 
 	for (i = 0; i < w->lines; i++)
 	{
-		Gfx_Make2DQuad(&w->textures[i], PACKEDCOL_WHITE, vertices);
+		beg = *vertices;
+		if (w->glyphs[i].count) {
+			GlyphText_BuildMesh(&w->glyphs[i], &w->textures[i], PACKEDCOL_WHITE, vertices);
+		} else {
+			Gfx_Make2DQuad(&w->textures[i], PACKEDCOL_WHITE, vertices);
+		}
+		/* Each line always uses same amount of vertices, see TextGroupWidget_RenderLine */
+		*vertices = beg + TEXTWIDGET_MAX;
+	}
+}
+
+void TextGroupWidget_RenderLine(struct TextGroupWidget* w, int index, int offset) {
+	offset += index * TEXTWIDGET_MAX;
+
+	if (w->glyphs[index].count) {
+		GlyphText_Render2(&w->glyphs[index], offset);
+	} else if (w->textures[index].ID) {
+		Gfx_BindTexture(w->textures[index].ID);
+		Gfx_DrawVb_IndexedTris_Range(4, offset);
 	}
 }
 
 static int TextGroupWidget_Render2(void* widget, int offset) {
 	struct TextGroupWidget* w = (struct TextGroupWidget*)widget;
-	struct Texture* textures  = w->textures;
 	int i;
 
-	for (i = 0; i < w->lines; i++, offset += 4)
+	for (i = 0; i < w->lines; i++)
 	{
-		if (!textures[i].ID) continue;
-
-		Gfx_BindTexture(textures[i].ID);
-		Gfx_DrawVb_IndexedTris_Range(4, offset);
+		TextGroupWidget_RenderLine(w, i, offset);
 	}
-	return offset;
+	return offset + w->lines * TEXTWIDGET_MAX;
 }
 
 static int TextGroupWidget_MaxVertices(void* widget) { 
 	struct TextGroupWidget* w = (struct TextGroupWidget*)widget;
-	return w->lines * 4;
+	return w->lines * TEXTWIDGET_MAX;
 }
 
 static const struct WidgetVTABLE TextGroupWidget_VTABLE = {
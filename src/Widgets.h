@@ -19,14 +19,19 @@ struct TextWidget {
 	Widget_Body
 	struct Texture tex;
 	PackedCol color;
+	struct GlyphText glyphs;
 };
-#define TEXTWIDGET_MAX 4
+/* Room for either the text's texture quad, or the text's glyph quads */
+#define TEXTWIDGET_MAX (GLYPHTEXT_MAX_VERTICES > 4 ? GLYPHTEXT_MAX_VERTICES : 4)
+/* Whether the text widget currently has any text to draw */
+#define TextWidget_HasText(w) ((w)->tex.ID || (w)->glyphs.count)
 
 /* Initialises a text widget. */
 CC_NOINLINE void TextWidget_Init(struct TextWidget* w);
 /* Initialises then adds a text widget. */
 CC_NOINLINE void TextWidget_Add(void* screen, struct TextWidget* w);
-/* Draws the given text into a texture, then updates the position and size of this widget. */
+/* Draws the given text into a texture (or as glyph quads for bitmapped fonts), */
+/*  then updates the position and size of this widget. */
 CC_NOINLINE void TextWidget_Set(struct TextWidget* w, const cc_string* text, struct FontDesc* font);
 /* Shorthand for TextWidget_Set using String_FromReadonly */
 CC_NOINLINE void TextWidget_SetConst(struct TextWidget* w, const char* text, struct FontDesc* font);
@@ -254,7 +259,10 @@ struct TextGroupWidget {
 	cc_bool underlineUrls;
 	struct Texture* textures;
 	TextGroupWidget_Get GetLine;
+	struct GlyphText glyphs[GUI_MAX_CHATLINES];
 };
+/* Whether the given line currently has any text to draw */
+#define TextGroupWidget_HasText(w, i) ((w)->textures[i].ID || (w)->glyphs[i].count)
 
 CC_NOINLINE void TextGroupWidget_Create(struct TextGroupWidget* w, int lines, struct Texture* textures, TextGroupWidget_Get getLine);
 CC_NOINLINE void TextGroupWidget_SetFont(struct TextGroupWidget* w, struct FontDesc* font);
@@ -275,6 +283,8 @@ CC_NOINLINE void TextGroupWidget_RedrawAll(struct TextGroupWidget* w);
 /* Calls TextGroupWidget_Redraw for all lines which have the given colour code. */
 /* Typically only called in response to the ChatEvents.ColCodeChanged event. */
 CC_NOINLINE void TextGroupWidget_RedrawAllWithCol(struct TextGroupWidget* w, char col);
+/* Draws the given line, using the vertices built by BuildMesh at the given widget offset */
+CC_NOINLINE void TextGroupWidget_RenderLine(struct TextGroupWidget* w, int index, int offset);
 /* Gets the text for the i'th line. */
 static CC_INLINE cc_string TextGroupWidget_UNSAFE_Get(struct TextGroupWidget* w, int i) { return w->GetLine(i); }
 
@@ -222,6 +222,33 @@ void Window_UpdateRawMouse(void);
 /* Cursor will also be unhidden and moved back to window centre. */
 void Window_DisableRawMouse(void);
 
+#if CC_WIN_BACKEND == CC_WIN_BACKEND_TERMINAL
+/* Marks the terminal as having been written to by something other than Window_DrawFramebuffer */
+/*  (e.g. Platform_Log), so that the next frame is redrawn in full to repair the damage */
+/* NOTE: Can be called from any thread */
+void Window_InvalidateTerminal(void);
+#endif
+
+#if CC_WIN_BACKEND == CC_WIN_BACKEND_HEADLESS
+/* Settings for rendering frames offscreen, without any display or input */
+extern struct _HeadlessData {
+	/* Resolution that frames are rendered at */
+	int Width, Height;
+	/* Number of frames to render before the window closes itself */
+	int Frames;
+	/* Path that the last rendered frame is saved to as a PNG */
+	cc_string Output;
+	/* Path that the draw calls of the last rendered frame are recorded to (if not empty) */
+	/* NOTE: Only supported by the software renderer, see Gfx_ReplayCapture */
+	cc_string Capture;
+	/* Whether the player is kept at the camera position and orientation below */
+	cc_bool SetCamera;
+	float CameraX, CameraY, CameraZ, CameraYaw, CameraPitch;
+	/* Error from loading the map or saving the frame, or 0 if successful */
+	cc_result Result;
+} HeadlessInfo;
+#endif
+
 /* OpenGL contexts are heavily tied to the window, so for simplicitly are also provided here */
 #if CC_GFX_BACKEND_IS_GL()
 #define GLCONTEXT_DEFAULT_DEPTH 24
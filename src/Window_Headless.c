@@ -0,0 +1,181 @@
+#include "Core.h"
+#if CC_WIN_BACKEND == CC_WIN_BACKEND_HEADLESS
+#include "_WindowBase.h"
+#include "String.h"
+#include "Funcs.h"
+#include "Bitmap.h"
+#include "Errors.h"
+#include "Stream.h"
+#include "Entity.h"
+#include "World.h"
+#include "Game.h"
+
+/* Renders frames into an offscreen framebuffer without a display, which is */
+/*  then saved as a PNG after the configured number of frames have been rendered */
+/* NOTE: Meant to be paired with Graphics_SoftGPU.c (e.g. for generating map thumbnails) */
+struct _HeadlessData HeadlessInfo;
+static cc_bool pendingClose;
+static int framesRendered;
+
+
+/*########################################################################################################################*
+*-------------------------------------------------------Window common-----------------------------------------------------*
+*#########################################################################################################################*/
+void Window_PreInit(void) {
+	DisplayInfo.CursorVisible = true;
+}
+
+void Window_Init(void) {
+	Input.Sources = INPUT_SOURCE_NORMAL;
+	DisplayInfo.Depth  = 4;
+	DisplayInfo.ScaleX = 1.0f;
+	DisplayInfo.ScaleY = 1.0f;
+}
+
+void Window_Free(void) { }
+
+static void DoCreateWindow(int width, int height) {
+	/* Requested size is ignored, frames are always rendered at the configured resolution */
+	Window_Main.Width    = max(HeadlessInfo.Width,  1);
+	Window_Main.Height   = max(HeadlessInfo.Height, 1);
+	Window_Main.Exists   = true;
+	Window_Main.Focused  = true;
+
+	Window_Main.UIScaleX = DEFAULT_UI_SCALE_X;
+	Window_Main.UIScaleY = DEFAULT_UI_SCALE_Y;
+	framesRendered = 0;
+}
+void Window_Create2D(int width, int height) { DoCreateWindow(width, height); }
+void Window_Create3D(int width, int height) { DoCreateWindow(width, height); }
+
+void Window_Destroy(void) { }
+
+void Window_SetTitle(const cc_string* title) { }
+
+void Clipboard_GetText(cc_string* value) { }
+
+void Clipboard_SetText(const cc_string* value) { }
+
+int Window_GetWindowState(void) {
+	return WINDOW_STATE_NORMAL;
+}
+
+cc_result Window_EnterFullscreen(void) {
+	return 0;
+}
+cc_result Window_ExitFullscreen(void) {
+	return 0;
+}
+
+int Window_IsObscured(void) { return 0; }
+
+void Window_Show(void) { }
+
+void Window_SetSize(int width, int height) { }
+
+void Window_RequestClose(void) {
+	pendingClose = true;
+}
+
+/* Moves the player to the configured camera position and orientation */
+static void UpdateCamera(void) {
+	struct LocalPlayer* p = Entities.CurPlayer;
+	struct LocationUpdate update;
+	if (!HeadlessInfo.SetCamera || !World.Loaded) return;
+
+	update.flags = LU_HAS_POS | LU_HAS_PITCH | LU_HAS_YAW | LU_POS_ABSOLUTE_INSTANT;
+	update.pos.x = HeadlessInfo.CameraX;
+	update.pos.y = HeadlessInfo.CameraY;
+	update.pos.z = HeadlessInfo.CameraZ;
+	update.yaw   = HeadlessInfo.CameraYaw;
+	update.pitch = HeadlessInfo.CameraPitch;
+
+	/* Stop gravity from moving the player away from the camera position between frames */
+	p->Hacks.Flying = true;
+	p->Hacks.Noclip = true;
+	p->Base.VTABLE->SetLocation(&p->Base, &update);
+}
+
+void Window_ProcessEvents(float delta) {
+	if (pendingClose) {
+		pendingClose = false;
+		Window_Main.Exists = false;
+		Event_RaiseVoid(&WindowEvents.Closing);
+		return;
+	}
+
+	Game_HideGui = true;
+	UpdateCamera();
+}
+
+void Gamepads_Init(void) { }
+
+void Gamepads_Process(float delta) { }
+
+static void Cursor_GetRawPos(int* x, int* y) {
+	*x = 0;
+	*y = 0;
+}
+
+void Cursor_SetPosition(int x, int y) { }
+
+static void Cursor_DoSetVisible(cc_bool visible) { }
+
+static void ShowDialogCore(const char* title, const char* msg) {
+	Platform_LogConst(title);
+	Platform_LogConst(msg);
+}
+
+cc_result Window_OpenFileDialog(const struct OpenFileDialogArgs* args) {
+	return ERR_NOT_SUPPORTED;
+}
+
+cc_result Window_SaveFileDialog(const struct SaveFileDialogArgs* args) {
+	return ERR_NOT_SUPPORTED;
+}
+
+void OnscreenKeyboard_Open(struct OpenKeyboardArgs* args) { }
+void OnscreenKeyboard_SetText(const cc_string* text) { }
+void OnscreenKeyboard_Close(void) { }
+
+void Window_EnableRawMouse(void)  { }
+void Window_UpdateRawMouse(void)  { }
+void Window_DisableRawMouse(void) { }
+
+
+/*########################################################################################################################*
+*-------------------------------------------------------Framebuffer-------------------------------------------------------*
+*#########################################################################################################################*/
+void Window_AllocFramebuffer(struct Bitmap* bmp, int width, int height) {
+	bmp->scan0  = (BitmapCol*)Mem_Alloc(width * height, BITMAPCOLOR_SIZE, "window pixels");
+	bmp->width  = width;
+	bmp->height = height;
+}
+
+void Window_FreeFramebuffer(struct Bitmap* bmp) {
+	Mem_Free(bmp->scan0);
+}
+
+static void SaveFrame(struct Bitmap* bmp) {
+	struct Stream stream;
+	cc_result res;
+
+	res = Stream_CreateFile(&stream, &HeadlessInfo.Output);
+	if (res) { Logger_SysWarn2(res, "creating", &HeadlessInfo.Output); HeadlessInfo.Result = res; return; }
+
+	res = Png_Encode(bmp, &stream, NULL, false, NULL);
+	if (res) { Logger_SysWarn2(res, "saving to", &HeadlessInfo.Output); HeadlessInfo.Result = res; }
+
+	res = stream.Close(&stream);
+	if (res) { Logger_SysWarn2(res, "closing", &HeadlessInfo.Output); HeadlessInfo.Result = res; }
+}
+
+void Window_DrawFramebuffer(Rect2D r, struct Bitmap* bmp) {
+	/* NOTE: One more frame is still rendered after requesting close */
+	framesRendered++;
+	if (framesRendered != HeadlessInfo.Frames || HeadlessInfo.Result) return;
+
+	if (HeadlessInfo.Output.length) SaveFrame(bmp);
+	Window_RequestClose();
+}
+#endif
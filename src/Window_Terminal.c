@@ -48,6 +48,9 @@
 #endif
 
 static void SetMousePosition(int x, int y);
+static void AllocCells(int width, int height);
+static void FreeCells(void);
+static void TermWorkers_Stop(void);
 static cc_bool pendingResize, pendingClose;
 static int supportsTruecolor;
 #define CHARS_PER_CELL 2
@@ -436,7 +439,7 @@ static void DoCreateWindow(int width, int height) {
 void Window_Create2D(int width, int height) { DoCreateWindow(width, height); }
 void Window_Create3D(int width, int height) { DoCreateWindow(width, height); }
 
-void Window_Destroy(void) { }
+void Window_Destroy(void) { TermWorkers_Stop(); }
 
 void Window_SetTitle(const cc_string* title) {
 	// TODO
@@ -535,10 +538,12 @@ void Window_AllocFramebuffer(struct Bitmap* bmp, int width, int height) {
 	bmp->scan0  = (BitmapCol*)Mem_Alloc(width * height, BITMAPCOLOR_SIZE, "window pixels");
 	bmp->width  = width;
 	bmp->height = height;
+	AllocCells(width, height);
 }
 
 void Window_FreeFramebuffer(struct Bitmap* bmp) {
 	Mem_Free(bmp->scan0);
+	FreeCells();
 }
 
 void OnscreenKeyboard_Open(struct OpenKeyboardArgs* args) { }
@@ -561,17 +566,52 @@ void Window_DisableRawMouse(void) {
 /*########################################################################################################################*
 *-------------------------------------------------------Console output-----------------------------------------------------*
 *#########################################################################################################################*/
-// TODO still wrong
-static void AppendByteFast(cc_string* str, int value) {
+/* Only cells which changed since the last frame are output, and the background/foreground colours */
+/*  are only output when they differ from the previous cell's, so mostly static frames need far */
+/*  less output (important over slow connections such as SSH) */
+/* Each row of cells is encoded into its own slot of the output buffer, so rows can be */
+/*  encoded in parallel by the worker threads and calling thread, then written in one call */
+#define TERM_MAX_CELL_BYTES 64 /* Upper bound for cursor move + 2 truecolour SGRs + BOX_CHAR */
+#define TERM_INVALID_COLOR  0xFFFFFFFFUL
+/* Rewriting a couple of unchanged cells is smaller than moving the cursor over them */
+#define TERM_MAX_REWRITE_GAP 2
+
+struct TermCell { cc_uint32 top, bot; };
+static struct TermCell* term_cells; /* Colours of each cell as last output to the terminal */
+static char* term_output;
+static int*  term_rowLens;
+static int term_width, term_rows;
+
+static struct Bitmap* term_bmp;
+static Rect2D term_rect;
+static int term_rowBeg, term_rowEnd;
+static volatile cc_bool term_invalidated;
+
+static char* AppendByteFast(char* dst, int value) {
 	if (value >= 100) { 
-		String_Append(str, '0' + (value / 100)); value %= 100;
-		String_Append(str, '0' + (value /  10)); value %=  10;
+		*dst++ = '0' + (value / 100); value %= 100;
+		*dst++ = '0' + (value /  10); value %=  10;
 	} else if (value >=  10) { 
-		String_Append(str, '0' + (value /  10)); value %=  10; 
+		*dst++ = '0' + (value /  10); value %=  10; 
 	}
-	String_Append(str, '0' + value);
+	*dst++ = '0' + value;
+	return dst;
 }
 
+static char* AppendIntFast(char* dst, int value) {
+	char digits[16];
+	int i = 0;
+
+	do {
+		digits[i++] = '0' + (value % 10); value /= 10;
+	} while (value);
+
+	while (i) *dst++ = digits[--i];
+	return dst;
+}
+
+#define AppendConstFast(dst, str) (Mem_Copy(dst, str, sizeof(str) - 1), dst += sizeof(str) - 1)
+
 static int Index256(int value) {
 	if (value <= 0x5F) return value;
 	// Add 20 to round to nearest
@@ -586,69 +626,272 @@ static int CalcIndex(BitmapCol rgb) {
 	return 16 + 36 * r + 6 * g + b;
 }
 
-void Window_DrawFramebuffer(Rect2D r, struct Bitmap* bmp) {
-	char buf[256];
-	cc_string str;
-	int len;
-	String_InitArray(str, buf);
-	
-	for (int y = r.y & ~0x01; y < r.y + r.height; y += 2)
+/* Returns the value that is actually output for the given colour */
+/*  (so colours that map to the same 256 colour index are treated as unchanged) */
+static cc_uint32 CalcCellColor(BitmapCol col) {
+	if (!supportsTruecolor) return CalcIndex(col);
+	return (BitmapCol_R(col) << 16) | (BitmapCol_G(col) << 8) | BitmapCol_B(col);
+}
+
+static char* AppendCellColor(char* dst, cc_uint32 col) {
+	if (supportsTruecolor) {
+		*dst++ = '2'; *dst++ = SEP_CHAR;
+		dst = AppendByteFast(dst, (col >> 16) & 0xFF); *dst++ = SEP_CHAR;
+		dst = AppendByteFast(dst, (col >>  8) & 0xFF); *dst++ = SEP_CHAR;
+		dst = AppendByteFast(dst, (col      ) & 0xFF);
+	} else {
+		*dst++ = '5'; *dst++ = SEP_CHAR;
+		dst = AppendByteFast(dst, col);
+	}
+	*dst++ = 'm';
+	return dst;
+}
+
+static void InvalidateCells(void) {
+	int i;
+	for (i = 0; i < term_width * term_rows; i++)
 	{
-		//len = sprintf(buf, CSI "%i;%iH", y / 2, r.x); // move cursor to start
-		//OutputConsole(buf, len);
-		str.length = 0;
-		String_AppendConst(&str, CSI);
-		String_AppendInt(  &str, y / CHARS_PER_CELL);
-		String_Append(     &str, ';');
-		String_AppendInt(  &str, r.x);
-		String_Append(     &str, 'H');
-		OutputConsole(buf, str.length);
-		
-		for (int x = r.x; x < r.x + r.width; x++)
-		{
-			BitmapCol top = Bitmap_GetPixel(bmp, x, y + 0);
-			BitmapCol bot = Bitmap_GetPixel(bmp, x, y + 1);
-	
-			// Use '▄' so each cell can use a background and foreground colour
-			// This essentially doubles the vertical resolution of the displayed image
-			//printf(CSI "48;2;%i;%i;%im", BitmapCol_R(top), BitmapCol_G(top), BitmapCol_B(top));
-			//printf(CSI "38;2;%i;%i;%im", BitmapCol_R(bot), BitmapCol_G(bot), BitmapCol_B(bot));
-			//printf("\xE2\x96\x84");
-			//len = sprintf(buf, CSI "48;2;%i;%i;%im" CSI "38;2;%i;%i;%im" BOX_CHAR, 
-			//				BitmapCol_R(top), BitmapCol_G(top), BitmapCol_B(top),
-			//				BitmapCol_R(bot), BitmapCol_G(bot), BitmapCol_B(bot));
-			
-			// https://en.wikipedia.org/wiki/ANSI_escape_code#Colors
-			str.length = 0;
-			if (supportsTruecolor) {
-				String_AppendConst(&str, CSI "48" SEP_STR "2" SEP_STR);
-				String_AppendInt(  &str, BitmapCol_R(top));
-				String_Append(     &str, SEP_CHAR);
-				String_AppendInt(  &str, BitmapCol_G(top));
-				String_Append(     &str, SEP_CHAR);
-				String_AppendInt(  &str, BitmapCol_B(top));
-				String_Append(     &str, 'm');
-				
-				String_AppendConst(&str, CSI "38" SEP_STR "2" SEP_STR);
-				String_AppendInt(  &str, BitmapCol_R(bot));
-				String_Append(     &str, SEP_CHAR);
-				String_AppendInt(  &str, BitmapCol_G(bot));
-				String_Append(     &str, SEP_CHAR);
-				String_AppendInt(  &str, BitmapCol_B(bot));
-				String_Append(     &str, 'm');
-			} else {
-				String_AppendConst(&str, CSI "48" SEP_STR "5" SEP_STR);
-				String_AppendInt(  &str, CalcIndex(top));
-				String_Append(     &str, 'm');
-				
-				String_AppendConst(&str, CSI "38" SEP_STR "5" SEP_STR);
-				String_AppendInt(  &str, CalcIndex(bot));
-				String_Append(     &str, 'm');
+		term_cells[i].top = TERM_INVALID_COLOR;
+		term_cells[i].bot = TERM_INVALID_COLOR;
+	}
+}
+
+void Window_InvalidateTerminal(void) { term_invalidated = true; }
+
+static void FreeCells(void) {
+	Mem_Free(term_cells);
+	Mem_Free(term_output);
+	Mem_Free(term_rowLens);
+
+	term_cells   = NULL;
+	term_output  = NULL;
+	term_rowLens = NULL;
+}
+
+static void AllocCells(int width, int height) {
+	FreeCells();
+	term_width = width;
+	term_rows  = (height + CHARS_PER_CELL - 1) / CHARS_PER_CELL;
+
+	term_cells   = (struct TermCell*)Mem_Alloc(width * term_rows, sizeof(struct TermCell), "terminal cells");
+	term_output  = (char*)Mem_Alloc(width * term_rows, TERM_MAX_CELL_BYTES, "terminal output");
+	term_rowLens = (int*)Mem_Alloc(term_rows, sizeof(int), "terminal row lengths");
+	InvalidateCells();
+}
+
+static void EncodeRow(int row) {
+	struct Bitmap* bmp = term_bmp;
+	int x, y = row * CHARS_PER_CELL;
+	int beg  = term_rect.x, end = term_rect.x + term_rect.width;
+	struct TermCell* cells = &term_cells[row * term_width];
+	char* start = term_output + row * term_width * TERM_MAX_CELL_BYTES;
+	char* dst   = start;
+	/* Position the terminal cursor will be at when the next cell is output (-1 for unknown) */
+	int cursorX = -1, gap, i;
+	cc_uint32 curTop = TERM_INVALID_COLOR, curBot = TERM_INVALID_COLOR;
+	cc_uint32 top, bot;
+
+	for (x = beg; x < end; x++)
+	{
+		top = CalcCellColor(Bitmap_GetPixel(bmp, x, y));
+		bot = y + 1 < bmp->height ? CalcCellColor(Bitmap_GetPixel(bmp, x, y + 1)) : top;
+		if (cells[x].top == top && cells[x].bot == bot) continue;
+
+		cells[x].top = top;
+		cells[x].bot = bot;
+		gap = x - cursorX;
+
+		if (cursorX >= 0 && gap <= TERM_MAX_REWRITE_GAP) {
+			/* Rewrite the unchanged cells in between if that doesn't need any colour changes */
+			for (i = cursorX; i < x; i++)
+			{
+				if (cells[i].top != curTop || cells[i].bot != curBot) break;
+			}
+			if (i < x) gap = TERM_MAX_REWRITE_GAP + 1;
+
+			for (i = cursorX; i < x && gap <= TERM_MAX_REWRITE_GAP; i++)
+			{
+				AppendConstFast(dst, BOX_CHAR);
 			}
-			
-			String_AppendConst(&str, BOX_CHAR);
-			OutputConsole(buf, str.length);
-		}		
+		}
+
+		if (cursorX < 0 || gap > TERM_MAX_REWRITE_GAP) {
+			/* Cursor positions are 1 based */
+			AppendConstFast(dst, CSI);
+			dst = AppendIntFast(dst, row + 1);
+			*dst++ = ';';
+			dst = AppendIntFast(dst, x + 1);
+			*dst++ = 'H';
+		}
+
+		// Use '▄' so each cell can use a background and foreground colour
+		// This essentially doubles the vertical resolution of the displayed image
+		// https://en.wikipedia.org/wiki/ANSI_escape_code#Colors
+		if (top != curTop) {
+			AppendConstFast(dst, CSI "48" SEP_STR);
+			dst = AppendCellColor(dst, top);
+			curTop = top;
+		}
+		if (bot != curBot) {
+			AppendConstFast(dst, CSI "38" SEP_STR);
+			dst = AppendCellColor(dst, bot);
+			curBot = bot;
+		}
+
+		AppendConstFast(dst, BOX_CHAR);
+		cursorX = x + 1;
+	}
+	term_rowLens[row] = (int)(dst - start);
+}
+
+#ifdef CC_BUILD_COOPTHREADED
+static void EncodeRows(void) {
+	int row;
+	for (row = term_rowBeg; row < term_rowEnd; row++) EncodeRow(row);
+}
+static void TermWorkers_Stop(void) { }
+#else
+#define TERM_WORKERS 3 /* Calling thread also encodes rows */
+/* Below this many cells, it's faster to just encode on the calling thread */
+#define TERM_MIN_PARALLEL_CELLS 2048
+
+static void* term_mutex;
+static void* term_done;
+static void* term_wakeups[TERM_WORKERS];
+static void* term_threads[TERM_WORKERS];
+static int term_nextRow, term_busyWorkers, term_startedWorkers;
+static cc_bool term_stopWorkers;
+
+/* Encodes rows until there are no more rows left to encode */
+static void EncodeNextRows(void) {
+	int row;
+
+	for (;;) {
+		Mutex_Lock(term_mutex);
+		row = term_nextRow++;
+		Mutex_Unlock(term_mutex);
+
+		if (row >= term_rowEnd) return;
+		EncodeRow(row);
+	}
+}
+
+static void TermWorker_Run(void) {
+	int id;
+	Mutex_Lock(term_mutex);
+	id = term_startedWorkers++;
+	Mutex_Unlock(term_mutex);
+
+	for (;;) {
+		Waitable_Wait(term_wakeups[id]);
+		if (term_stopWorkers) return;
+		EncodeNextRows();
+
+		Mutex_Lock(term_mutex);
+		{
+			if (--term_busyWorkers == 0) Waitable_Signal(term_done);
+		}
+		Mutex_Unlock(term_mutex);
+	}
+}
+
+static void TermWorkers_Start(void) {
+	int i;
+	if (term_mutex) return;
+
+	term_mutex = Mutex_Create("Terminal rows");
+	term_done  = Waitable_Create("Terminal done");
+	term_startedWorkers = 0;
+	term_stopWorkers    = false;
+
+	for (i = 0; i < TERM_WORKERS; i++) {
+		term_wakeups[i] = Waitable_Create("Terminal wakeup");
+		Thread_Run(&term_threads[i], TermWorker_Run, 64 * 1024, "Terminal worker");
+	}
+}
+
+static void TermWorkers_Stop(void) {
+	int i;
+	if (!term_mutex) return;
+
+	/* Workers are always idle outside of EncodeRows */
+	term_stopWorkers = true;
+	for (i = 0; i < TERM_WORKERS; i++) Waitable_Signal(term_wakeups[i]);
+
+	for (i = 0; i < TERM_WORKERS; i++) {
+		Thread_Join(term_threads[i]);
+		Waitable_Free(term_wakeups[i]);
 	}
+
+	Waitable_Free(term_done);
+	Mutex_Free(term_mutex);
+	term_mutex = NULL;
+}
+
+static void EncodeRows(void) {
+	int i, busy, cells = term_rect.width * (term_rowEnd - term_rowBeg);
+	TermWorkers_Start();
+
+	Mutex_Lock(term_mutex);
+	{
+		term_nextRow     = term_rowBeg;
+		term_busyWorkers = cells >= TERM_MIN_PARALLEL_CELLS ? TERM_WORKERS : 0;
+		busy = term_busyWorkers;
+	}
+	Mutex_Unlock(term_mutex);
+
+	for (i = 0; i < busy; i++) Waitable_Signal(term_wakeups[i]);
+	EncodeNextRows();
+
+	/* Wait for the workers to finish encoding their last rows */
+	while (busy) {
+		Waitable_Wait(term_done);
+
+		Mutex_Lock(term_mutex);
+		busy = term_busyWorkers;
+		Mutex_Unlock(term_mutex);
+	}
+}
+#endif
+
+void Window_DrawFramebuffer(Rect2D r, struct Bitmap* bmp) {
+	char* dst;
+	int row, len;
+	if (!term_cells) return;
+
+	/* Clamp the dirty region to the framebuffer */
+	if (r.x < 0) { r.width  += r.x; r.x = 0; }
+	if (r.y < 0) { r.height += r.y; r.y = 0; }
+	r.width  = min(r.width,  bmp->width  - r.x);
+	r.height = min(r.height, bmp->height - r.y);
+
+	term_bmp    = bmp;
+	term_rect   = r;
+	term_rowBeg = r.y / CHARS_PER_CELL;
+	term_rowEnd = (r.y + r.height + CHARS_PER_CELL - 1) / CHARS_PER_CELL;
+	if (r.width <= 0 || term_rowBeg >= term_rowEnd) return;
+
+	/* Something else wrote to the terminal, so redraw every cell instead of only changed ones */
+	/* NOTE: Must be reset before encoding, so output while encoding invalidates the next frame */
+	if (term_invalidated) {
+		term_invalidated = false;
+		InvalidateCells();
+		term_rowBeg = 0;
+		term_rowEnd = term_rows;
+		term_rect.x = 0; term_rect.width = bmp->width;
+	}
+	EncodeRows();
+
+	/* Move the encoded rows together, so the whole frame can be output at once */
+	dst = term_output + term_rowBeg * term_width * TERM_MAX_CELL_BYTES;
+	for (row = term_rowBeg; row < term_rowEnd; row++)
+	{
+		len = term_rowLens[row];
+		Mem_Move(dst, term_output + row * term_width * TERM_MAX_CELL_BYTES, len);
+		dst += len;
+	}
+
+	len = (int)(dst - (term_output + term_rowBeg * term_width * TERM_MAX_CELL_BYTES));
+	if (len) OutputConsole(term_output + term_rowBeg * term_width * TERM_MAX_CELL_BYTES, len);
 }
 #endif
@@ -7,6 +7,7 @@
 #include "Game.h"
 #include "Utils.h"
 #include "Options.h"
+#include "Errors.h"
 
 static cc_bool httpsOnly, httpOnly, httpsVerify;
 static char skinServer_buffer[128];
@@ -15,10 +16,13 @@ static cc_string skinServer = String_FromArray(skinServer_buffer);
 void HttpRequest_Free(struct HttpRequest* request) {
 	Mem_Free(request->data);
 	Mem_Free(request->error);
+	Mem_Free(request->path);
 
 	request->data  = NULL;
 	request->size  = 0;
 	request->error = NULL;
+	request->path  = NULL;
+	request->_capacity = 0;
 }
 #define HttpRequest_Copy(dst, src) Mem_Copy(dst, src, sizeof(struct HttpRequest))
 
@@ -110,6 +114,318 @@ static void RequestList_Free(struct RequestList* list) {
 }
 
 
+/*########################################################################################################################*
+*--------------------------------------------------------Http cache-------------------------------------------------------*
+*#########################################################################################################################*/
+/* Responses are cached in texturecache/[CRC32 of url] (where texture packs were originally cached) */
+#define HTTP_CACHE_ENABLED 0x01 /* Response can be stored in and loaded from the cache */
+#define HTTP_CACHE_NOSTORE 0x02 /* Server forbids storing the response (Cache-Control: no-store) */
+#define HTTP_CACHE_FRESH   0x04 /* Cached response hasn't expired yet, so server doesn't need to be asked */
+#define HTTP_CACHE_SKIPLOAD 0x08 /* Cached response contents don't need to be read into the request */
+
+static struct StringsBuffer cacheETags, cacheLastModified, cacheExpires;
+static void* cacheMutex;
+static cc_bool cacheLoaded, cacheDirty;
+#define CACHE_ETAGS_TXT   "texturecache/etags.txt"
+#define CACHE_LASTMOD_TXT "texturecache/lastmodified.txt"
+#define CACHE_EXPIRES_TXT "texturecache/expires.txt"
+
+static void HttpCache_Init(void) {
+	/* Http component gets initialised multiple times on Android */
+	if (cacheLoaded) return;
+	cacheLoaded = true;
+
+	Utils_EnsureDirectory("texturecache");
+	EntryList_UNSAFE_Load(&cacheETags,        CACHE_ETAGS_TXT);
+	EntryList_UNSAFE_Load(&cacheLastModified, CACHE_LASTMOD_TXT);
+	EntryList_UNSAFE_Load(&cacheExpires,      CACHE_EXPIRES_TXT);
+	cacheMutex = Mutex_Create("HTTP cache");
+}
+
+/* Expiry times are stored as unix timestamps */
+static cc_uint32 HttpCache_Now(void) {
+	return (cc_uint32)(DateTime_CurrentUTC() - UNIX_EPOCH_SECONDS);
+}
+
+CC_INLINE static void HashUrl(cc_string* key, const cc_string* url) {
+	String_AppendUInt32(key, Utils_CRC32((const cc_uint8*)url->buffer, url->length));
+}
+
+/* NOTE: Protected by cacheMutex, since these are used from multiple HTTP worker threads */
+static cc_bool createdCache, cacheInvalid;
+static cc_bool UseDedicatedCache(cc_string* path, const cc_string* key) {
+	cc_bool invalid;
+	cc_result res;
+	cc_filepath str;
+	Directory_GetCachePath(path);
+	if (!path->length) return false;
+
+	Mutex_Lock(cacheMutex);
+	{
+		invalid = cacheInvalid;
+	}
+	Mutex_Unlock(cacheMutex);
+	if (invalid) return false;
+
+	String_AppendConst(path, "/texturecache");
+	Platform_EncodePath(&str, path);
+	res = Directory_Create(&str);
+
+	Mutex_Lock(cacheMutex);
+	{
+		/* Check if something is deleting the cache directory behind our back */
+		/*  (Several users have reported this happening on some Android devices) */
+		/* NOTE: Can be called from HTTP worker threads, so can't show a message in chat */
+		if (createdCache && res == 0 && !cacheInvalid) {
+			Platform_LogConst("Something has deleted system managed cache folder");
+			Platform_LogConst("  Falling back to caching to game folder instead..");
+			cacheInvalid = true;
+		}
+		if (res == 0) createdCache = true;
+		invalid = cacheInvalid;
+	}
+	Mutex_Unlock(cacheMutex);
+
+	String_Format1(path, "/%s", key);
+	return !invalid;
+}
+
+CC_NOINLINE static void MakeCachePath(cc_string* mainPath, cc_string* altPath, const cc_string* url) {
+	cc_string key; char keyBuffer[STRING_INT_CHARS];
+	String_InitArray(key, keyBuffer);
+	HashUrl(&key, url);
+	
+	if (UseDedicatedCache(mainPath, &key)) {
+		/* If using dedicated cache directory, also fallback to default cache directory */
+		String_Format1(altPath,  "texturecache/%s",  &key);
+	} else {
+		mainPath->length = 0;
+		String_Format1(mainPath, "texturecache/%s",  &key);
+	}
+}
+
+/* Returns non-zero if given URL has been cached */
+static int HttpCache_Exists(const cc_string* url) {
+	cc_string mainPath; char mainBuffer[FILENAME_SIZE];
+	cc_string altPath;  char  altBuffer[FILENAME_SIZE];
+	cc_filepath mainStr, altStr;
+	
+	String_InitArray(mainPath, mainBuffer);
+	String_InitArray(altPath,   altBuffer);
+
+	MakeCachePath(&mainPath, &altPath, url);
+	Platform_EncodePath(&mainStr, &mainPath);
+	Platform_EncodePath(&altStr,  &altPath);
+
+	return File_Exists(&mainStr) || (altPath.length && File_Exists(&altStr));
+}
+
+static cc_result HttpCache_OpenFile(const cc_string* mainPath, const cc_string* altPath, struct Stream* stream) {
+	cc_result res = Stream_OpenFile(stream, mainPath);
+
+	/* try fallback cache if can't find in main cache */
+	if (res == ReturnCode_FileNotFound && altPath->length)
+		res = Stream_OpenFile(stream, altPath);
+	return res;
+}
+
+static cc_result HttpCache_Open(const cc_string* url, struct Stream* stream) {
+	cc_string mainPath; char mainBuffer[FILENAME_SIZE];
+	cc_string altPath;  char  altBuffer[FILENAME_SIZE];
+	String_InitArray(mainPath, mainBuffer);
+	String_InitArray(altPath,   altBuffer);
+
+	MakeCachePath(&mainPath, &altPath, url);
+	return HttpCache_OpenFile(&mainPath, &altPath, stream);
+}
+
+cc_bool Http_OpenCachedData(const cc_string* url, struct Stream* stream) {
+	cc_result res = HttpCache_Open(url, stream);
+
+	if (res == ReturnCode_FileNotFound) return false;
+	if (res) { Logger_SysWarn2(res, "opening cache for", url); return false; }
+	return true;
+}
+
+CC_NOINLINE static cc_string GetCachedTag(const cc_string* url, struct StringsBuffer* list) {
+	cc_string key; char keyBuffer[STRING_INT_CHARS];
+	String_InitArray(key, keyBuffer);
+
+	HashUrl(&key, url);
+	return EntryList_UNSAFE_Get(list, &key, ' ');
+}
+
+static cc_string GetCachedLastModified(const cc_string* url) {
+	int i;
+	cc_string entry = GetCachedTag(url, &cacheLastModified);
+	/* Entry used to be a timestamp of C# DateTime ticks since 01/01/0001 */
+	/* Check whether timestamp entry is old or new format */
+	for (i = 0; i < entry.length; i++) {
+		if (entry.buffer[i] < '0' || entry.buffer[i] > '9') return entry;
+	}
+
+	/* Entry is all digits, so the old unsupported format */
+	entry.length = 0; return entry;
+}
+
+/* NOTE: Must be called while cacheMutex is locked */
+CC_NOINLINE static void SetCachedTag(const cc_string* url, struct StringsBuffer* list, const cc_string* data) {
+	cc_string key; char keyBuffer[STRING_INT_CHARS];
+	String_InitArray(key, keyBuffer);
+	HashUrl(&key, url);
+
+	if (data->length) {
+		EntryList_Set(list, &key, data, ' ');
+	} else if (!EntryList_Remove(list, &key, ' ')) {
+		return;
+	}
+	cacheDirty = true;
+}
+
+/* Saves the ETag/Last-Modified/expiry lists, if any have changed since they were last saved */
+/* NOTE: Lists are saved in batches, rather than rewriting all of them for every cached response */
+static void HttpCache_Save(void) {
+	if (!cacheMutex) return;
+
+	Mutex_Lock(cacheMutex);
+	if (cacheDirty) {
+		EntryList_Save(&cacheETags,        CACHE_ETAGS_TXT);
+		EntryList_Save(&cacheLastModified, CACHE_LASTMOD_TXT);
+		EntryList_Save(&cacheExpires,      CACHE_EXPIRES_TXT);
+		cacheDirty = false;
+	}
+	Mutex_Unlock(cacheMutex);
+}
+
+/* Sets up the request to revalidate the cached response (if any) with the server */
+static void HttpCache_Prepare(struct HttpRequest* req) {
+	cc_string url = String_FromRawArray(req->url);
+	cc_string value;
+	cc_uint64 expires;
+
+	/* Can't reuse ETag/Last-Modified if user deleted the cached file */
+	if (!HttpCache_Exists(&url)) return;
+
+	Mutex_Lock(cacheMutex);
+	{
+		value = GetCachedTag(&url, &cacheExpires);
+		if (Convert_ParseUInt64(&value, &expires) && HttpCache_Now() < expires) {
+			req->_cache |= HTTP_CACHE_FRESH;
+		}
+
+		value = GetCachedTag(&url, &cacheETags);
+		String_CopyToRawArray(req->etag, &value);
+		value = GetCachedLastModified(&url);
+		String_CopyToRawArray(req->lastModified, &value);
+	}
+	Mutex_Unlock(cacheMutex);
+}
+
+static void HttpCache_UpdateExpiry(struct HttpRequest* req, const cc_string* url) {
+	cc_string value; char valueBuffer[STRING_INT_CHARS];
+	String_InitArray(value, valueBuffer);
+
+	/* No max-age means the response must always be revalidated */
+	if (req->_maxAge > 0) {
+		String_AppendUInt32(&value, HttpCache_Now() + req->_maxAge);
+	}
+	SetCachedTag(url, &cacheExpires, &value);
+}
+
+/* Stores the response contents and ETag/Last-Modified/expiry time in the cache */
+static void HttpCache_Store(struct HttpRequest* req) {
+	cc_string url, value, altPath;
+	cc_string path; char pathBuffer[FILENAME_SIZE];
+	cc_result res;
+	if (Platform_ReadonlyFilesystem) return;
+
+	url = String_FromRawArray(req->url);
+	String_InitArray(path, pathBuffer);
+	altPath = String_Empty;
+	MakeCachePath(&path, &altPath, &url);
+
+	/* Another worker might be storing or reading the same url at the same time */
+	Mutex_Lock(cacheMutex);
+	{
+		res = Stream_WriteAllTo(&path, req->data, req->size);
+		if (!res) {
+			value = String_FromRawArray(req->etag);
+			SetCachedTag(&url, &cacheETags,        &value);
+			value = String_FromRawArray(req->lastModified);
+			SetCachedTag(&url, &cacheLastModified, &value);
+			HttpCache_UpdateExpiry(req, &url);
+		}
+	}
+	Mutex_Unlock(cacheMutex);
+	if (res) Platform_Log2("Error %e caching %s", &res, &url);
+}
+
+/* Replaces a 304 Not Modified response with the cached response contents */
+static void HttpCache_Load(struct HttpRequest* req) {
+	cc_string url = String_FromRawArray(req->url);
+	cc_string mainPath; char mainBuffer[FILENAME_SIZE];
+	cc_string altPath;  char  altBuffer[FILENAME_SIZE];
+	struct Stream stream;
+	cc_uint32 length;
+	cc_uint8* data = NULL;
+	cc_result res;
+
+	/* Discard the body of the 304 response (if any) */
+	Mem_Free(req->data);
+	req->data      = NULL;
+	req->size      = 0;
+	req->_capacity = 0;
+	req->fromCache = true;
+
+	/* Server confirmed cached response is still valid, so also update when it next expires */
+	if (!(req->_cache & HTTP_CACHE_FRESH)) {
+		Mutex_Lock(cacheMutex);
+		{
+			HttpCache_UpdateExpiry(req, &url);
+		}
+		Mutex_Unlock(cacheMutex);
+	}
+	/* Caller will read the cached response itself */
+	if (req->_cache & HTTP_CACHE_SKIPLOAD) return;
+
+	String_InitArray(mainPath, mainBuffer);
+	String_InitArray(altPath,   altBuffer);
+	MakeCachePath(&mainPath, &altPath, &url);
+
+	/* Another worker might be storing a newer response for the same url at the same time */
+	Mutex_Lock(cacheMutex);
+	{
+		if (!(res = HttpCache_OpenFile(&mainPath, &altPath, &stream))) {
+			res = stream.Length(&stream, &length);
+			if (!res) {
+				data = (cc_uint8*)Mem_TryAlloc(length, 1);
+				res  = data ? Stream_Read(&stream, data, length) : ERR_OUT_OF_MEMORY;
+			}
+			(void)stream.Close(&stream);
+		}
+	}
+	Mutex_Unlock(cacheMutex);
+
+	if (res) {
+		Mem_Free(data);
+		Platform_Log2("Error %e reading cache for %s", &res, &url); return;
+	}
+	req->data       = data;
+	req->size       = length;
+	req->statusCode = 200;
+}
+
+static void HttpCache_Finish(struct HttpRequest* req) {
+	if (req->result) return;
+
+	if (req->statusCode == 304) {
+		HttpCache_Load(req);
+	} else if (req->statusCode == 200 && req->data && req->size && !(req->_cache & HTTP_CACHE_NOSTORE)) {
+		HttpCache_Store(req);
+	}
+}
+
+
 /*########################################################################################################################*
 *--------------------------------------------------Common downloader code-------------------------------------------------*
 *#########################################################################################################################*/
@@ -120,7 +436,8 @@ static void HttpBackend_Add(struct HttpRequest* req, cc_uint8 flags);
 
 /* Adds a req to the list of pending requests, waking up worker thread if needed. */
 static int Http_Add(const cc_string* url, cc_uint8 flags, cc_uint8 type, const cc_string* lastModified,
-					const cc_string* etag, const void* data, cc_uint32 size, struct StringsBuffer* cookies) {
+					const cc_string* etag, const void* data, cc_uint32 size, struct StringsBuffer* cookies,
+					const cc_string* path) {
 	static const cc_string https = String_FromConst("https://");
 	static const cc_string http  = String_FromConst("http://");
 	struct HttpRequest req = { 0 };
@@ -131,6 +448,14 @@ static int Http_Add(const cc_string* url, cc_uint8 flags, cc_uint8 type, const c
 	req.id = ++nextReqID;
 	req.requestType = type;
 
+	if (flags & HTTP_FLAG_PRIORITY) {
+		req.priority = HTTP_PRIORITY_HIGH;
+	} else if (flags & HTTP_FLAG_BACKGROUND) {
+		req.priority = HTTP_PRIORITY_BACKGROUND;
+	} else {
+		req.priority = HTTP_PRIORITY_NORMAL;
+	}
+
 	/* Change http:// to https:// if required */
 	if (httpsOnly) {
 		cc_string url_ = String_FromRawArray(req.url);
@@ -148,6 +473,16 @@ static int Http_Add(const cc_string* url, cc_uint8 flags, cc_uint8 type, const c
 	if (etag) { 
 		String_CopyToRawArray(req.etag, etag);
 	}
+	/* Most requests aren't file downloads, so only allocate the path when needed */
+	if (path) {
+		req.path = (char*)Mem_Alloc(path->length + 1, 1, "Http download path");
+		String_CopyToRaw(req.path, path->length + 1, path);
+	}
+	/* Caching a response that is being written to a file is pointless */
+	if ((flags & HTTP_FLAG_CACHE) && type == REQUEST_TYPE_GET && !path) {
+		req._cache = HTTP_CACHE_ENABLED;
+		if (flags & HTTP_FLAG_CACHE_SKIPLOAD) req._cache |= HTTP_CACHE_SKIPLOAD;
+	}
 
 	if (data) {
 		req.data = (cc_uint8*)Mem_Alloc(size, 1, "Http_PostData");
@@ -184,9 +519,33 @@ static void Http_GetUrl(struct HttpRequest* req, cc_string* dst) {
 }
 
 
+/* Writes the response contents of a completed http request to its file */
+static void Http_FinishDownload(struct HttpRequest* req) {
+	cc_string path = String_FromReadonly(req->path);
+	cc_result res;
+
+	/* Backends which stream the response contents straight to the file have no data left here */
+	if (!req->result && req->statusCode == 200 && req->data) {
+		res = Stream_WriteAllTo(&path, req->data, req->size);
+		if (res) req->result = res;
+	}
+
+	Mem_Free(req->data);
+	Mem_Free(req->path);
+	req->data = NULL;
+	req->size = 0;
+	req->path = NULL;
+}
+
 /* Updates state after a completed http request */
 static void Http_FinishRequest(struct HttpRequest* req) {
-	req->success = !req->result && req->statusCode == 200 && req->data && req->size;
+	if (req->path) {
+		Http_FinishDownload(req);
+		req->success = !req->result && (req->statusCode == 200 || req->statusCode == 206);
+	} else {
+		if (req->_cache) HttpCache_Finish(req);
+		req->success = !req->result && req->statusCode == 200 && req->data && req->size;
+	}
 
 	if (!req->success) {
 		char* error = req->error; req->error = NULL;
@@ -204,6 +563,7 @@ static void Http_FinishRequest(struct HttpRequest* req) {
 }
 
 /* Deletes cached responses that are over 10 seconds old */
+/* Also saves any changes to the http cache ETag/Last-Modified/expiry lists */
 static void Http_CleanCacheTask(struct ScheduledTask* task) {
 	struct HttpRequest* item;
 	int i;
@@ -222,6 +582,7 @@ static void Http_CleanCacheTask(struct ScheduledTask* task) {
 		}
 	}
 	Mutex_Unlock(processedMutex);
+	HttpCache_Save();
 }
 
 
@@ -241,16 +602,19 @@ int Http_AsyncGetSkin(const cc_string* skinName, cc_uint8 flags) {
 }
 
 int Http_AsyncGetData(const cc_string* url, cc_uint8 flags) {
-	return Http_Add(url, flags, REQUEST_TYPE_GET, NULL, NULL, NULL, 0, NULL);
+	return Http_Add(url, flags, REQUEST_TYPE_GET, NULL, NULL, NULL, 0, NULL, NULL);
 }
 int Http_AsyncGetHeaders(const cc_string* url, cc_uint8 flags) {
-	return Http_Add(url, flags, REQUEST_TYPE_HEAD, NULL, NULL, NULL, 0, NULL);
+	return Http_Add(url, flags, REQUEST_TYPE_HEAD, NULL, NULL, NULL, 0, NULL, NULL);
 }
 int Http_AsyncPostData(const cc_string* url, cc_uint8 flags, const void* data, cc_uint32 size, struct StringsBuffer* cookies) {
-	return Http_Add(url, flags, REQUEST_TYPE_POST, NULL, NULL, data, size, cookies);
+	return Http_Add(url, flags, REQUEST_TYPE_POST, NULL, NULL, data, size, cookies, NULL);
 }
 int Http_AsyncGetDataEx(const cc_string* url, cc_uint8 flags, const cc_string* lastModified, const cc_string* etag, struct StringsBuffer* cookies) {
-	return Http_Add(url, flags, REQUEST_TYPE_GET, lastModified, etag, NULL, 0, cookies);
+	return Http_Add(url, flags, REQUEST_TYPE_GET, lastModified, etag, NULL, 0, cookies, NULL);
+}
+int Http_AsyncDownloadFile(const cc_string* url, cc_uint8 flags, const cc_string* path) {
+	return Http_Add(url, flags, REQUEST_TYPE_GET, NULL, NULL, NULL, 0, NULL, path);
 }
 
 static cc_bool Http_UrlDirect(cc_uint8 c) {
@@ -309,12 +673,18 @@ static void Http_InitCommon(void) {
 	httpsVerify = Options_GetBool(OPT_HTTPS_VERIFY, true);
 
 	Options_Get(OPT_SKIN_SERVER, &skinServer, SKINS_SERVER);
+	HttpCache_Init();
 	ScheduledTask_Add(30, Http_CleanCacheTask);
 }
 static void Http_Init(void);
 
+static void Http_Free(void) {
+	Http_ClearPending();
+	HttpCache_Save();
+}
+
 struct IGameComponent Http_Component = {
 	Http_Init,        /* Init  */
-	Http_ClearPending,/* Free  */
+	Http_Free,        /* Free  */
 	Http_ClearPending /* Reset */
 };
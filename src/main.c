@@ -9,6 +9,7 @@
 #include "Launcher.h"
 #include "Server.h"
 #include "Options.h"
+#include "Graphics.h"
 #include "main.h"
 
 /*########################################################################################################################*
@@ -147,12 +148,97 @@ static int ParseMPArgs(const cc_string* user, const cc_string* mppass, const cc_
 	return true;
 }
 
+#if CC_WIN_BACKEND == CC_WIN_BACKEND_HEADLESS
+#if CC_GFX_BACKEND == CC_GFX_BACKEND_SOFTGPU
+/* --replay [capture file] - render a previously captured frame 100 times, and log how long that took */
+/* --replay [capture file] [iterations] [output] - same, but also saves the rendered frame as a PNG */
+static int RunReplay(int argsCount, const cc_string* args) {
+	static const cc_string usage = String_FromConst(
+		"Expected --replay [capture file] and optionally [iterations] [output]");
+	int iterations = 100;
+
+	if (argsCount < 2 || argsCount > 4) {
+		Logger_DialogTitle = "Failed to start";
+		Logger_DialogWarn(&usage);
+		return 1;
+	}
+
+	if (argsCount >= 3 && (!Convert_ParseInt(&args[2], &iterations) || iterations <= 0)) {
+		WarnInvalidArg("Invalid iterations", &args[2]); return 1;
+	}
+	return Gfx_ReplayCapture(&args[1], iterations, argsCount == 4 ? &args[3] : &String_Empty) ? 1 : 0;
+}
+#endif
+
+/* [map file] [width] [height] [frames] [output] - render a map offscreen, then save last frame as a PNG */
+/* [map file] [width] [height] [frames] [output] [x] [y] [z] [yaw] [pitch] - same, but from the given camera */
+/* --capture [capture file] followed by any of the above - also record the last frame's draw calls */
+static int RunHeadless(int argsCount, const cc_string* args) {
+	static char outputBuffer[FILENAME_SIZE], captureBuffer[FILENAME_SIZE];
+	static const cc_string usage = String_FromConst(
+		"Expected [map file] [width] [height] [frames] [output] and optionally [x] [y] [z] [yaw] [pitch]");
+	String_InitArray(HeadlessInfo.Output,  outputBuffer);
+	String_InitArray(HeadlessInfo.Capture, captureBuffer);
+
+#if CC_GFX_BACKEND == CC_GFX_BACKEND_SOFTGPU
+	if (argsCount && String_CaselessEqualsConst(&args[0], "--replay")) return RunReplay(argsCount, args);
+
+	if (argsCount >= 2 && String_CaselessEqualsConst(&args[0], "--capture")) {
+		String_Copy(&HeadlessInfo.Capture, &args[1]);
+		args += 2; argsCount -= 2;
+	}
+#endif
+
+	if (argsCount != 5 && argsCount != 10) {
+		Logger_DialogTitle = "Failed to start";
+		Logger_DialogWarn(&usage);
+		return 1;
+	}
+
+	if (!Convert_ParseInt(&args[1], &HeadlessInfo.Width)  || HeadlessInfo.Width  <= 0) {
+		WarnInvalidArg("Invalid width",  &args[1]); return 1;
+	}
+	if (!Convert_ParseInt(&args[2], &HeadlessInfo.Height) || HeadlessInfo.Height <= 0) {
+		WarnInvalidArg("Invalid height", &args[2]); return 1;
+	}
+	if (!Convert_ParseInt(&args[3], &HeadlessInfo.Frames) || HeadlessInfo.Frames <= 0) {
+		WarnInvalidArg("Invalid frame count", &args[3]); return 1;
+	}
+	String_Copy(&HeadlessInfo.Output, &args[4]);
+
+	if (argsCount == 10) {
+		HeadlessInfo.SetCamera = 
+			Convert_ParseFloat(&args[5], &HeadlessInfo.CameraX)   && 
+			Convert_ParseFloat(&args[6], &HeadlessInfo.CameraY)   &&
+			Convert_ParseFloat(&args[7], &HeadlessInfo.CameraZ)   &&
+			Convert_ParseFloat(&args[8], &HeadlessInfo.CameraYaw) &&
+			Convert_ParseFloat(&args[9], &HeadlessInfo.CameraPitch);
+
+		if (!HeadlessInfo.SetCamera) { WarnInvalidArg("Invalid camera", &args[5]); return 1; }
+	}
+
+	Options_Get(LOPT_USERNAME, &Game_Username, DEFAULT_USERNAME);
+	String_Copy(&SP_AutoloadMap, &args[0]);
+	/* Display size was unknown when window backend was initialised */
+	DisplayInfo.Width  = HeadlessInfo.Width;
+	DisplayInfo.Height = HeadlessInfo.Height;
+
+	Game_Run(HeadlessInfo.Width, HeadlessInfo.Height, &String_Empty);
+	/* Failure has already been logged by this point */
+	return HeadlessInfo.Result ? 1 : 0;
+}
+#endif
+
 static int RunProgram(int argc, char** argv) {
 	cc_string args[GAME_MAX_CMDARGS];
 	int argsCount = Platform_GetCommandLineArgs(argc, argv, args);
 	struct ResumeInfo r;
 	cc_string host;
 
+#if CC_WIN_BACKEND == CC_WIN_BACKEND_HEADLESS
+	return RunHeadless(argsCount, args);
+#endif
+
 #ifdef _MSC_VER
 	/* NOTE: Make sure to comment this out before pushing a commit */
 	//cc_string rawArgs = String_FromConst("UnknownShadow200 fffff 127.0.0.1 25565");